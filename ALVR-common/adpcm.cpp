@@ -0,0 +1,239 @@
+#include <string.h>
+#include <algorithm>
+
+#include "adpcm.h"
+
+namespace {
+	const int STEP_TABLE[89] = {
+		7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+		19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+		50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+		130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+		337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+		876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+		2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+		5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+		15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+	};
+	const int INDEX_TABLE[16] = {
+		-1, -1, -1, -1, 2, 4, 6, 8,
+		-1, -1, -1, -1, 2, 4, 6, 8
+	};
+
+	struct State {
+		int predictor;
+		int index;
+
+		void Load(const AdpcmChannelState &s) {
+			predictor = s.predictor;
+			index = std::min<int>(s.stepIndex, 88);
+		}
+		void Store(AdpcmChannelState &s) const {
+			s.predictor = (int16_t)predictor;
+			s.stepIndex = (uint8_t)index;
+			s.reserved = 0;
+		}
+		// Same arithmetic as Encode, so encoder and decoder predictors never drift apart.
+		int Decode(int nibble) {
+			int step = STEP_TABLE[index];
+			int delta = step >> 3;
+			if (nibble & 4) delta += step;
+			if (nibble & 2) delta += step >> 1;
+			if (nibble & 1) delta += step >> 2;
+			predictor += (nibble & 8) ? -delta : delta;
+			predictor = std::min(std::max(predictor, -32768), 32767);
+			index = std::min(std::max(index + INDEX_TABLE[nibble], 0), 88);
+			return predictor;
+		}
+		int Encode(int sample) {
+			int step = STEP_TABLE[index];
+			int diff = sample - predictor;
+			int nibble = 0;
+			if (diff < 0) {
+				nibble = 8;
+				diff = -diff;
+			}
+			if (diff >= step) {
+				nibble |= 4;
+				diff -= step;
+			}
+			if (diff >= step >> 1) {
+				nibble |= 2;
+				diff -= step >> 1;
+			}
+			if (diff >= step >> 2) {
+				nibble |= 1;
+			}
+			Decode(nibble);
+			return nibble;
+		}
+	};
+
+	// Encodes count samples of src, taken every stride samples, into count / 2 bytes.
+	void EncodeChannel(State &state, const int16_t *src, int stride, int count, uint8_t *out) {
+		for (int i = 0; i < count; i += 2) {
+			int low = state.Encode(src[i * stride]);
+			int high = state.Encode(src[(i + 1) * stride]);
+			*out++ = (uint8_t)(low | (high << 4));
+		}
+	}
+
+	void DecodeChannel(State &state, const uint8_t *src, int count, int16_t *dst, int stride) {
+		for (int i = 0; i < count; i += 2) {
+			uint8_t byte = *src++;
+			dst[i * stride] = (int16_t)state.Decode(byte & 0xF);
+			dst[(i + 1) * stride] = (int16_t)state.Decode(byte >> 4);
+		}
+	}
+
+	int ChannelBytes(int frameSamples) {
+		return sizeof(AdpcmChannelState) + frameSamples / 2;
+	}
+}
+
+AdpcmEncoder::AdpcmEncoder(int channels, int frameSamples, bool redundancy)
+	: mChannels(channels)
+	, mFrameSamples(frameSamples & ~1)
+	, mRedundancy(redundancy)
+	, mState(channels)
+	, mPrevious(frameSamples & ~1)
+{
+	Reset();
+}
+
+int AdpcmEncoder::GetMaxFrameBytes(int channels, int frameSamples, bool redundancy)
+{
+	return sizeof(AdpcmFrameHeader) + (channels + (redundancy ? 1 : 0)) * ChannelBytes(frameSamples & ~1);
+}
+
+int AdpcmEncoder::Encode(const int16_t *pcm, uint8_t *out)
+{
+	auto *header = (AdpcmFrameHeader *)out;
+	header->frameSamples = (uint16_t)mFrameSamples;
+	header->channels = (uint8_t)mChannels;
+	header->redundantChannels = (mRedundancy && mHasPrevious) ? 1 : 0;
+	uint8_t *p = out + sizeof(AdpcmFrameHeader);
+
+	for (int c = 0; c < mChannels; c++) {
+		State state;
+		state.Load(mState[c]);
+		EncodeChannel(state, pcm + c, mChannels, mFrameSamples, p + sizeof(AdpcmChannelState));
+		memcpy(p, &mState[c], sizeof(AdpcmChannelState));
+		state.Store(mState[c]);
+		p += ChannelBytes(mFrameSamples);
+	}
+
+	if (mRedundancy) {
+		if (mHasPrevious) {
+			State state;
+			state.Load(mRedundantState);
+			EncodeChannel(state, &mPrevious[0], 1, mFrameSamples, p + sizeof(AdpcmChannelState));
+			memcpy(p, &mRedundantState, sizeof(AdpcmChannelState));
+			state.Store(mRedundantState);
+			p += ChannelBytes(mFrameSamples);
+		}
+		for (int i = 0; i < mFrameSamples; i++) {
+			int sum = 0;
+			for (int c = 0; c < mChannels; c++) {
+				sum += pcm[i * mChannels + c];
+			}
+			mPrevious[i] = (int16_t)(sum / mChannels);
+		}
+		mHasPrevious = true;
+	}
+	return static_cast<int>(p - out);
+}
+
+void AdpcmEncoder::Reset()
+{
+	for (auto &s : mState) {
+		s = {};
+	}
+	mRedundantState = {};
+	mHasPrevious = false;
+}
+
+AdpcmDecoder::AdpcmDecoder(int channels, int frameSamples)
+	: mChannels(channels)
+	, mFrameSamples(frameSamples & ~1)
+	, mLast(channels * (frameSamples & ~1))
+{
+	Reset();
+}
+
+int AdpcmDecoder::Decode(const uint8_t *payload, int len, int16_t *pcm)
+{
+	const AdpcmFrameHeader *header;
+	if (!Validate(payload, len, header)) {
+		return -1;
+	}
+	const uint8_t *p = payload + sizeof(AdpcmFrameHeader);
+	for (int c = 0; c < mChannels; c++) {
+		State state;
+		state.Load(*(const AdpcmChannelState *)p);
+		DecodeChannel(state, p + sizeof(AdpcmChannelState), mFrameSamples, pcm + c, mChannels);
+		p += ChannelBytes(mFrameSamples);
+	}
+	Remember(pcm);
+	return mFrameSamples;
+}
+
+int AdpcmDecoder::DecodeRedundant(const uint8_t *payload, int len, int16_t *pcm)
+{
+	const AdpcmFrameHeader *header;
+	if (!Validate(payload, len, header)) {
+		return -1;
+	}
+	if (header->redundantChannels == 0) {
+		return 0;
+	}
+	const uint8_t *p = payload + sizeof(AdpcmFrameHeader) + mChannels * ChannelBytes(mFrameSamples);
+	State state;
+	state.Load(*(const AdpcmChannelState *)p);
+	DecodeChannel(state, p + sizeof(AdpcmChannelState), mFrameSamples, pcm, mChannels);
+	for (int i = 0; i < mFrameSamples; i++) {
+		for (int c = 1; c < mChannels; c++) {
+			pcm[i * mChannels + c] = pcm[i * mChannels];
+		}
+	}
+	Remember(pcm);
+	return mFrameSamples;
+}
+
+int AdpcmDecoder::Conceal(int16_t *pcm)
+{
+	// Repeat last frame, fading out linearly over CONCEAL_FRAMES frames.
+	int total = mFrameSamples * CONCEAL_FRAMES;
+	for (int i = 0; i < mFrameSamples; i++) {
+		int remaining = std::max(total - (mConcealed * mFrameSamples + i), 0);
+		for (int c = 0; c < mChannels; c++) {
+			pcm[i * mChannels + c] = (int16_t)(mLast[i * mChannels + c] * remaining / total);
+		}
+	}
+	mConcealed = std::min(mConcealed + 1, (int)CONCEAL_FRAMES);
+	return mFrameSamples;
+}
+
+void AdpcmDecoder::Reset()
+{
+	std::fill(mLast.begin(), mLast.end(), (int16_t)0);
+	mConcealed = 0;
+}
+
+bool AdpcmDecoder::Validate(const uint8_t *payload, int len, const AdpcmFrameHeader *&header)
+{
+	if (len < (int)sizeof(AdpcmFrameHeader)) {
+		return false;
+	}
+	header = (const AdpcmFrameHeader *)payload;
+	if (header->channels != mChannels || header->frameSamples != mFrameSamples || header->redundantChannels > 1) {
+		return false;
+	}
+	return len >= (int)sizeof(AdpcmFrameHeader) + (mChannels + header->redundantChannels) * ChannelBytes(mFrameSamples);
+}
+
+void AdpcmDecoder::Remember(const int16_t *pcm)
+{
+	memcpy(&mLast[0], pcm, mLast.size() * sizeof(int16_t));
+	mConcealed = 0;
+}
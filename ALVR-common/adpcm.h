@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// IMA ADPCM audio frames for ALVR_AUDIO_CODEC_ADPCM. 4 bits per sample, a quarter of 16-bit PCM.
+//
+// Each frame carries the predictor state of every channel at its start, so frames decode
+// independently of each other and a lost packet never desynchronizes the decoder.
+//
+// In-band FEC: a frame may also carry the previous frame downmixed to mono, which costs half of
+// the primary data. When frame N is lost and N + 1 arrives, the decoder recovers N from it.
+// Frames lost without redundancy are concealed by repeating the last frame with decaying gain.
+//
+// Payload layout:
+//   AdpcmFrameHeader
+//   AdpcmChannelState[channels], then per channel frameSamples / 2 bytes (low nibble first)
+//   if redundantChannels: AdpcmChannelState, then frameSamples / 2 bytes of previous frame in mono
+#pragma pack(push, 1)
+struct AdpcmFrameHeader {
+	// Samples per channel. Even.
+	uint16_t frameSamples;
+	uint8_t channels;
+	// 1 if previous frame is carried in mono, 0 if not.
+	uint8_t redundantChannels;
+};
+struct AdpcmChannelState {
+	int16_t predictor;
+	uint8_t stepIndex;
+	uint8_t reserved;
+};
+#pragma pack(pop)
+
+class AdpcmEncoder {
+public:
+	AdpcmEncoder(int channels, int frameSamples, bool redundancy);
+
+	static int GetMaxFrameBytes(int channels, int frameSamples, bool redundancy);
+
+	// pcm: frameSamples interleaved samples of each channel. out: GetMaxFrameBytes bytes.
+	// Returns payload length.
+	int Encode(const int16_t *pcm, uint8_t *out);
+	void Reset();
+private:
+	int mChannels;
+	int mFrameSamples;
+	bool mRedundancy;
+	std::vector<AdpcmChannelState> mState;
+	AdpcmChannelState mRedundantState;
+	// Previous frame downmixed to mono.
+	std::vector<int16_t> mPrevious;
+	bool mHasPrevious;
+};
+
+// Client side. Not thread safe.
+class AdpcmDecoder {
+public:
+	AdpcmDecoder(int channels, int frameSamples);
+
+	// pcm: frameSamples interleaved samples of each channel.
+	// Returns samples per channel, or -1 if payload does not match channels and frameSamples.
+	int Decode(const uint8_t *payload, int len, int16_t *pcm);
+	// Decodes previous frame from redundant copy in payload, upmixed to all channels.
+	// Call it for a lost frame before Decode of the next one. Returns 0 if payload has no redundancy.
+	int DecodeRedundant(const uint8_t *payload, int len, int16_t *pcm);
+	// Packet loss concealment for a lost frame which could not be recovered.
+	// Returns samples per channel, silence after CONCEAL_FRAMES frames.
+	int Conceal(int16_t *pcm);
+	void Reset();
+
+	static const int CONCEAL_FRAMES = 4;
+private:
+	int mChannels;
+	int mFrameSamples;
+	std::vector<int16_t> mLast;
+	int mConcealed;
+
+	bool Validate(const uint8_t *payload, int len, const AdpcmFrameHeader *&header);
+	void Remember(const int16_t *pcm);
+};
@@ -0,0 +1,281 @@
+#include <string.h>
+#include <algorithm>
+
+#include "fec_reassembler.h"
+
+FECReassembler::FECReassembler(int maxFrames, int maxFrameBytes)
+	: mMaxFrames(std::max(1, maxFrames))
+	, mMaxFrameBytes(maxFrameBytes)
+	, mExpiredIndex(0)
+	, mSlots(mMaxFrames)
+	, mDecodeMatrices(DECODE_MATRIX_CACHE_SIZE)
+{
+	memset(&mStats, 0, sizeof(mStats));
+
+	// Shard packets grow with fecPercentage. Frames which need more than at 100% are ignored.
+	mMaxPackets = ALVR_FEC_SHARDS_MAX * CalculateFECShardPackets(mMaxFrameBytes, 100);
+	int receivedWords = (mMaxPackets + 63) / 64;
+	mPayload.reset(new uint8_t[static_cast<size_t>(mMaxFrames) * mMaxPackets * ALVR_MAX_VIDEO_BUFFER_SIZE]);
+	mReceived.reset(new uint64_t[mMaxFrames * receivedWords]);
+	mStripeShards.reset(new uint8_t[mMaxFrames * mMaxPackets]);
+	for (int i = 0; i < mMaxFrames; i++) {
+		Slot &slot = mSlots[i];
+		memset(&slot, 0, sizeof(slot));
+		slot.payload = &mPayload[static_cast<size_t>(i) * mMaxPackets * ALVR_MAX_VIDEO_BUFFER_SIZE];
+		slot.received = &mReceived[i * receivedWords];
+		slot.stripeShards = &mStripeShards[i * mMaxPackets];
+	}
+	for (auto &decodeMatrix : mDecodeMatrices) {
+		decodeMatrix.key = 0;
+	}
+}
+
+FECReassembler::~FECReassembler()
+{
+}
+
+bool FECReassembler::AddPacket(const uint8_t *packet, int len, ReassembledFrame &frame)
+{
+	mStats.packets++;
+	if (len < static_cast<int>(sizeof(VideoFrame))) {
+		mStats.ignoredPackets++;
+		return false;
+	}
+	const VideoFrame *header = reinterpret_cast<const VideoFrame *>(packet);
+	int payloadLen = len - static_cast<int>(sizeof(VideoFrame));
+	uint64_t index = header->videoFrameIndex;
+
+	if (index < mExpiredIndex) {
+		mStats.ignoredPackets++;
+		return false;
+	}
+	if (index - mExpiredIndex >= static_cast<uint64_t>(mMaxFrames)) {
+		Expire(index - mMaxFrames + 1);
+	}
+
+	Slot &slot = mSlots[index % mMaxFrames];
+	if (!slot.used) {
+		if (!InitSlot(slot, header)) {
+			mStats.ignoredPackets++;
+			return false;
+		}
+	}
+	else if (slot.frameByteSize != header->frameByteSize || slot.fecPercentage != header->fecPercentage) {
+		mStats.ignoredPackets++;
+		return false;
+	}
+	if (slot.done) {
+		mStats.ignoredPackets++;
+		return false;
+	}
+
+	int fecIndex = static_cast<int>(header->fecIndex);
+	int expectedLen;
+	if (fecIndex < slot.dataPackets) {
+		expectedLen = std::min(ALVR_MAX_VIDEO_BUFFER_SIZE, static_cast<int>(slot.frameByteSize) - fecIndex * ALVR_MAX_VIDEO_BUFFER_SIZE);
+	}
+	else if (fecIndex >= slot.dataShards * slot.shardPackets && fecIndex < slot.totalPackets) {
+		expectedLen = ALVR_MAX_VIDEO_BUFFER_SIZE;
+	}
+	else {
+		// Padding packets are never sent.
+		expectedLen = -1;
+	}
+	if (payloadLen != expectedLen) {
+		mStats.ignoredPackets++;
+		return false;
+	}
+
+	uint64_t bit = 1ULL << (fecIndex % 64);
+	if (slot.received[fecIndex / 64] & bit) {
+		mStats.duplicatePackets++;
+		return false;
+	}
+	slot.received[fecIndex / 64] |= bit;
+	memcpy(slot.payload + fecIndex * ALVR_MAX_VIDEO_BUFFER_SIZE, header + 1, payloadLen);
+
+	if (fecIndex < slot.dataPackets) {
+		slot.dataReceived++;
+	}
+	if (++slot.stripeShards[fecIndex % slot.shardPackets] == slot.dataShards) {
+		slot.stripesPending--;
+	}
+
+	if (slot.dataReceived == slot.dataPackets) {
+		Complete(slot, false, frame);
+		return true;
+	}
+	if (slot.stripesPending == 0) {
+		if (!Decode(slot)) {
+			slot.done = true;
+			mStats.framesLost++;
+			return false;
+		}
+		Complete(slot, true, frame);
+		return true;
+	}
+	return false;
+}
+
+int FECReassembler::Expire(uint64_t videoFrameIndex)
+{
+	int lost = 0;
+	for (Slot &slot : mSlots) {
+		if (slot.used && slot.videoFrameIndex < videoFrameIndex) {
+			lost += slot.done ? 0 : 1;
+			Retire(slot);
+		}
+	}
+	mExpiredIndex = std::max(mExpiredIndex, videoFrameIndex);
+	return lost;
+}
+
+void FECReassembler::Reset()
+{
+	for (Slot &slot : mSlots) {
+		slot.used = false;
+	}
+	mExpiredIndex = 0;
+}
+
+FECReassembler::Stats FECReassembler::GetStats()
+{
+	return mStats;
+}
+
+bool FECReassembler::InitSlot(Slot &slot, const VideoFrame *header)
+{
+	int len = static_cast<int>(header->frameByteSize);
+	if (len <= 0 || len > mMaxFrameBytes) {
+		return false;
+	}
+	int shardPackets = CalculateFECShardPackets(len, header->fecPercentage);
+	int blockSize = shardPackets * ALVR_MAX_VIDEO_BUFFER_SIZE;
+	int dataShards = (len + blockSize - 1) / blockSize;
+	int parityShards = CalculateParityShards(dataShards, header->fecPercentage);
+	int totalPackets = (dataShards + parityShards) * shardPackets;
+	if (dataShards + parityShards > ALVR_FEC_SHARDS_MAX || totalPackets > mMaxPackets) {
+		return false;
+	}
+
+	slot.used = true;
+	slot.done = false;
+	slot.videoFrameIndex = header->videoFrameIndex;
+	slot.trackingFrameIndex = header->trackingFrameIndex;
+	slot.sentTime = header->sentTime;
+	slot.sliceIndex = header->sliceIndex;
+	slot.sliceCount = header->sliceCount;
+	slot.frameByteSize = header->frameByteSize;
+	slot.fecPercentage = header->fecPercentage;
+	slot.shardPackets = shardPackets;
+	slot.dataShards = dataShards;
+	slot.parityShards = parityShards;
+	slot.dataPackets = (len + ALVR_MAX_VIDEO_BUFFER_SIZE - 1) / ALVR_MAX_VIDEO_BUFFER_SIZE;
+	slot.totalPackets = totalPackets;
+	slot.dataReceived = 0;
+	memset(slot.received, 0, (totalPackets + 63) / 64 * sizeof(uint64_t));
+
+	// Tail of last data packet and padding shards are encoded as zero.
+	memset(slot.payload + len, 0, dataShards * blockSize - len);
+	slot.stripesPending = 0;
+	for (int j = 0; j < shardPackets; j++) {
+		int padding = 0;
+		for (int i = 0; i < dataShards; i++) {
+			padding += i * shardPackets + j >= slot.dataPackets ? 1 : 0;
+		}
+		slot.stripeShards[j] = static_cast<uint8_t>(padding);
+		slot.stripesPending += padding < dataShards ? 1 : 0;
+	}
+	return true;
+}
+
+void FECReassembler::Retire(Slot &slot)
+{
+	if (!slot.done) {
+		mStats.framesLost++;
+	}
+	slot.used = false;
+}
+
+bool FECReassembler::Decode(Slot &slot)
+{
+	uint8_t *inputs[ALVR_FEC_SHARDS_MAX];
+	uint8_t *outputs[ALVR_FEC_SHARDS_MAX];
+	int totalShards = slot.dataShards + slot.parityShards;
+	uint32_t dataMask = (1u << slot.dataShards) - 1;
+	reed_solomon *rs = ReedSolomonCache::Instance().Get(slot.dataShards, slot.parityShards);
+	if (rs == NULL) {
+		return false;
+	}
+
+	for (int j = 0; j < slot.shardPackets; j++) {
+		uint32_t erasureMask = 0;
+		for (int i = 0; i < totalShards; i++) {
+			int index = i * slot.shardPackets + j;
+			bool padding = i < slot.dataShards && index >= slot.dataPackets;
+			if (!padding && !(slot.received[index / 64] & (1ULL << (index % 64)))) {
+				erasureMask |= 1u << i;
+			}
+		}
+		if ((erasureMask & dataMask) == 0) {
+			continue;
+		}
+
+		const DecodeMatrix *decodeMatrix = GetDecodeMatrix(slot, rs, erasureMask);
+		if (decodeMatrix == NULL) {
+			return false;
+		}
+		for (int i = 0; i < slot.dataShards; i++) {
+			inputs[i] = slot.payload + (decodeMatrix->inputs[i] * slot.shardPackets + j) * ALVR_MAX_VIDEO_BUFFER_SIZE;
+		}
+		for (int i = 0; i < decodeMatrix->erasedCount; i++) {
+			outputs[i] = slot.payload + (decodeMatrix->erased[i] * slot.shardPackets + j) * ALVR_MAX_VIDEO_BUFFER_SIZE;
+		}
+		reed_solomon_decode_with_matrix(rs, decodeMatrix->matrix, inputs, outputs, decodeMatrix->erasedCount
+			, ALVR_MAX_VIDEO_BUFFER_SIZE);
+	}
+	return true;
+}
+
+const FECReassembler::DecodeMatrix *FECReassembler::GetDecodeMatrix(const Slot &slot, reed_solomon *rs, uint32_t erasureMask)
+{
+	uint64_t key = static_cast<uint64_t>(slot.dataShards) | static_cast<uint64_t>(slot.parityShards) << 8
+		| static_cast<uint64_t>(erasureMask) << 16;
+	DecodeMatrix &entry = mDecodeMatrices[((key * 0x9E3779B97F4A7C15ULL) >> 32) % DECODE_MATRIX_CACHE_SIZE];
+	if (entry.key == key) {
+		mStats.decodeMatrixHits++;
+		return &entry;
+	}
+	mStats.decodeMatrixMisses++;
+
+	uint8_t marks[ALVR_FEC_SHARDS_MAX];
+	for (int i = 0; i < slot.dataShards + slot.parityShards; i++) {
+		marks[i] = (erasureMask >> i) & 1;
+	}
+	entry.key = 0;
+	entry.erasedCount = reed_solomon_decode_matrix(rs, marks, entry.matrix, entry.inputs, entry.erased);
+	if (entry.erasedCount <= 0) {
+		return NULL;
+	}
+	entry.key = key;
+	return &entry;
+}
+
+void FECReassembler::Complete(Slot &slot, bool recovered, ReassembledFrame &frame)
+{
+	slot.done = true;
+	if (recovered) {
+		mStats.framesRecovered++;
+	}
+	else {
+		mStats.framesComplete++;
+	}
+	frame.videoFrameIndex = slot.videoFrameIndex;
+	frame.trackingFrameIndex = slot.trackingFrameIndex;
+	frame.sentTime = slot.sentTime;
+	frame.sliceIndex = slot.sliceIndex;
+	frame.sliceCount = slot.sliceCount;
+	frame.data = slot.payload;
+	frame.len = static_cast<int>(slot.frameByteSize);
+	frame.recovered = recovered;
+}
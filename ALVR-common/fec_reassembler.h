@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+
+#include "packet_types.h"
+#include "reedsolomon/rs_cache.h"
+
+// A video frame reassembled from VideoFrame packets.
+struct ReassembledFrame {
+	uint64_t videoFrameIndex;
+	uint64_t trackingFrameIndex;
+	uint64_t sentTime;
+	// Part of encoded picture, see VideoFrame::sliceIndex.
+	int sliceIndex;
+	int sliceCount;
+	const uint8_t *data;
+	int len;
+	// Some data packets were reconstructed from parity.
+	bool recovered;
+};
+
+// Client side of FECPacketizer. Collects VideoFrame packets by videoFrameIndex and fecIndex and
+// reconstructs lost data packets with Reed-Solomon parity.
+//
+// All memory is allocated in constructor. Frames in flight live in a fixed arena of maxFrames slots,
+// frame N in slot N % maxFrames, so packets of frame N + maxFrames evict frame N. Packets are written
+// into place, and data packets are contiguous, so a complete frame is returned without another copy.
+//
+// Completion is detected in O(1) per packet. Each slot keeps a bitset of received packets (for
+// duplicates), the number of received data packets and, for each packet stripe, the number of received
+// shards. A frame is complete when all data packets have arrived or every stripe has at least dataShards
+// shards. Only then stripes with missing data are decoded.
+//
+// Decoding a stripe needs the inverse of the surviving rows of the encode matrix. It only depends on the
+// codec and the erasure pattern, and loss tends to repeat the same patterns, so inverted matrices are
+// kept in a small direct mapped cache instead of inverted again for each stripe.
+//
+// Not thread safe.
+class FECReassembler {
+public:
+	struct Stats {
+		uint64_t packets;
+		uint64_t duplicatePackets;
+		// Packets of frames already complete, given up or evicted, or inconsistent with their frame.
+		uint64_t ignoredPackets;
+		uint64_t framesComplete;
+		uint64_t framesRecovered;
+		// Incomplete frames given up by Expire or evicted by a newer frame, or failed to decode.
+		uint64_t framesLost;
+		uint64_t decodeMatrixHits;
+		uint64_t decodeMatrixMisses;
+	};
+
+	// Frames larger than maxFrameBytes are ignored. reed_solomon_init() must be called before.
+	FECReassembler(int maxFrames, int maxFrameBytes);
+	~FECReassembler();
+
+	// packet is whole datagram starting with VideoFrame header.
+	// Returns true if this packet completed its frame. frame is then valid until packets of frame
+	// videoFrameIndex + maxFrames arrive or Reset is called.
+	bool AddPacket(const uint8_t *packet, int len, ReassembledFrame &frame);
+
+	// Gives up incomplete frames older than videoFrameIndex. Later packets of them are ignored.
+	// Returns number of frames given up.
+	int Expire(uint64_t videoFrameIndex);
+
+	// Forgets all frames, as after reconnect. Stats are kept.
+	void Reset();
+	Stats GetStats();
+private:
+	struct Slot {
+		bool used;
+		bool done;
+		uint64_t videoFrameIndex;
+		uint64_t trackingFrameIndex;
+		uint64_t sentTime;
+		uint8_t sliceIndex;
+		uint8_t sliceCount;
+		uint32_t frameByteSize;
+		uint16_t fecPercentage;
+		int shardPackets;
+		int dataShards;
+		int parityShards;
+		int dataPackets;
+		int totalPackets;
+		int dataReceived;
+		// Stripes which have less than dataShards shards.
+		int stripesPending;
+		uint8_t *payload;
+		uint64_t *received;
+		// Received shards per stripe, including padding shards beyond end of frame.
+		uint8_t *stripeShards;
+	};
+
+	struct DecodeMatrix {
+		// dataShards | parityShards << 8 | erasure mask << 16. 0 is unused.
+		uint64_t key;
+		int erasedCount;
+		uint8_t inputs[ALVR_FEC_SHARDS_MAX];
+		uint8_t erased[ALVR_FEC_SHARDS_MAX];
+		uint8_t matrix[ALVR_FEC_SHARDS_MAX * ALVR_FEC_SHARDS_MAX];
+	};
+	static const int DECODE_MATRIX_CACHE_SIZE = 64;
+
+	int mMaxFrames;
+	int mMaxFrameBytes;
+	int mMaxPackets;
+	// Packets of frames older than this are ignored.
+	uint64_t mExpiredIndex;
+	Stats mStats;
+
+	std::unique_ptr<uint8_t[]> mPayload;
+	std::unique_ptr<uint64_t[]> mReceived;
+	std::unique_ptr<uint8_t[]> mStripeShards;
+	std::vector<Slot> mSlots;
+	std::vector<DecodeMatrix> mDecodeMatrices;
+
+	bool InitSlot(Slot &slot, const VideoFrame *header);
+	void Retire(Slot &slot);
+	bool Decode(Slot &slot);
+	const DecodeMatrix *GetDecodeMatrix(const Slot &slot, reed_solomon *rs, uint32_t erasureMask);
+	void Complete(Slot &slot, bool recovered, ReassembledFrame &frame);
+
+	FECReassembler(const FECReassembler &) = delete;
+	FECReassembler &operator=(const FECReassembler &) = delete;
+};
@@ -0,0 +1,148 @@
+#include <string.h>
+
+#include "opus_frames.h"
+
+#ifdef ALVR_OPUS
+#include <opus/opus.h>
+
+#ifdef _MSC_VER
+#pragma comment(lib, "opus.lib")
+#endif
+
+const int OpusFrameEncoder::BITRATE;
+
+OpusFrameEncoder *OpusFrameEncoder::Create(int sampleRate, int channels, int frameSamples, bool redundancy)
+{
+	int error = OPUS_OK;
+	OpusEncoder *encoder = opus_encoder_create(sampleRate, channels, OPUS_APPLICATION_RESTRICTED_LOWDELAY, &error);
+	if (error != OPUS_OK) {
+		return NULL;
+	}
+	if (opus_encoder_ctl(encoder, OPUS_SET_BITRATE(BITRATE)) != OPUS_OK
+		|| opus_encoder_ctl(encoder, OPUS_SET_VBR(0)) != OPUS_OK
+		|| opus_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC)) != OPUS_OK) {
+		opus_encoder_destroy(encoder);
+		return NULL;
+	}
+	// Opus accepts 2.5 to 60 ms frames only.
+	int16_t silence[2 * 2880] = {};
+	uint8_t packet[1500];
+	if (channels > 2 || frameSamples > 2880 || opus_encode(encoder, silence, frameSamples, packet, sizeof(packet)) < 0) {
+		opus_encoder_destroy(encoder);
+		return NULL;
+	}
+	opus_encoder_ctl(encoder, OPUS_RESET_STATE);
+	return new OpusFrameEncoder(encoder, frameSamples, GetMaxFrameBytes(sampleRate, frameSamples, false)
+		- (int)sizeof(OpusFrameHeader), redundancy);
+}
+
+OpusFrameEncoder::OpusFrameEncoder(OpusEncoder *encoder, int frameSamples, int packetBytes, bool redundancy)
+	: mEncoder(encoder)
+	, mFrameSamples(frameSamples)
+	, mPacketBytes(packetBytes)
+	, mRedundancy(redundancy)
+{
+}
+
+OpusFrameEncoder::~OpusFrameEncoder()
+{
+	opus_encoder_destroy(mEncoder);
+}
+
+int OpusFrameEncoder::GetMaxFrameBytes(int sampleRate, int frameSamples, bool redundancy)
+{
+	int packetBytes = (int)((int64_t)BITRATE * frameSamples / sampleRate / 8);
+	return (int)sizeof(OpusFrameHeader) + packetBytes * (redundancy ? 2 : 1);
+}
+
+int OpusFrameEncoder::Encode(const int16_t *pcm, uint8_t *out)
+{
+	OpusFrameHeader header;
+	int primary = opus_encode(mEncoder, pcm, mFrameSamples, out + sizeof(header), mPacketBytes);
+	if (primary < 0) {
+		return 0;
+	}
+	header.primaryBytes = (uint16_t)primary;
+	memcpy(out, &header, sizeof(header));
+	int len = (int)sizeof(header) + primary;
+	if (mRedundancy) {
+		if (!mPrevious.empty()) {
+			memcpy(out + len, &mPrevious[0], mPrevious.size());
+			len += (int)mPrevious.size();
+		}
+		mPrevious.assign(out + sizeof(header), out + sizeof(header) + primary);
+	}
+	return len;
+}
+
+void OpusFrameEncoder::Reset()
+{
+	opus_encoder_ctl(mEncoder, OPUS_RESET_STATE);
+	mPrevious.clear();
+}
+
+OpusFrameDecoder *OpusFrameDecoder::Create(int sampleRate, int channels, int frameSamples)
+{
+	int error = OPUS_OK;
+	OpusDecoder *decoder = opus_decoder_create(sampleRate, channels, &error);
+	if (error != OPUS_OK) {
+		return NULL;
+	}
+	return new OpusFrameDecoder(decoder, frameSamples);
+}
+
+OpusFrameDecoder::OpusFrameDecoder(OpusDecoder *decoder, int frameSamples)
+	: mDecoder(decoder)
+	, mFrameSamples(frameSamples)
+{
+}
+
+OpusFrameDecoder::~OpusFrameDecoder()
+{
+	opus_decoder_destroy(mDecoder);
+}
+
+int OpusFrameDecoder::Decode(const uint8_t *payload, int len, int16_t *pcm)
+{
+	const OpusFrameHeader *header;
+	if (!Validate(payload, len, header)) {
+		return -1;
+	}
+	int samples = opus_decode(mDecoder, payload + sizeof(OpusFrameHeader), header->primaryBytes, pcm, mFrameSamples, 0);
+	return samples < 0 ? -1 : samples;
+}
+
+int OpusFrameDecoder::DecodeRedundant(const uint8_t *payload, int len, int16_t *pcm)
+{
+	const OpusFrameHeader *header;
+	if (!Validate(payload, len, header)) {
+		return 0;
+	}
+	int offset = (int)sizeof(OpusFrameHeader) + header->primaryBytes;
+	if (len == offset) {
+		return 0;
+	}
+	int samples = opus_decode(mDecoder, payload + offset, len - offset, pcm, mFrameSamples, 0);
+	return samples < 0 ? 0 : samples;
+}
+
+int OpusFrameDecoder::Conceal(int16_t *pcm)
+{
+	int samples = opus_decode(mDecoder, NULL, 0, pcm, mFrameSamples, 0);
+	return samples < 0 ? 0 : samples;
+}
+
+void OpusFrameDecoder::Reset()
+{
+	opus_decoder_ctl(mDecoder, OPUS_RESET_STATE);
+}
+
+bool OpusFrameDecoder::Validate(const uint8_t *payload, int len, const OpusFrameHeader *&header)
+{
+	if (len < (int)sizeof(OpusFrameHeader)) {
+		return false;
+	}
+	header = (const OpusFrameHeader *)payload;
+	return header->primaryBytes > 0 && (int)sizeof(OpusFrameHeader) + header->primaryBytes <= len;
+}
+#endif
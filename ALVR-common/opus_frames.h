@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Opus audio frames for ALVR_AUDIO_CODEC_OPUS. One Opus packet (RFC 6716) per frame.
+//
+// The encoder runs in OPUS_APPLICATION_RESTRICTED_LOWDELAY mode (CELT only, 2.5 ms look-ahead) at a
+// constant BITRATE. Opus in-band FEC exists only in the SILK modes, which this mode never uses, so
+// redundancy repeats the previous Opus packet after the current one instead (temporal redundancy as
+// in RFC 7198). When frame N is lost and N + 1 arrives, the decoder decodes the copy of N first, so
+// its state stays continuous. Frames lost without redundancy are concealed by the Opus decoder.
+//
+// Payload layout:
+//   OpusFrameHeader
+//   primaryBytes of the Opus packet of this frame
+//   rest: Opus packet of the previous frame, if redundant
+#pragma pack(push, 1)
+struct OpusFrameHeader {
+	uint16_t primaryBytes;
+};
+#pragma pack(pop)
+
+// Defined if libopus is available (libopus/build.sh). Without it, AudioEncoder falls back to ADPCM.
+#if defined(__has_include)
+#if __has_include(<opus/opus.h>)
+#define ALVR_OPUS 1
+#endif
+#endif
+
+#ifdef ALVR_OPUS
+struct OpusEncoder;
+struct OpusDecoder;
+
+class OpusFrameEncoder {
+public:
+	// Returns null if libopus rejects sampleRate, channels or frameSamples.
+	static OpusFrameEncoder *Create(int sampleRate, int channels, int frameSamples, bool redundancy);
+	~OpusFrameEncoder();
+
+	static int GetMaxFrameBytes(int sampleRate, int frameSamples, bool redundancy);
+
+	// pcm: frameSamples interleaved samples of each channel. out: GetMaxFrameBytes bytes.
+	// Returns payload length, 0 on encoder error.
+	int Encode(const int16_t *pcm, uint8_t *out);
+	void Reset();
+
+	static const int BITRATE = 96000;
+private:
+	OpusFrameEncoder(OpusEncoder *encoder, int frameSamples, int packetBytes, bool redundancy);
+
+	OpusEncoder *mEncoder;
+	int mFrameSamples;
+	// Constant Opus packet size at BITRATE.
+	int mPacketBytes;
+	bool mRedundancy;
+	// Opus packet of previous frame. Empty after Reset.
+	std::vector<uint8_t> mPrevious;
+};
+
+// Client side. Not thread safe.
+class OpusFrameDecoder {
+public:
+	// Returns null if libopus rejects sampleRate or channels.
+	static OpusFrameDecoder *Create(int sampleRate, int channels, int frameSamples);
+	~OpusFrameDecoder();
+
+	// pcm: frameSamples interleaved samples of each channel.
+	// Returns samples per channel, or -1 if payload is malformed.
+	int Decode(const uint8_t *payload, int len, int16_t *pcm);
+	// Decodes previous frame from redundant copy in payload.
+	// Call it for a lost frame before Decode of the next one. Returns 0 if payload has no redundancy.
+	int DecodeRedundant(const uint8_t *payload, int len, int16_t *pcm);
+	// Opus packet loss concealment for a lost frame which could not be recovered.
+	// Returns samples per channel.
+	int Conceal(int16_t *pcm);
+	void Reset();
+private:
+	OpusFrameDecoder(OpusDecoder *decoder, int frameSamples);
+
+	OpusDecoder *mDecoder;
+	int mFrameSamples;
+
+	bool Validate(const uint8_t *payload, int len, const OpusFrameHeader *&header);
+};
+#endif
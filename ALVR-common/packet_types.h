@@ -31,7 +31,7 @@ enum ALVR_PACKET_TYPE {
 };
 
 enum {
-	ALVR_PROTOCOL_VERSION = 24
+	ALVR_PROTOCOL_VERSION = 31
 };
 
 enum ALVR_CODEC {
@@ -39,6 +39,23 @@ enum ALVR_CODEC {
 	ALVR_CODEC_H265 = 1,
 };
 
+enum ALVR_AUDIO_CODEC {
+	// 48kHz 16bit stereo PCM.
+	ALVR_AUDIO_CODEC_PCM = 0,
+	// 48kHz stereo IMA ADPCM frames (adpcm.h).
+	ALVR_AUDIO_CODEC_ADPCM = 1,
+	// 48kHz stereo Opus frames (opus_frames.h).
+	ALVR_AUDIO_CODEC_OPUS = 2,
+};
+
+enum ALVR_FRAME_TYPE {
+	// No later frame references this one.
+	ALVR_FRAME_TYPE_NON_REFERENCE = 0,
+	ALVR_FRAME_TYPE_REFERENCE = 1,
+	// Decodable without previous frames.
+	ALVR_FRAME_TYPE_IDR = 2,
+};
+
 enum ALVR_LOST_FRAME_TYPE {
 	ALVR_LOST_FRAME_TYPE_VIDEO = 0,
 	ALVR_LOST_FRAME_TYPE_AUDIO = 1,
@@ -321,6 +338,15 @@ struct ChangeSettings {
 	uint64_t debugFlags;
 	uint32_t suspend;
 	uint32_t frameQueueSize;
+	// Foveation of video frames from the next IDR frame of videoWidth x videoHeight on. Starts as in
+	// ConnectionMessage and is changed while streaming with the link bandwidth (FoveationController).
+	// Sent again with the next few TimeSync replies in case it is lost.
+	uint8_t foveationMode;
+	float foveationStrength;
+	float foveationShape;
+	float foveationVerticalOffset;
+	uint32_t videoWidth; // in pixels, encoded
+	uint32_t videoHeight; // in pixels, encoded
 };
 struct VideoFrame {
 	uint32_t type; // ALVR_PACKET_TYPE_VIDEO_FRAME
@@ -333,6 +359,18 @@ struct VideoFrame {
 	uint32_t frameByteSize;
 	uint32_t fecIndex;
 	uint16_t fecPercentage;
+	// Parity shards of this frame may be sent interleaved with packets of up to this many following
+	// video frames. Client should keep an incomplete frame until packets of frame
+	// videoFrameIndex + fecInterleaveDepth arrive before giving up on it. 0 means no interleaving.
+	uint8_t fecInterleaveDepth;
+	uint8_t frameType; // ALVR_FRAME_TYPE
+	// Encoded picture may be sent in sliceCount parts, each with its own videoFrameIndex and FEC, as soon
+	// as the encoder has written it. Parts of a picture have consecutive videoFrameIndex, from
+	// videoFrameIndex - sliceIndex. They can be passed to the decoder in order as they complete.
+	// sliceCount of the last part is authoritative; it may be less than that of earlier parts if the
+	// encoder produced fewer slices than configured. 1 means whole picture.
+	uint8_t sliceIndex;
+	uint8_t sliceCount;
 	// char frameBuffer[];
 };
 struct AudioFrameStart {
@@ -340,6 +378,7 @@ struct AudioFrameStart {
 	uint32_t packetCounter;
 	uint64_t presentationTime;
 	uint32_t frameByteSize;
+	uint8_t codec; // ALVR_AUDIO_CODEC
 	// char frameBuffer[];
 };
 struct AudioFrame {
@@ -347,12 +386,16 @@ struct AudioFrame {
 	uint32_t packetCounter;
 	// char frameBuffer[];
 };
+// 48kHz 16bit mono. 10ms.
+static const int ALVR_MAX_MIC_SAMPLES = 480;
 struct MicAudioFrame {
-	uint32_t type; // ALVR_PACKET_TYPE_MIC_AUDIO_FRAME
-	size_t outputBufferNumElements;
-	size_t completeSize;
-	int packetIndex;
-	int16_t micBuffer[100];
+	uint32_t type; // ALVR_PACKET_TYPE_MIC_AUDIO
+	// Incremented by one for each packet. Server reorders and detects loss with it.
+	uint32_t packetIndex;
+	// Valid samples in micBuffer. Packet may be truncated after them.
+	uint16_t sampleCount;
+	uint16_t reserved;
+	int16_t micBuffer[ALVR_MAX_MIC_SAMPLES];
 };
 
 // Report packet loss/error from client to server.
@@ -45,6 +45,28 @@
 #define alloca(x) _alloca(x)
 #endif
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RS_HAVE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define RS_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/*
+ * MSVC accepts any intrinsic in any function. GCC and Clang need the
+ * instruction set to be enabled per function, so the rest of the file is
+ * still built for the baseline target and the kernels are picked at runtime.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define RS_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RS_TARGET(isa)
+#endif
+
 typedef unsigned char gf;
 
 #define GF_BITS  8
@@ -80,6 +102,20 @@ static gf __declspec(align (256)) gf_mul_table[(GF_SIZE + 1)*(GF_SIZE + 1)];
 static gf gf_mul_table[(GF_SIZE + 1)*(GF_SIZE + 1)] __attribute__((aligned (256)));
 #endif
 
+/*
+ * Split nibble tables for the SIMD kernels. For each constant c,
+ * gf_nibble_table[c][0..15] = c * i and gf_nibble_table[c][16..31] = c * (i << 4),
+ * so that c * x = lo[x & 0x0f] ^ hi[x >> 4] can be done with a 16-entry
+ * byte shuffle (PSHUFB / VPSHUFB / TBL).
+ */
+#ifdef _MSC_VER
+static gf __declspec(align (32)) gf_nibble_table[GF_SIZE + 1][32];
+#else
+static gf gf_nibble_table[GF_SIZE + 1][32] __attribute__((aligned (32)));
+#endif
+
+typedef void (*gf_mul_fn)(gf *dst, const gf *src, gf c, int sz);
+
 /*
  * modnn(x) computes x % GF_SIZE, where GF_SIZE is 2**GF_BITS - 1,
  * without a slow divide.
@@ -113,7 +149,190 @@ static void mul(gf *dst1, gf *src1, gf c, int sz) {
         for (; dst < lim; dst++, src++)
             GF_MULC(*dst , *src);
     } else
-        memset(dst1, 0, c);
+        memset(dst1, 0, sz);
+}
+
+static void addmul_scalar(gf *dst, const gf *src, gf c, int sz) {
+    addmul(dst, (gf *)src, c, sz);
+}
+
+static void mul_scalar(gf *dst, const gf *src, gf c, int sz) {
+    mul(dst, (gf *)src, c, sz);
+}
+
+#ifdef RS_HAVE_X86
+RS_TARGET("ssse3")
+static void addmul_ssse3(gf *dst, const gf *src, gf c, int sz) {
+    int i = 0;
+    if (c == 0)
+        return;
+    {
+        const __m128i lo = _mm_load_si128((const __m128i *)&gf_nibble_table[c][0]);
+        const __m128i hi = _mm_load_si128((const __m128i *)&gf_nibble_table[c][16]);
+        const __m128i mask = _mm_set1_epi8(0x0f);
+        for (; i + 16 <= sz; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *)&src[i]);
+            __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(x, mask));
+            __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+            __m128i d = _mm_loadu_si128((const __m128i *)&dst[i]);
+            _mm_storeu_si128((__m128i *)&dst[i], _mm_xor_si128(d, _mm_xor_si128(l, h)));
+        }
+    }
+    addmul_scalar(dst + i, src + i, c, sz - i);
+}
+
+RS_TARGET("ssse3")
+static void mul_ssse3(gf *dst, const gf *src, gf c, int sz) {
+    int i = 0;
+    if (c == 0) {
+        memset(dst, 0, sz);
+        return;
+    }
+    {
+        const __m128i lo = _mm_load_si128((const __m128i *)&gf_nibble_table[c][0]);
+        const __m128i hi = _mm_load_si128((const __m128i *)&gf_nibble_table[c][16]);
+        const __m128i mask = _mm_set1_epi8(0x0f);
+        for (; i + 16 <= sz; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *)&src[i]);
+            __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(x, mask));
+            __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+            _mm_storeu_si128((__m128i *)&dst[i], _mm_xor_si128(l, h));
+        }
+    }
+    mul_scalar(dst + i, src + i, c, sz - i);
+}
+
+RS_TARGET("avx2")
+static void addmul_avx2(gf *dst, const gf *src, gf c, int sz) {
+    int i = 0;
+    if (c == 0)
+        return;
+    {
+        const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)&gf_nibble_table[c][0]));
+        const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)&gf_nibble_table[c][16]));
+        const __m256i mask = _mm256_set1_epi8(0x0f);
+        for (; i + 32 <= sz; i += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)&src[i]);
+            __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(x, mask));
+            __m256i h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask));
+            __m256i d = _mm256_loadu_si256((const __m256i *)&dst[i]);
+            _mm256_storeu_si256((__m256i *)&dst[i], _mm256_xor_si256(d, _mm256_xor_si256(l, h)));
+        }
+    }
+    addmul_scalar(dst + i, src + i, c, sz - i);
+}
+
+RS_TARGET("avx2")
+static void mul_avx2(gf *dst, const gf *src, gf c, int sz) {
+    int i = 0;
+    if (c == 0) {
+        memset(dst, 0, sz);
+        return;
+    }
+    {
+        const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)&gf_nibble_table[c][0]));
+        const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)&gf_nibble_table[c][16]));
+        const __m256i mask = _mm256_set1_epi8(0x0f);
+        for (; i + 32 <= sz; i += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)&src[i]);
+            __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(x, mask));
+            __m256i h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask));
+            _mm256_storeu_si256((__m256i *)&dst[i], _mm256_xor_si256(l, h));
+        }
+    }
+    mul_scalar(dst + i, src + i, c, sz - i);
+}
+#endif
+
+#ifdef RS_HAVE_NEON
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define RS_NEON_LOOKUP(table, idx) vqtbl1q_u8(table, idx)
+#else
+/* ARMv7 has no 128-bit TBL, look up each half with the 2-register VTBL. */
+static inline uint8x16_t rs_neon_lookup(uint8x16_t table, uint8x16_t idx) {
+    uint8x8x2_t t = { { vget_low_u8(table), vget_high_u8(table) } };
+    return vcombine_u8(vtbl2_u8(t, vget_low_u8(idx)), vtbl2_u8(t, vget_high_u8(idx)));
+}
+#define RS_NEON_LOOKUP(table, idx) rs_neon_lookup(table, idx)
+#endif
+
+static void addmul_neon(gf *dst, const gf *src, gf c, int sz) {
+    int i = 0;
+    if (c == 0)
+        return;
+    {
+        const uint8x16_t lo = vld1q_u8(&gf_nibble_table[c][0]);
+        const uint8x16_t hi = vld1q_u8(&gf_nibble_table[c][16]);
+        const uint8x16_t mask = vdupq_n_u8(0x0f);
+        for (; i + 16 <= sz; i += 16) {
+            uint8x16_t x = vld1q_u8(&src[i]);
+            uint8x16_t p = veorq_u8(RS_NEON_LOOKUP(lo, vandq_u8(x, mask)), RS_NEON_LOOKUP(hi, vshrq_n_u8(x, 4)));
+            vst1q_u8(&dst[i], veorq_u8(vld1q_u8(&dst[i]), p));
+        }
+    }
+    addmul_scalar(dst + i, src + i, c, sz - i);
+}
+
+static void mul_neon(gf *dst, const gf *src, gf c, int sz) {
+    int i = 0;
+    if (c == 0) {
+        memset(dst, 0, sz);
+        return;
+    }
+    {
+        const uint8x16_t lo = vld1q_u8(&gf_nibble_table[c][0]);
+        const uint8x16_t hi = vld1q_u8(&gf_nibble_table[c][16]);
+        const uint8x16_t mask = vdupq_n_u8(0x0f);
+        for (; i + 16 <= sz; i += 16) {
+            uint8x16_t x = vld1q_u8(&src[i]);
+            vst1q_u8(&dst[i], veorq_u8(RS_NEON_LOOKUP(lo, vandq_u8(x, mask)), RS_NEON_LOOKUP(hi, vshrq_n_u8(x, 4))));
+        }
+    }
+    mul_scalar(dst + i, src + i, c, sz - i);
+}
+#endif
+
+/*
+ * Kernels used for shard coding. Selected by reed_solomon_init() and
+ * reed_solomon_set_simd(). Matrix inversion keeps using the scalar addmul()
+ * because rows are at most DATA_SHARDS_MAX bytes.
+ */
+static int gf_simd_level = RS_SIMD_NONE;
+static gf_mul_fn gf_addmul_impl = addmul_scalar;
+static gf_mul_fn gf_mul_impl = mul_scalar;
+
+static int detect_simd(void) {
+#if defined(RS_HAVE_X86)
+#ifdef _MSC_VER
+    int info[4];
+    int maxLeaf, ssse3, osxsave, avx;
+
+    __cpuid(info, 0);
+    maxLeaf = info[0];
+    __cpuid(info, 1);
+    ssse3 = (info[2] >> 9) & 1;
+    osxsave = (info[2] >> 27) & 1;
+    avx = (info[2] >> 28) & 1;
+    /* AVX2 also needs the OS to save YMM registers (XCR0 bits 1 and 2). */
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5))
+            return RS_SIMD_AVX2;
+    }
+    return ssse3 ? RS_SIMD_SSSE3 : RS_SIMD_NONE;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return RS_SIMD_AVX2;
+    if (__builtin_cpu_supports("ssse3"))
+        return RS_SIMD_SSSE3;
+    return RS_SIMD_NONE;
+#endif
+#elif defined(RS_HAVE_NEON)
+    return RS_SIMD_NEON;
+#else
+    return RS_SIMD_NONE;
+#endif
 }
 
 /* y = a.dot(b) */
@@ -148,6 +367,12 @@ static void init_mul_table(void) {
 
     for (j=0; j< GF_SIZE+1; j++)
         gf_mul_table[j] = gf_mul_table[j<<8] = 0;
+
+    for (i=0; i< GF_SIZE+1; i++)
+    for (j=0; j< 16; j++) {
+        gf_nibble_table[i][j] = gf_mul(i, j);
+        gf_nibble_table[i][16 + j] = gf_mul(i, (j << 4));
+    }
 }
 
 /*
@@ -356,13 +581,15 @@ static gf* sub_matrix(gf* matrix, int rmin, int cmin, int rmax, int cmax,  int n
 static inline int code_some_shards(gf* matrixRows, gf** inputs, gf** outputs, int dataShards, int outputCount, int byteCount) {
     gf* in;
     int iRow, c;
+    gf_mul_fn mulFn = gf_mul_impl;
+    gf_mul_fn addmulFn = gf_addmul_impl;
     for (c = 0; c < dataShards; c++) {
         in = inputs[c];
         for (iRow = 0; iRow < outputCount; iRow++) {
             if (0 == c)
-                mul(outputs[iRow], in, matrixRows[iRow*dataShards+c], byteCount);
+                mulFn(outputs[iRow], in, matrixRows[iRow*dataShards+c], byteCount);
             else
-                addmul(outputs[iRow], in, matrixRows[iRow*dataShards+c], byteCount);
+                addmulFn(outputs[iRow], in, matrixRows[iRow*dataShards+c], byteCount);
         }
     }
 
@@ -372,6 +599,47 @@ static inline int code_some_shards(gf* matrixRows, gf** inputs, gf** outputs, in
 void reed_solomon_init(void) {
     generate_gf();
     init_mul_table();
+    reed_solomon_set_simd(RS_SIMD_AUTO);
+}
+
+int reed_solomon_set_simd(int level) {
+    int supported = detect_simd();
+
+    if (level == RS_SIMD_AUTO || level > supported)
+        level = supported;
+    /* NEON and the x86 levels are exclusive, never pick one the CPU can't run. */
+    if (level != RS_SIMD_NONE && (level == RS_SIMD_NEON) != (supported == RS_SIMD_NEON))
+        level = RS_SIMD_NONE;
+
+    switch (level) {
+#ifdef RS_HAVE_X86
+    case RS_SIMD_AVX2:
+        gf_mul_impl = mul_avx2;
+        gf_addmul_impl = addmul_avx2;
+        break;
+    case RS_SIMD_SSSE3:
+        gf_mul_impl = mul_ssse3;
+        gf_addmul_impl = addmul_ssse3;
+        break;
+#endif
+#ifdef RS_HAVE_NEON
+    case RS_SIMD_NEON:
+        gf_mul_impl = mul_neon;
+        gf_addmul_impl = addmul_neon;
+        break;
+#endif
+    default:
+        level = RS_SIMD_NONE;
+        gf_mul_impl = mul_scalar;
+        gf_addmul_impl = addmul_scalar;
+        break;
+    }
+    gf_simd_level = level;
+    return level;
+}
+
+int reed_solomon_get_simd(void) {
+    return gf_simd_level;
 }
 
 reed_solomon* reed_solomon_new(int data_shards, int parity_shards) {
@@ -554,6 +822,64 @@ static int reed_solomon_decode(reed_solomon* rs, unsigned char **data_blocks, in
     return code_some_shards(dataDecodeMatrix, subShards, outputs, dataShards, nr_fec_blocks, block_size);
 }
 
+/**
+ * build the matrix which recovers erased data shards of one stripe
+ * only depends on the erasure pattern, so callers may cache it per marks
+ * input:
+ * rs
+ * marks[rs->shards] marks as errors
+ * output:
+ * matrix[nr_erased * rs->data_shards]
+ * inputs[rs->data_shards]: surviving shard numbers to pass as inputs, in order
+ * erased[nr_erased]: data shard numbers recovered, in order of matrix rows
+ * return: nr_erased, or -1 if not enough shards survive
+ * */
+int reed_solomon_decode_matrix(reed_solomon* rs, const unsigned char* marks, unsigned char* matrix, unsigned char* inputs, unsigned char* erased) {
+    gf dataDecodeMatrix[DATA_SHARDS_MAX*DATA_SHARDS_MAX];
+    gf* m = rs->m;
+    int i, subMatrixRow, nr_erased;
+    int ds = rs->data_shards;
+
+    nr_erased = 0;
+    subMatrixRow = 0;
+    for (i = 0; i < ds; i++) {
+        if (marks[i]) {
+            erased[nr_erased++] = (unsigned char)i;
+        } else {
+            memcpy(dataDecodeMatrix + subMatrixRow*ds, m + i*ds, ds);
+            inputs[subMatrixRow++] = (unsigned char)i;
+        }
+    }
+    for (i = ds; i < rs->shards && subMatrixRow < ds; i++) {
+        if (!marks[i]) {
+            memcpy(dataDecodeMatrix + subMatrixRow*ds, m + i*ds, ds);
+            inputs[subMatrixRow++] = (unsigned char)i;
+        }
+    }
+
+    if (subMatrixRow < ds)
+        return -1;
+    if (0 == nr_erased)
+        return 0;
+    if (0 != invert_mat(dataDecodeMatrix, ds))
+        return -1;
+
+    for (i = 0; i < nr_erased; i++)
+        memcpy(matrix + i*ds, dataDecodeMatrix + erased[i]*ds, ds);
+
+    return nr_erased;
+}
+
+/**
+ * recover erased data shards of one stripe with matrix from reed_solomon_decode_matrix
+ * input:
+ * inputs[rs->data_shards][block_size] in order of inputs from reed_solomon_decode_matrix
+ * outputs[nr_erased][block_size] in order of erased from reed_solomon_decode_matrix
+ * */
+void reed_solomon_decode_with_matrix(reed_solomon* rs, const unsigned char* matrix, unsigned char** inputs, unsigned char** outputs, int nr_erased, int block_size) {
+    code_some_shards((gf*)matrix, inputs, outputs, rs->data_shards, nr_erased, block_size);
+}
+
 /**
  * encode a big size of buffer
  * input:
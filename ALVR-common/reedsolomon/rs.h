@@ -16,11 +16,29 @@ extern "C" {
 		unsigned char* parity;
 	} reed_solomon;
 
+	/* SIMD level of the GF(2^8) multiply kernels used for encode/reconstruct */
+	enum {
+		RS_SIMD_AUTO = -1,
+		RS_SIMD_NONE = 0,
+		RS_SIMD_SSSE3 = 1,
+		RS_SIMD_AVX2 = 2,
+		RS_SIMD_NEON = 3,
+	};
+
 	/**
 	 * MUST initial one time
+	 * Also selects the best SIMD kernels supported by this CPU.
 	 * */
 	void reed_solomon_init(void);
 
+	/**
+	 * Select the kernels used for shard coding. All levels give bit-identical results.
+	 * level: RS_SIMD_* (RS_SIMD_AUTO picks the best supported one)
+	 * return: the level actually applied (lowered when the CPU does not support it)
+	 * */
+	int reed_solomon_set_simd(int level);
+	int reed_solomon_get_simd(void);
+
 	reed_solomon* reed_solomon_new(int data_shards, int parity_shards);
 	void reed_solomon_release(reed_solomon* rs);
 
@@ -43,6 +61,25 @@ extern "C" {
 	 * */
 	int reed_solomon_reconstruct(reed_solomon* rs, unsigned char** shards, unsigned char* marks, int nr_shards, int block_size);
 
+	/**
+	 * build the matrix which recovers erased data shards of one stripe
+	 * only depends on the erasure pattern, so callers may cache it per marks
+	 * input:
+	 * marks[rs->shards] marks as errors
+	 * output:
+	 * matrix[nr_erased * rs->data_shards]
+	 * inputs[rs->data_shards]: surviving shard numbers to pass as inputs, in order
+	 * erased[nr_erased]: data shard numbers recovered, in order of matrix rows
+	 * return: nr_erased, or -1 if not enough shards survive
+	 * */
+	int reed_solomon_decode_matrix(reed_solomon* rs, const unsigned char* marks, unsigned char* matrix, unsigned char* inputs, unsigned char* erased);
+
+	/**
+	 * recover erased data shards of one stripe with matrix from reed_solomon_decode_matrix
+	 * inputs[rs->data_shards][block_size], outputs[nr_erased][block_size]
+	 * */
+	void reed_solomon_decode_with_matrix(reed_solomon* rs, const unsigned char* matrix, unsigned char** inputs, unsigned char** outputs, int nr_erased, int block_size);
+
 #ifdef __cplusplus
 };
 #endif
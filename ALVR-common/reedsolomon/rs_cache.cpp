@@ -0,0 +1,43 @@
+#include "rs_cache.h"
+
+ReedSolomonCache::ReedSolomonCache() {
+}
+
+ReedSolomonCache::~ReedSolomonCache() {
+	Clear();
+}
+
+ReedSolomonCache &ReedSolomonCache::Instance() {
+	static ReedSolomonCache instance;
+	return instance;
+}
+
+reed_solomon *ReedSolomonCache::Get(int dataShards, int parityShards) {
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto key = std::make_pair(dataShards, parityShards);
+	auto it = mCodecs.find(key);
+	if (it != mCodecs.end()) {
+		return it->second;
+	}
+	reed_solomon *rs = reed_solomon_new(dataShards, parityShards);
+	if (rs == NULL) {
+		return NULL;
+	}
+	mCodecs.insert(std::make_pair(key, rs));
+	return rs;
+}
+
+void ReedSolomonCache::Clear() {
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	for (auto it = mCodecs.begin(); it != mCodecs.end(); ++it) {
+		reed_solomon_release(it->second);
+	}
+	mCodecs.clear();
+}
+
+size_t ReedSolomonCache::Size() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mCodecs.size();
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <utility>
+
+extern "C" {
+#include "rs.h"
+};
+
+// Cache of Reed-Solomon codecs keyed by (dataShards, parityShards).
+// Building a codec inverts a Vandermonde matrix and allocates, which is too slow to do for each video frame.
+// Only a few geometries are possible (ALVR_FEC_SHARDS_MAX), so the codecs are kept until the cache is destroyed.
+// Returned codecs are only read by reed_solomon_encode/reed_solomon_reconstruct, so they can be shared between threads.
+class ReedSolomonCache {
+public:
+	ReedSolomonCache();
+	~ReedSolomonCache();
+
+	static ReedSolomonCache &Instance();
+
+	// Returns NULL if the geometry is invalid. reed_solomon_init() must be called before.
+	reed_solomon *Get(int dataShards, int parityShards);
+
+	// Releases all codecs. Must not be called while a returned codec is still in use.
+	void Clear();
+	size_t Size();
+private:
+	std::mutex mMutex;
+	std::map<std::pair<int, int>, reed_solomon *> mCodecs;
+
+	ReedSolomonCache(const ReedSolomonCache &) = delete;
+	ReedSolomonCache &operator=(const ReedSolomonCache &) = delete;
+};
@@ -157,6 +157,17 @@ namespace ALVR
                 driverConfig.listenHost = "0.0.0.0";
                 driverConfig.sendingTimeslotUs = 500;
                 driverConfig.limitTimeslotPackets = 0;
+                driverConfig.framePacing = false;
+                driverConfig.adaptiveFec = true;
+                driverConfig.maxFecPercentage = 20;
+                driverConfig.idrFecPercentage = 0; // 0: off. Unequal protection loses more frames in total.
+                driverConfig.fecInterleaveDepth = 0;
+                driverConfig.fecInterleaveMaxDelayUs = 30000;
+                driverConfig.sliceCount = 1;
+                driverConfig.nvencSubFrameReadback = false;
+                driverConfig.trackingThread = true;
+                driverConfig.audioCodec = 1; // 0: PCM, 1: ADPCM, 2: Opus (needs libopus, ADPCM without it)
+                driverConfig.audioFec = true;
                 driverConfig.controlListenPort = 9944;
                 driverConfig.controlListenHost = "127.0.0.1";
                 driverConfig.useKeyedMutex = true;
@@ -223,6 +234,7 @@ namespace ALVR
                 driverConfig.force3DOF = c.force3DOF;
                 driverConfig.aggressiveKeyframeResend = c.aggressiveKeyframeResend;
                 driverConfig.nv12 = c.nv12;
+                driverConfig.softwareEncoder = false;
 
                 driverConfig.disableController = c.disableController;
 
@@ -289,6 +301,9 @@ namespace ALVR
                 driverConfig.foveationStrength = c.foveationStrength / 100f;
                 driverConfig.foveationShape = 1.5f;
                 driverConfig.foveationVerticalOffset = c.foveationVerticalOffset / 100f;
+                driverConfig.adaptiveFoveation = true;
+                driverConfig.foveationMaxStrength = 5.0f;
+                driverConfig.minEncodeBitrateInMBits = 10;
 
                 driverConfig.enableColorCorrection = c.enableColorCorrection;
                 driverConfig.brightness = (float)c.brightness;
@@ -501,6 +501,15 @@ void AudioCapture::LoopbackCapture() {
 	}
 
 	std::unique_ptr<Resampler> resampler(std::make_unique<Resampler>(pwfx->nSamplesPerSec, DEFAULT_SAMPLE_RATE, pwfx->nChannels, DEFAULT_CHANNELS));
+	AudioEncoder encoder(Settings::Instance().m_audioCodec, Settings::Instance().m_audioFec, DEFAULT_SAMPLE_RATE, DEFAULT_CHANNELS
+		, [&](uint8_t *buf, int len, uint64_t presentationTime) {
+		m_listener->SendAudio(buf, len, presentationTime, (uint8_t)encoder.GetCodec());
+	});
+	if (encoder.GetCodec() != Settings::Instance().m_audioCodec) {
+		// Opus needs libopus at build time (libopus/build.sh).
+		LogDriver("AudioCapture: Audio codec %d is not available. Falling back to %d."
+			, Settings::Instance().m_audioCodec, encoder.GetCodec());
+	}
 
 	// activate an IAudioCaptureClient
 	ComPtr<IAudioCaptureClient> pAudioCaptureClient;
@@ -588,7 +597,7 @@ void AudioCapture::LoopbackCapture() {
 			LONG lBytesToWrite = nNumFramesToRead * nBlockAlign;
 			resampler->FeedInput(nNumFramesToRead, (uint8_t *)pData);
 
-			m_listener->SendAudio(resampler->GetDest(), resampler->GetDestBufSize(), GetTimestampUs());
+			encoder.Feed(resampler->GetDest(), resampler->GetDestBufSize(), GetTimestampUs());
 
 			m_frames += nNumFramesToRead;
 
@@ -14,6 +14,7 @@
 #include "Utils.h"
 #include "ClientConnection.h"
 #include "ResampleUtils.h"
+#include "AudioEncoder.h"
 
 using Microsoft::WRL::ComPtr;
 
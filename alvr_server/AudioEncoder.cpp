@@ -0,0 +1,107 @@
+#include <string.h>
+#include <algorithm>
+
+#include "AudioEncoder.h"
+
+AudioEncoder::AudioEncoder(int codec, bool fec, int sampleRate, int channels, FrameCallback onFrame)
+	: mCodec(codec)
+	, mSampleRate(sampleRate)
+	, mChannels(channels)
+	, mFrameSamples((sampleRate * FRAME_MS / 1000) & ~1)
+	, mOnFrame(onFrame)
+	, mFrame(mFrameSamples * channels)
+	, mFilled(0)
+{
+	if (mCodec == ALVR_AUDIO_CODEC_OPUS) {
+#ifdef ALVR_OPUS
+		mOpus.reset(OpusFrameEncoder::Create(sampleRate, channels, mFrameSamples, fec));
+		if (mOpus) {
+			mOutput.resize(OpusFrameEncoder::GetMaxFrameBytes(sampleRate, mFrameSamples, fec));
+			return;
+		}
+#endif
+		mCodec = ALVR_AUDIO_CODEC_ADPCM;
+	}
+	if (mCodec == ALVR_AUDIO_CODEC_ADPCM) {
+		mAdpcm = std::make_unique<AdpcmEncoder>(channels, mFrameSamples, fec);
+		mOutput.resize(AdpcmEncoder::GetMaxFrameBytes(channels, mFrameSamples, fec));
+	}
+	else {
+		mCodec = ALVR_AUDIO_CODEC_PCM;
+	}
+}
+
+void AudioEncoder::Feed(const uint8_t *buf, int len, uint64_t time)
+{
+	const int16_t *samples = (const int16_t *)buf;
+	int count = len / (int)sizeof(int16_t) / mChannels;
+	int pos = 0;
+	while (pos < count) {
+		int n = std::min(count - pos, mFrameSamples - mFilled);
+		memcpy(&mFrame[mFilled * mChannels], samples + pos * mChannels, n * mChannels * sizeof(int16_t));
+		mFilled += n;
+		pos += n;
+		if (mFilled < mFrameSamples) {
+			break;
+		}
+		mFilled = 0;
+
+		// End of this frame, relative to end of buf.
+		uint64_t presentationTime = time - (uint64_t)(count - pos) * 1000 * 1000 / mSampleRate;
+#ifdef ALVR_OPUS
+		if (mOpus) {
+			int encoded = mOpus->Encode(&mFrame[0], &mOutput[0]);
+			if (encoded > 0) {
+				mOnFrame(&mOutput[0], encoded, presentationTime);
+			}
+			continue;
+		}
+#endif
+		if (mAdpcm) {
+			int encoded = mAdpcm->Encode(&mFrame[0], &mOutput[0]);
+			mOnFrame(&mOutput[0], encoded, presentationTime);
+		}
+		else {
+			mOnFrame((uint8_t *)&mFrame[0], static_cast<int>(mFrame.size() * sizeof(int16_t)), presentationTime);
+		}
+	}
+}
+
+void AudioEncoder::Reset()
+{
+	mFilled = 0;
+	if (mAdpcm) {
+		mAdpcm->Reset();
+	}
+#ifdef ALVR_OPUS
+	if (mOpus) {
+		mOpus->Reset();
+	}
+#endif
+}
+
+int AudioEncoder::GetCodec() const
+{
+	return mCodec;
+}
+
+int AudioEncoder::GetFrameSamples() const
+{
+	return mFrameSamples;
+}
+
+int AudioEncoder::GetBytesPerSecond(int codec, bool fec, int sampleRate, int channels)
+{
+	int frameSamples = (sampleRate * FRAME_MS / 1000) & ~1;
+	int framesPerSecond = 1000 / FRAME_MS;
+#ifdef ALVR_OPUS
+	if (codec == ALVR_AUDIO_CODEC_OPUS) {
+		return OpusFrameEncoder::GetMaxFrameBytes(sampleRate, frameSamples, fec) * framesPerSecond;
+	}
+#endif
+	// Opus without libopus falls back to ADPCM.
+	if (codec == ALVR_AUDIO_CODEC_ADPCM || codec == ALVR_AUDIO_CODEC_OPUS) {
+		return AdpcmEncoder::GetMaxFrameBytes(channels, frameSamples, fec) * framesPerSecond;
+	}
+	return frameSamples * channels * (int)sizeof(int16_t) * framesPerSecond;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "packet_types.h"
+#include "adpcm.h"
+#include "opus_frames.h"
+
+// Cuts resampled 16-bit PCM into fixed FRAME_MS frames and encodes them with an ALVR_AUDIO_CODEC for
+// ClientConnection::SendAudio. Fixed frames bound the delay added by encoding to one frame and let the
+// client recover or conceal a lost packet frame by frame.
+// Not thread safe. Used by the audio capture thread only.
+class AudioEncoder {
+public:
+	// buf is valid during the call only.
+	typedef std::function<void(uint8_t *buf, int len, uint64_t presentationTime)> FrameCallback;
+
+	// fec: carry previous frame in each ADPCM or Opus frame. Ignored for PCM.
+	// Opus falls back to ADPCM if libopus is not available or rejects the format.
+	AudioEncoder(int codec, bool fec, int sampleRate, int channels, FrameCallback onFrame);
+
+	// buf: interleaved samples. time: timestamp of the end of buf.
+	void Feed(const uint8_t *buf, int len, uint64_t time);
+	void Reset();
+
+	int GetCodec() const;
+	int GetFrameSamples() const;
+	// Bytes sent per second.
+	static int GetBytesPerSecond(int codec, bool fec, int sampleRate, int channels);
+
+	static const int FRAME_MS = 10;
+private:
+	int mCodec;
+	int mSampleRate;
+	int mChannels;
+	int mFrameSamples;
+	FrameCallback mOnFrame;
+	std::unique_ptr<AdpcmEncoder> mAdpcm;
+#ifdef ALVR_OPUS
+	std::unique_ptr<OpusFrameEncoder> mOpus;
+#endif
+
+	// Samples of current frame, interleaved.
+	std::vector<int16_t> mFrame;
+	int mFilled;
+	std::vector<uint8_t> mOutput;
+};
@@ -0,0 +1,101 @@
+#include <string.h>
+#include <algorithm>
+
+#include "AudioSink.h"
+
+NullAudioSink::NullAudioSink(int sampleRate, int bufferSamples, std::function<uint64_t()> clock)
+	: mSampleRate(sampleRate)
+	, mBufferSamples(bufferSamples)
+	, mClock(clock)
+	, mStartTime(clock())
+	, mWritten(0)
+	, mStarved(0)
+{
+}
+
+int NullAudioSink::GetWritableSamples()
+{
+	uint64_t played = GetPlayed();
+	if (played > mWritten) {
+		// Device ran dry. It plays silence and continues from where it is.
+		mStarved += played - mWritten;
+		mWritten = played;
+	}
+	return std::max(mBufferSamples - (int)(mWritten - played), 0);
+}
+
+void NullAudioSink::Write(const int16_t *samples, int count)
+{
+	GetWritableSamples();
+	Output(samples, count);
+	mWritten += count;
+}
+
+uint64_t NullAudioSink::GetStarvedSamples() const
+{
+	return mStarved;
+}
+
+uint64_t NullAudioSink::GetPlayed()
+{
+	return (mClock() - mStartTime) * mSampleRate / (1000 * 1000);
+}
+
+WavFileAudioSink::WavFileAudioSink(const std::string &path, int sampleRate, int bufferSamples, std::function<uint64_t()> clock)
+	: NullAudioSink(sampleRate, bufferSamples, clock)
+	, mFile(fopen(path.c_str(), "wb"))
+	, mSampleRate(sampleRate)
+	, mDataBytes(0)
+{
+	if (mFile != NULL) {
+		WriteHeader();
+	}
+}
+
+WavFileAudioSink::~WavFileAudioSink()
+{
+	if (mFile != NULL) {
+		fseek(mFile, 0, SEEK_SET);
+		WriteHeader();
+		fclose(mFile);
+	}
+}
+
+bool WavFileAudioSink::IsOpen() const
+{
+	return mFile != NULL;
+}
+
+void WavFileAudioSink::Output(const int16_t *samples, int count)
+{
+	if (mFile != NULL) {
+		fwrite(samples, sizeof(int16_t), count, mFile);
+		mDataBytes += count * sizeof(int16_t);
+	}
+}
+
+void WavFileAudioSink::WriteHeader()
+{
+	uint8_t header[44];
+	uint32_t riffSize = 36 + mDataBytes;
+	uint32_t fmtSize = 16;
+	uint16_t format = 1;
+	uint16_t channels = 1;
+	uint32_t rate = mSampleRate;
+	uint32_t byteRate = mSampleRate * 2;
+	uint16_t blockAlign = 2;
+	uint16_t bits = 16;
+	memcpy(header, "RIFF", 4);
+	memcpy(header + 4, &riffSize, 4);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	memcpy(header + 16, &fmtSize, 4);
+	memcpy(header + 20, &format, 2);
+	memcpy(header + 22, &channels, 2);
+	memcpy(header + 24, &rate, 4);
+	memcpy(header + 28, &byteRate, 4);
+	memcpy(header + 32, &blockAlign, 2);
+	memcpy(header + 34, &bits, 2);
+	memcpy(header + 36, "data", 4);
+	memcpy(header + 40, &mDataBytes, 4);
+	fwrite(header, 1, sizeof(header), mFile);
+}
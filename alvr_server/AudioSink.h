@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <string>
+
+// Audio output device. Write never blocks: callers write at most GetWritableSamples samples, and the
+// rate at which the sink frees space is the output clock.
+// 48kHz 16bit mono unless noted.
+class AudioSink {
+public:
+	virtual ~AudioSink() {}
+
+	// Samples which can be written now without blocking.
+	virtual int GetWritableSamples() = 0;
+	virtual void Write(const int16_t *samples, int count) = 0;
+};
+
+// Plays samples out at sampleRate of clock (microseconds), keeping up to bufferSamples queued like a
+// device buffer. Discards samples. Used when no device is available and in tests, where clock can run
+// faster or slower than the sender to simulate clock drift.
+class NullAudioSink : public AudioSink {
+public:
+	NullAudioSink(int sampleRate, int bufferSamples, std::function<uint64_t()> clock);
+
+	int GetWritableSamples() override;
+	void Write(const int16_t *samples, int count) override;
+
+	// Samples the device played while nothing was queued.
+	uint64_t GetStarvedSamples() const;
+protected:
+	virtual void Output(const int16_t *samples, int count) {}
+private:
+	int mSampleRate;
+	int mBufferSamples;
+	std::function<uint64_t()> mClock;
+	uint64_t mStartTime;
+	uint64_t mWritten;
+	uint64_t mStarved;
+
+	uint64_t GetPlayed();
+};
+
+// NullAudioSink which also records samples to a WAV file.
+class WavFileAudioSink : public NullAudioSink {
+public:
+	WavFileAudioSink(const std::string &path, int sampleRate, int bufferSamples, std::function<uint64_t()> clock);
+	~WavFileAudioSink();
+
+	bool IsOpen() const;
+protected:
+	void Output(const int16_t *samples, int count) override;
+private:
+	FILE *mFile;
+	int mSampleRate;
+	uint32_t mDataBytes;
+
+	void WriteHeader();
+};
@@ -0,0 +1,83 @@
+#include <algorithm>
+
+#include "BandWorkers.h"
+
+const int BandWorkers::MAX_THREADS;
+
+BandWorkers::BandWorkers(int threadCount)
+	: mThreadCount(threadCount)
+{
+	if (mThreadCount <= 0) {
+		mThreadCount = std::min(std::max((int)std::thread::hardware_concurrency(), 1), MAX_THREADS);
+	}
+}
+
+BandWorkers::~BandWorkers()
+{
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mExiting = true;
+	}
+	mStartCondition.notify_all();
+	for (auto &worker : mWorkers) {
+		worker.join();
+	}
+}
+
+void BandWorkers::Run(int bandCount, const std::function<void(int band, int bandCount)> &work)
+{
+	bandCount = std::max(std::min(bandCount, mThreadCount), 1);
+	if (bandCount == 1) {
+		work(0, 1);
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		while ((int)mWorkers.size() < mThreadCount - 1) {
+			mWorkers.emplace_back(&BandWorkers::WorkerThread, this, (int)mWorkers.size() + 1);
+		}
+		mWork = &work;
+		mBandCount = bandCount;
+		mPending = (int)mWorkers.size();
+		mGeneration++;
+	}
+	mStartCondition.notify_all();
+
+	work(0, bandCount);
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDoneCondition.wait(lock, [this] { return mPending == 0; });
+}
+
+int BandWorkers::GetThreadCount() const
+{
+	return mThreadCount;
+}
+
+void BandWorkers::WorkerThread(int band)
+{
+	uint64_t generation = 0;
+	while (true) {
+		const std::function<void(int band, int bandCount)> *work;
+		int bandCount;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mStartCondition.wait(lock, [&] { return mExiting || mGeneration != generation; });
+			if (mExiting) {
+				return;
+			}
+			generation = mGeneration;
+			work = mWork;
+			bandCount = mBandCount;
+		}
+		if (band < bandCount) {
+			(*work)(band, bandCount);
+		}
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mPending--;
+		}
+		mDoneCondition.notify_one();
+	}
+}
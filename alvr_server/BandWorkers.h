@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Runs per frame work split into bands of rows on several threads, for the CPU image processing
+// (RGBToNV12ConverterCPU, FFRCPU). The calling thread runs the first band and worker threads the
+// others. Workers are started on first use and wait for the next frame between calls.
+class BandWorkers {
+public:
+	// threadCount: bands per call at most, 0 for one per hardware thread up to MAX_THREADS.
+	explicit BandWorkers(int threadCount);
+	~BandWorkers();
+
+	BandWorkers(const BandWorkers &) = delete;
+	BandWorkers &operator=(const BandWorkers &) = delete;
+
+	// Calls work(band, bandCount) for each band below bandCount, which is limited to the thread count,
+	// and returns when all are done.
+	void Run(int bandCount, const std::function<void(int band, int bandCount)> &work);
+
+	int GetThreadCount() const;
+
+	static const int MAX_THREADS = 8;
+private:
+	int mThreadCount;
+
+	std::vector<std::thread> mWorkers;
+	std::mutex mMutex;
+	std::condition_variable mStartCondition;
+	std::condition_variable mDoneCondition;
+	// Incremented for each call given to the workers.
+	uint64_t mGeneration = 0;
+	int mPending = 0;
+	bool mExiting = false;
+	const std::function<void(int band, int bandCount)> *mWork = nullptr;
+	int mBandCount = 0;
+
+	void WorkerThread(int band);
+};
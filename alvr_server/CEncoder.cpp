@@ -5,6 +5,9 @@
 			: m_bExiting(false)
 			, m_frameIndex(0)
 			, m_frameIndex2(0)
+			, m_foveationSequence(0)
+			, m_bitrateInMBits(static_cast<int>(Settings::Instance().mEncodeBitrate.toMiBits()))
+			, m_foveationStrength(Settings::Instance().m_foveationStrength)
 		{
 			m_encodeFinished.Set();
 		}
@@ -20,11 +23,19 @@
 		}
 
 		void CEncoder::Initialize(std::shared_ptr<CD3DRender> d3dRender, std::shared_ptr<ClientConnection> listener) {
+			m_listener = listener;
 			m_FrameRender = std::make_shared<FrameRender>(d3dRender);
 			m_FrameRender->Startup();
 			uint32_t encoderWidth, encoderHeight;
 			m_FrameRender->GetEncodingResolution(&encoderWidth, &encoderHeight);
 
+			if (Settings::Instance().m_softwareEncoder) {
+				LogDriver("Use VideoEncoderSW.");
+				m_videoEncoder = std::make_shared<VideoEncoderSW>(d3dRender, listener, encoderWidth, encoderHeight);
+				m_videoEncoder->Initialize();
+				return;
+			}
+
 			Exception vceException;
 			Exception nvencException;
 			try {
@@ -46,6 +57,8 @@
 			catch (Exception e) {
 				nvencException = e;
 			}
+			// VideoEncoderSW is not tried: at full VR resolution it can not keep up, which is worse than a
+			// clear error. It is only used when softwareEncoder is set.
 			throw MakeException(L"All VideoEncoder are not available. VCE: %s, NVENC: %s", vceException.what(), nvencException.what());
 		}
 
@@ -57,6 +70,14 @@
 			m_clientTime = clientTime;
 			m_FrameRender->Startup();
 
+			// Encoder thread is idle until NewFrameReady, so FFR and encoder can be switched here.
+			FoveationController::Decision decision;
+			uint64_t sequence = m_listener->GetFoveationDecision(decision);
+			if (sequence != m_foveationSequence) {
+				m_foveationSequence = sequence;
+				Reconfigure(decision.bitrateInMBits, decision.strength);
+			}
+
 			char buf[200];
 			snprintf(buf, sizeof(buf), "\nindex2: %llu", m_frameIndex2);
 
@@ -118,4 +139,22 @@
 
 		void CEncoder::Reconfigure(int refreshRate, int renderWidth, int renderHeight, int bitrateInMBits) {
 			m_videoEncoder->Reconfigure(refreshRate, renderWidth, renderHeight, bitrateInMBits);
+		}
+
+		void CEncoder::Reconfigure(int bitrateInMBits, float foveationStrength) {
+			if (bitrateInMBits == m_bitrateInMBits && foveationStrength == m_foveationStrength) {
+				return;
+			}
+			bool resize = foveationStrength != m_foveationStrength;
+			if (resize) {
+				m_FrameRender->SetFoveationStrength(foveationStrength);
+			}
+			uint32_t encoderWidth, encoderHeight;
+			m_FrameRender->GetEncodingResolution(&encoderWidth, &encoderHeight);
+			m_videoEncoder->Reconfigure(Settings::Instance().m_refreshRate, encoderWidth, encoderHeight, bitrateInMBits);
+			m_bitrateInMBits = bitrateInMBits;
+			m_foveationStrength = foveationStrength;
+			if (resize) {
+				m_listener->SendFoveationSettings(foveationStrength, encoderWidth, encoderHeight);
+			}
 		}
\ No newline at end of file
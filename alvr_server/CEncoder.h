@@ -16,6 +16,7 @@
 #include "VideoEncoder.h"
 #include "VideoEncoderNVENC.h"
 #include "VideoEncoderVCE.h"
+#include "VideoEncoderSW.h"
 #include "IDRScheduler.h"
 
 
@@ -51,6 +52,10 @@
 
 		void Reconfigure(int refreshRate, int renderWidth, int renderHeight, int bitrateInMBits);
 
+		// Switches FFR and encoder to a FoveationController decision. Only while no frame is being encoded.
+		// Bitrate alone changes without IDR frame.
+		void Reconfigure(int bitrateInMBits, float foveationStrength);
+
 	private:
 		CThreadEvent m_newFrameReady, m_encodeFinished;
 		std::shared_ptr<VideoEncoder> m_videoEncoder;
@@ -64,5 +69,11 @@
 		std::shared_ptr<FrameRender> m_FrameRender;
 
 		IDRScheduler m_scheduler;
+
+		std::shared_ptr<ClientConnection> m_listener;
+		// Last applied ClientConnection::GetFoveationDecision.
+		uint64_t m_foveationSequence;
+		int m_bitrateInMBits;
+		float m_foveationStrength;
 	};
 
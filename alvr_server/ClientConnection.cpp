@@ -7,9 +7,8 @@ ClientConnection::ClientConnection()
 	, m_Enabled(false)
 	, m_Connected(false)
 	, m_Streaming(false)
-	, m_LastSeen(0) {
-	memset(&m_TrackingInfo, 0, sizeof(m_TrackingInfo));
-	InitializeCriticalSection(&m_CS);
+	, m_LastSeen(0)
+	, m_foveationSettingsRepeat(0) {
 
 	m_Statistics = std::make_shared<Statistics>();
 	m_MicPlayer  = std::make_shared<MicPlayer>();
@@ -29,7 +28,6 @@ ClientConnection::ClientConnection()
 }
 
 ClientConnection::~ClientConnection() {
-	DeleteCriticalSection(&m_CS);
 }
 
 void ClientConnection::SetLauncherCallback(std::function<void()> callback) {
@@ -61,9 +59,7 @@ bool ClientConnection::Startup() {
 	if (Settings::Instance().IsLoaded()) {
 		m_Force3DOF = Settings::Instance().m_force3DOF;
 		m_Enabled = true;
-		m_Socket = std::make_shared<UdpSocket>(Settings::Instance().m_Host, Settings::Instance().m_Port
-			, m_Poller, m_Statistics, Settings::Instance().mThrottlingBitrate);
-		if (!m_Socket->Startup()) {
+		if (!StartupSocket()) {
 			return false;
 		}
 	}
@@ -72,10 +68,38 @@ bool ClientConnection::Startup() {
 	return true;
 }
 
+bool ClientConnection::StartupSocket() {
+	bool trackingThread = Settings::Instance().m_trackingThread;
+	m_Socket = std::make_shared<UdpSocket>(Settings::Instance().m_Host, Settings::Instance().m_Port
+		, m_Poller, m_Statistics, Settings::Instance().mThrottlingBitrate);
+	if (!m_Socket->Startup(trackingThread)) {
+		return false;
+	}
+	m_micThread.reset(new MicPlaybackThread(m_MicPlayer));
+	m_micThread->Start();
+	if (trackingThread) {
+		m_ingressThread.reset(new IngressThread(m_Socket
+			, [this](const ReceivedPacket &packet) { return ProcessIngress(packet); }
+			, [this]() { m_Poller->Wake(); }));
+		m_ingressThread->Start();
+	}
+	return true;
+}
+
 void ClientConnection::Run() {
+	ScheduleTimeoutCheck();
+	ScheduleTelemetryTick();
 	while (!m_bExiting) {
-		CheckTimeout();
-		if (m_Poller->Do() == 0) {
+		int ready = m_Poller->Do();
+		if (m_ingressThread) {
+			// Woken by IngressThread through Poller::Wake, so check the queue on every return.
+			ReceivedPacket *packet;
+			while ((packet = m_ingressThread->Front()) != NULL) {
+				ProcessRecv(packet->buf, packet->len, &packet->addr, packet->receivedUs);
+				m_ingressThread->Pop();
+			}
+		}
+		if (ready == 0) {
 			if (m_Socket) {
 				m_Socket->Run();
 			}
@@ -83,12 +107,16 @@ void ClientConnection::Run() {
 		}
 
 		if (m_Socket) {
-			sockaddr_in addr;
-			int addrlen = sizeof(addr);
-			char buf[2000];
-			int len = sizeof(buf);
-			if (m_Socket->Recv(buf, &len, &addr, addrlen)) {
-				ProcessRecv(buf, len, &addr);
+			if (!m_ingressThread) {
+				sockaddr_in addr;
+				int addrlen = sizeof(addr);
+				char buf[2000];
+				int len = sizeof(buf);
+				uint64_t receivedUs;
+				while (m_Socket->Recv(buf, &len, &addr, addrlen, &receivedUs)) {
+					ProcessRecv(buf, len, &addr, receivedUs);
+					len = sizeof(buf);
+				}
 			}
 			m_Socket->Run();
 		}
@@ -97,9 +125,7 @@ void ClientConnection::Run() {
 			if (!m_Enabled) {
 				m_Enabled = true;
 				Settings::Instance().Load();
-				m_Socket = std::make_shared<UdpSocket>(Settings::Instance().m_Host, Settings::Instance().m_Port
-					, m_Poller, m_Statistics, Settings::Instance().mThrottlingBitrate);
-				if (!m_Socket->Startup()) {
+				if (!StartupSocket()) {
 					return;
 				}
 			}
@@ -127,93 +153,61 @@ void ClientConnection::Run() {
 	}
 }
 
-void ClientConnection::FECSend(uint8_t *buf, int len, uint64_t frameIndex, uint64_t videoFrameIndex) {
-	int shardPackets = CalculateFECShardPackets(len, m_fecPercentage);
-
-	int blockSize = shardPackets * ALVR_MAX_VIDEO_BUFFER_SIZE;
-
-	int dataShards = (len + blockSize - 1) / blockSize;
-	int totalParityShards = CalculateParityShards(dataShards, m_fecPercentage);
-	int totalShards = dataShards + totalParityShards;
-
-	assert(totalShards <= DATA_SHARDS_MAX);
-
-	Log("reed_solomon_new. dataShards=%d totalParityShards=%d totalShards=%d blockSize=%d shardPackets=%d"
-		, dataShards, totalParityShards, totalShards, blockSize, shardPackets);
-
-	reed_solomon *rs = reed_solomon_new(dataShards, totalParityShards);
-
-	std::vector<uint8_t *> shards(totalShards);
-
-	for (int i = 0; i < dataShards; i++) {
-		shards[i] = buf + i * blockSize;
-	}
-	if (len % blockSize != 0) {
-		// Padding
-		shards[dataShards - 1] = new uint8_t[blockSize];
-		memset(shards[dataShards - 1], 0, blockSize);
-		memcpy(shards[dataShards - 1], buf + (dataShards - 1) * blockSize, len % blockSize);
-	}
-	for (int i = 0; i < totalParityShards; i++) {
-		shards[dataShards + i] = new uint8_t[blockSize];
-	}
-
-	int ret = reed_solomon_encode(rs, &shards[0], totalShards, blockSize);
-	assert(ret == 0);
-
-	reed_solomon_release(rs);
-
-	uint8_t packetBuffer[2000];
-	VideoFrame *header = (VideoFrame *)packetBuffer;
-	uint8_t *payload = packetBuffer + sizeof(VideoFrame);
-	int dataRemain = len;
-
-	Log("Sending video frame. trackingFrameIndex=%llu videoFrameIndex=%llu size=%d", frameIndex, videoFrameIndex, len);
-
-	header->type = ALVR_PACKET_TYPE_VIDEO_FRAME;
-	header->trackingFrameIndex = frameIndex;
-	header->videoFrameIndex = videoFrameIndex;
-	header->sentTime = GetTimestampUs();
-	header->frameByteSize = len;
-	header->fecIndex = 0;
-	header->fecPercentage = m_fecPercentage;
-	for (int i = 0; i < dataShards; i++) {
-		for (int j = 0; j < shardPackets; j++) {
-			int copyLength = std::min(ALVR_MAX_VIDEO_BUFFER_SIZE, dataRemain);
-			if (copyLength <= 0) {
-				break;
+void ClientConnection::FECSend(uint8_t *buf, int len, uint64_t frameIndex, uint64_t videoFrameIndex, const NalParser::FrameInfo &info
+	, int sliceIndex, int sliceCount) {
+	VideoFrame header;
+
+	Log("Sending video frame. trackingFrameIndex=%llu videoFrameIndex=%llu size=%d frameType=%d parameterSets=%d slice=%d/%d", frameIndex
+		, videoFrameIndex, len, info.frameType, info.parameterSets, sliceIndex, sliceCount);
+
+	header.type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+	header.packetCounter = 0;
+	header.trackingFrameIndex = frameIndex;
+	header.videoFrameIndex = videoFrameIndex;
+	header.sentTime = GetTimestampUs();
+	header.frameByteSize = len;
+	header.fecIndex = 0;
+	header.frameType = info.frameType;
+	header.sliceIndex = static_cast<uint8_t>(sliceIndex);
+	header.sliceCount = static_cast<uint8_t>(sliceCount);
+	// Unequal error protection: losing these costs an IDR round trip.
+	bool important = info.frameType == ALVR_FRAME_TYPE_IDR || info.parameterSets;
+	bool resetInterleaver = false;
+	{
+		IPCCriticalSectionLock lock(m_fecPolicyCS);
+		if (m_fecPolicy) {
+			if (important) {
+				m_importantFecPercentage = m_fecPolicy->GetImportantFecPercentage(len);
+			}
+			else {
+				m_fecPercentage = m_fecPolicy->GetFecPercentage(len);
 			}
-			memcpy(payload, shards[i] + j * ALVR_MAX_VIDEO_BUFFER_SIZE, copyLength);
-			dataRemain -= ALVR_MAX_VIDEO_BUFFER_SIZE;
-
-			header->packetCounter = videoPacketCounter;
-			videoPacketCounter++;
-			m_Socket->Send((char *)packetBuffer, sizeof(VideoFrame) + copyLength, frameIndex);
-			header->fecIndex++;
 		}
+		resetInterleaver = m_fecInterleaverReset;
+		m_fecInterleaverReset = false;
 	}
-	header->fecIndex = dataShards * shardPackets;
-	for (int i = 0; i < totalParityShards; i++) {
-		for (int j = 0; j < shardPackets; j++) {
-			int copyLength = ALVR_MAX_VIDEO_BUFFER_SIZE;
-			memcpy(payload, shards[dataShards + i] + j * ALVR_MAX_VIDEO_BUFFER_SIZE, copyLength);
-
-			header->packetCounter = videoPacketCounter;
-			videoPacketCounter++;
-			m_Socket->Send((char *)packetBuffer, sizeof(VideoFrame) + copyLength, frameIndex);
-			header->fecIndex++;
-		}
+	header.fecPercentage = important ? m_importantFecPercentage : m_fecPercentage;
+	if (resetInterleaver) {
+		ConfigureFecInterleaver();
 	}
 
-	if (len % blockSize != 0) {
-		delete[] shards[dataShards - 1];
-	}
-	for (int i = 0; i < totalParityShards; i++) {
-		delete[] shards[dataShards + i];
+	uint32_t firstPacket = videoPacketCounter;
+	m_Socket->BeginSend();
+	bool packetized = m_fecInterleaver.Packetize(m_FECPacketizer, buf, len, header, videoPacketCounter
+		, [this]() { return m_Socket->AllocatePacket(); }, GetCounterUs());
+	if (!m_Socket->EndSend(packetized)) {
+		LogDriver("Video frame dropped. Send queue is full or client is not connected. videoFrameIndex=%llu size=%d", videoFrameIndex, len);
+		return;
 	}
+	IPCCriticalSectionLock lock(m_fecPolicyCS);
+	m_frameLossTracker.OnFrameSent(info.frameType, firstPacket, videoPacketCounter - firstPacket, FECLayout::Calculate(len, header.fecPercentage));
 }
 
-void ClientConnection::SendVideo(uint8_t *buf, int len, uint64_t frameIndex) {
+void ClientConnection::SendVideo(uint8_t *buf, int len, uint64_t frameIndex, bool insertedIDR) {
+	SendVideoSlice(buf, len, frameIndex, 0, 1, insertedIDR);
+}
+
+void ClientConnection::SendVideoSlice(uint8_t *buf, int len, uint64_t frameIndex, int sliceIndex, int sliceCount, bool insertedIDR) {
 	if (!m_Socket->IsClientValid()) {
 		LogDriver("Skip sending packet because client is not connected. Packet Length=%d FrameIndex=%llu", len, frameIndex);
 		return;
@@ -222,11 +216,18 @@ void ClientConnection::SendVideo(uint8_t *buf, int len, uint64_t frameIndex) {
 		LogDriver("Skip sending packet because streaming is off.");
 		return;
 	}
-	FECSend(buf, len, frameIndex, mVideoFrameIndex);
+	// Codec may change on reconnect, so the parser is cheap to make per frame. NAL list is reused.
+	NalParser parser(Settings::Instance().m_codec);
+	parser.Parse(buf, len, m_videoNals);
+	NalParser::FrameInfo info = parser.Classify(m_videoNals);
+	if (insertedIDR) {
+		info.frameType = ALVR_FRAME_TYPE_IDR;
+	}
+	FECSend(buf, len, frameIndex, mVideoFrameIndex, info, sliceIndex, sliceCount);
 	mVideoFrameIndex++;
 }
 
-void ClientConnection::SendAudio(uint8_t *buf, int len, uint64_t presentationTime) {
+void ClientConnection::SendAudio(uint8_t *buf, int len, uint64_t presentationTime, uint8_t codec) {
 	uint8_t packetBuffer[2000];
 
 	if (!m_Socket->IsClientValid()) {
@@ -251,6 +252,7 @@ void ClientConnection::SendAudio(uint8_t *buf, int len, uint64_t presentationTim
 			header->packetCounter = soundPacketCounter;
 			header->presentationTime = presentationTime;
 			header->frameByteSize = len;
+			header->codec = codec;
 
 			pos = sizeof(*header);
 		}
@@ -272,7 +274,7 @@ void ClientConnection::SendAudio(uint8_t *buf, int len, uint64_t presentationTim
 
 		soundPacketCounter++;
 
-		int ret = m_Socket->Send((char *)packetBuffer, pos);
+		int ret = m_Socket->Send((char *)packetBuffer, pos, 0, ThrottlingBuffer::PRIORITY_AUDIO);
 
 	}
 }
@@ -296,10 +298,10 @@ void ClientConnection::SendHapticsFeedback(uint64_t startTime, float amplitude,
 	packetBuffer.duration = duration;
 	packetBuffer.frequency = frequency;
 	packetBuffer.hand = hand;
-	m_Socket->Send((char *)&packetBuffer, sizeof(HapticsFeedback));
+	m_Socket->Send((char *)&packetBuffer, sizeof(HapticsFeedback), 0, ThrottlingBuffer::PRIORITY_HAPTICS);
 }
 
-void ClientConnection::ProcessRecv(char *buf, int len, sockaddr_in *addr) {
+void ClientConnection::ProcessRecv(char *buf, int len, sockaddr_in *addr, uint64_t receivedUs) {
 	if (len < 4) {
 		return;
 	}
@@ -349,29 +351,7 @@ void ClientConnection::ProcessRecv(char *buf, int len, sockaddr_in *addr) {
 		}
 	}
 	else if (type == ALVR_PACKET_TYPE_TRACKING_INFO && len >= sizeof(TrackingInfo)) {
-		if (!m_Connected || !m_Socket->IsLegitClient(addr)) {
-			LogDriver("Recieved message from invalid address: %hs", AddrPortToStr(addr).c_str());
-			return;
-		}
-		UpdateLastSeen();
-
-		EnterCriticalSection(&m_CS);
-		m_TrackingInfo = *(TrackingInfo *)buf;
-		LeaveCriticalSection(&m_CS);
-
-		// if 3DOF, zero the positional data!
-		if (m_Force3DOF) {
-			m_TrackingInfo.HeadPose_Pose_Position.x = 0;
-			m_TrackingInfo.HeadPose_Pose_Position.y = 0;
-			m_TrackingInfo.HeadPose_Pose_Position.z = 0;
-		}
-
-		Log("got tracking info %d %f %f %f %f", (int)m_TrackingInfo.FrameIndex,
-			m_TrackingInfo.HeadPose_Pose_Orientation.x,
-			m_TrackingInfo.HeadPose_Pose_Orientation.y,
-			m_TrackingInfo.HeadPose_Pose_Orientation.z,
-			m_TrackingInfo.HeadPose_Pose_Orientation.w);
-		m_PoseUpdatedCallback();
+		ProcessTrackingInfo(buf, addr, receivedUs);
 	}
 	else if (type == ALVR_PACKET_TYPE_TIME_SYNC && len >= sizeof(TimeSync)) {
 		if (!m_Connected || !m_Socket->IsLegitClient(addr)) {
@@ -385,22 +365,45 @@ void ClientConnection::ProcessRecv(char *buf, int len, sockaddr_in *addr) {
 
 		if (timeSync->mode == 0) {
 			m_reportedStatistics = *timeSync;
+			m_Statistics->GetNetworkTelemetry().RecordTransportLatency(timeSync->averageTransportLatency, timeSync->maxTransportLatency);
+			{
+				IPCCriticalSectionLock lock(m_fecPolicyCS);
+				if (m_fecPolicy) {
+					m_fecPolicy->OnReport(GetCounterUs(), m_Statistics->GetPacketsSentInSecond(), timeSync->packetsLostInSecond);
+				}
+			}
+			if (m_foveationController && m_foveationController->OnReport(GetCounterUs(), m_Statistics->GetPacketsSentInSecond()
+				, timeSync->packetsLostInSecond, m_Statistics->GetNetworkTelemetry().Get(NetworkTelemetry::QUEUE_DELAY, 1).p95)) {
+				const FoveationController::Decision &decision = m_foveationController->GetDecision();
+				LogDriver("Foveation: %d Mbits strength %.2f %ux%u (budget %.1f Mbits)", decision.bitrateInMBits, decision.strength
+					, decision.width, decision.height, m_foveationController->GetBudget());
+				m_foveationDecision.Write(decision);
+			}
 			TimeSync sendBuf = *timeSync;
 			sendBuf.mode = 1;
+			// serverTime is stamped right before sendto, so RTT and clock offset exclude time in send queue.
 			sendBuf.serverTime = Current;
-			m_Socket->Send((char *)&sendBuf, sizeof(sendBuf), 0);
+			m_Socket->Send((char *)&sendBuf, sizeof(sendBuf), 0, ThrottlingBuffer::PRIORITY_CONTROL, offsetof(TimeSync, serverTime));
+
+			if (m_foveationSettingsRepeat > 0) {
+				m_foveationSettingsRepeat--;
+				SendChangeSettings();
+			}
 
 			if (timeSync->fecFailure) {
 				OnFecFailure();
 			}
 		}
 		else if (timeSync->mode == 2) {
-			// Calclate RTT
-			uint64_t RTT = Current - timeSync->serverTime;
-			// Estimated difference between server and client clock
-			uint64_t TimeDiff = Current - (timeSync->clientTime + RTT / 2);
-			m_TimeDiff = TimeDiff;
-			Log("TimeSync: server - client = %lld us RTT = %lld us", TimeDiff, RTT);
+			// Use time of receive, not of processing, so the round trip excludes our own queueing.
+			uint64_t received = Current - (GetCounterUs() - receivedUs);
+			uint64_t RTT = received - timeSync->serverTime;
+			m_Statistics->GetNetworkTelemetry().RecordRoundTrip(RTT);
+			m_clockSync.AddSample(timeSync->serverTime, timeSync->clientTime, received);
+			const ClockSyncEstimate &estimate = m_clockSync.GetEstimate();
+			m_clockEstimate.Write(estimate);
+			Log("TimeSync: server - client = %.0f us RTT = %lld us uncertainty = %.0f us skew = %.1f ppm"
+				, estimate.GetOffset(received), RTT, estimate.GetUncertainty(received), estimate.skew * 1e6);
 		}
 	}
 	else if (type == ALVR_PACKET_TYPE_STREAM_CONTROL_MESSAGE && len >= sizeof(StreamControlMessage)) {
@@ -427,32 +430,108 @@ void ClientConnection::ProcessRecv(char *buf, int len, sockaddr_in *addr) {
 		}
 		auto *packetErrorReport = (PacketErrorReport *)buf;
 		LogDriver("Packet loss was reported. Type=%d %lu - %lu", packetErrorReport->lostFrameType, packetErrorReport->fromPacketCounter, packetErrorReport->toPacketCounter);
+		uint32_t lostPackets = packetErrorReport->toPacketCounter - packetErrorReport->fromPacketCounter + 1;
+		m_Statistics->GetNetworkTelemetry().RecordLossRun(lostPackets);
 		if (packetErrorReport->lostFrameType == ALVR_LOST_FRAME_TYPE_VIDEO) {
+			{
+				IPCCriticalSectionLock lock(m_fecPolicyCS);
+				if (m_fecPolicy) {
+					m_fecPolicy->OnLossRun(GetCounterUs(), lostPackets);
+				}
+				m_frameLossTracker.OnLossRun(packetErrorReport->fromPacketCounter, packetErrorReport->toPacketCounter);
+			}
 			// Recover video frame.
 			OnFecFailure();
 		}
 	}
-	else if (type == ALVR_PACKET_TYPE_MIC_AUDIO && len >= sizeof(MicAudioFrame)) {
+	else if (type == ALVR_PACKET_TYPE_MIC_AUDIO && len >= offsetof(MicAudioFrame, micBuffer)) {
 		if (!m_Connected || !m_Socket->IsLegitClient(addr)) {
 			LogDriver("Recieved message from invalid address: %hs", AddrPortToStr(addr).c_str());
 			return;
 		}
-		auto *frame = (MicAudioFrame *)buf;
-		LogDriver("Got MicAudio Frame with length - %zu  %zu index: %i", frame->outputBufferNumElements, frame->completeSize, frame->packetIndex);
+		if (!m_micThread->Push(buf, len, receivedUs)) {
+			Log("Skipped playing mic audio: Queue is full");
+		}
+	}
+}
+
+bool ClientConnection::ProcessIngress(const ReceivedPacket &packet) {
+	if (packet.len < 4) {
+		return false;
+	}
+	uint32_t type = *(uint32_t*)packet.buf;
+
+	if (type == ALVR_PACKET_TYPE_TRACKING_INFO && packet.len >= sizeof(TrackingInfo)) {
+		Log("Received packet. Type=%d", type);
+		ProcessTrackingInfo(packet.buf, &packet.addr, packet.receivedUs);
+		return true;
+	}
+	else if (type == ALVR_PACKET_TYPE_MIC_AUDIO && packet.len >= offsetof(MicAudioFrame, micBuffer)) {
+		if (!IsConnectedClient(&packet.addr)) {
+			LogDriver("Recieved message from invalid address: %hs", AddrPortToStr(&packet.addr).c_str());
+			return true;
+		}
+		if (!m_micThread->Push(packet.buf, packet.len, packet.receivedUs)) {
+			Log("Skipped playing mic audio: Queue is full");
+		}
+		return true;
+	}
+	return false;
+}
 
-		m_MicPlayer->playAudio( (char*)frame->micBuffer , sizeof(int16_t)  *  frame->outputBufferNumElements);
-	
+void ClientConnection::ProcessTrackingInfo(const char *buf, const sockaddr_in *addr, uint64_t receivedUs) {
+	if (!IsConnectedClient(addr)) {
+		LogDriver("Recieved message from invalid address: %hs", AddrPortToStr(addr).c_str());
+		return;
+	}
+	UpdateLastSeen();
+
+	TrackingInfo info;
+	memcpy(&info, buf, sizeof(info));
+
+	// if 3DOF, zero the positional data!
+	if (m_Force3DOF) {
+		info.HeadPose_Pose_Position.x = 0;
+		info.HeadPose_Pose_Position.y = 0;
+		info.HeadPose_Pose_Position.z = 0;
+	}
+
+	m_TrackingInfo.Write(info);
+	if (m_TrackingHistory.GetCount() == 0 || m_lastHistoryFrameIndex != info.FrameIndex) {
+		m_TrackingHistory.Push(info);
+		m_lastHistoryFrameIndex = info.FrameIndex;
 	}
+
+	Log("got tracking info %d %f %f %f %f", (int)info.FrameIndex,
+		info.HeadPose_Pose_Orientation.x,
+		info.HeadPose_Pose_Orientation.y,
+		info.HeadPose_Pose_Orientation.z,
+		info.HeadPose_Pose_Orientation.w);
+	m_PoseUpdatedCallback();
+	m_Statistics->GetNetworkTelemetry().RecordPoseLatency(GetCounterUs() - receivedUs);
+}
+
+bool ClientConnection::IsConnectedClient(const sockaddr_in *addr) const {
+	sockaddr_in client;
+	m_connectedClientAddr.Read(client);
+	return client.sin_family == AF_INET && client.sin_addr.S_un.S_addr == addr->sin_addr.S_un.S_addr
+		&& client.sin_port == addr->sin_port;
 }
 
 void ClientConnection::ProcessCommand(const std::string &commandName, const std::string args) {
 	if (commandName == "SetDebugFlags") {
-		m_Settings.debugFlags = strtol(args.c_str(), NULL, 10);
+		{
+			IPCCriticalSectionLock lock(m_settingsCS);
+			m_Settings.debugFlags = strtol(args.c_str(), NULL, 10);
+		}
 		SendChangeSettings();
 		SendCommandResponse("OK\n");
 	}
 	else if (commandName == "Suspend") {
-		m_Settings.suspend = atoi(args.c_str());
+		{
+			IPCCriticalSectionLock lock(m_settingsCS);
+			m_Settings.suspend = atoi(args.c_str());
+		}
 		SendChangeSettings();
 		SendCommandResponse("OK\n");
 	}
@@ -495,8 +574,13 @@ void ClientConnection::ProcessCommand(const std::string &commandName, const std:
 		SendCommandResponse("OK\n");
 	}
 	else if (commandName == "GetStat") {
-		char buf[1000];
-		snprintf(buf, sizeof(buf),
+		char buf[4000];
+		int len = 0;
+		// snprintf returns the untruncated length. Keep buf + len inside buf once the output is truncated.
+		auto advance = [&](int written) {
+			len = std::min(len + std::max(written, 0), static_cast<int>(sizeof(buf)) - 1);
+		};
+		advance(snprintf(buf, sizeof(buf),
 			"TotalPackets %llu Packets\n"
 			"PacketRate %llu Packets/s\n"
 			"PacketsLostTotal %llu Packets\n"
@@ -513,6 +597,9 @@ void ClientConnection::ProcessCommand(const std::string &commandName, const std:
 			"FecFailureInSecond %llu Packets/s\n"
 			"ClientFPS %d\n"
 			"ServerFPS %d\n"
+			"StaleFramesDroppedTotal %llu Frames\n"
+			"StaleFramesDroppedInSecond %llu Frames/s\n"
+			"SendQueueOverflowTotal %llu\n"
 			, m_Statistics->GetPacketsSentTotal()
 			, m_Statistics->GetPacketsSentInSecond()
 			, m_reportedStatistics.packetsLostTotal
@@ -528,7 +615,81 @@ void ClientConnection::ProcessCommand(const std::string &commandName, const std:
 			, m_reportedStatistics.fecFailureTotal
 			, m_reportedStatistics.fecFailureInSecond
 			, m_reportedStatistics.fps
-			, m_Statistics->GetFPS());
+			, m_Statistics->GetFPS()
+			, m_Statistics->GetStaleFramesDroppedTotal()
+			, m_Statistics->GetStaleFramesDroppedInSecond()
+			, m_Statistics->GetOverflowDropsTotal()));
+
+		// Tail latency over last NetworkTelemetry::WINDOW_SECONDS. Loss runs over last second.
+		NetworkTelemetry &telemetry = m_Statistics->GetNetworkTelemetry();
+		struct {
+			const char *name;
+			NetworkTelemetry::Metric metric;
+			int seconds;
+		} metrics[] = {
+			{ "SendQueueDelay", NetworkTelemetry::QUEUE_DELAY, NetworkTelemetry::WINDOW_SECONDS },
+			{ "RTT", NetworkTelemetry::RTT, NetworkTelemetry::WINDOW_SECONDS },
+			{ "TransportLatencyAvg", NetworkTelemetry::TRANSPORT_LATENCY, NetworkTelemetry::WINDOW_SECONDS },
+			{ "TransportLatencyMax", NetworkTelemetry::TRANSPORT_LATENCY_MAX, NetworkTelemetry::WINDOW_SECONDS },
+			{ "PoseLatency", NetworkTelemetry::POSE_LATENCY, NetworkTelemetry::WINDOW_SECONDS },
+		};
+		for (auto &m : metrics) {
+			NetworkTelemetry::Percentiles p = telemetry.Get(m.metric, m.seconds);
+			advance(snprintf(buf + len, sizeof(buf) - len, "%s %.1f/%.1f/%.1f/%.1f ms (p50/p95/p99/max)\n", m.name
+				, p.p50 / 1000.0, p.p95 / 1000.0, p.p99 / 1000.0, p.max / 1000.0));
+		}
+		NetworkTelemetry::Percentiles loss = telemetry.Get(NetworkTelemetry::LOSS_RUN_LENGTH, 1);
+		advance(snprintf(buf + len, sizeof(buf) - len,
+			"Jitter %.1f ms\n"
+			"LossRunsInSecond %llu\n"
+			"LossRunLength %llu/%llu/%llu/%llu Packets (p50/p95/p99/max)\n"
+			, telemetry.GetJitter() / 1000.0
+			, loss.count
+			, loss.p50, loss.p95, loss.p99, loss.max));
+
+		ClockSyncEstimate clock;
+		m_clockEstimate.Read(clock);
+		uint64_t now = GetTimestampUs();
+		advance(snprintf(buf + len, sizeof(buf) - len,
+			"ClockOffset %.1f ms\n"
+			"ClockUncertainty %.1f ms\n"
+			"ClockSkew %.1f ppm\n"
+			, clock.GetOffset(now) / 1000.0
+			, clock.valid ? clock.GetUncertainty(now) / 1000.0 : 0.0
+			, clock.skew * 1e6));
+
+		{
+			IPCCriticalSectionLock lock(m_fecPolicyCS);
+			advance(snprintf(buf + len, sizeof(buf) - len, "FecPercentageIDR %d %%\n", m_importantFecPercentage));
+			const char *typeNames[FrameLossTracker::FRAME_TYPES] = { "NonReference", "Reference", "IDR" };
+			for (int type = 0; type < FrameLossTracker::FRAME_TYPES; type++) {
+				const FrameLossTracker::TypeStats &frames = m_frameLossTracker.GetStats(type);
+				advance(snprintf(buf + len, sizeof(buf) - len, "Frames%s %llu/%llu/%llu (sent/recovered/lost)\n", typeNames[type]
+					, frames.frames, frames.recovered, frames.lost));
+			}
+		}
+
+		if (m_foveationController) {
+			const FoveationController::Decision &decision = m_foveationController->GetDecision();
+			advance(snprintf(buf + len, sizeof(buf) - len,
+				"EncodeBitrate %d Mbps\n"
+				"BandwidthBudget %.1f Mbps\n"
+				"FoveationStrength %.2f\n"
+				"EncodeResolution %ux%u\n"
+				, decision.bitrateInMBits, m_foveationController->GetBudget(), decision.strength, decision.width, decision.height));
+		}
+
+		if (m_micThread) {
+			MicJitterBuffer::Stats mic = m_micThread->GetStats();
+			advance(snprintf(buf + len, sizeof(buf) - len,
+				"MicPackets %llu\n"
+				"MicLostPackets %llu\n"
+				"MicLatePackets %llu\n"
+				"MicReorderedPackets %llu\n"
+				"MicUnderruns %llu\n"
+				"MicConcealedSamples %llu\n"
+				, mic.packets, mic.lostPackets, mic.latePackets, mic.reorderedPackets, mic.underruns, mic.concealedSamples));
+		}
 		SendCommandResponse(buf);
 	}
 	else if (commandName == "Disconnect") {
@@ -544,7 +705,10 @@ void ClientConnection::ProcessCommand(const std::string &commandName, const std:
 			auto name = args.substr(0, index);
 			if (name == k_pch_Settings_FrameQueueSize_Int32) {
 				Settings::Instance().m_frameQueueSize = atoi(args.substr(index + 1).c_str());
-				m_Settings.frameQueueSize = Settings::Instance().m_frameQueueSize;
+				{
+					IPCCriticalSectionLock lock(m_settingsCS);
+					m_Settings.frameQueueSize = Settings::Instance().m_frameQueueSize;
+				}
 				SendChangeSettings();
 			}
 			else {
@@ -563,7 +727,27 @@ void ClientConnection::SendChangeSettings() {
 	if (!m_Socket->IsClientValid()) {
 		return;
 	}
-	m_Socket->Send((char *)&m_Settings, sizeof(m_Settings), 0);
+	ChangeSettings settings;
+	{
+		IPCCriticalSectionLock lock(m_settingsCS);
+		settings = m_Settings;
+	}
+	m_Socket->Send((char *)&settings, sizeof(settings), 0, ThrottlingBuffer::PRIORITY_CONTROL);
+}
+
+uint64_t ClientConnection::GetFoveationDecision(FoveationController::Decision &decision) const {
+	return m_foveationDecision.Read(decision);
+}
+
+void ClientConnection::SendFoveationSettings(float strength, uint32_t width, uint32_t height) {
+	{
+		IPCCriticalSectionLock lock(m_settingsCS);
+		m_Settings.foveationStrength = strength;
+		m_Settings.videoWidth = width;
+		m_Settings.videoHeight = height;
+	}
+	m_foveationSettingsRepeat = FOVEATION_SETTINGS_REPEAT;
+	SendChangeSettings();
 }
 
 void ClientConnection::Stop()
@@ -571,6 +755,12 @@ void ClientConnection::Stop()
 	LogDriver("Listener::Stop().");
 	m_bExiting = true;
 
+	if (m_ingressThread) {
+		m_ingressThread->Stop();
+	}
+	if (m_micThread) {
+		m_micThread->Stop();
+	}
 	if (m_Socket) {
 		m_Socket->Shutdown();
 	}
@@ -579,21 +769,28 @@ void ClientConnection::Stop()
 }
 
 bool ClientConnection::HasValidTrackingInfo() const {
-	return m_TrackingInfo.type == ALVR_PACKET_TYPE_TRACKING_INFO;
+	return m_TrackingInfo.GetSequence() != 0;
 }
 
 void ClientConnection::GetTrackingInfo(TrackingInfo &info) {
-	EnterCriticalSection(&m_CS);
-	info = m_TrackingInfo;
-	LeaveCriticalSection(&m_CS);
+	// All zero until first TrackingInfo arrives.
+	m_TrackingInfo.Read(info);
+}
+
+int ClientConnection::GetTrackingHistory(TrackingInfo *infos, int maxCount) {
+	return m_TrackingHistory.ReadRecent(infos, maxCount);
 }
 
 uint64_t ClientConnection::clientToServerTime(uint64_t clientTime) const {
-	return clientTime + m_TimeDiff;
+	ClockSyncEstimate estimate;
+	m_clockEstimate.Read(estimate);
+	return estimate.ClientToServer(clientTime);
 }
 
 uint64_t ClientConnection::serverToClientTime(uint64_t serverTime) const {
-	return serverTime - m_TimeDiff;
+	ClockSyncEstimate estimate;
+	m_clockEstimate.Read(estimate);
+	return estimate.ServerToClient(serverTime);
 }
 
 void ClientConnection::SendCommandResponse(const char *commandResponse) {
@@ -685,6 +882,20 @@ void ClientConnection::CheckTimeout() {
 	}
 }
 
+void ClientConnection::ScheduleTimeoutCheck() {
+	m_Poller->AddTimer(GetCounterUs() + TIMEOUT_CHECK_INTERVAL, [this]() {
+		CheckTimeout();
+		ScheduleTimeoutCheck();
+	});
+}
+
+void ClientConnection::ScheduleTelemetryTick() {
+	m_Poller->AddTimer(GetCounterUs() + 1000 * 1000, [this]() {
+		m_Statistics->GetNetworkTelemetry().Tick();
+		ScheduleTelemetryTick();
+	});
+}
+
 void ClientConnection::UpdateLastSeen() {
 	m_LastSeen = GetTimestampUs();
 }
@@ -709,12 +920,56 @@ void ClientConnection::Connect(const sockaddr_in *addr) {
 	m_NewClientCallback();
 
 	m_Socket->SetClientAddr(addr);
+	m_connectedClientAddr.Write(*addr);
 	m_Connected = true;
 	videoPacketCounter = 0;
 	soundPacketCounter = 0;
-	m_fecPercentage = INITIAL_FEC_PERCENTAGE;
+	{
+		IPCCriticalSectionLock lock(m_fecPolicyCS);
+		m_fecPolicy = CreateFECPolicy(Settings::Instance().m_adaptiveFec, Settings::Instance().m_maxFecPercentage
+			, Settings::Instance().m_idrFecPercentage);
+		m_fecPercentage = m_fecPolicy->GetFecPercentage(0);
+		m_importantFecPercentage = m_fecPolicy->GetImportantFecPercentage(0);
+		m_frameLossTracker.Reset();
+		m_fecInterleaverReset = true;
+	}
 	memset(&m_reportedStatistics, 0, sizeof(m_reportedStatistics));
 	m_Statistics->ResetAll();
+	// Client may be another device.
+	m_clockSync.Reset();
+	m_clockEstimate.Write(m_clockSync.GetEstimate());
+
+	// Without adaptive foveation the controller keeps configured bitrate and strength.
+	Settings &settings = Settings::Instance();
+	FoveationController::Config foveation;
+	foveation.mode = settings.m_foveationMode;
+	foveation.renderWidth = settings.m_renderWidth;
+	foveation.renderHeight = settings.m_renderHeight;
+	foveation.leftEyeFov = settings.m_eyeFov[0];
+	foveation.strength = settings.m_foveationStrength;
+	foveation.maxStrength = settings.m_foveationStrength;
+	foveation.shape = settings.m_foveationShape;
+	foveation.verticalOffset = settings.m_foveationVerticalOffset;
+	foveation.bitrateInMBits = static_cast<int>(settings.mEncodeBitrate.toMiBits());
+	foveation.minBitrateInMBits = foveation.bitrateInMBits;
+	if (settings.m_adaptiveFoveation && settings.m_foveationMode != FOVEATION_MODE_DISABLED) {
+		foveation.maxStrength = settings.m_foveationMaxStrength;
+		foveation.minBitrateInMBits = settings.m_minEncodeBitrateInMBits;
+	}
+	m_foveationController = std::make_unique<FoveationController>(foveation);
+	// Encoder keeps its configuration if it already uses this one.
+	m_foveationDecision.Write(m_foveationController->GetDecision());
+	m_foveationSettingsRepeat = 0;
+	{
+		IPCCriticalSectionLock lock(m_settingsCS);
+		m_Settings.frameQueueSize = settings.m_frameQueueSize;
+		m_Settings.foveationMode = static_cast<uint8_t>(settings.m_foveationMode);
+		m_Settings.foveationStrength = m_foveationController->GetDecision().strength;
+		m_Settings.foveationShape = settings.m_foveationShape;
+		m_Settings.foveationVerticalOffset = settings.m_foveationVerticalOffset;
+		m_Settings.videoWidth = m_foveationController->GetDecision().width;
+		m_Settings.videoHeight = m_foveationController->GetDecision().height;
+	}
 	UpdateLastSeen();
 
 	ConnectionMessage message = {};
@@ -732,7 +987,7 @@ void ClientConnection::Connect(const sockaddr_in *addr) {
 	message.foveationShape = Settings::Instance().m_foveationShape;
 	message.foveationVerticalOffset = Settings::Instance().m_foveationVerticalOffset;
 
-	m_Socket->Send((char *)&message, sizeof(message), 0);
+	m_Socket->Send((char *)&message, sizeof(message), 0, ThrottlingBuffer::PRIORITY_CONTROL);
 }
 
 void ClientConnection::Disconnect() {
@@ -740,16 +995,30 @@ void ClientConnection::Disconnect() {
 	m_clientDeviceName = "";
 
 	m_Socket->InvalidateClient();
+	sockaddr_in invalid = {};
+	m_connectedClientAddr.Write(invalid);
+}
+
+void ClientConnection::ConfigureFecInterleaver() {
+	// Parity deferred by depth frames arrives about depth frame intervals late, which must stay within the delay budget.
+	uint64_t maxDelayUs = Settings::Instance().m_fecInterleaveMaxDelayUs;
+	int depth = Settings::Instance().m_fecInterleaveDepth;
+	if (Settings::Instance().m_refreshRate > 0) {
+		depth = static_cast<int>(std::min<uint64_t>(depth, maxDelayUs * Settings::Instance().m_refreshRate / (1000 * 1000)));
+	}
+	depth = std::min(depth, static_cast<int>(UINT8_MAX));
+	LogDriver("Configure FEC interleaver. Depth=%d MaxDelay=%llu us", depth, maxDelayUs);
+	m_fecInterleaver.Configure(depth, maxDelayUs);
 }
 
 void ClientConnection::OnFecFailure() {
 	LogDriver("Listener::OnFecFailure().");
-	if (GetTimestampUs() - m_lastFecFailure < CONTINUOUS_FEC_FAILURE) {
-		if (m_fecPercentage < MAX_FEC_PERCENTAGE) {
-			m_fecPercentage += 5;
+	{
+		IPCCriticalSectionLock lock(m_fecPolicyCS);
+		if (m_fecPolicy) {
+			m_fecPolicy->OnFecFailure(GetCounterUs());
 		}
 	}
-	m_lastFecFailure = GetTimestampUs();
 	m_PacketLossCallback();
 }
 
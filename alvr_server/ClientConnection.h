@@ -15,10 +15,22 @@
 #include "Settings.h"
 #include "Statistics.h"
 #include "MicPlayer.h"
+#include "FECPacketizer.h"
+#include "FECPolicy.h"
+#include "FrameLossTracker.h"
+#include "FECInterleaver.h"
+#include "FoveationController.h"
+#include "NalParser.h"
+#include "Seqlock.h"
+#include "ClockSync.h"
+#include "IngressThread.h"
+#include "MicPlaybackThread.h"
+#include "ipctools.h"
 
 extern "C" {
 #include "reedsolomon/rs.h"
 };
+#include "reedsolomon/rs_cache.h"
 
 class ClientConnection : public CThread {
 public:
@@ -34,17 +46,34 @@ public:
 	void SetShutdownCallback(std::function<void()> callback);
 
 	bool Startup();
+	bool StartupSocket();
 	void Run() override;
-	void FECSend(uint8_t *buf, int len, uint64_t frameIndex, uint64_t videoFrameIndex);
-	void SendVideo(uint8_t *buf, int len, uint64_t frameIndex);
-	void SendAudio(uint8_t *buf, int len, uint64_t presentationTime);
+	void FECSend(uint8_t *buf, int len, uint64_t frameIndex, uint64_t videoFrameIndex, const NalParser::FrameInfo &info
+		, int sliceIndex, int sliceCount);
+	// insertedIDR: encoder was asked for an IDR frame. Protected as one even if NAL types say otherwise.
+	void SendVideo(uint8_t *buf, int len, uint64_t frameIndex, bool insertedIDR = false);
+	// Part of a frame from SliceStreamer. Each part is sent as a video frame of its own.
+	void SendVideoSlice(uint8_t *buf, int len, uint64_t frameIndex, int sliceIndex, int sliceCount, bool insertedIDR = false);
+	// buf is one audio frame encoded with codec (ALVR_AUDIO_CODEC).
+	void SendAudio(uint8_t *buf, int len, uint64_t presentationTime, uint8_t codec = ALVR_AUDIO_CODEC_PCM);
 	void SendHapticsFeedback(uint64_t startTime, float amplitude, float duration, float frequency, uint8_t hand);
-	void ProcessRecv(char *buf, int len, sockaddr_in *addr);
+	void ProcessRecv(char *buf, int len, sockaddr_in *addr, uint64_t receivedUs);
+	// Receive thread part of ProcessRecv. Returns false to queue packet for connection thread.
+	bool ProcessIngress(const ReceivedPacket &packet);
+	void ProcessTrackingInfo(const char *buf, const sockaddr_in *addr, uint64_t receivedUs);
+	bool IsConnectedClient(const sockaddr_in *addr) const;
 	void ProcessCommand(const std::string &commandName, const std::string args);
 	void SendChangeSettings();
+	// Latest FoveationController decision, for encoder thread. Returns its sequence, which changes with it.
+	uint64_t GetFoveationDecision(FoveationController::Decision &decision) const;
+	// Encoder thread, once the encoder switched to strength and width x height. Tells the client.
+	void SendFoveationSettings(float strength, uint32_t width, uint32_t height);
 	void Stop();
 	bool HasValidTrackingInfo() const;
 	void GetTrackingInfo(TrackingInfo &info);
+	static const int TRACKING_HISTORY_SIZE = 10;
+	// Up to maxCount most recent TrackingInfo with distinct FrameIndex, newest first.
+	int GetTrackingHistory(TrackingInfo *infos, int maxCount);
 	uint64_t clientToServerTime(uint64_t clientTime) const;
 	uint64_t serverToClientTime(uint64_t serverTime) const;
 	void SendCommandResponse(const char *commandResponse);
@@ -52,10 +81,13 @@ public:
 	void SanitizeDeviceName(char deviceName[32]);
 	std::string DumpConfig();
 	void CheckTimeout();
+	void ScheduleTimeoutCheck();
+	void ScheduleTelemetryTick();
 	void UpdateLastSeen();
 	void FindClientName(const sockaddr_in *addr);
 	void Connect(const sockaddr_in *addr);
 	void Disconnect();
+	void ConfigureFecInterleaver();
 	void OnFecFailure();
 	std::shared_ptr<Statistics> GetStatistics();
 	bool IsStreaming();
@@ -67,6 +99,10 @@ private:
 	std::shared_ptr<ControlSocket> m_ControlSocket;
 	std::shared_ptr<Statistics> m_Statistics;
 	std::shared_ptr<MicPlayer> m_MicPlayer;
+	// Only with Settings::m_trackingThread.
+	std::unique_ptr<IngressThread> m_ingressThread;
+	// Fed by IngressThread, or by connection thread without it.
+	std::unique_ptr<MicPlaybackThread> m_micThread;
 
 	std::ofstream outfile;
 
@@ -74,11 +110,19 @@ private:
 	static const int PACKET_SIZE = 1400;
 	static const int64_t REQUEST_TIMEOUT = 5 * 1000 * 1000;
 	static const int64_t CONNECTION_TIMEOUT = 5 * 1000 * 1000;
+	static const uint64_t TIMEOUT_CHECK_INTERVAL = 100 * 1000;
 
 	uint32_t videoPacketCounter = 0;
+	FECPacketizer m_FECPacketizer;
+	// Encoder thread only. Reconfigured on next frame after Connect sets m_fecInterleaverReset.
+	FECInterleaver m_fecInterleaver;
+	bool m_fecInterleaverReset = false;
+	// Encoder thread only. NAL units of the frame being sent, for tagging its ALVR_FRAME_TYPE.
+	std::vector<NalUnit> m_videoNals;
 	uint32_t soundPacketCounter = 0;
 
-	time_t m_LastSeen;
+	// Updated by receive thread.
+	std::atomic<uint64_t> m_LastSeen;
 	std::function<void()> m_LauncherCallback;
 	std::function<void(std::string, std::string)> m_CommandCallback;
 	std::function<void()> m_PoseUpdatedCallback;
@@ -86,12 +130,25 @@ private:
 	std::function<void()> m_StreamStartCallback;
 	std::function<void()> m_PacketLossCallback;
 	std::function<void()> m_ShutdownCallback;
-	TrackingInfo m_TrackingInfo;
-
-	uint64_t m_TimeDiff = 0;
-	CRITICAL_SECTION m_CS;
-
+	// Written by the thread receiving TrackingInfo only (IngressThread, or connection thread without it).
+	// Read by SteamVR threads without blocking it.
+	Seqlock<TrackingInfo> m_TrackingInfo;
+	SeqlockRing<TrackingInfo, TRACKING_HISTORY_SIZE> m_TrackingHistory;
+	uint64_t m_lastHistoryFrameIndex = 0;
+	// Copy of client address for receive thread. sin_family is 0 while disconnected.
+	Seqlock<sockaddr_in> m_connectedClientAddr;
+
+	// Fed by TimeSync on connection thread. Estimate is published for clientToServerTime/serverToClientTime
+	// callers on encoder and SteamVR threads.
+	ClockSync m_clockSync;
+	Seqlock<ClockSyncEstimate> m_clockEstimate;
+
+	// Written by connection thread, and by encoder thread in SendFoveationSettings. Guarded by m_settingsCS.
 	ChangeSettings m_Settings;
+	IPCCriticalSection m_settingsCS;
+	// TimeSync replies still to be followed by ChangeSettings after a foveation change.
+	std::atomic<int> m_foveationSettingsRepeat;
+	static const int FOVEATION_SETTINGS_REPEAT = 3;
 
 	bool m_Connected;
 	bool m_Streaming;
@@ -109,11 +166,18 @@ private:
 
 	std::string m_clientDeviceName;
 	TimeSync m_reportedStatistics;
-	uint64_t m_lastFecFailure = 0;
-	static const uint64_t CONTINUOUS_FEC_FAILURE = 60 * 1000 * 1000;
-	static const int INITIAL_FEC_PERCENTAGE = 5;
-	static const int MAX_FEC_PERCENTAGE = 10;
-	int m_fecPercentage = INITIAL_FEC_PERCENTAGE;
+	// Chosen per frame on encoder thread and fed from connection thread. Guarded by m_fecPolicyCS
+	// as are m_fecInterleaverReset and m_frameLossTracker.
+	std::unique_ptr<FECPolicy> m_fecPolicy;
+	IPCCriticalSection m_fecPolicyCS;
+	FrameLossTracker m_frameLossTracker;
+	// Last used percentages for ordinary and important (IDR, parameter sets) frames, for GetStat.
+	int m_fecPercentage = StepFECPolicy::INITIAL_FEC_PERCENTAGE;
+	int m_importantFecPercentage = StepFECPolicy::INITIAL_FEC_PERCENTAGE;
+
+	// Fed by TimeSync on connection thread. Decision is published for encoder thread.
+	std::unique_ptr<FoveationController> m_foveationController;
+	Seqlock<FoveationController::Decision> m_foveationDecision;
 
 	uint64_t mVideoFrameIndex = 1;
 };
@@ -0,0 +1,151 @@
+#include <math.h>
+#include <algorithm>
+
+#include "ClockSync.h"
+
+double ClockSyncEstimate::GetOffset(uint64_t serverTime) const
+{
+	if (!valid) {
+		return 0;
+	}
+	double elapsed = (double)(int64_t)(serverTime - slewTime);
+	double current = slewOffset + skew * elapsed;
+	double target = fitOffset + skew * (double)(int64_t)(serverTime - fitTime);
+	double maxStep = maxSlew * std::max(elapsed, 0.0);
+	return current + std::min(std::max(target - current, -maxStep), maxStep);
+}
+
+double ClockSyncEstimate::GetUncertainty(uint64_t serverTime) const
+{
+	double target = fitOffset + skew * (double)(int64_t)(serverTime - fitTime);
+	return uncertainty + fabs(target - GetOffset(serverTime));
+}
+
+uint64_t ClockSyncEstimate::ClientToServer(uint64_t clientTime) const
+{
+	// Offset changes by ppm, so evaluating it at an estimate of the server time is accurate enough.
+	uint64_t approx = clientTime + (int64_t)llround(slewOffset);
+	return clientTime + (int64_t)llround(GetOffset(approx));
+}
+
+uint64_t ClockSyncEstimate::ServerToClient(uint64_t serverTime) const
+{
+	return serverTime - (int64_t)llround(GetOffset(serverTime));
+}
+
+constexpr double ClockSync::MAX_SKEW;
+constexpr double ClockSync::MAX_SLEW;
+
+ClockSync::ClockSync(int windowSize)
+	: mWindowSize(std::max(windowSize, (int)MIN_FIT_SAMPLES))
+{
+	Reset();
+}
+
+bool ClockSync::AddSample(uint64_t serverSendTime, uint64_t clientTime, uint64_t serverReceiveTime)
+{
+	if (serverReceiveTime < serverSendTime) {
+		return false;
+	}
+	Sample sample;
+	sample.rtt = serverReceiveTime - serverSendTime;
+	sample.time = serverSendTime + sample.rtt / 2;
+	sample.offset = (double)(int64_t)(sample.time - clientTime);
+
+	bool step = !mEstimate.valid || (int)mSamples.size() < MIN_FIT_SAMPLES;
+	if (mEstimate.valid) {
+		// Error of a sample is at most half of its round trip. Anything beyond that is the client
+		// clock being set, and old samples describe another clock.
+		double error = fabs(sample.offset - mEstimate.GetOffset(sample.time));
+		if (error > STEP_THRESHOLD_US + sample.rtt / 2) {
+			mSamples.clear();
+			step = true;
+		}
+	}
+
+	mSamples.push_back(sample);
+	if ((int)mSamples.size() > mWindowSize) {
+		mSamples.erase(mSamples.begin());
+	}
+
+	double applied = mEstimate.GetOffset(serverReceiveTime);
+	Fit();
+	mEstimate.slewTime = serverReceiveTime;
+	if (step) {
+		mEstimate.slewOffset = mEstimate.fitOffset + mEstimate.skew * (double)(int64_t)(serverReceiveTime - mEstimate.fitTime);
+	} else {
+		mEstimate.slewOffset = applied;
+	}
+	mEstimate.valid = true;
+	return true;
+}
+
+void ClockSync::Reset()
+{
+	mSamples.clear();
+	mSelected.clear();
+	mEstimate = {};
+	mEstimate.valid = false;
+	mEstimate.maxSlew = MAX_SLEW;
+}
+
+const ClockSyncEstimate &ClockSync::GetEstimate() const
+{
+	return mEstimate;
+}
+
+int ClockSync::GetSampleCount() const
+{
+	return static_cast<int>(mSamples.size());
+}
+
+void ClockSync::Fit()
+{
+	// Min-RTT filter
+	mSelected = mSamples;
+	int count = std::min(std::max((int)mSelected.size() / 4, (int)MIN_FIT_SAMPLES), (int)mSelected.size());
+	std::nth_element(mSelected.begin(), mSelected.begin() + (count - 1), mSelected.end()
+		, [](const Sample &a, const Sample &b) { return a.rtt < b.rtt; });
+	mSelected.resize(count);
+
+	// Least squares of offset over time, relative to the newest sample to keep precision.
+	uint64_t origin = mSamples.back().time;
+	uint64_t first = mSelected[0].time;
+	uint64_t last = mSelected[0].time;
+	uint64_t maxRtt = 0;
+	double meanX = 0;
+	double meanY = 0;
+	for (auto &s : mSelected) {
+		meanX += (double)(int64_t)(s.time - origin);
+		meanY += s.offset;
+		first = std::min(first, s.time);
+		last = std::max(last, s.time);
+		maxRtt = std::max(maxRtt, s.rtt);
+	}
+	meanX /= count;
+	meanY /= count;
+
+	double skew = 0;
+	if (last - first >= MIN_SKEW_SPAN_US) {
+		double sxx = 0;
+		double sxy = 0;
+		for (auto &s : mSelected) {
+			double dx = (double)(int64_t)(s.time - origin) - meanX;
+			sxx += dx * dx;
+			sxy += dx * (s.offset - meanY);
+		}
+		skew = std::min(std::max(sxy / sxx, -MAX_SKEW), MAX_SKEW);
+	}
+	double offset = meanY - skew * meanX;
+
+	double residual = 0;
+	for (auto &s : mSelected) {
+		double e = s.offset - (offset + skew * (double)(int64_t)(s.time - origin));
+		residual += e * e;
+	}
+
+	mEstimate.fitOffset = offset;
+	mEstimate.fitTime = origin;
+	mEstimate.skew = skew;
+	mEstimate.uncertainty = maxRtt / 2.0 + sqrt(residual / count);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Estimated offset between server and client clocks (server - client), in microseconds.
+// Trivially copyable so that it can be published to other threads through a Seqlock.
+struct ClockSyncEstimate {
+	bool valid;
+	// Linear fit of filtered samples: fitOffset at server time fitTime, changing by skew us per us.
+	double fitOffset;
+	uint64_t fitTime;
+	double skew;
+	// Offset in use at slewTime. It follows the fit with the same skew and moves towards it by at most
+	// maxSlew us per us, so converted times never jump.
+	double slewOffset;
+	uint64_t slewTime;
+	double maxSlew;
+	// Bound of fit error: half of the largest round trip among filtered samples plus RMS residual.
+	// Asymmetric path delay can not be observed, so this is the best bound available.
+	double uncertainty;
+
+	double GetOffset(uint64_t serverTime) const;
+	// uncertainty plus the part of the fit not yet slewed to.
+	double GetUncertainty(uint64_t serverTime) const;
+	uint64_t ClientToServer(uint64_t clientTime) const;
+	uint64_t ServerToClient(uint64_t serverTime) const;
+};
+
+// Clock offset and drift estimator fed by TimeSync round trips.
+//
+// Each round trip gives an offset sample which is off by half the difference of downlink and uplink
+// delay, so samples with long round trips (Wi-Fi retries, queueing) are the least trustworthy.
+// The last windowSize samples are kept, the quarter with the shortest round trips (at least
+// MIN_FIT_SAMPLES) is selected and a line is fitted to their offsets over time. The slope is the
+// clock skew, which is only estimated once selected samples span MIN_SKEW_SPAN_US.
+//
+// The applied offset slews towards the fit at MAX_SLEW. It steps only while warming up and when
+// the client clock jumps by more than STEP_THRESHOLD_US, in which case old samples are discarded.
+//
+// Not thread safe. Publish GetEstimate() to readers.
+class ClockSync {
+public:
+	ClockSync(int windowSize = DEFAULT_WINDOW_SIZE);
+
+	// serverSendTime: TimeSync::serverTime of mode 1, stamped at sendto.
+	// clientTime: TimeSync::clientTime of the mode 2 answer.
+	// serverReceiveTime: server time when mode 2 was received.
+	// Returns false if the sample was inconsistent and ignored.
+	bool AddSample(uint64_t serverSendTime, uint64_t clientTime, uint64_t serverReceiveTime);
+	void Reset();
+
+	const ClockSyncEstimate &GetEstimate() const;
+	int GetSampleCount() const;
+
+	static const int DEFAULT_WINDOW_SIZE = 64;
+	static const int MIN_FIT_SAMPLES = 4;
+	static const uint64_t MIN_SKEW_SPAN_US = 10 * 1000 * 1000;
+	// 500 ppm, far beyond any crystal.
+	static constexpr double MAX_SKEW = 500e-6;
+	// 2 ms per second.
+	static constexpr double MAX_SLEW = 2000e-6;
+	static const uint64_t STEP_THRESHOLD_US = 50 * 1000;
+private:
+	struct Sample {
+		// Server time at middle of round trip.
+		uint64_t time;
+		double offset;
+		uint64_t rtt;
+	};
+
+	int mWindowSize;
+	std::vector<Sample> mSamples;
+	std::vector<Sample> mSelected;
+	ClockSyncEstimate mEstimate;
+
+	void Fit();
+};
@@ -0,0 +1,74 @@
+#include "CpuFrame.h"
+
+CpuFrame::CpuFrame(Format format, int width, int height)
+	: mFormat(format)
+	, mWidth(width)
+	, mHeight(height)
+	, mPitch(GetRowBytes(format, width))
+{
+	mStorage.resize(GetSize());
+	mData = mStorage.data();
+}
+
+CpuFrame::CpuFrame(Format format, int width, int height, uint8_t *data, int pitch)
+	: mFormat(format)
+	, mWidth(width)
+	, mHeight(height)
+	, mPitch(pitch)
+	, mData(data)
+{
+}
+
+CpuFrame::Format CpuFrame::GetFormat() const
+{
+	return mFormat;
+}
+
+int CpuFrame::GetWidth() const
+{
+	return mWidth;
+}
+
+int CpuFrame::GetHeight() const
+{
+	return mHeight;
+}
+
+int CpuFrame::GetPlaneCount() const
+{
+	return mFormat == FORMAT_NV12 ? 2 : 1;
+}
+
+uint8_t *CpuFrame::GetPlane(int plane)
+{
+	return mData + (plane == 0 ? 0 : mPitch * mHeight);
+}
+
+const uint8_t *CpuFrame::GetPlane(int plane) const
+{
+	return mData + (plane == 0 ? 0 : mPitch * mHeight);
+}
+
+int CpuFrame::GetPitch() const
+{
+	return mPitch;
+}
+
+int CpuFrame::GetPlaneHeight(int plane) const
+{
+	return plane == 0 ? mHeight : mHeight / 2;
+}
+
+int CpuFrame::GetSize() const
+{
+	int size = 0;
+	for (int plane = 0; plane < GetPlaneCount(); plane++) {
+		size += mPitch * GetPlaneHeight(plane);
+	}
+	return size;
+}
+
+int CpuFrame::GetRowBytes(Format format, int width)
+{
+	return format == FORMAT_NV12 ? width : width * 4;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Picture in system memory, input of VideoEncoderSW. It either owns its pixels or wraps memory of
+// someone else, such as a mapped staging texture.
+//
+// FORMAT_RGBA has one plane of 4 bytes per pixel, R first. FORMAT_NV12 has a Y plane and a plane of
+// interleaved U and V of half width and height; its width and height are even.
+class CpuFrame {
+public:
+	enum Format {
+		FORMAT_RGBA,
+		FORMAT_NV12
+	};
+
+	// Allocates pixels with rows of width bytes per plane pixel, without padding.
+	CpuFrame(Format format, int width, int height);
+	// Wraps pixels which must outlive the frame. pitch: bytes between rows of each plane. NV12 planes
+	// are contiguous, UV following height rows of Y.
+	CpuFrame(Format format, int width, int height, uint8_t *data, int pitch);
+
+	Format GetFormat() const;
+	int GetWidth() const;
+	int GetHeight() const;
+	int GetPlaneCount() const;
+	uint8_t *GetPlane(int plane);
+	const uint8_t *GetPlane(int plane) const;
+	int GetPitch() const;
+	// Rows of plane.
+	int GetPlaneHeight(int plane) const;
+	// Bytes of all planes, including padding.
+	int GetSize() const;
+private:
+	Format mFormat;
+	int mWidth;
+	int mHeight;
+	int mPitch;
+	std::vector<uint8_t> mStorage;
+	uint8_t *mData;
+
+	static int GetRowBytes(Format format, int width);
+};
@@ -0,0 +1,178 @@
+#include <string.h>
+#include <algorithm>
+
+#include "FECInterleaver.h"
+#include "FECPolicy.h"
+#include "Logger.h"
+
+FECInterleaver::FECInterleaver()
+{
+}
+
+FECInterleaver::~FECInterleaver()
+{
+}
+
+void FECInterleaver::Configure(int depth, uint64_t maxDelayUs)
+{
+	mDepth = std::max(0, depth);
+	mMaxDelayUs = maxDelayUs;
+	Reset();
+}
+
+void FECInterleaver::Reset()
+{
+	ReleaseDeferred(mDeferred.begin(), mDeferred.end());
+	mFrameCount = 0;
+}
+
+int FECInterleaver::GetDepth()
+{
+	return mDepth;
+}
+
+bool FECInterleaver::Packetize(FECPacketizer &packetizer, const uint8_t *buf, int len, const VideoFrame &header, uint32_t &packetCounter
+	, std::function<PacketBuffer *()> allocate, uint64_t now)
+{
+	VideoFrame frameHeader = header;
+	frameHeader.fecInterleaveDepth = static_cast<uint8_t>(mDepth);
+
+	if (mDepth == 0) {
+		return !packetizer.Packetize(buf, len, frameHeader, packetCounter, allocate).empty();
+	}
+
+	mFrameCount++;
+
+	FECLayout layout = FECLayout::Calculate(len, header.fecPercentage);
+	// Deferred parity due with this frame is at front.
+	int due = 0;
+	while (due < static_cast<int>(mDeferred.size()) && mDeferred[due].sendFrame <= mFrameCount) {
+		due++;
+	}
+
+	mSendOrder.clear();
+	mNewDeferred.clear();
+	int allocated = 0;
+	int interleaved = 0;
+	bool failed = false;
+
+	// Copy deferred packet into send queue. Expired ones are skipped.
+	auto sendDeferred = [&]() {
+		DeferredPacket &deferred = mDeferred[interleaved];
+		interleaved++;
+		if (deferred.deadlineUs < now) {
+			return true;
+		}
+		PacketBuffer *packet = allocate();
+		if (packet == NULL) {
+			return false;
+		}
+		memcpy(packet->buf, deferred.packet->buf, deferred.packet->len);
+		packet->len = deferred.packet->len;
+		// Travels with this frame.
+		packet->frameIndex = header.trackingFrameIndex;
+		mSendOrder.push_back(packet);
+		return true;
+	};
+
+	// Packetizer allocates data packets first, then parity packets shard by shard.
+	uint32_t unusedCounter = 0;
+	auto &packets = packetizer.Packetize(buf, len, frameHeader, unusedCounter, [&]() -> PacketBuffer * {
+		int index = allocated++;
+		if (index < layout.dataPackets) {
+			// Spread due packets evenly among data packets.
+			while (interleaved < due && static_cast<int64_t>(interleaved) * layout.dataPackets < static_cast<int64_t>(index) * due) {
+				if (!sendDeferred()) {
+					failed = true;
+					return NULL;
+				}
+			}
+		}
+		else {
+			int part = (index - layout.dataPackets) / layout.shardPackets % (mDepth + 1);
+			if (part != 0) {
+				DeferredPacket deferred;
+				deferred.packet = GetFreePacket();
+				deferred.sendFrame = mFrameCount + part;
+				deferred.deadlineUs = now + mMaxDelayUs;
+				mNewDeferred.push_back(deferred);
+				return deferred.packet;
+			}
+		}
+		PacketBuffer *packet = allocate();
+		if (packet == NULL) {
+			failed = true;
+			return NULL;
+		}
+		mSendOrder.push_back(packet);
+		return packet;
+	});
+	while (!failed && !packets.empty() && interleaved < due) {
+		failed = !sendDeferred();
+	}
+
+	if (failed || packets.empty()) {
+		for (auto &deferred : mNewDeferred) {
+			mFreePackets.push_back(deferred.packet);
+		}
+		mNewDeferred.clear();
+		return false;
+	}
+
+	for (PacketBuffer *packet : mSendOrder) {
+		reinterpret_cast<VideoFrame *>(packet->buf)->packetCounter = packetCounter;
+		packetCounter++;
+	}
+
+	for (int i = 0; i < due; i++) {
+		if (mDeferred[i].deadlineUs < now) {
+			mExpired++;
+		}
+	}
+	ReleaseDeferred(mDeferred.begin(), mDeferred.begin() + due);
+	mDeferred.insert(mDeferred.end(), mNewDeferred.begin(), mNewDeferred.end());
+	std::stable_sort(mDeferred.begin(), mDeferred.end(), [](const DeferredPacket &a, const DeferredPacket &b) {
+		return a.sendFrame < b.sendFrame;
+	});
+	mNewDeferred.clear();
+
+	Log("FECInterleaver::Packetize. videoFrameIndex=%llu sent=%d interleaved=%d deferred=%d"
+		, header.videoFrameIndex, static_cast<int>(mSendOrder.size()), due, static_cast<int>(mDeferred.size()));
+	return true;
+}
+
+int FECInterleaver::GetDeferredPackets()
+{
+	return static_cast<int>(mDeferred.size());
+}
+
+uint64_t FECInterleaver::GetExpiredPackets()
+{
+	return mExpired;
+}
+
+PacketBuffer *FECInterleaver::GetFreePacket()
+{
+	if (mFreePackets.empty()) {
+		// operator new does not honor alignas before C++17.
+		mStorage.emplace_back(new char[sizeof(PacketBuffer) + CACHE_LINE_SIZE]);
+		uintptr_t p = reinterpret_cast<uintptr_t>(mStorage.back().get());
+		p = (p + CACHE_LINE_SIZE - 1) & ~static_cast<uintptr_t>(CACHE_LINE_SIZE - 1);
+		mFreePackets.push_back(reinterpret_cast<PacketBuffer *>(p));
+	}
+	PacketBuffer *packet = mFreePackets.back();
+	mFreePackets.pop_back();
+	packet->len = 0;
+	packet->frameIndex = 0;
+	packet->queuedUs = 0;
+	packet->pushId = 0;
+	return packet;
+}
+
+void FECInterleaver::ReleaseDeferred(std::deque<DeferredPacket>::iterator begin, std::deque<DeferredPacket>::iterator end)
+{
+	for (auto it = begin; it != end; ++it) {
+		mFreePackets.push_back(it->packet);
+	}
+	mDeferred.erase(begin, end);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+
+#include "packet_types.h"
+#include "PacketRing.h"
+#include "FECPacketizer.h"
+
+// Spreads parity of each video frame over following frames, so that a loss burst which hits a frame
+// does not also hit all of its parity.
+//
+// With depth D, parity shards of frame N are split into D + 1 parts by shard index (shard % (D + 1)).
+// Part 0 is sent right after the data of frame N as before. Part k is held back and sent interleaved
+// evenly among the data packets of the k-th following frame. Each part is whole shards, so it protects
+// every packet stripe of the frame. A frame with little loss is still recovered from part 0 without
+// delay. Only a frame hit by a longer burst waits for later parts.
+//
+// Deferred parity older than maxDelayUs is discarded instead of sent, as the client has given up on
+// the frame by then. packetCounter is assigned in sending order, so interleaving by itself does not
+// look like loss to the client.
+//
+// Not thread safe. Used from encoder thread only.
+class FECInterleaver
+{
+public:
+	FECInterleaver();
+	~FECInterleaver();
+
+	// depth 0 disables interleaving. Discards deferred parity.
+	void Configure(int depth, uint64_t maxDelayUs);
+	void Reset();
+	int GetDepth();
+
+	// Packetize frame with packetizer and interleave deferred parity of previous frames into it.
+	// header supplies all fields except packetCounter, fecIndex and fecInterleaveDepth.
+	// Packets are obtained from allocate in sending order. If allocate returns NULL, false is returned
+	// and deferred parity of previous frames is kept for the next frame.
+	bool Packetize(FECPacketizer &packetizer, const uint8_t *buf, int len, const VideoFrame &header, uint32_t &packetCounter
+		, std::function<PacketBuffer *()> allocate, uint64_t now);
+
+	// Number of parity packets waiting for following frames.
+	int GetDeferredPackets();
+	// Deferred parity packets discarded because of maxDelayUs.
+	uint64_t GetExpiredPackets();
+private:
+	struct DeferredPacket {
+		PacketBuffer *packet;
+		// Value of mFrameCount of the frame to be sent with.
+		uint64_t sendFrame;
+		uint64_t deadlineUs;
+	};
+
+	int mDepth = 0;
+	uint64_t mMaxDelayUs = 0;
+	uint64_t mFrameCount = 0;
+	uint64_t mExpired = 0;
+
+	// In order of sendFrame, then fecIndex.
+	std::deque<DeferredPacket> mDeferred;
+	// Parity of current frame to be deferred, until Packetize succeeds.
+	std::vector<DeferredPacket> mNewDeferred;
+	// Deferred packets are allocated from here. Grows up to the largest number deferred at a time.
+	std::vector<std::unique_ptr<char[]>> mStorage;
+	std::vector<PacketBuffer *> mFreePackets;
+	// All packets of current call in sending order.
+	std::vector<PacketBuffer *> mSendOrder;
+
+	PacketBuffer *GetFreePacket();
+	void ReleaseDeferred(std::deque<DeferredPacket>::iterator begin, std::deque<DeferredPacket>::iterator end);
+};
@@ -0,0 +1,101 @@
+#include <string.h>
+#include <algorithm>
+
+#include "FECPacketizer.h"
+#include "Logger.h"
+#include "reedsolomon/rs_cache.h"
+
+const uint8_t FECPacketizer::ZERO_PAYLOAD[ALVR_MAX_VIDEO_BUFFER_SIZE] = {};
+
+FECPacketizer::FECPacketizer()
+{
+}
+
+FECPacketizer::~FECPacketizer()
+{
+}
+
+const std::vector<PacketBuffer *> &FECPacketizer::Packetize(const uint8_t *buf, int len, const VideoFrame &header, uint32_t &packetCounter
+	, std::function<PacketBuffer *()> allocate)
+{
+	int shardPackets = CalculateFECShardPackets(len, header.fecPercentage);
+
+	int blockSize = shardPackets * ALVR_MAX_VIDEO_BUFFER_SIZE;
+
+	int dataShards = (len + blockSize - 1) / blockSize;
+	int totalParityShards = CalculateParityShards(dataShards, header.fecPercentage);
+	int totalShards = dataShards + totalParityShards;
+
+	assert(totalShards <= ALVR_FEC_SHARDS_MAX);
+
+	int dataPackets = (len + ALVR_MAX_VIDEO_BUFFER_SIZE - 1) / ALVR_MAX_VIDEO_BUFFER_SIZE;
+	int parityPackets = totalParityShards * shardPackets;
+
+	Log("FECPacketizer::Packetize. dataShards=%d totalParityShards=%d totalShards=%d blockSize=%d shardPackets=%d dataPackets=%d"
+		, dataShards, totalParityShards, totalShards, blockSize, shardPackets, dataPackets);
+
+	reed_solomon *rs = ReedSolomonCache::Instance().Get(dataShards, totalParityShards);
+
+	mPackets.clear();
+	for (int i = 0; i < dataPackets + parityPackets; i++) {
+		PacketBuffer *packet = allocate();
+		if (packet == NULL) {
+			mPackets.clear();
+			return mPackets;
+		}
+		VideoFrame *packetHeader = (VideoFrame *)packet->buf;
+		*packetHeader = header;
+		packetHeader->packetCounter = packetCounter;
+		packetCounter++;
+		packet->frameIndex = header.trackingFrameIndex;
+
+		if (i < dataPackets) {
+			int offset = i * ALVR_MAX_VIDEO_BUFFER_SIZE;
+			int copyLength = std::min(ALVR_MAX_VIDEO_BUFFER_SIZE, len - offset);
+			packetHeader->fecIndex = i;
+			memcpy(GetPayload(packet), buf + offset, copyLength);
+			if (copyLength < ALVR_MAX_VIDEO_BUFFER_SIZE) {
+				// Zero padding is used as shard input but not sent.
+				memset(GetPayload(packet) + copyLength, 0, ALVR_MAX_VIDEO_BUFFER_SIZE - copyLength);
+			}
+			packet->len = sizeof(VideoFrame) + copyLength;
+		}
+		else {
+			packetHeader->fecIndex = dataShards * shardPackets + (i - dataPackets);
+			packet->len = sizeof(VideoFrame) + ALVR_MAX_VIDEO_BUFFER_SIZE;
+		}
+		mPackets.push_back(packet);
+	}
+
+	// Reed-Solomon works on each byte column independently, so a shard of shardPackets packets
+	// is encoded as shardPackets independent stripes of single packet. Output is identical to
+	// encoding contiguous blocks of blockSize bytes.
+	uint8_t *shards[ALVR_FEC_SHARDS_MAX];
+	for (int j = 0; j < shardPackets; j++) {
+		for (int i = 0; i < dataShards; i++) {
+			int index = i * shardPackets + j;
+			if (index < dataPackets - 1 || (index == dataPackets - 1 && len % ALVR_MAX_VIDEO_BUFFER_SIZE == 0)) {
+				shards[i] = const_cast<uint8_t *>(buf) + index * ALVR_MAX_VIDEO_BUFFER_SIZE;
+			}
+			else if (index == dataPackets - 1) {
+				// Last partial packet. Use zero padded copy in packet buffer.
+				shards[i] = GetPayload(mPackets[index]);
+			}
+			else {
+				shards[i] = const_cast<uint8_t *>(ZERO_PAYLOAD);
+			}
+		}
+		for (int i = 0; i < totalParityShards; i++) {
+			shards[dataShards + i] = GetPayload(mPackets[dataPackets + i * shardPackets + j]);
+		}
+		int ret = reed_solomon_encode(rs, shards, totalShards, ALVR_MAX_VIDEO_BUFFER_SIZE);
+		assert(ret == 0);
+	}
+
+	return mPackets;
+}
+
+uint8_t *FECPacketizer::GetPayload(PacketBuffer *packet)
+{
+	return (uint8_t *)packet->buf + sizeof(VideoFrame);
+}
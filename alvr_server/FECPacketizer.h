@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <functional>
+
+#include "packet_types.h"
+#include "PacketRing.h"
+
+// Splits encoded video frame into VideoFrame packets with Reed-Solomon parity.
+// Payload of data packets is copied from encoder bitstream exactly once and parity is encoded directly into packet buffers.
+// Data shards are referenced in place, so no intermediate shard buffers are allocated.
+class FECPacketizer
+{
+public:
+	FECPacketizer();
+	~FECPacketizer();
+
+	// header supplies all fields except packetCounter and fecIndex.
+	// packetCounter is incremented for each generated packet.
+	// Returned packets are in sending order. The vector is valid until next call.
+	// If allocate returns NULL, packetizing is aborted and empty vector is returned.
+	const std::vector<PacketBuffer *> &Packetize(const uint8_t *buf, int len, const VideoFrame &header, uint32_t &packetCounter
+		, std::function<PacketBuffer *()> allocate);
+private:
+	std::vector<PacketBuffer *> mPackets;
+
+	// Input for padding shards which are entirely beyond end of frame.
+	static const uint8_t ZERO_PAYLOAD[ALVR_MAX_VIDEO_BUFFER_SIZE];
+
+	static uint8_t *GetPayload(PacketBuffer *packet);
+};
@@ -0,0 +1,234 @@
+#include <math.h>
+#include <limits.h>
+#include <algorithm>
+#include <vector>
+
+#include "FECPolicy.h"
+
+FECLayout FECLayout::Calculate(int len, int fecPercentage)
+{
+	FECLayout layout = {};
+	if (len <= 0) {
+		return layout;
+	}
+	layout.shardPackets = CalculateFECShardPackets(len, fecPercentage);
+	int blockSize = layout.shardPackets * ALVR_MAX_VIDEO_BUFFER_SIZE;
+	layout.dataShards = (len + blockSize - 1) / blockSize;
+	layout.parityShards = CalculateParityShards(layout.dataShards, fecPercentage);
+	layout.dataPackets = (len + ALVR_MAX_VIDEO_BUFFER_SIZE - 1) / ALVR_MAX_VIDEO_BUFFER_SIZE;
+	layout.parityPackets = layout.parityShards * layout.shardPackets;
+	return layout;
+}
+
+FixedFECPolicy::FixedFECPolicy(int fecPercentage)
+	: mFecPercentage(fecPercentage)
+{
+}
+
+int FixedFECPolicy::GetFecPercentage(int)
+{
+	return mFecPercentage;
+}
+
+const char *FixedFECPolicy::GetName()
+{
+	return "Fixed";
+}
+
+StepFECPolicy::StepFECPolicy(int maxPercentage)
+	: mMaxPercentage(maxPercentage)
+{
+}
+
+void StepFECPolicy::OnFecFailure(uint64_t now)
+{
+	if (mLastFailure != 0 && now - mLastFailure < CONTINUOUS_FEC_FAILURE) {
+		if (mFecPercentage < mMaxPercentage) {
+			mFecPercentage += 5;
+		}
+	}
+	mLastFailure = now;
+}
+
+int StepFECPolicy::GetFecPercentage(int)
+{
+	return mFecPercentage;
+}
+
+const int StepFECPolicy::INITIAL_FEC_PERCENTAGE;
+const int StepFECPolicy::MAX_FEC_PERCENTAGE;
+const uint64_t StepFECPolicy::CONTINUOUS_FEC_FAILURE;
+
+const char *StepFECPolicy::GetName()
+{
+	return "Step";
+}
+
+AdaptiveFECPolicy::AdaptiveFECPolicy(int minPercentage, int maxPercentage)
+	: mMinPercentage(std::max(static_cast<int>(MIN_FEC_PERCENTAGE), minPercentage))
+	, mMaxPercentage(std::min(static_cast<int>(MAX_FEC_PERCENTAGE), std::max(mMinPercentage, maxPercentage)))
+{
+}
+
+void AdaptiveFECPolicy::OnReport(uint64_t now, uint64_t packetsSent, uint64_t packetsLost)
+{
+	if (packetsSent != 0) {
+		double rate = std::min(1.0, static_cast<double>(packetsLost) / packetsSent);
+		if (rate >= mLossRate) {
+			mLossRate = rate;
+			mLastIncrease = now;
+		}
+		else if (now - mLastIncrease >= HOLD_US) {
+			mLossRate += (rate - mLossRate) * DECAY;
+		}
+	}
+	UpdateBurstLength(now);
+	DecayMargin(now);
+}
+
+void AdaptiveFECPolicy::OnLossRun(uint64_t now, int packets)
+{
+	// A single lost packet is random loss, which mLossRate accounts for.
+	if (packets >= 2) {
+		mRuns.push_back({ now, packets });
+	}
+	UpdateBurstLength(now);
+}
+
+void AdaptiveFECPolicy::OnFecFailure(uint64_t now)
+{
+	// An isolated failure is the residual loss the layout is sized for. Only repeated ones add margin.
+	if (mLastFailure != 0 && now - mLastFailure < HOLD_US) {
+		mMargin = std::min(mMargin + 1, static_cast<int>(MAX_MARGIN));
+		mLastMarginChange = now;
+	}
+	mLastFailure = now;
+}
+
+int AdaptiveFECPolicy::GetFecPercentage(int frameBytes)
+{
+	if (frameBytes <= 0) {
+		// No frame to size parity for yet, e.g. on connect.
+		return mMinPercentage;
+	}
+	// Shard layouts are coarse: many percentages give the same parity, and a higher one may give less.
+	// Choose by parity packets actually sent, lowest percentage among equal ones.
+	int best = mMaxPercentage;
+	int bestParityPackets = INT_MAX;
+	for (int percentage = mMinPercentage; percentage <= mMaxPercentage; percentage++) {
+		FECLayout layout = FECLayout::Calculate(frameBytes, percentage);
+		// Packets sent in each stripe. Each stripe is recovered independently with parityShards symbols.
+		double stripePackets = static_cast<double>(layout.dataPackets + layout.parityPackets) / layout.shardPackets;
+		double mean = stripePackets * mLossRate;
+		int random = static_cast<int>(ceil(mean + LOSS_SIGMA * sqrt(mean)));
+		// Consecutive packets belong to consecutive stripes, so a burst hits each stripe ceil(burst / shardPackets) times.
+		int burst = (mBurstLength + layout.shardPackets - 1) / layout.shardPackets;
+		if (layout.parityShards >= std::max(random, burst) + mMargin && layout.parityPackets < bestParityPackets) {
+			best = percentage;
+			bestParityPackets = layout.parityPackets;
+		}
+	}
+	return best;
+}
+
+const int AdaptiveFECPolicy::MIN_FEC_PERCENTAGE;
+const int AdaptiveFECPolicy::MAX_FEC_PERCENTAGE;
+constexpr double AdaptiveFECPolicy::DECAY;
+const uint64_t AdaptiveFECPolicy::HOLD_US;
+const uint64_t AdaptiveFECPolicy::BURST_WINDOW_US;
+const int AdaptiveFECPolicy::MAX_MARGIN;
+constexpr double AdaptiveFECPolicy::LOSS_SIGMA;
+
+const char *AdaptiveFECPolicy::GetName()
+{
+	return "Adaptive";
+}
+
+double AdaptiveFECPolicy::GetLossRate()
+{
+	return mLossRate;
+}
+
+int AdaptiveFECPolicy::GetBurstLength()
+{
+	return mBurstLength;
+}
+
+void AdaptiveFECPolicy::UpdateBurstLength(uint64_t now)
+{
+	while (!mRuns.empty() && now - mRuns.front().time > BURST_WINDOW_US) {
+		mRuns.pop_front();
+	}
+	if (mRuns.empty()) {
+		mBurstLength = 0;
+		return;
+	}
+	std::vector<int> lengths;
+	for (auto &run : mRuns) {
+		lengths.push_back(run.packets);
+	}
+	size_t index = lengths.size() * 95 / 100;
+	std::nth_element(lengths.begin(), lengths.begin() + index, lengths.end());
+	mBurstLength = lengths[index];
+}
+
+void AdaptiveFECPolicy::DecayMargin(uint64_t now)
+{
+	if (mMargin > 0 && now - mLastMarginChange >= HOLD_US) {
+		mMargin--;
+		mLastMarginChange = now;
+	}
+}
+
+UnequalFECPolicy::UnequalFECPolicy(std::unique_ptr<FECPolicy> policy, int importantPercentage)
+	: mPolicy(std::move(policy))
+	, mImportantPercentage(std::min(importantPercentage, static_cast<int>(AdaptiveFECPolicy::MAX_FEC_PERCENTAGE)))
+	, mName(std::string(mPolicy->GetName()) + "+UEP")
+{
+}
+
+void UnequalFECPolicy::OnReport(uint64_t now, uint64_t packetsSent, uint64_t packetsLost)
+{
+	mPolicy->OnReport(now, packetsSent, packetsLost);
+}
+
+void UnequalFECPolicy::OnLossRun(uint64_t now, int packets)
+{
+	mPolicy->OnLossRun(now, packets);
+}
+
+void UnequalFECPolicy::OnFecFailure(uint64_t now)
+{
+	mPolicy->OnFecFailure(now);
+}
+
+int UnequalFECPolicy::GetFecPercentage(int frameBytes)
+{
+	return mPolicy->GetFecPercentage(frameBytes);
+}
+
+int UnequalFECPolicy::GetImportantFecPercentage(int frameBytes)
+{
+	return std::max(mPolicy->GetImportantFecPercentage(frameBytes), mImportantPercentage);
+}
+
+const char *UnequalFECPolicy::GetName()
+{
+	return mName.c_str();
+}
+
+std::unique_ptr<FECPolicy> CreateFECPolicy(bool adaptive, int maxPercentage, int importantPercentage)
+{
+	std::unique_ptr<FECPolicy> policy;
+	if (adaptive) {
+		policy.reset(new AdaptiveFECPolicy(AdaptiveFECPolicy::MIN_FEC_PERCENTAGE, maxPercentage));
+	}
+	else {
+		// maxPercentage is for the adaptive policy. Step policy keeps its own cap.
+		policy.reset(new StepFECPolicy());
+	}
+	if (importantPercentage > 0) {
+		policy.reset(new UnequalFECPolicy(std::move(policy), importantPercentage));
+	}
+	return policy;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "packet_types.h"
+
+// Shard layout of a video frame, as produced by FECPacketizer for given frame size and fecPercentage.
+struct FECLayout {
+	int shardPackets;
+	int dataShards;
+	int parityShards;
+	int dataPackets;
+	int parityPackets;
+
+	// All zero for len 0 or less.
+	static FECLayout Calculate(int len, int fecPercentage);
+};
+
+// Chooses VideoFrame::fecPercentage for each video frame from loss feedback of the client.
+// Time arguments are in microseconds on any monotonic clock.
+// Not thread safe. Caller serializes feedback (connection thread) and GetFecPercentage (encoder thread).
+class FECPolicy {
+public:
+	virtual ~FECPolicy() {}
+
+	// TimeSync mode 0 report at time now (first argument): packets sent by server and packets lost on
+	// client during last second.
+	virtual void OnReport(uint64_t, uint64_t, uint64_t) {}
+	// PacketErrorReport range of consecutive lost packets at time now: number of packets.
+	virtual void OnLossRun(uint64_t, int) {}
+	// Frame was not recoverable by FEC at time now.
+	virtual void OnFecFailure(uint64_t) {}
+
+	virtual int GetFecPercentage(int frameBytes) = 0;
+	// Frame the stream can not continue without: IDR frame or parameter sets. Losing one costs another
+	// IDR request round trip and a visible freeze. By default it is protected like any other frame.
+	virtual int GetImportantFecPercentage(int frameBytes) { return GetFecPercentage(frameBytes); }
+	virtual const char *GetName() = 0;
+};
+
+class FixedFECPolicy : public FECPolicy {
+public:
+	FixedFECPolicy(int fecPercentage);
+
+	int GetFecPercentage(int frameBytes);
+	const char *GetName();
+private:
+	int mFecPercentage;
+};
+
+// Previous behaviour. Starts at 5% and adds 5% when FEC failures come within 60 s of each other.
+// Never lowers again.
+class StepFECPolicy : public FECPolicy {
+public:
+	StepFECPolicy(int maxPercentage = MAX_FEC_PERCENTAGE);
+
+	void OnFecFailure(uint64_t now);
+	int GetFecPercentage(int frameBytes);
+	const char *GetName();
+
+	static const int INITIAL_FEC_PERCENTAGE = 5;
+	static const int MAX_FEC_PERCENTAGE = 10;
+private:
+	int mMaxPercentage;
+	int mFecPercentage = INITIAL_FEC_PERCENTAGE;
+	uint64_t mLastFailure = 0;
+	static const uint64_t CONTINUOUS_FEC_FAILURE = 60 * 1000 * 1000;
+};
+
+// Sizes parity per frame so that each packet stripe can absorb the expected random loss
+// (Poisson tail, about 99.9%) and the 95th percentile loss burst of the recent past.
+//
+// Loss rate rises immediately with reports and decays slowly only after HOLD_US without increase.
+// Loss runs of single packets count as random loss, not as bursts.
+// Each FEC failure within HOLD_US of the previous one adds one more parity shard of margin, which
+// decays one per HOLD_US.
+// Chosen percentage is the one in [minPercentage, maxPercentage] meeting the requirement with the
+// fewest parity packets, or minPercentage for frameBytes 0 or less.
+class AdaptiveFECPolicy : public FECPolicy {
+public:
+	AdaptiveFECPolicy(int minPercentage, int maxPercentage);
+
+	void OnReport(uint64_t now, uint64_t packetsSent, uint64_t packetsLost);
+	void OnLossRun(uint64_t now, int packets);
+	void OnFecFailure(uint64_t now);
+	int GetFecPercentage(int frameBytes);
+	const char *GetName();
+
+	double GetLossRate();
+	int GetBurstLength();
+
+	static const int MIN_FEC_PERCENTAGE = 1;
+	// Highest percentage for which CalculateFECShardPackets stays within ALVR_FEC_SHARDS_MAX.
+	static const int MAX_FEC_PERCENTAGE = 100;
+private:
+	int mMinPercentage;
+	int mMaxPercentage;
+
+	double mLossRate = 0;
+	uint64_t mLastIncrease = 0;
+	int mMargin = 0;
+	uint64_t mLastMarginChange = 0;
+	uint64_t mLastFailure = 0;
+
+	struct LossRun {
+		uint64_t time;
+		int packets;
+	};
+	std::deque<LossRun> mRuns;
+	int mBurstLength = 0;
+
+	// Weight of new report when loss rate decays.
+	static constexpr double DECAY = 0.1;
+	static const uint64_t HOLD_US = 10 * 1000 * 1000;
+	static const uint64_t BURST_WINDOW_US = 20 * 1000 * 1000;
+	static const int MAX_MARGIN = 2;
+	// Standard deviations above mean lost packets per stripe.
+	static constexpr double LOSS_SIGMA = 3.0;
+
+	void UpdateBurstLength(uint64_t now);
+	void DecayMargin(uint64_t now);
+};
+
+// Unequal error protection. Ordinary frames are protected by policy, important frames get at least
+// importantPercentage. IDR frames are several times larger than P frames but rare, so a high
+// percentage for them costs little of the average overhead on a clean link. On a lossy link every
+// lost P frame is followed by an IDR frame: UEP saves IDR retries, but the same overhead spent on
+// all frames loses fewer frames in total (fec_policy_test). Feedback is forwarded to policy.
+class UnequalFECPolicy : public FECPolicy {
+public:
+	UnequalFECPolicy(std::unique_ptr<FECPolicy> policy, int importantPercentage);
+
+	void OnReport(uint64_t now, uint64_t packetsSent, uint64_t packetsLost);
+	void OnLossRun(uint64_t now, int packets);
+	void OnFecFailure(uint64_t now);
+	int GetFecPercentage(int frameBytes);
+	int GetImportantFecPercentage(int frameBytes);
+	const char *GetName();
+private:
+	std::unique_ptr<FECPolicy> mPolicy;
+	int mImportantPercentage;
+	std::string mName;
+};
+
+// maxPercentage caps the adaptive policy only. importantPercentage 0 protects important frames like the others.
+std::unique_ptr<FECPolicy> CreateFECPolicy(bool adaptive, int maxPercentage, int importantPercentage = 0);
@@ -1,17 +1,12 @@
 #pragma once
 
 #include "d3d-render-utils/RenderPipeline.h"
-
-enum FOVEATION_MODE {
-	FOVEATION_MODE_DISABLED = 0,
-	FOVEATION_MODE_SLICES = 1,
-	FOVEATION_MODE_WARP = 2,
-};
+#include "FoveationVars.h"
 
 class FFR
 {
 public:
-	FFR(ID3D11Device* device);
+	FFR(ID3D11Device* device, float strength);
 	void Initialize(ID3D11Texture2D* compositionTexture);
 	void Render();
 	void GetOptimizedResolution(uint32_t* width, uint32_t* height);
@@ -19,6 +14,7 @@ public:
 
 private:
 	Microsoft::WRL::ComPtr<ID3D11Device> mDevice;
+	float mStrength;
 	Microsoft::WRL::ComPtr<ID3D11Texture2D> mOptimizedTexture;
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> mQuadVertexShader;
 
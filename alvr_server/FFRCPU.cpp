@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "FFRCPU.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FFR_CPU_X86
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// Linear values are encoded back to sRGB through a table of this many steps, fine enough to give
+	// back the same byte for a texel which is only copied.
+	const int LINEAR_STEPS = 16383;
+
+	struct SRGBTables {
+		float toLinear[256];
+		uint8_t toSRGB[LINEAR_STEPS + 1];
+
+		SRGBTables() {
+			for (int i = 0; i < 256; i++) {
+				float c = i / 255.f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i <= LINEAR_STEPS; i++) {
+				float l = (float)i / LINEAR_STEPS;
+				float c = l <= 0.0031308f ? 12.92f * l : 1.055f * powf(l, 1.f / 2.4f) - 0.055f;
+				toSRGB[i] = (uint8_t)std::min(std::max((int)(c * 255.f + 0.5f), 0), 255);
+			}
+		}
+	};
+
+	const SRGBTables &GetSRGBTables() {
+		static SRGBTables tables;
+		return tables;
+	}
+
+	float Saturate(float a) {
+		return std::min(std::max(a, 0.f), 1.f);
+	}
+
+	// Functions of FoveatedRendering.hlsli.
+	void TextureToEyeUV(float u, float v, bool isRightEye, float &eyeU, float &eyeV) {
+		eyeU = (u + float(isRightEye) * (1.f - 2.f * u)) * 2.f;
+		eyeV = v;
+	}
+
+	void EyeToTextureUV(float eyeU, float eyeV, bool isRightEye, float &u, float &v) {
+		float x = Saturate(eyeU);
+		u = x / 2.f + float(isRightEye) * (1.f - x);
+		v = Saturate(eyeV);
+	}
+
+	// CompressSlicesPixelShader.hlsl. Terms of foveationRescale which are not float2 add to both axes.
+	void CompressSlicesUV(const FoveationVars &vars, float u, float v, float &sourceU, float &sourceV) {
+		float targetX = (float)vars.targetEyeWidth;
+		float targetY = (float)vars.targetEyeHeight;
+		float paddingX = 1.f / targetX;
+		float paddingY = 1.f / targetY;
+
+		bool isRightEye = u > 0.5f;
+		float eyeU, eyeV;
+		TextureToEyeUV(u, v, isRightEye, eyeU, eyeV);
+
+		float alignedX = eyeU * ((float)vars.optimizedEyeWidth / targetX);
+		float alignedY = eyeV * ((float)vars.optimizedEyeHeight / targetY);
+		float edgeX = vars.foveationScaleX + 4.f * paddingX;
+		float edgeY = vars.foveationScaleY + 4.f * paddingY;
+
+		float overEdgeX = alignedX > edgeX ? 1.f : 0.f;
+		float overEdgeY = alignedY > edgeY ? 1.f : 0.f;
+		float overHalfEdgeX = alignedX > edgeX / 2.f ? 1.f : 0.f;
+		float overHalfEdgeY = alignedY > edgeY / 2.f ? 1.f : 0.f;
+
+		float sourceScale = (overEdgeX + 1.f) * (overEdgeY + 1.f);
+
+		float compressedOffsetX = 1.f / 2.f * overEdgeX * (1.f - overHalfEdgeY);
+		float compressedOffsetY = 1.f / 2.f * overEdgeY * (1.f - overHalfEdgeX);
+
+		float rescale = overEdgeX * overHalfEdgeY + overEdgeY * overHalfEdgeX + overEdgeX * overEdgeY;
+		float foveationRescaleX = 1.f / 2.f + 3.f * compressedOffsetX + rescale;
+		float foveationRescaleY = 1.f / 2.f + 3.f * compressedOffsetY + rescale;
+
+		float paddingCountX = 2.f + overEdgeX * 3.f + overEdgeY * (-1.f + 2.f * overHalfEdgeX - overEdgeX);
+		float paddingCountY = 2.f + overEdgeX * (-1.f + 2.f * overHalfEdgeY - overEdgeY) + overEdgeY * 3.f;
+
+		float compressedX = (alignedX - paddingCountX * paddingX) * sourceScale +
+			vars.focusPositionX - foveationRescaleX * vars.foveationScaleX - compressedOffsetX;
+		float compressedY = (alignedY - paddingCountY * paddingY) * sourceScale +
+			vars.focusPositionY - foveationRescaleY * vars.foveationScaleY - compressedOffsetY;
+
+		EyeToTextureUV(fmodf(compressedX + 1.f, 1.f), fmodf(compressedY + 1.f, 1.f), isRightEye, sourceU, sourceV);
+	}
+
+	// VertBlurDistortionPixelShader.hlsl, with the arctangent Distort.
+	void WarpUV(const FoveationVars &vars, float u, float v, float &sourceU, float &sourceV) {
+		bool isRightEye = u > 0.5f;
+		float eyeU, eyeV;
+		TextureToEyeUV(u, v, isRightEye, eyeU, eyeV);
+
+		float x = eyeU * vars.distortedWidth + vars.boundStartX;
+		float y = eyeV * vars.distortedHeight + vars.boundStartY;
+		float radius = sqrtf(x * x + y * y);
+		// tan(r) / r is 1 at the focus, where the shader divides by zero.
+		if (radius > 0) {
+			float distortion = tanf(radius);
+			x = distortion * x / radius;
+			y = distortion * y / radius;
+		}
+
+		EyeToTextureUV(x / vars.foveationScaleX + vars.focusPositionX, y / vars.foveationScaleY + vars.focusPositionY
+			, isRightEye, sourceU, sourceV);
+	}
+
+	// First texel and weight of the next one in 1/256 along one axis, as D3D11 bilinear filtering
+	// with clamp addressing.
+	void Quantize(float coord, int size, int &texel, int &weight) {
+		float t = coord * size - 0.5f;
+		texel = (int)floorf(t);
+		weight = (int)((t - texel) * 256.f + 0.5f);
+		if (weight == 256) {
+			texel++;
+			weight = 0;
+		}
+		if (texel < 0) {
+			texel = 0;
+			weight = 0;
+		}
+		if (texel >= size - 1) {
+			texel = size - 1;
+			weight = 0;
+		}
+	}
+}
+
+FFRCPU::FFRCPU(FOVEATION_MODE mode, const FoveationVars &vars, int threadCount)
+	: mMode(mode)
+	, mVars(vars)
+	, mWorkers(threadCount)
+	, mWidth(vars.optimizedEyeWidth * 2)
+	, mHeight(vars.optimizedEyeHeight)
+	, mTaps(mWidth * mHeight)
+{
+	mWorkers.Run(mHeight, [this](int band, int bandCount) {
+		BuildTaps(band, bandCount);
+	});
+}
+
+void FFRCPU::Render(const CpuFrame &src, CpuFrame &dst)
+{
+#ifdef FFR_CPU_X86
+	RenderRowFunc renderRow = RenderRowSSE2;
+#else
+	RenderRowFunc renderRow = RenderRowScalar;
+#endif
+	mWorkers.Run(mHeight, [&](int band, int bandCount) {
+		int end = mHeight * (band + 1) / bandCount;
+		for (int y = mHeight * band / bandCount; y < end; y++) {
+			uint8_t *row = dst.GetPlane(0) + dst.GetPitch() * y;
+			renderRow(src.GetPlane(0), src.GetPitch(), GetTaps(y), row, mWidth);
+			if (mMode == FOVEATION_MODE_WARP) {
+				// The warp shader outputs opaque pixels.
+				for (int x = 0; x < mWidth; x++) {
+					row[x * 4 + 3] = 255;
+				}
+			}
+		}
+	});
+}
+
+void FFRCPU::GetOptimizedResolution(uint32_t *width, uint32_t *height) const
+{
+	*width = mWidth;
+	*height = mHeight;
+}
+
+int FFRCPU::GetThreadCount() const
+{
+	return mWorkers.GetThreadCount();
+}
+
+const FFRCPU::Tap *FFRCPU::GetTaps(int y) const
+{
+	return &mTaps[mWidth * y];
+}
+
+void FFRCPU::RenderRowScalar(const uint8_t *src, int srcPitch, const Tap *taps, uint8_t *dst, int width)
+{
+	const SRGBTables &tables = GetSRGBTables();
+	for (int i = 0; i < width; i++, dst += 4) {
+		const Tap &tap = taps[i];
+		const uint8_t *p00 = src + tap.y * srcPitch + tap.x * 4;
+		if (tap.fx == 0 && tap.fy == 0) {
+			memcpy(dst, p00, 4);
+			continue;
+		}
+		const uint8_t *p01 = p00 + 4;
+		const uint8_t *p10 = p00 + srcPitch;
+		const uint8_t *p11 = p10 + 4;
+		float wx = tap.fx * (1.f / 256);
+		float wy = tap.fy * (1.f / 256);
+		for (int c = 0; c < 4; c++) {
+			// Alpha is not sRGB.
+			const float *toLinear = c < 3 ? tables.toLinear : nullptr;
+			float a = toLinear ? toLinear[p00[c]] : (float)p00[c];
+			float b = toLinear ? toLinear[p01[c]] : (float)p01[c];
+			float d = toLinear ? toLinear[p10[c]] : (float)p10[c];
+			float e = toLinear ? toLinear[p11[c]] : (float)p11[c];
+			float top = a + (b - a) * wx;
+			float bottom = d + (e - d) * wx;
+			float value = top + (bottom - top) * wy;
+			int index = (int)(value * (toLinear ? (float)LINEAR_STEPS : 1.f) + 0.5f);
+			dst[c] = toLinear ? tables.toSRGB[index] : (uint8_t)index;
+		}
+	}
+}
+
+#ifdef FFR_CPU_X86
+void FFRCPU::RenderRowSSE2(const uint8_t *src, int srcPitch, const Tap *taps, uint8_t *dst, int width)
+{
+	const SRGBTables &tables = GetSRGBTables();
+	const __m128 scale = _mm_setr_ps((float)LINEAR_STEPS, (float)LINEAR_STEPS, (float)LINEAR_STEPS, 1.f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	auto load = [&](const uint8_t *p) {
+		return _mm_setr_ps(tables.toLinear[p[0]], tables.toLinear[p[1]], tables.toLinear[p[2]], (float)p[3]);
+	};
+	for (int i = 0; i < width; i++, dst += 4) {
+		const Tap &tap = taps[i];
+		const uint8_t *p00 = src + tap.y * srcPitch + tap.x * 4;
+		if (tap.fx == 0 && tap.fy == 0) {
+			memcpy(dst, p00, 4);
+			continue;
+		}
+		const uint8_t *p10 = p00 + srcPitch;
+		__m128 wx = _mm_set1_ps(tap.fx * (1.f / 256));
+		__m128 wy = _mm_set1_ps(tap.fy * (1.f / 256));
+		__m128 a = load(p00);
+		__m128 d = load(p10);
+		__m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(load(p00 + 4), a), wx));
+		__m128 bottom = _mm_add_ps(d, _mm_mul_ps(_mm_sub_ps(load(p10 + 4), d), wx));
+		__m128 value = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), wy));
+
+		int32_t index[4];
+		_mm_storeu_si128((__m128i *)index, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, scale), half)));
+		dst[0] = tables.toSRGB[index[0]];
+		dst[1] = tables.toSRGB[index[1]];
+		dst[2] = tables.toSRGB[index[2]];
+		dst[3] = (uint8_t)index[3];
+	}
+}
+#else
+void FFRCPU::RenderRowSSE2(const uint8_t *src, int srcPitch, const Tap *taps, uint8_t *dst, int width)
+{
+	RenderRowScalar(src, srcPitch, taps, dst, width);
+}
+#endif
+
+void FFRCPU::BuildTaps(int band, int bandCount)
+{
+	int sourceWidth = mVars.targetEyeWidth * 2;
+	int sourceHeight = mVars.targetEyeHeight;
+	int end = mHeight * (band + 1) / bandCount;
+	for (int y = mHeight * band / bandCount; y < end; y++) {
+		Tap *taps = &mTaps[mWidth * y];
+		// Pixel centers, as interpolated from the quad of QuadVertexShader.
+		float v = (y + 0.5f) / mHeight;
+		for (int x = 0; x < mWidth; x++) {
+			float u = (x + 0.5f) / mWidth;
+			float sourceU, sourceV;
+			if (mMode == FOVEATION_MODE_SLICES) {
+				CompressSlicesUV(mVars, u, v, sourceU, sourceV);
+			}
+			else {
+				WarpUV(mVars, u, v, sourceU, sourceV);
+			}
+
+			int tx, ty, fx, fy;
+			Quantize(sourceU, sourceWidth, tx, fx);
+			Quantize(sourceV, sourceHeight, ty, fy);
+			if (fx != 0 || fy != 0) {
+				// Filtered pixels read the next column and row, which must exist. A whole weight of
+				// the texel before gives the same result.
+				if (tx == sourceWidth - 1) {
+					tx--;
+					fx = 256;
+				}
+				if (ty == sourceHeight - 1) {
+					ty--;
+					fy = 256;
+				}
+			}
+			taps[x] = { (uint16_t)tx, (uint16_t)ty, (uint16_t)fx, (uint16_t)fy };
+		}
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "CpuFrame.h"
+#include "BandWorkers.h"
+#include "FoveationVars.h"
+
+// CPU implementation of FFR: renders the optimized resolution frame of FOVEATION_MODE_SLICES
+// (CompressSlicesPixelShader.hlsl) or FOVEATION_MODE_WARP (VertBlurDistortionPixelShader.hlsl) from
+// the composited frame, for the software encoder path and for tests without D3D11.
+//
+// Sampling follows the pipelines of FFR: sRGB textures, so texels are decoded to linear before
+// bilinear filtering and the result is encoded back, 8 bits of subtexel precision and clamp
+// addressing. The source position of each output pixel only depends on FoveationVars, so it is
+// computed once by the constructor and Render only filters. Pixels which fall on a texel center, as
+// most of the center slice does, are copied.
+//
+// Rows are filtered with SSE2 on x86, each pixel as one vector of RGBA, and split into bands between
+// the threads of BandWorkers.
+class FFRCPU {
+public:
+	// mode: FOVEATION_MODE_SLICES or FOVEATION_MODE_WARP. vars: CalculateFoveationVars for mode.
+	// threadCount: as BandWorkers.
+	FFRCPU(FOVEATION_MODE mode, const FoveationVars &vars, int threadCount = 0);
+
+	// src: FORMAT_RGBA of targetEyeWidth * 2 x targetEyeHeight. dst: FORMAT_RGBA of
+	// optimizedEyeWidth * 2 x optimizedEyeHeight.
+	void Render(const CpuFrame &src, CpuFrame &dst);
+
+	void GetOptimizedResolution(uint32_t *width, uint32_t *height) const;
+	int GetThreadCount() const;
+
+	// Output pixel: bilinear filter of texels (x, y) to (x + 1, y + 1), fx and fy being the weights of
+	// x + 1 and y + 1 in 1/256. Both weights 0 is a copy of (x, y), which is the only case which may
+	// be on the last column or row.
+	struct Tap {
+		uint16_t x;
+		uint16_t y;
+		uint16_t fx;
+		uint16_t fy;
+	};
+
+	// Filters one output row, for tests and benchmarks. src: composited frame.
+	typedef void(*RenderRowFunc)(const uint8_t *src, int srcPitch, const Tap *taps, uint8_t *dst, int width);
+	static void RenderRowScalar(const uint8_t *src, int srcPitch, const Tap *taps, uint8_t *dst, int width);
+	// Same as RenderRowScalar where SSE2 is not available.
+	static void RenderRowSSE2(const uint8_t *src, int srcPitch, const Tap *taps, uint8_t *dst, int width);
+
+	// Row y of the taps.
+	const Tap *GetTaps(int y) const;
+private:
+	FOVEATION_MODE mMode;
+	FoveationVars mVars;
+	BandWorkers mWorkers;
+	int mWidth;
+	int mHeight;
+	std::vector<Tap> mTaps;
+
+	void BuildTaps(int band, int bandCount);
+};
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <math.h>
+
+#include "FoveationController.h"
+
+FoveationController::FoveationController(const Config &config)
+	: mConfig(config)
+	, mBudget(config.bitrateInMBits)
+{
+	mConfig.minBitrateInMBits = std::max(1, std::min(config.minBitrateInMBits, config.bitrateInMBits));
+
+	for (int step = 0; ; step++) {
+		float strength = config.strength + step * STRENGTH_STEP;
+		if (step > 0 && strength > config.maxStrength) {
+			if (mLevels.back().strength < config.maxStrength) {
+				strength = config.maxStrength;
+			}
+			else {
+				break;
+			}
+		}
+		Level level;
+		level.strength = strength;
+		if (config.mode == FOVEATION_MODE_DISABLED) {
+			level.width = config.renderWidth;
+			level.height = config.renderHeight;
+		}
+		else {
+			FoveationVars vars = CalculateFoveationVars(config.mode, config.renderWidth, config.renderHeight
+				, config.leftEyeFov, strength, config.shape, config.verticalOffset);
+			level.width = vars.optimizedEyeWidth * 2;
+			level.height = vars.optimizedEyeHeight;
+		}
+		level.pixels = static_cast<uint64_t>(level.width) * level.height;
+		mLevels.push_back(level);
+		if (config.mode == FOVEATION_MODE_DISABLED || strength >= config.maxStrength) {
+			break;
+		}
+	}
+
+	mDecision.bitrateInMBits = config.bitrateInMBits;
+	mDecision.strength = mLevels[0].strength;
+	mDecision.width = mLevels[0].width;
+	mDecision.height = mLevels[0].height;
+}
+
+bool FoveationController::OnReport(uint64_t now, uint64_t packetsSent, uint64_t packetsLost, uint64_t queueDelayUs)
+{
+	double loss = packetsSent == 0 ? 0 : std::min(1.0, static_cast<double>(packetsLost) / packetsSent);
+	bool congested = loss > LOSS_CONGESTED || queueDelayUs > QUEUE_DELAY_CONGESTED_US;
+	bool clean = loss < LOSS_CLEAN && queueDelayUs < QUEUE_DELAY_CLEAN_US;
+
+	if (congested) {
+		mCleanReports = 0;
+		if (!mDecreased || now - mLastDecrease >= SETTLE_US) {
+			// Raised budget did not hold: probe less often.
+			if (mProbing && now - mLastIncrease < PROBE_FAILURE_US) {
+				mRecoverReports = std::min(mRecoverReports * 2, static_cast<int>(MAX_RECOVER_REPORTS));
+			}
+			else {
+				mRecoverReports = RECOVER_REPORTS;
+			}
+			mBudget = std::max<double>(mConfig.minBitrateInMBits, mBudget * (1 - loss) * DECREASE);
+			mLastDecrease = now;
+			mDecreased = true;
+			mProbing = false;
+		}
+	}
+	else if (clean) {
+		if (mProbing && now - mLastIncrease >= PROBE_FAILURE_US) {
+			mRecoverReports = RECOVER_REPORTS;
+			mProbing = false;
+		}
+		mCleanReports++;
+		if (mCleanReports >= mRecoverReports && mBudget < mConfig.bitrateInMBits) {
+			mBudget = std::min<double>(mConfig.bitrateInMBits, mBudget + mConfig.bitrateInMBits * INCREASE);
+			mCleanReports = 0;
+			mLastIncrease = now;
+			mProbing = true;
+		}
+	}
+	else {
+		mCleanReports = 0;
+	}
+
+	int bitrateInMBits = std::max(mConfig.minBitrateInMBits, static_cast<int>(floor(mBudget)));
+	int level = ChooseLevel(now, bitrateInMBits);
+	if (level > mLevel) {
+		mLastStrengthIncrease = now;
+	}
+
+	bool changed = bitrateInMBits != mDecision.bitrateInMBits || level != mLevel;
+	mLevel = level;
+	mDecision.bitrateInMBits = bitrateInMBits;
+	mDecision.strength = mLevels[level].strength;
+	mDecision.width = mLevels[level].width;
+	mDecision.height = mLevels[level].height;
+	return changed;
+}
+
+const FoveationController::Decision &FoveationController::GetDecision() const
+{
+	return mDecision;
+}
+
+double FoveationController::GetBudget() const
+{
+	return mBudget;
+}
+
+uint64_t FoveationController::GetPixels(float strength) const
+{
+	for (const Level &level : mLevels) {
+		if (level.strength == strength) {
+			return level.pixels;
+		}
+	}
+	return 0;
+}
+
+int FoveationController::ChooseLevel(uint64_t now, int bitrateInMBits) const
+{
+	int level = 0;
+	while (level + 1 < static_cast<int>(mLevels.size()) && !MeetsTarget(level, bitrateInMBits)) {
+		level++;
+	}
+	// Lowered only once the raised bitrate held.
+	if (level < mLevel && (now - mLastStrengthIncrease < STRENGTH_HOLD_US
+		|| mProbing)) {
+		return mLevel;
+	}
+	return level;
+}
+
+bool FoveationController::MeetsTarget(int level, int bitrateInMBits) const
+{
+	// bitrate / pixels >= BPP_TARGET * configured bitrate / configured pixels
+	return static_cast<double>(bitrateInMBits) * mLevels[0].pixels
+		>= BPP_TARGET * mConfig.bitrateInMBits * mLevels[level].pixels;
+}
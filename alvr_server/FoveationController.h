@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "FoveationVars.h"
+
+// Chooses the encode bitrate and foveation strength from the bandwidth the link delivers.
+//
+// A link which can not carry the encode bitrate loses packets until the bitrate is lowered, and a lower
+// bitrate at the same resolution blurs the whole image. The controller lowers the bitrate to the
+// estimated budget and raises the foveation strength with it, so that the encoded pixels keep about the
+// bits per pixel they get at the configured bitrate and strength. The center of the view, which FFR
+// keeps at full resolution, keeps its quality and the periphery pays for it.
+//
+// Budget starts at the configured bitrate. A report with loss above LOSS_CONGESTED or send queue delay
+// above QUEUE_DELAY_CONGESTED_US scales it by the delivered share of packets and DECREASE, at most once
+// per SETTLE_US as reports lag behind changes. After enough clean reports in a row it is raised by
+// INCREASE of the configured bitrate, up to it. Starting at RECOVER_REPORTS, that number doubles each
+// time the raised budget is congested again within PROBE_FAILURE_US, up to MAX_RECOVER_REPORTS.
+// So the bitrate moves in steps of about 10 % or more, unless it reaches a bound, and not more often
+// than SETTLE_US down and RECOVER_REPORTS reports up. The encoders apply a change of bitrate alone to
+// rate control, without IDR frame.
+//
+// Strength is the lowest step of STRENGTH_STEP from the configured strength up to maxStrength whose
+// bits per pixel at the budget are at least BPP_TARGET of the configured ones. It is raised at once
+// but only lowered STRENGTH_HOLD_US after it was last raised, since each change rebuilds the FFR
+// pipelines and restarts the stream with an IDR frame.
+//
+// Time arguments are in microseconds on any monotonic clock. Not thread safe.
+class FoveationController {
+public:
+	struct Config {
+		FOVEATION_MODE mode;
+		// Composited frame, both eyes.
+		int renderWidth;
+		int renderHeight;
+		EyeFov leftEyeFov;
+		// Strength on a good link, and highest one used. maxStrength at most strength only adapts bitrate.
+		float strength;
+		float maxStrength;
+		float shape;
+		float verticalOffset;
+		int bitrateInMBits;
+		int minBitrateInMBits;
+	};
+
+	struct Decision {
+		int bitrateInMBits;
+		float strength;
+		// Encoding resolution at strength.
+		uint32_t width;
+		uint32_t height;
+	};
+
+	explicit FoveationController(const Config &config);
+
+	// TimeSync mode 0 report, about once per second. packetsSent: sent by server during last second.
+	// packetsLost: lost on client during last second. queueDelayUs: send queue delay of last second.
+	// Returns true if the decision changed.
+	bool OnReport(uint64_t now, uint64_t packetsSent, uint64_t packetsLost, uint64_t queueDelayUs);
+
+	const Decision &GetDecision() const;
+	// Estimated bitrate the link carries, in Mbit/s.
+	double GetBudget() const;
+	// Encoded pixels per frame at a strength of the ladder.
+	uint64_t GetPixels(float strength) const;
+
+	static constexpr double LOSS_CONGESTED = 0.03;
+	static constexpr double LOSS_CLEAN = 0.01;
+	static const uint64_t QUEUE_DELAY_CONGESTED_US = 20 * 1000;
+	static const uint64_t QUEUE_DELAY_CLEAN_US = 5 * 1000;
+	static constexpr double DECREASE = 0.9;
+	static constexpr double INCREASE = 0.1;
+	static const uint64_t SETTLE_US = 2 * 1000 * 1000;
+	static const int RECOVER_REPORTS = 5;
+	static const int MAX_RECOVER_REPORTS = 40;
+	static const uint64_t PROBE_FAILURE_US = 5 * 1000 * 1000;
+	static constexpr float STRENGTH_STEP = 0.5f;
+	static constexpr double BPP_TARGET = 0.9;
+	static const uint64_t STRENGTH_HOLD_US = 10 * 1000 * 1000;
+private:
+	struct Level {
+		float strength;
+		uint32_t width;
+		uint32_t height;
+		uint64_t pixels;
+	};
+
+	Config mConfig;
+	// Ascending strength, first one configured.
+	std::vector<Level> mLevels;
+	int mLevel = 0;
+	Decision mDecision;
+
+	double mBudget;
+	int mCleanReports = 0;
+	int mRecoverReports = RECOVER_REPORTS;
+	uint64_t mLastDecrease = 0;
+	uint64_t mLastIncrease = 0;
+	uint64_t mLastStrengthIncrease = 0;
+	bool mDecreased = false;
+	// Budget was raised and has not been congested for PROBE_FAILURE_US yet.
+	bool mProbing = false;
+
+	int ChooseLevel(uint64_t now, int bitrateInMBits) const;
+	bool MeetsTarget(int level, int bitrateInMBits) const;
+};
@@ -0,0 +1,117 @@
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "FoveationVars.h"
+
+namespace {
+	const float DEG_TO_RAD = (float)M_PI / 180;
+
+#define INVERSE_DISTORTION_FN(a) atan(a);
+	const float INVERSE_DISTORTION_DERIVATIVE_IN_0 = 1; // d(atan(0))/dx = 1
+
+	float CalcBoundStart(float focusPos, float fovScale) {
+		return INVERSE_DISTORTION_FN(-focusPos * fovScale);
+	}
+
+	float CalcBoundEnd(float focusPos, float fovScale) {
+		return INVERSE_DISTORTION_FN((1.f - focusPos) * fovScale);
+	}
+
+	float CalcDistortedDimension(float focusPos, float fovScale) {
+		float boundEnd = CalcBoundEnd(focusPos, fovScale);
+		float boundStart = CalcBoundStart(focusPos, fovScale);
+		return boundEnd - boundStart;
+	}
+
+	float CalcOptimalDimensionForWarp(float scale, float distortedDim, float originalDim) {
+		float inverseDistortionDerivative = INVERSE_DISTORTION_DERIVATIVE_IN_0 * scale;
+		float gradientOnFocus = inverseDistortionDerivative / distortedDim;
+		return originalDim / gradientOnFocus;
+	}
+
+	float Align4Normalized(float scale, float originalDim) {
+		return float(int(scale * originalDim / 4.f) * 4) / originalDim;
+	}
+
+	float CalcOptimalDimensionForSlicing(float scale, float originalDim) {
+		return (1. + 3. * scale) / 4. * originalDim + 6;
+	}
+}
+
+FoveationVars CalculateFoveationVars(FOVEATION_MODE mode, int renderWidth, int renderHeight, const EyeFov &leftEye
+	, float strength, float shape, float verticalOffset)
+{
+	float targetEyeWidth = (float)renderWidth / 2;
+	float targetEyeHeight = (float)renderHeight;
+
+	// left and right side screen plane width with unit focal
+	float leftHalfWidth = tan(leftEye.left * DEG_TO_RAD);
+	float rightHalfWidth = tan(leftEye.right * DEG_TO_RAD);
+	// foveated center X assuming screen plane with unit width
+	float focusPositionX = leftHalfWidth / (leftHalfWidth + rightHalfWidth);
+	// align focus position to a number of pixel multiple of 4 to avoid blur and artifacts
+	if (mode == FOVEATION_MODE_SLICES) {
+		focusPositionX = Align4Normalized(focusPositionX, targetEyeWidth);
+	}
+
+
+	// NB: swapping top/bottom fov
+	float topHalfHeight = tan(leftEye.bottom * DEG_TO_RAD);
+	float bottomHalfHeight = tan(leftEye.top * DEG_TO_RAD);
+	float focusPositionY = topHalfHeight / (topHalfHeight + bottomHalfHeight);
+	focusPositionY += verticalOffset;
+	if (mode == FOVEATION_MODE_SLICES) {
+		focusPositionY = Align4Normalized(focusPositionY, targetEyeHeight);
+	}
+
+	//calculate foveation scale such as the "area" of the foveation region remains equal to (mFoveationStrengthMean)^2
+	// solve for {foveationScaleX, foveationScaleY}:
+	// /{ foveationScaleX * foveationScaleY = (mFoveationStrengthMean)^2
+	// \{ foveationScaleX / foveationScaleY = 1 / mFoveationShapeRatio
+	// then foveationScaleX := foveationScaleX / (targetEyeWidth / targetEyeHeight) to compensate for non square frame.
+	float foveationStrength = strength;
+	float foveationShape = shape;
+	if (mode == FOVEATION_MODE_SLICES) {
+		foveationStrength = 1.f / (foveationStrength / 2.f + 1.f);
+		foveationShape = 1.f / foveationShape;
+	}
+	float scaleCoeff = foveationStrength * sqrt(foveationShape);
+	float foveationScaleX = scaleCoeff / foveationShape / (targetEyeWidth / targetEyeHeight);
+	float foveationScaleY = scaleCoeff;
+	if (mode == FOVEATION_MODE_SLICES) {
+		foveationScaleX = Align4Normalized(foveationScaleX, targetEyeWidth);
+		foveationScaleY = Align4Normalized(foveationScaleY, targetEyeHeight);
+	}
+
+	float optimizedEyeWidth = 0;
+	float optimizedEyeHeight = 0;
+	float boundStartX = 0;
+	float boundStartY = 0;
+	float distortedWidth = 0;
+	float distortedHeight = 0;
+
+	if (mode == FOVEATION_MODE_SLICES) {
+		optimizedEyeWidth = CalcOptimalDimensionForSlicing(foveationScaleX, targetEyeWidth);
+		optimizedEyeHeight = CalcOptimalDimensionForSlicing(foveationScaleY, targetEyeHeight);
+	}
+	else if (mode == FOVEATION_MODE_WARP) {
+		boundStartX = CalcBoundStart(focusPositionX, foveationScaleX);
+		boundStartY = CalcBoundStart(focusPositionY, foveationScaleY);
+
+		distortedWidth = CalcDistortedDimension(focusPositionX, foveationScaleX);
+		distortedHeight = CalcDistortedDimension(focusPositionY, foveationScaleY);
+
+		optimizedEyeWidth = CalcOptimalDimensionForWarp(foveationScaleX, distortedWidth, targetEyeWidth);
+		optimizedEyeHeight = CalcOptimalDimensionForWarp(foveationScaleY, distortedHeight, targetEyeHeight);
+	}
+
+	// round the frame dimensions to a number of pixel multiple of 32 for the encoder
+	auto optimizedEyeWidthAligned = (uint32_t)ceil(optimizedEyeWidth / 32.f) * 32;
+	auto optimizedEyeHeightAligned = (uint32_t)ceil(optimizedEyeHeight / 32.f) * 32;
+
+	//throw MakeException("%f %f %f %f %d", targetEyeHeight, focusPositionY, foveationScaleY, optimizedEyeHeight, optimizedEyeHeightAligned);
+
+	return { (uint32_t)targetEyeWidth, (uint32_t)targetEyeHeight, optimizedEyeWidthAligned, optimizedEyeHeightAligned,
+		focusPositionX, focusPositionY, foveationScaleX, foveationScaleY,
+		boundStartX, boundStartY, distortedWidth, distortedHeight };
+}
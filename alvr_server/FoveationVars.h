@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "packet_types.h"
+
+enum FOVEATION_MODE {
+	FOVEATION_MODE_DISABLED = 0,
+	FOVEATION_MODE_SLICES = 1,
+	FOVEATION_MODE_WARP = 2,
+};
+
+// Constant buffer of the FFR shaders (FoveatedRendering.hlsli), shared by FFR and FFRCPU.
+struct FoveationVars {
+	uint32_t targetEyeWidth;
+	uint32_t targetEyeHeight;
+	uint32_t optimizedEyeWidth;
+	uint32_t optimizedEyeHeight;
+	float focusPositionX;
+	float focusPositionY;
+	float foveationScaleX;
+	float foveationScaleY;
+
+	float boundStartX;
+	float boundStartY;
+	float distortedWidth;
+	float distortedHeight;
+};
+
+// renderWidth, renderHeight: composited frame with both eyes side by side. leftEye: fov in degrees.
+// strength, shape, verticalOffset: as m_foveationStrength, m_foveationShape, m_foveationVerticalOffset.
+FoveationVars CalculateFoveationVars(FOVEATION_MODE mode, int renderWidth, int renderHeight, const EyeFov &leftEye
+	, float strength, float shape, float verticalOffset);
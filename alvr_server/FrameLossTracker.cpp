@@ -0,0 +1,71 @@
+#include <algorithm>
+
+#include "FrameLossTracker.h"
+
+FrameLossTracker::FrameLossTracker()
+	: mFrames(HISTORY_FRAMES)
+{
+	Reset();
+}
+
+void FrameLossTracker::OnFrameSent(uint8_t frameType, uint32_t firstPacket, uint32_t packets, const FECLayout &layout)
+{
+	Frame &frame = mFrames[mNext];
+	frame.frameType = std::min(frameType, static_cast<uint8_t>(FRAME_TYPES - 1));
+	frame.firstPacket = firstPacket;
+	frame.packets = packets;
+	frame.shardPackets = std::max(layout.shardPackets, 1);
+	frame.parityShards = layout.parityShards;
+	frame.stripeLoss = 0;
+	mNext = (mNext + 1) % mFrames.size();
+	mCount = std::min(mCount + 1, mFrames.size());
+	mStats[frame.frameType].frames++;
+}
+
+void FrameLossTracker::OnLossRun(uint32_t fromPacket, uint32_t toPacket)
+{
+	if (static_cast<int32_t>(toPacket - fromPacket) < 0) {
+		return;
+	}
+	uint32_t runPackets = toPacket - fromPacket + 1;
+	for (size_t i = 0; i < mCount; i++) {
+		Frame &frame = mFrames[(mNext + mFrames.size() - mCount + i) % mFrames.size()];
+		// Frame range relative to the run, so that counter wrap-around does not matter.
+		int64_t begin = static_cast<int32_t>(frame.firstPacket - fromPacket);
+		int64_t end = begin + frame.packets;
+		int64_t overlap = std::min<int64_t>(end, runPackets) - std::max<int64_t>(begin, 0);
+		if (overlap <= 0) {
+			continue;
+		}
+		int lost = static_cast<int>(overlap);
+
+		TypeStats &stats = mStats[frame.frameType];
+		bool wasLost = frame.stripeLoss > frame.parityShards;
+		bool wasHit = frame.stripeLoss > 0;
+		frame.stripeLoss += (lost + frame.shardPackets - 1) / frame.shardPackets;
+		bool isLost = frame.stripeLoss > frame.parityShards;
+		if (isLost && !wasLost) {
+			stats.lost++;
+			if (wasHit) {
+				stats.recovered--;
+			}
+		}
+		else if (!isLost && !wasHit) {
+			stats.recovered++;
+		}
+	}
+}
+
+void FrameLossTracker::Reset()
+{
+	mNext = 0;
+	mCount = 0;
+	for (auto &stats : mStats) {
+		stats = {};
+	}
+}
+
+const FrameLossTracker::TypeStats &FrameLossTracker::GetStats(int frameType) const
+{
+	return mStats[std::min(std::max(frameType, 0), FRAME_TYPES - 1)];
+}
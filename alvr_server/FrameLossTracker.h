@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "packet_types.h"
+#include "FECPolicy.h"
+
+// Recovered and lost video frames per ALVR_FRAME_TYPE, estimated from PacketErrorReport ranges.
+//
+// The last HISTORY_FRAMES frames are remembered with their packetCounter range and FEC layout.
+// Each reported run of lost packets is split among the frames whose range it overlaps. A run of
+// n packets within a frame hits each packet stripe at most ceil(n / shardPackets) times, so a frame
+// is counted as lost once the sum of that over its runs exceeds parityShards, and as recovered while
+// it does not. The bound is conservative, and parity deferred by FECInterleaver is sent in the range
+// of a later frame, so treat the numbers as an estimate.
+//
+// Not thread safe.
+class FrameLossTracker {
+public:
+	struct TypeStats {
+		uint64_t frames;
+		// Hit by loss, still recoverable by FEC.
+		uint64_t recovered;
+		uint64_t lost;
+	};
+
+	FrameLossTracker();
+
+	// Frame took packetCounter values [firstPacket, firstPacket + packets).
+	void OnFrameSent(uint8_t frameType, uint32_t firstPacket, uint32_t packets, const FECLayout &layout);
+	// Packets [fromPacket, toPacket] were lost.
+	void OnLossRun(uint32_t fromPacket, uint32_t toPacket);
+	void Reset();
+
+	// frameType: ALVR_FRAME_TYPE
+	const TypeStats &GetStats(int frameType) const;
+
+	static const int HISTORY_FRAMES = 256;
+	static const int FRAME_TYPES = ALVR_FRAME_TYPE_IDR + 1;
+private:
+	struct Frame {
+		uint8_t frameType;
+		uint32_t firstPacket;
+		uint32_t packets;
+		int shardPackets;
+		int parityShards;
+		int stripeLoss;
+	};
+
+	// Ring in sending order.
+	std::vector<Frame> mFrames;
+	size_t mNext;
+	size_t mCount;
+	TypeStats mStats[FRAME_TYPES];
+};
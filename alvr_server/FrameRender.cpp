@@ -337,8 +337,9 @@ bool FrameRender::Startup()
 
 	enableFFR = Settings::Instance().m_foveationMode != FOVEATION_MODE_DISABLED;
 	if (enableFFR) {
-		m_ffr = std::make_unique<FFR>(m_pD3DRender->GetDevice());
-		m_ffr->Initialize(m_pStagingTexture.Get());
+		m_ffrInputTexture = m_pStagingTexture;
+		m_ffr = std::make_unique<FFR>(m_pD3DRender->GetDevice(), Settings::Instance().m_foveationStrength);
+		m_ffr->Initialize(m_ffrInputTexture.Get());
 
 		m_pStagingTexture = m_ffr->GetOutputTexture();
 	}
@@ -614,6 +615,16 @@ void FrameRender::CreateResourceTexture()
 	}
 }
 
+void FrameRender::SetFoveationStrength(float strength) {
+	if (!enableFFR) {
+		return;
+	}
+	m_ffr = std::make_unique<FFR>(m_pD3DRender->GetDevice(), strength);
+	m_ffr->Initialize(m_ffrInputTexture.Get());
+
+	m_pStagingTexture = m_ffr->GetOutputTexture();
+}
+
 void FrameRender::GetEncodingResolution(uint32_t *width, uint32_t *height) {
 	if (enableFFR) {
 		m_ffr->GetOptimizedResolution(width, height);
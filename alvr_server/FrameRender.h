@@ -29,6 +29,9 @@ public:
 	void RenderMessage(const std::string& message);
 	void RenderDebugText(const std::string& debugText);
 	void CreateResourceTexture();
+	// Rebuilds the FFR pipelines for a new strength. GetTexture and GetEncodingResolution change with it.
+	// Must not run while the texture is being encoded.
+	void SetFoveationStrength(float strength);
 	void GetEncodingResolution(uint32_t *width, uint32_t *height);
 
 	ComPtr<ID3D11Texture2D> GetTexture();
@@ -73,6 +76,8 @@ private:
 	std::unique_ptr<d3d_render_utils::RenderPipeline> m_colorCorrectionPipeline;
 	bool enableColorCorrection;
 
+	// Input of m_ffr, kept to rebuild it in SetFoveationStrength.
+	ComPtr<ID3D11Texture2D> m_ffrInputTexture;
 	std::unique_ptr<FFR> m_ffr;
 	bool enableFFR;
 };
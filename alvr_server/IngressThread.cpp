@@ -0,0 +1,100 @@
+#include "IngressThread.h"
+#include "Logger.h"
+
+#include <avrt.h>
+
+IngressThread::IngressThread(std::shared_ptr<UdpSocket> socket, std::function<bool(const ReceivedPacket &)> fastPath
+	, std::function<void()> wake)
+	: mSocket(socket)
+	, mFastPath(fastPath)
+	, mWake(wake)
+	, mQueue(QUEUE_CAPACITY)
+	, mExiting(false)
+	, mDroppedPackets(0)
+{
+}
+
+void IngressThread::Run()
+{
+	LogDriver("IngressThread: Start thread. Id=%d", GetCurrentThreadId());
+	HANDLE task = RaisePriority();
+
+	ReceivedPacket packet;
+	while (!mExiting) {
+		int ret = mSocket->WaitRecv(WAIT_TIME_US);
+		if (ret == SOCKET_ERROR) {
+			if (mExiting) {
+				break;
+			}
+			LogDriver("IngressThread: Wait error : %d %ls", GetLastSocketError(), GetErrorStr(GetLastSocketError()).c_str());
+			continue;
+		}
+		if (ret == 0) {
+			continue;
+		}
+
+		bool queued = false;
+		while (true) {
+			packet.len = sizeof(packet.buf);
+			if (!mSocket->Recv(packet.buf, &packet.len, &packet.addr, sizeof(packet.addr), &packet.receivedUs)) {
+				break;
+			}
+			if (mFastPath(packet)) {
+				continue;
+			}
+			ReceivedPacket *slot = mQueue.Reserve();
+			if (slot == NULL) {
+				mDroppedPackets++;
+				continue;
+			}
+			slot->len = packet.len;
+			slot->addr = packet.addr;
+			slot->receivedUs = packet.receivedUs;
+			memcpy(slot->buf, packet.buf, packet.len);
+			mQueue.Commit();
+			queued = true;
+		}
+		if (queued) {
+			mWake();
+		}
+	}
+	if (task != NULL) {
+		AvRevertMmThreadCharacteristics(task);
+	}
+	LogDriver("IngressThread: Exit thread.");
+}
+
+void IngressThread::Stop()
+{
+	mExiting = true;
+	Join();
+}
+
+ReceivedPacket *IngressThread::Front()
+{
+	return mQueue.Front();
+}
+
+void IngressThread::Pop()
+{
+	mQueue.Pop();
+}
+
+uint64_t IngressThread::GetDroppedPackets()
+{
+	return mDroppedPackets;
+}
+
+HANDLE IngressThread::RaisePriority()
+{
+	// MMCSS schedules registered threads in real-time priority range without needing admin rights.
+	DWORD taskIndex = 0;
+	HANDLE task = AvSetMmThreadCharacteristicsW(L"Pro Audio", &taskIndex);
+	if (task != NULL) {
+		AvSetMmThreadPriority(task, AVRT_PRIORITY_CRITICAL);
+		return task;
+	}
+	LogDriver("IngressThread: AvSetMmThreadCharacteristics failed: %u. Use THREAD_PRIORITY_TIME_CRITICAL.", GetLastError());
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+	return NULL;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "threadtools.h"
+#include "UdpSocket.h"
+#include "SPSCQueue.h"
+
+// Datagram received from client, stamped with GetCounterUs() when it was read from socket.
+struct ReceivedPacket {
+	int len;
+	sockaddr_in addr;
+	uint64_t receivedUs;
+	char buf[MAX_PACKET_UDP_PACKET_SIZE];
+};
+
+// Receives all datagrams of UdpSocket on its own real-time priority thread, waiting on the socket
+// with its own SocketWaiter, so pose updates are not queued behind video sends, timers and control
+// commands of the connection thread.
+//
+// Each datagram is first offered to fastPath on this thread. fastPath must not block; it handles
+// tracking inline and hands mic audio to its worker. Everything else is queued for the connection
+// thread, which is woken by wake and drains the queue with Front/Pop.
+class IngressThread : public CThread {
+public:
+	IngressThread(std::shared_ptr<UdpSocket> socket, std::function<bool(const ReceivedPacket &)> fastPath
+		, std::function<void()> wake);
+
+	void Run() override;
+	void Stop();
+
+	// Connection thread
+
+	ReceivedPacket *Front();
+	void Pop();
+	// Datagrams dropped because the connection thread did not keep up.
+	uint64_t GetDroppedPackets();
+private:
+	std::shared_ptr<UdpSocket> mSocket;
+	std::function<bool(const ReceivedPacket &)> mFastPath;
+	std::function<void()> mWake;
+	SPSCQueue<ReceivedPacket> mQueue;
+	std::atomic<bool> mExiting;
+	std::atomic<uint64_t> mDroppedPackets;
+
+	static const int QUEUE_CAPACITY = 256;
+	// Upper bound of wait, to notice Stop.
+	static const uint64_t WAIT_TIME_US = 10 * 1000;
+
+	// Returns MMCSS task handle to revert on exit, or NULL.
+	HANDLE RaisePriority();
+};
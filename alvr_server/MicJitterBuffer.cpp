@@ -0,0 +1,234 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "MicJitterBuffer.h"
+
+constexpr double MicJitterBuffer::MAX_RATIO_DEVIATION;
+constexpr double MicJitterBuffer::DEAD_BAND;
+constexpr double MicJitterBuffer::LEVEL_SMOOTHING;
+
+namespace {
+	// Ratio deviation per fraction of target the level is off, outside the dead band.
+	const double RATIO_GAIN = 0.01;
+}
+
+MicJitterBuffer::MicJitterBuffer(int sampleRate)
+	: mSampleRate(sampleRate)
+	, mSlots(SLOTS)
+{
+	Reset();
+}
+
+void MicJitterBuffer::Push(uint32_t packetIndex, const int16_t *samples, int count, uint64_t arrivalTime)
+{
+	if (count <= 0) {
+		return;
+	}
+	count = std::min(count, ALVR_MAX_MIC_SAMPLES);
+	mStats.packets++;
+
+	int32_t ahead = (int32_t)(packetIndex - mNextIndex);
+	if (!mReceived || ahead >= SLOTS || ahead < -SLOTS) {
+		// First packet, or client restarted its counter or came back after a long outage.
+		for (auto &slot : mSlots) {
+			slot.valid = false;
+		}
+		mReceived = true;
+		mStarted = false;
+		mNextIndex = packetIndex;
+		mHighestIndex = packetIndex;
+		mFirstIndex = packetIndex;
+		mReadOffset = 0;
+		mBufferedSamples = 0;
+		mPacketSamples = count;
+		mLastTransit = (double)arrivalTime;
+	}
+	if ((int32_t)(packetIndex - mNextIndex) < 0) {
+		mStats.latePackets++;
+		return;
+	}
+	Slot &slot = mSlots[packetIndex % SLOTS];
+	if (slot.valid && slot.packetIndex == packetIndex) {
+		mStats.duplicatePackets++;
+		return;
+	}
+	if ((int32_t)(packetIndex - mHighestIndex) < 0) {
+		mStats.reorderedPackets++;
+	}
+	else {
+		mHighestIndex = packetIndex;
+	}
+
+	slot.valid = true;
+	slot.packetIndex = packetIndex;
+	slot.count = count;
+	memcpy(slot.samples, samples, count * sizeof(int16_t));
+	mBufferedSamples += count;
+	mPacketSamples = count;
+
+	// Transit time up to a constant: arrival minus media time of the packet.
+	double transit = (double)arrivalTime - (double)(packetIndex - mFirstIndex) * mPacketSamples * 1000 * 1000 / mSampleRate;
+	mJitterUs += (fabs(transit - mLastTransit) - mJitterUs) / 16;
+	mLastTransit = transit;
+
+	while (mBufferedSamples > (int)((int64_t)OVERFLOW_DELAY_US * mSampleRate / (1000 * 1000))) {
+		DropOldest();
+	}
+}
+
+void MicJitterBuffer::Pull(int16_t *out, int count)
+{
+	if (!mStarted && mReceived && mBufferedSamples >= GetTargetSamples()) {
+		mStarted = true;
+		mConcealRemaining = 0;
+		mLevel = GetMeanTargetSamples();
+	}
+	int before = mBufferedSamples;
+	for (int i = 0; i < count; i++) {
+		out[i] = (int16_t)lround(mPrevious + (mCurrent - mPrevious) * mPosition);
+		mPosition += mRatio;
+		while (mPosition >= 1) {
+			mPosition -= 1;
+			mPrevious = mCurrent;
+			mCurrent = ReadSample();
+		}
+	}
+	UpdateRatio((before + mBufferedSamples) / 2.0);
+}
+
+void MicJitterBuffer::Reset()
+{
+	for (auto &slot : mSlots) {
+		slot.valid = false;
+	}
+	mStats = {};
+	mReceived = false;
+	mStarted = false;
+	mNextIndex = 0;
+	mHighestIndex = 0;
+	mReadOffset = 0;
+	mBufferedSamples = 0;
+	mPacketSamples = 0;
+	mFirstIndex = 0;
+	mLastTransit = 0;
+	mJitterUs = 0;
+	mLastCount = 0;
+	mConcealed = 0;
+	mConcealRemaining = 0;
+	mLevel = 0;
+	mRatio = 1;
+	mPosition = 0;
+	mPrevious = 0;
+	mCurrent = 0;
+}
+
+int MicJitterBuffer::GetBufferedSamples() const
+{
+	return mBufferedSamples;
+}
+
+int MicJitterBuffer::GetTargetSamples() const
+{
+	double delayUs = (double)mPacketSamples * 1000 * 1000 / mSampleRate + JITTER_MULTIPLIER * mJitterUs;
+	delayUs = std::min(std::max(delayUs, (double)MIN_DELAY_US), (double)MAX_DELAY_US);
+	return (int)(delayUs * mSampleRate / (1000 * 1000));
+}
+
+double MicJitterBuffer::GetRatio() const
+{
+	return mRatio;
+}
+
+double MicJitterBuffer::GetJitterUs() const
+{
+	return mJitterUs;
+}
+
+const MicJitterBuffer::Stats &MicJitterBuffer::GetStats() const
+{
+	return mStats;
+}
+
+int16_t MicJitterBuffer::ReadSample()
+{
+	if (mStarted && mConcealRemaining == 0) {
+		if (mBufferedSamples > 0) {
+			Slot &slot = mSlots[mNextIndex % SLOTS];
+			if (slot.valid && slot.packetIndex == mNextIndex) {
+				int16_t sample = slot.samples[mReadOffset++];
+				mBufferedSamples--;
+				mConcealed = 0;
+				if (mReadOffset == slot.count) {
+					memcpy(mLast, slot.samples, slot.count * sizeof(int16_t));
+					mLastCount = slot.count;
+					slot.valid = false;
+					mNextIndex++;
+					mReadOffset = 0;
+				}
+				return sample;
+			}
+			// Later packets are waiting, so this one is lost. Conceal its duration and move on.
+			mStats.lostPackets++;
+			mNextIndex++;
+			mReadOffset = 0;
+			mConcealRemaining = mPacketSamples;
+		}
+		else {
+			mStarted = false;
+			mStats.underruns++;
+		}
+	}
+	if (mConcealRemaining > 0) {
+		mConcealRemaining--;
+	}
+	return ConcealSample();
+}
+
+int16_t MicJitterBuffer::ConcealSample()
+{
+	int total = CONCEAL_PACKETS * mLastCount;
+	if (mConcealed >= total) {
+		return 0;
+	}
+	int16_t sample = (int16_t)(mLast[mConcealed % mLastCount] * (total - mConcealed) / total);
+	mConcealed++;
+	mStats.concealedSamples++;
+	return sample;
+}
+
+void MicJitterBuffer::DropOldest()
+{
+	Slot &slot = mSlots[mNextIndex % SLOTS];
+	if (slot.valid && slot.packetIndex == mNextIndex) {
+		mBufferedSamples -= slot.count - mReadOffset;
+		slot.valid = false;
+		mStats.overflowPackets++;
+	}
+	mNextIndex++;
+	mReadOffset = 0;
+}
+
+double MicJitterBuffer::GetMeanTargetSamples() const
+{
+	// Level rises by a packet on arrival and drains back between arrivals. Playback starts at the
+	// top of this sawtooth, so the target for the average is half a packet below.
+	return GetTargetSamples() - mPacketSamples / 2.0;
+}
+
+void MicJitterBuffer::UpdateRatio(double level)
+{
+	if (!mStarted) {
+		mRatio = 1;
+		return;
+	}
+	mLevel += (level - mLevel) * LEVEL_SMOOTHING;
+	double target = GetMeanTargetSamples();
+	double error = (mLevel - target) / target;
+	if (fabs(error) <= DEAD_BAND) {
+		mRatio = 1;
+		return;
+	}
+	error -= error > 0 ? DEAD_BAND : -DEAD_BAND;
+	mRatio = 1 + std::min(std::max(error * RATIO_GAIN, -MAX_RATIO_DEVIATION), MAX_RATIO_DEVIATION);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "packet_types.h"
+
+// Adaptive jitter buffer for MicAudioFrame packets, between the network (Push) and an AudioSink (Pull).
+//
+// Packets are stored by packetIndex in a fixed ring of SLOTS, so reordering within the ring is undone
+// and duplicates and packets arriving after their turn are dropped. Playback starts once the target
+// delay is buffered. A packet missing at its turn while later ones are waiting is lost: its duration
+// is filled by repeating the last packet with decaying gain. When the buffer runs dry the same
+// concealment fades to silence and playback starts again at the target delay.
+//
+// Target delay follows interarrival jitter (RFC 3550 estimator): one packet plus JITTER_MULTIPLIER
+// times the jitter, within MIN_DELAY_US and MAX_DELAY_US.
+//
+// Client microphone and server audio device run on different clocks, so the buffer would slowly fill
+// or drain. Output is resampled by linear interpolation at a ratio within MAX_RATIO_DEVIATION of 1,
+// steered by the smoothed buffer level against the target. Inside a dead band the ratio is exactly 1.
+//
+// Not thread safe. Both sides are called from MicPlaybackThread.
+class MicJitterBuffer {
+public:
+	struct Stats {
+		uint64_t packets;
+		uint64_t reorderedPackets;
+		uint64_t duplicatePackets;
+		// Arrived after their turn was concealed.
+		uint64_t latePackets;
+		uint64_t lostPackets;
+		// Dropped because buffer was over OVERFLOW_DELAY_US.
+		uint64_t overflowPackets;
+		uint64_t underruns;
+		uint64_t concealedSamples;
+	};
+
+	MicJitterBuffer(int sampleRate = 48000);
+
+	// arrivalTime: microseconds on any monotonic clock.
+	void Push(uint32_t packetIndex, const int16_t *samples, int count, uint64_t arrivalTime);
+	// Always fills count samples.
+	void Pull(int16_t *out, int count);
+	void Reset();
+
+	int GetBufferedSamples() const;
+	int GetTargetSamples() const;
+	// Input samples consumed per output sample.
+	double GetRatio() const;
+	// Estimated interarrival jitter in microseconds.
+	double GetJitterUs() const;
+	const Stats &GetStats() const;
+
+	static const int SLOTS = 64;
+	static const int MIN_DELAY_US = 20 * 1000;
+	static const int MAX_DELAY_US = 200 * 1000;
+	static const int OVERFLOW_DELAY_US = 2 * MAX_DELAY_US;
+	static const int JITTER_MULTIPLIER = 4;
+	// Concealment fades to silence over this many packets.
+	static const int CONCEAL_PACKETS = 4;
+	// 0.3%, about 5 cents of pitch.
+	static constexpr double MAX_RATIO_DEVIATION = 0.003;
+	// Buffer level within this fraction of target does not change ratio.
+	static constexpr double DEAD_BAND = 0.25;
+	// Smoothing of buffer level per Pull.
+	static constexpr double LEVEL_SMOOTHING = 0.01;
+private:
+	struct Slot {
+		bool valid;
+		uint32_t packetIndex;
+		int count;
+		int16_t samples[ALVR_MAX_MIC_SAMPLES];
+	};
+
+	int mSampleRate;
+	std::vector<Slot> mSlots;
+	Stats mStats;
+
+	bool mReceived;
+	bool mStarted;
+	uint32_t mNextIndex;
+	uint32_t mHighestIndex;
+	int mReadOffset;
+	int mBufferedSamples;
+	int mPacketSamples;
+
+	// Jitter estimator.
+	uint32_t mFirstIndex;
+	double mLastTransit;
+	double mJitterUs;
+
+	// Concealment source and progress.
+	int16_t mLast[ALVR_MAX_MIC_SAMPLES];
+	int mLastCount;
+	int mConcealed;
+	int mConcealRemaining;
+
+	// Resampler.
+	double mLevel;
+	double mRatio;
+	double mPosition;
+	int16_t mPrevious;
+	int16_t mCurrent;
+
+	int16_t ReadSample();
+	int16_t ConcealSample();
+	void DropOldest();
+	double GetMeanTargetSamples() const;
+	// level: average buffered samples over the last Pull.
+	void UpdateRatio(double level);
+};
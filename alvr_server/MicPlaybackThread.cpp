@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <stddef.h>
+
+#include "MicPlaybackThread.h"
+#include "Logger.h"
+
+MicPlaybackThread::MicPlaybackThread(std::shared_ptr<AudioSink> sink)
+	: mSink(sink)
+	, mQueue(QUEUE_CAPACITY)
+	, mExiting(false)
+	, mStats()
+{
+}
+
+void MicPlaybackThread::Run()
+{
+	LogDriver("MicPlaybackThread: Start thread. Id=%d", GetCurrentThreadId());
+	int16_t samples[PULL_SAMPLES];
+	while (!mExiting) {
+		mEvent.Wait(WAIT_TIME_MS);
+		ReceivedPacket *packet;
+		while ((packet = mQueue.Front()) != NULL) {
+			auto *frame = (MicAudioFrame *)packet->buf;
+			int count = std::min((int)frame->sampleCount, ALVR_MAX_MIC_SAMPLES);
+			count = std::min(count, (int)((packet->len - offsetof(MicAudioFrame, micBuffer)) / sizeof(int16_t)));
+			mJitterBuffer.Push(frame->packetIndex, frame->micBuffer, count, packet->receivedUs);
+			mQueue.Pop();
+		}
+
+		int writable = mSink->GetWritableSamples();
+		while (writable > 0) {
+			int count = std::min(writable, (int)PULL_SAMPLES);
+			mJitterBuffer.Pull(samples, count);
+			mSink->Write(samples, count);
+			writable -= count;
+		}
+		{
+			IPCCriticalSectionLock lock(mStatsCS);
+			mStats = mJitterBuffer.GetStats();
+		}
+	}
+	LogDriver("MicPlaybackThread: Exit thread.");
+}
+
+void MicPlaybackThread::Stop()
+{
+	mExiting = true;
+	mEvent.Set();
+	Join();
+}
+
+bool MicPlaybackThread::Push(const char *buf, int len, uint64_t receivedUs)
+{
+	ReceivedPacket *slot = mQueue.Reserve();
+	if (slot == NULL) {
+		return false;
+	}
+	slot->len = std::min(len, (int)sizeof(slot->buf));
+	slot->receivedUs = receivedUs;
+	memcpy(slot->buf, buf, slot->len);
+	mQueue.Commit();
+	mEvent.Set();
+	return true;
+}
+
+MicJitterBuffer::Stats MicPlaybackThread::GetStats()
+{
+	IPCCriticalSectionLock lock(mStatsCS);
+	return mStats;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "IngressThread.h"
+#include "threadtools.h"
+#include "ipctools.h"
+#include "AudioSink.h"
+#include "MicJitterBuffer.h"
+
+// Plays MicAudioFrame packets on its own thread so that audio output never delays the receive thread.
+// Push is called from single producer (IngressThread, or connection thread without it) and never blocks.
+// Packets go through MicJitterBuffer, which is drained as fast as the sink consumes.
+class MicPlaybackThread : public CThread {
+public:
+	MicPlaybackThread(std::shared_ptr<AudioSink> sink);
+
+	void Run() override;
+	void Stop();
+
+	// Returns false if queue is full and packet was dropped.
+	bool Push(const char *buf, int len, uint64_t receivedUs);
+	// Copy of jitter buffer statistics, for GetStat.
+	MicJitterBuffer::Stats GetStats();
+private:
+	std::shared_ptr<AudioSink> mSink;
+	SPSCQueue<ReceivedPacket> mQueue;
+	CThreadEvent mEvent;
+	std::atomic<bool> mExiting;
+	MicJitterBuffer mJitterBuffer;
+	IPCCriticalSection mStatsCS;
+	MicJitterBuffer::Stats mStats;
+
+	// About 600ms of 10ms frames.
+	static const int QUEUE_CAPACITY = 64;
+	// Sink is refilled at least this often. Shorter than a waveOut block.
+	static const uint32_t WAIT_TIME_MS = 5;
+	static const int PULL_SAMPLES = 256;
+};
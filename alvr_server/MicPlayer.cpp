@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "MicPlayer.h"
 
 
@@ -115,7 +117,9 @@ MicPlayer::MicPlayer()
 		CALLBACK_FUNCTION
 	) != MMSYSERR_NOERROR) {
 		Log("unable to open wave mapper device\n");
+		return;
 	}
+	opened = true;
 
 	Log("Mic Audio device opened");
 }
@@ -182,14 +186,27 @@ void MicPlayer::freeBlocks(WAVEHDR* blockArray)
 }
 
 
-void MicPlayer::playAudio(LPSTR data, int size)
+int MicPlayer::GetWritableSamples()
 {
+	if (!opened) {
+		return 0;
+	}
+	EnterCriticalSection(&waveCriticalSection);
+	int queued = BLOCK_COUNT - waveFreeBlockCount;
+	LeaveCriticalSection(&waveCriticalSection);
+
+	int bytes = (QUEUED_BLOCKS - queued) * BLOCK_SIZE - static_cast<int>(waveBlocks[waveCurrentBlock].dwUser);
+	return std::max(bytes, 0) / static_cast<int>(sizeof(int16_t));
+}
 
-	if (deviceID == -1) {		
+void MicPlayer::Write(const int16_t *samples, int count)
+{
+	if (!opened) {
 		return;
 	}
-		
 
+	LPSTR data = (LPSTR)samples;
+	int size = count * sizeof(int16_t);
 	WAVEHDR* current;
 	int remain;
 	current = &waveBlocks[waveCurrentBlock];	
@@ -224,16 +241,11 @@ void MicPlayer::playAudio(LPSTR data, int size)
 		waveFreeBlockCount--;
 		LeaveCriticalSection(&waveCriticalSection);
 		/*
-		 * wait for a block to become free
-		 */
-		while (!waveFreeBlockCount)
-			Sleep(10);
-		/*
-		 * point to the next block
+		 * point to the next block. Caller keeps to GetWritableSamples, so it is free.
 		 */
 		waveCurrentBlock++;
 		waveCurrentBlock %= BLOCK_COUNT;
 		current = &waveBlocks[waveCurrentBlock];
 		current->dwUser = 0;
 	}
-}
\ No newline at end of file
+}
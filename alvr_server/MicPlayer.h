@@ -5,6 +5,7 @@
 #include <tchar.h>
 #include "Logger.h"
 #include "Settings.h"
+#include "AudioSink.h"
 
 /*
  * some good values for block size and count
@@ -20,12 +21,14 @@ http://www.planet-source-code.com/vb/scripts/ShowCode.asp?txtCodeId=4422&lngWId=
 
 Needs the CABLE audio driver https://www.vb-audio.com/Cable/
 */
-class MicPlayer
+class MicPlayer : public AudioSink
 {
 public:
 	MicPlayer();
 	~MicPlayer();
-	void playAudio(LPSTR data, int size);
+	// Keeps up to QUEUED_BLOCKS blocks queued to waveOut. Never waits for a free block.
+	int GetWritableSamples() override;
+	void Write(const int16_t *samples, int count) override;
 	void waveCallback();
 
 	UINT getCableHWID();
@@ -53,6 +56,10 @@ private:
 
 	HWAVEOUT hWaveOut; /* device handle */
 	WAVEFORMATEX wfx; 
+	bool opened = false;
+
+	// About 32ms of output latency.
+	static const int QUEUED_BLOCKS = 3;
 };
 
 
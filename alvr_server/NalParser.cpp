@@ -0,0 +1,304 @@
+#include <string.h>
+
+#include "NalParser.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NAL_PARSER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__)
+#define NAL_PARSER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define NAL_PARSER_TARGET_AVX2
+#endif
+
+namespace {
+	const int H264_NAL_SLICE = 1;
+	const int H264_NAL_IDR = 5;
+	const int H264_NAL_SPS = 7;
+	const int H264_NAL_PPS = 8;
+	const int H264_NAL_AUD = 9;
+
+	const int H265_NAL_RSV_VCL_N14 = 14;
+	const int H265_NAL_BLA_W_LP = 16;
+	const int H265_NAL_CRA = 21;
+	const int H265_NAL_VPS = 32;
+	const int H265_NAL_PPS = 34;
+	const int H265_NAL_AUD = 35;
+
+	typedef const uint8_t *(*FindStartCodeFunc)(const uint8_t *begin, const uint8_t *end);
+
+	FindStartCodeFunc SelectFindStartCode() {
+#ifdef NAL_PARSER_X86
+		if (NalParser::HasAVX2()) {
+			return NalParser::FindStartCodeAVX2;
+		}
+		return NalParser::FindStartCodeSSE2;
+#else
+		return NalParser::FindStartCodeScalar;
+#endif
+	}
+
+	int CountTrailingZeros(uint32_t mask) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return (int)index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+}
+
+NalParser::NalParser(int codec)
+	: mCodec(codec)
+{
+}
+
+void NalParser::Parse(const uint8_t *buf, int len, std::vector<NalUnit> &nals) const
+{
+	nals.clear();
+	const uint8_t *end = buf + len;
+	const uint8_t *p = FindStartCode(buf, end);
+	while (p != end) {
+		const uint8_t *data = p + 3;
+		const uint8_t *next = FindStartCode(data, end);
+		// A zero before the next start code is either its fourth byte or trailing_zero_8bits.
+		const uint8_t *nalEnd = next;
+		while (nalEnd > data && nalEnd[-1] == 0) {
+			nalEnd--;
+		}
+		if (nalEnd - data >= GetHeaderSize()) {
+			NalUnit nal;
+			nal.data = data;
+			nal.size = static_cast<int>(nalEnd - data);
+			nal.startCodeSize = (p > buf && p[-1] == 0) ? 4 : 3;
+			nal.type = GetType(data);
+			nals.push_back(nal);
+		}
+		p = next;
+	}
+}
+
+NalParser::FrameInfo NalParser::Classify(const uint8_t *buf, int len) const
+{
+	Parse(buf, len, mNals);
+	return Classify(mNals);
+}
+
+NalParser::FrameInfo NalParser::Classify(const std::vector<NalUnit> &nals) const
+{
+	FrameInfo info = {};
+	// A frame without slices (parameter sets only) is needed by the following frames.
+	info.frameType = ALVR_FRAME_TYPE_REFERENCE;
+	info.nalCount = static_cast<int>(nals.size());
+	bool hasSlice = false;
+	bool reference = false;
+	bool idr = false;
+	for (auto &nal : nals) {
+		if (IsParameterSet(nal.type)) {
+			info.parameterSets = true;
+		}
+		else if (IsSlice(nal.type)) {
+			hasSlice = true;
+			idr = idr || IsIDR(nal.type);
+			reference = reference || IsReference(nal);
+		}
+	}
+	if (idr) {
+		info.frameType = ALVR_FRAME_TYPE_IDR;
+	}
+	else if (hasSlice && !reference) {
+		info.frameType = ALVR_FRAME_TYPE_NON_REFERENCE;
+	}
+	return info;
+}
+
+void NalParser::StripAUD(uint8_t **buf, int *len) const
+{
+	uint8_t *base = *buf;
+	uint8_t *end = base + *len;
+	Parse(base, *len, mNals);
+
+	size_t first = 0;
+	while (first < mNals.size() && IsAUD(mNals[first].type)) {
+		first++;
+	}
+	if (first == mNals.size()) {
+		// Nothing else to send. Leave it to the caller.
+		return;
+	}
+
+	uint8_t *write = NULL;
+	for (size_t i = first; i < mNals.size(); i++) {
+		uint8_t *begin = base + (mNals[i].data - mNals[i].startCodeSize - base);
+		uint8_t *next = i + 1 < mNals.size() ? base + (mNals[i + 1].data - mNals[i + 1].startCodeSize - base) : end;
+		if (IsAUD(mNals[i].type)) {
+			if (write == NULL) {
+				write = begin;
+			}
+			continue;
+		}
+		if (write != NULL) {
+			memmove(write, begin, next - begin);
+			write += next - begin;
+		}
+	}
+	if (write != NULL) {
+		end = write;
+	}
+	*buf = base + (mNals[first].data - mNals[first].startCodeSize - base);
+	*len = static_cast<int>(end - *buf);
+}
+
+bool NalParser::IsAUD(int type) const
+{
+	return type == (mCodec == ALVR_CODEC_H264 ? H264_NAL_AUD : H265_NAL_AUD);
+}
+
+bool NalParser::IsParameterSet(int type) const
+{
+	if (mCodec == ALVR_CODEC_H264) {
+		return type == H264_NAL_SPS || type == H264_NAL_PPS;
+	}
+	return type >= H265_NAL_VPS && type <= H265_NAL_PPS;
+}
+
+bool NalParser::IsSlice(int type) const
+{
+	if (mCodec == ALVR_CODEC_H264) {
+		return type >= H264_NAL_SLICE && type <= H264_NAL_IDR;
+	}
+	return type <= H265_NAL_RSV_VCL_N14 || (type >= H265_NAL_BLA_W_LP && type <= H265_NAL_CRA);
+}
+
+bool NalParser::IsIDR(int type) const
+{
+	if (mCodec == ALVR_CODEC_H264) {
+		return type == H264_NAL_IDR;
+	}
+	return type >= H265_NAL_BLA_W_LP && type <= H265_NAL_CRA;
+}
+
+bool NalParser::IsReference(const NalUnit &nal) const
+{
+	if (mCodec == ALVR_CODEC_H264) {
+		// nal_ref_idc
+		return (nal.data[0] & 0x60) != 0;
+	}
+	// Even types up to RSV_VCL_N14 are sub-layer non-reference pictures.
+	return nal.type > H265_NAL_RSV_VCL_N14 || (nal.type & 1) != 0;
+}
+
+const uint8_t *NalParser::FindStartCode(const uint8_t *begin, const uint8_t *end)
+{
+	static const FindStartCodeFunc find = SelectFindStartCode();
+	return find(begin, end);
+}
+
+const uint8_t *NalParser::FindStartCodeScalar(const uint8_t *begin, const uint8_t *end)
+{
+	const uint8_t *p = begin;
+	while (p + 3 <= end) {
+		if (p[2] > 1) {
+			// p[2] can not be any byte of a start code at p, p + 1 or p + 2.
+			p += 3;
+		}
+		else if (p[2] == 1 && p[1] == 0 && p[0] == 0) {
+			return p;
+		}
+		else {
+			p++;
+		}
+	}
+	return end;
+}
+
+const uint8_t *NalParser::FindStartCodeSSE2(const uint8_t *begin, const uint8_t *end)
+{
+#ifdef NAL_PARSER_X86
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	const uint8_t *p = begin;
+	// Bit i of mask: p[i], p[i + 1], p[i + 2] are 00 00 01.
+	while (end - p >= 16 + 2) {
+		__m128i b0 = _mm_loadu_si128((const __m128i *)p);
+		__m128i b1 = _mm_loadu_si128((const __m128i *)(p + 1));
+		__m128i b2 = _mm_loadu_si128((const __m128i *)(p + 2));
+		__m128i match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)), _mm_cmpeq_epi8(b2, one));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(match);
+		if (mask != 0) {
+			return p + CountTrailingZeros(mask);
+		}
+		p += 16;
+	}
+	return FindStartCodeScalar(p, end);
+#else
+	return FindStartCodeScalar(begin, end);
+#endif
+}
+
+NAL_PARSER_TARGET_AVX2
+const uint8_t *NalParser::FindStartCodeAVX2(const uint8_t *begin, const uint8_t *end)
+{
+#ifdef NAL_PARSER_X86
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi8(1);
+	const uint8_t *p = begin;
+	while (end - p >= 32 + 2) {
+		__m256i b0 = _mm256_loadu_si256((const __m256i *)p);
+		__m256i b1 = _mm256_loadu_si256((const __m256i *)(p + 1));
+		__m256i b2 = _mm256_loadu_si256((const __m256i *)(p + 2));
+		__m256i match = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero), _mm256_cmpeq_epi8(b1, zero)), _mm256_cmpeq_epi8(b2, one));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(match);
+		if (mask != 0) {
+			return p + CountTrailingZeros(mask);
+		}
+		p += 32;
+	}
+	return FindStartCodeSSE2(p, end);
+#else
+	return FindStartCodeScalar(begin, end);
+#endif
+}
+
+bool NalParser::HasAVX2()
+{
+#if defined(NAL_PARSER_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	// OS must save YMM registers on context switch.
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(NAL_PARSER_X86)
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return false;
+#endif
+}
+
+int NalParser::GetType(const uint8_t *header) const
+{
+	if (mCodec == ALVR_CODEC_H264) {
+		return header[0] & 0x1F;
+	}
+	return (header[0] >> 1) & 0x3F;
+}
+
+int NalParser::GetHeaderSize() const
+{
+	return mCodec == ALVR_CODEC_H264 ? 1 : 2;
+}
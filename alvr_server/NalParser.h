@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "packet_types.h"
+
+// NAL unit of an Annex-B byte stream. Points into the parsed buffer, nothing is copied.
+struct NalUnit {
+	// NAL header, just after the start code.
+	const uint8_t *data;
+	// Up to the next start code, without trailing zero bytes.
+	int size;
+	// 3 or 4. Start code begins at data - startCodeSize.
+	int startCodeSize;
+	// nal_unit_type of the codec.
+	int type;
+};
+
+// Parser of H.264 and H.265 Annex-B streams as produced by NVENC and VCE.
+//
+// The cost is in scanning for start codes (00 00 01), which touches every byte of every frame.
+// FindStartCode compares 16 (SSE2) or 32 (AVX2, when the CPU supports it) positions per step and
+// only falls back to bytes at the end of the buffer. Emulation prevention guarantees 00 00 01 does
+// not occur inside a NAL unit, so any match is a real start code.
+//
+// Frame classification follows slice NAL types:
+// - IDR: H.264 IDR slice, H.265 IRAP (BLA, IDR, CRA).
+// - Reference: H.264 slice with nal_ref_idc != 0, H.265 slice which is not a sub-layer non-reference
+//   picture (TRAIL_N, TSA_N, ...).
+// - Non-reference: anything else with a slice, which can be lost without affecting later frames.
+class NalParser {
+public:
+	struct FrameInfo {
+		// ALVR_FRAME_TYPE
+		uint8_t frameType;
+		// Carries SPS/PPS (and VPS for H.265).
+		bool parameterSets;
+		int nalCount;
+	};
+
+	// codec: ALVR_CODEC
+	NalParser(int codec);
+
+	// Replaces contents of nals with NAL units of buf. Bytes before the first start code are ignored.
+	void Parse(const uint8_t *buf, int len, std::vector<NalUnit> &nals) const;
+	FrameInfo Classify(const uint8_t *buf, int len) const;
+	FrameInfo Classify(const std::vector<NalUnit> &nals) const;
+
+	// Removes access unit delimiters from an encoded frame. Leading delimiters are skipped by moving
+	// *buf, which is the common case and copies nothing. Delimiters between other NAL units are
+	// removed by moving the following bytes down in place.
+	void StripAUD(uint8_t **buf, int *len) const;
+
+	bool IsAUD(int type) const;
+	bool IsParameterSet(int type) const;
+	bool IsSlice(int type) const;
+	bool IsIDR(int type) const;
+	bool IsReference(const NalUnit &nal) const;
+	// nal_unit_type of NAL unit whose header starts at header.
+	int GetType(const uint8_t *header) const;
+	// Bytes of NAL header, 1 for H.264 and 2 for H.265.
+	int GetHeaderSize() const;
+
+	// Returns first position of 00 00 01 in [begin, end), or end.
+	static const uint8_t *FindStartCode(const uint8_t *begin, const uint8_t *end);
+	// Implementations behind FindStartCode, for tests and benchmarks. FindStartCodeAVX2 must only be
+	// called if HasAVX2.
+	static const uint8_t *FindStartCodeScalar(const uint8_t *begin, const uint8_t *end);
+	static const uint8_t *FindStartCodeSSE2(const uint8_t *begin, const uint8_t *end);
+	static const uint8_t *FindStartCodeAVX2(const uint8_t *begin, const uint8_t *end);
+	static bool HasAVX2();
+private:
+	int mCodec;
+
+	// Reused by StripAUD and Classify.
+	mutable std::vector<NalUnit> mNals;
+};
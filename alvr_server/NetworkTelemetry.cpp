@@ -0,0 +1,6 @@
+#include "NetworkTelemetry.h"
+
+const int LatencyHistogram::SUB_BUCKET_BITS;
+const int LatencyHistogram::SUB_BUCKETS;
+const int LatencyHistogram::BUCKETS;
+const int NetworkTelemetry::WINDOW_SECONDS;
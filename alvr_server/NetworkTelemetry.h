@@ -0,0 +1,230 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Log-linear histogram of microsecond values, laid out like HdrHistogram.
+// Values below 2 * SUB_BUCKETS are exact. Above that each power of two is split into SUB_BUCKETS,
+// so relative error is below 1 / SUB_BUCKETS. Values are clamped to 32 bits (about 71 minutes).
+// Record is lock-free and may be called from any thread. Counts are cumulative.
+// Counts over an interval are obtained by subtracting an earlier snapshot.
+class LatencyHistogram {
+public:
+	static const int SUB_BUCKET_BITS = 4;
+	static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static const int BUCKETS = 2 * SUB_BUCKETS + (32 - SUB_BUCKET_BITS - 1) * SUB_BUCKETS;
+
+	struct Snapshot {
+		uint64_t counts[BUCKETS];
+		uint64_t total;
+
+		void Subtract(const Snapshot &base) {
+			for (int i = 0; i < BUCKETS; i++) {
+				counts[i] -= base.counts[i];
+			}
+			total -= base.total;
+		}
+
+		// Highest value equivalent to the bucket containing percentile (0-100). 0 if empty.
+		uint64_t ValueAtPercentile(double percentile) const {
+			if (total == 0) {
+				return 0;
+			}
+			uint64_t target = static_cast<uint64_t>(total * percentile / 100.0 + 0.5);
+			target = std::max<uint64_t>(1, std::min(target, total));
+			uint64_t count = 0;
+			for (int i = 0; i < BUCKETS; i++) {
+				count += counts[i];
+				if (count >= target) {
+					return BucketUpperBound(i);
+				}
+			}
+			return BucketUpperBound(BUCKETS - 1);
+		}
+	};
+
+	LatencyHistogram() {
+		Reset();
+	}
+
+	void Record(uint64_t value) {
+		mCounts[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void Read(Snapshot &out) const {
+		out.total = 0;
+		for (int i = 0; i < BUCKETS; i++) {
+			out.counts[i] = mCounts[i].load(std::memory_order_relaxed);
+			out.total += out.counts[i];
+		}
+	}
+
+	// Concurrent Record calls may be lost.
+	void Reset() {
+		for (int i = 0; i < BUCKETS; i++) {
+			mCounts[i].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	static int BucketIndex(uint64_t value) {
+		if (value > UINT32_MAX) {
+			value = UINT32_MAX;
+		}
+		if (value < 2 * SUB_BUCKETS) {
+			return static_cast<int>(value);
+		}
+		int shift = HighestBit(static_cast<uint32_t>(value)) - SUB_BUCKET_BITS;
+		int top = static_cast<int>(value >> shift);
+		return 2 * SUB_BUCKETS + (shift - 1) * SUB_BUCKETS + (top - SUB_BUCKETS);
+	}
+
+	static uint64_t BucketUpperBound(int index) {
+		if (index < 2 * SUB_BUCKETS) {
+			return index;
+		}
+		int shift = (index - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+		uint64_t top = (index - 2 * SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+		return ((top + 1) << shift) - 1;
+	}
+private:
+	std::atomic<uint64_t> mCounts[BUCKETS];
+
+	static int HighestBit(uint32_t value) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, value);
+		return static_cast<int>(index);
+#else
+		return 31 - __builtin_clz(value);
+#endif
+	}
+};
+
+// Network telemetry used to tune bitrate and FEC from tail latency instead of one-second averages.
+//
+// QUEUE_DELAY: time each packet spent in send queue, recorded by ThrottlingBuffer on sendto.
+// RTT: round trip of each TimeSync mode 1 -> 2 exchange.
+// TRANSPORT_LATENCY(_MAX): average and maximum one-way latency the client computed from
+//   VideoFrame::sentTime, from each TimeSync mode 0 report.
+// LOSS_RUN_LENGTH: number of consecutive packets in each PacketErrorReport range.
+// POSE_LATENCY: time from reading each TrackingInfo from socket to return of TrackedDevicePoseUpdated.
+//
+// Jitter is the RFC 3550 interarrival jitter estimator applied to consecutive RTT samples.
+//
+// Record* may be called from any thread. Tick, Reset and Get* must be called from single thread.
+class NetworkTelemetry {
+public:
+	enum Metric {
+		QUEUE_DELAY,
+		RTT,
+		TRANSPORT_LATENCY,
+		TRANSPORT_LATENCY_MAX,
+		LOSS_RUN_LENGTH,
+		POSE_LATENCY,
+		METRIC_COUNT
+	};
+
+	struct Percentiles {
+		uint64_t count;
+		uint64_t p50;
+		uint64_t p95;
+		uint64_t p99;
+		uint64_t max;
+	};
+
+	// Number of one-second intervals kept for Get.
+	static const int WINDOW_SECONDS = 10;
+
+	NetworkTelemetry() {
+		Reset();
+	}
+
+	void Reset() {
+		for (int i = 0; i < METRIC_COUNT; i++) {
+			mHistograms[i].Reset();
+		}
+		mTicks = 0;
+		mLastRtt = 0;
+		mJitter = 0;
+		mHistoryPos = 0;
+		for (int i = 0; i < METRIC_COUNT; i++) {
+			mHistograms[i].Read(mHistory[mHistoryPos][i]);
+		}
+	}
+
+	void RecordQueueDelay(uint64_t us) {
+		mHistograms[QUEUE_DELAY].Record(us);
+	}
+
+	// Must be called from single thread because it updates jitter.
+	void RecordRoundTrip(uint64_t rttUs) {
+		mHistograms[RTT].Record(rttUs);
+		if (mLastRtt != 0) {
+			double d = fabs(static_cast<double>(rttUs) - static_cast<double>(mLastRtt));
+			mJitter += (d - mJitter) / 16.0;
+		}
+		mLastRtt = rttUs;
+	}
+
+	void RecordTransportLatency(uint64_t averageUs, uint64_t maxUs) {
+		mHistograms[TRANSPORT_LATENCY].Record(averageUs);
+		mHistograms[TRANSPORT_LATENCY_MAX].Record(maxUs);
+	}
+
+	void RecordLossRun(uint64_t packets) {
+		mHistograms[LOSS_RUN_LENGTH].Record(packets);
+	}
+
+	void RecordPoseLatency(uint64_t us) {
+		mHistograms[POSE_LATENCY].Record(us);
+	}
+
+	// Close current one-second interval. Called once per second.
+	void Tick() {
+		mHistoryPos = (mHistoryPos + 1) % (WINDOW_SECONDS + 1);
+		for (int i = 0; i < METRIC_COUNT; i++) {
+			mHistograms[i].Read(mHistory[mHistoryPos][i]);
+		}
+		mTicks++;
+	}
+
+	// Percentiles over last completed intervals (1 to WINDOW_SECONDS).
+	Percentiles Get(Metric metric, int seconds) {
+		seconds = std::max(1, std::min(seconds, static_cast<int>(std::min<uint64_t>(mTicks, WINDOW_SECONDS))));
+		Percentiles result = {};
+		if (mTicks == 0) {
+			return result;
+		}
+		int basePos = (mHistoryPos + WINDOW_SECONDS + 1 - seconds) % (WINDOW_SECONDS + 1);
+		mSnapshot = mHistory[mHistoryPos][metric];
+		mSnapshot.Subtract(mHistory[basePos][metric]);
+
+		result.count = mSnapshot.total;
+		result.p50 = mSnapshot.ValueAtPercentile(50);
+		result.p95 = mSnapshot.ValueAtPercentile(95);
+		result.p99 = mSnapshot.ValueAtPercentile(99);
+		result.max = mSnapshot.ValueAtPercentile(100);
+		return result;
+	}
+
+	double GetJitter() {
+		return mJitter;
+	}
+private:
+	LatencyHistogram mHistograms[METRIC_COUNT];
+
+	// Cumulative snapshots at each Tick.
+	LatencyHistogram::Snapshot mHistory[WINDOW_SECONDS + 1][METRIC_COUNT];
+	int mHistoryPos;
+	uint64_t mTicks;
+	LatencyHistogram::Snapshot mSnapshot;
+
+	uint64_t mLastRtt;
+	double mJitter;
+};
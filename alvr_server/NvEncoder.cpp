@@ -9,8 +9,15 @@
 *
 */
 
+#include <chrono>
+#include <thread>
+
 #include "NvEncoder.h"
 
+const uint32_t NvEncoder::SUBFRAME_STATUS_COMPLETE;
+const int NvEncoder::SUBFRAME_POLL_INTERVAL_US;
+const int NvEncoder::SUBFRAME_POLL_TIMEOUT_MS;
+
 #ifndef _WIN32
 #include <cstring>
 static inline bool operator==(const GUID &guid1, const GUID &guid2) {
@@ -271,6 +278,7 @@ void NvEncoder::CreateEncoder(const NV_ENC_INITIALIZE_PARAMS* pEncoderParams)
     NVENC_API_CALL(m_nvenc.nvEncInitializeEncoder(m_hEncoder, &m_initializeParams));
 
     m_bEncoderInitialized = true;
+    m_bSubFrameReadback = m_initializeParams.enableSubFrameWrite && !m_initializeParams.enableEncodeAsync;
     m_nWidth = m_initializeParams.encodeWidth;
     m_nHeight = m_initializeParams.encodeHeight;
     m_nMaxEncodeWidth = m_initializeParams.maxEncodeWidth;
@@ -290,7 +298,8 @@ void NvEncoder::CreateEncoder(const NV_ENC_INITIALIZE_PARAMS* pEncoderParams)
 
     m_vpCompletionEvent.resize(m_nEncoderBuffer, nullptr);
 #if defined(_WIN32)
-    for (int i = 0; i < m_nEncoderBuffer; i++) 
+    // Completion events are for async mode only. Sub-frame readback needs sync mode.
+    for (int i = 0; i < m_nEncoderBuffer && m_initializeParams.enableEncodeAsync; i++) 
     {
         m_vpCompletionEvent[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
         NV_ENC_EVENT_PARAMS eventParams = { NV_ENC_EVENT_PARAMS_VER };
@@ -430,7 +439,81 @@ void NvEncoder::GetSequenceParams(std::vector<uint8_t> &seqParams)
     seqParams.insert(seqParams.end(), &spsppsData[0], &spsppsData[spsppsSize]);
 }
 
-void NvEncoder::DoEncode(NV_ENC_INPUT_PTR inputBuffer, std::vector<std::vector<uint8_t>> &vPacket, NV_ENC_PIC_PARAMS *pPicParams)
+void NvEncoder::EncodeFrameSubFrame(const std::function<void(uint8_t *pData, int nSize, bool bComplete)> &onOutput, NV_ENC_PIC_PARAMS *pPicParams)
+{
+    if (!IsHWEncoderInitialized())
+    {
+        NVENC_THROW_ERROR("Encoder device not found", NV_ENC_ERR_NO_ENCODE_DEVICE);
+    }
+    if (!IsZeroDelay())
+    {
+        NVENC_THROW_ERROR("Sub-frame readback needs zero output delay", NV_ENC_ERR_INVALID_CALL);
+    }
+    int i = m_iToSend % m_nEncoderBuffer;
+    NV_ENC_MAP_INPUT_RESOURCE mapInputResource = { NV_ENC_MAP_INPUT_RESOURCE_VER };
+    mapInputResource.registeredResource = m_vRegisteredResources[i];
+    NVENC_API_CALL(m_nvenc.nvEncMapInputResource(m_hEncoder, &mapInputResource));
+    m_vMappedInputBuffers[i] = mapInputResource.mappedResource;
+
+    NVENCSTATUS nvStatus = SubmitPicture(m_vMappedInputBuffers[i], pPicParams);
+    if (nvStatus != NV_ENC_SUCCESS)
+    {
+        NVENC_THROW_ERROR("nvEncEncodePicture API failed", nvStatus);
+    }
+    m_iToSend++;
+
+    // Sub-frame readback as documented for nvEncLockBitstream: in sync mode, lock with doNotWait to
+    // get what has been written so far, and retry after a short sleep on NV_ENC_ERR_LOCK_BUSY.
+    // hwEncodeStatus SUBFRAME_STATUS_COMPLETE ends polling. This is not confirmed on hardware: if
+    // completion is not reported within SUBFRAME_POLL_TIMEOUT_MS, sub-frame readback is turned off.
+    // The blocking lock below returns the whole frame in any case.
+    uint32_t nWritten = 0;
+    auto pollEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(SUBFRAME_POLL_TIMEOUT_MS);
+    while (m_bSubFrameReadback)
+    {
+        NV_ENC_LOCK_BITSTREAM lockBitstreamData = { NV_ENC_LOCK_BITSTREAM_VER };
+        lockBitstreamData.outputBitstream = m_vBitstreamOutputBuffer[i];
+        lockBitstreamData.doNotWait = true;
+        nvStatus = m_nvenc.nvEncLockBitstream(m_hEncoder, &lockBitstreamData);
+        if (nvStatus == NV_ENC_SUCCESS)
+        {
+            bool bComplete = lockBitstreamData.hwEncodeStatus == SUBFRAME_STATUS_COMPLETE;
+            if (!bComplete && lockBitstreamData.bitstreamSizeInBytes > nWritten)
+            {
+                nWritten = lockBitstreamData.bitstreamSizeInBytes;
+                onOutput((uint8_t *)lockBitstreamData.bitstreamBufferPtr, (int)nWritten, false);
+            }
+            NVENC_API_CALL(m_nvenc.nvEncUnlockBitstream(m_hEncoder, lockBitstreamData.outputBitstream));
+            if (bComplete)
+            {
+                break;
+            }
+        }
+        else if (nvStatus != NV_ENC_ERR_LOCK_BUSY)
+        {
+            NVENC_THROW_ERROR("nvEncLockBitstream API failed", nvStatus);
+        }
+        if (std::chrono::steady_clock::now() >= pollEnd)
+        {
+            m_bSubFrameReadback = false;
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(SUBFRAME_POLL_INTERVAL_US));
+    }
+
+    NV_ENC_LOCK_BITSTREAM lockBitstreamData = { NV_ENC_LOCK_BITSTREAM_VER };
+    lockBitstreamData.outputBitstream = m_vBitstreamOutputBuffer[i];
+    lockBitstreamData.doNotWait = false;
+    NVENC_API_CALL(m_nvenc.nvEncLockBitstream(m_hEncoder, &lockBitstreamData));
+    onOutput((uint8_t *)lockBitstreamData.bitstreamBufferPtr, (int)lockBitstreamData.bitstreamSizeInBytes, true);
+    NVENC_API_CALL(m_nvenc.nvEncUnlockBitstream(m_hEncoder, lockBitstreamData.outputBitstream));
+
+    NVENC_API_CALL(m_nvenc.nvEncUnmapInputResource(m_hEncoder, m_vMappedInputBuffers[i]));
+    m_vMappedInputBuffers[i] = nullptr;
+    m_iGot++;
+}
+
+NVENCSTATUS NvEncoder::SubmitPicture(NV_ENC_INPUT_PTR inputBuffer, NV_ENC_PIC_PARAMS *pPicParams)
 {
     NV_ENC_PIC_PARAMS picParams = {};
     if (pPicParams)
@@ -445,7 +528,12 @@ void NvEncoder::DoEncode(NV_ENC_INPUT_PTR inputBuffer, std::vector<std::vector<u
     picParams.inputHeight = GetEncodeHeight();
     picParams.outputBitstream = m_vBitstreamOutputBuffer[m_iToSend % m_nEncoderBuffer];
     picParams.completionEvent = m_vpCompletionEvent[m_iToSend % m_nEncoderBuffer];
-    NVENCSTATUS nvStatus = m_nvenc.nvEncEncodePicture(m_hEncoder, &picParams);
+    return m_nvenc.nvEncEncodePicture(m_hEncoder, &picParams);
+}
+
+void NvEncoder::DoEncode(NV_ENC_INPUT_PTR inputBuffer, std::vector<std::vector<uint8_t>> &vPacket, NV_ENC_PIC_PARAMS *pPicParams)
+{
+    NVENCSTATUS nvStatus = SubmitPicture(inputBuffer, pPicParams);
     if (nvStatus == NV_ENC_SUCCESS || nvStatus == NV_ENC_ERR_NEED_MORE_INPUT)
     {
         m_iToSend++;
@@ -629,6 +717,11 @@ void NvEncoder::UnregisterResources()
 void NvEncoder::WaitForCompletionEvent(int iEvent)
 {
 #if defined(_WIN32)
+    if (!m_vpCompletionEvent[iEvent])
+    {
+        // Sync mode: nvEncLockBitstream waits.
+        return;
+    }
 #ifdef DEBUG
     WaitForSingleObject(m_vpCompletionEvent[iEvent], INFINITE);
 #else
@@ -12,6 +12,7 @@
 #pragma once
 
 #include <vector>
+#include <functional>
 #include "nvEncodeAPI.h"
 #include <stdint.h>
 #include <mutex>
@@ -125,6 +126,17 @@ public:
     */
     void EncodeFrame(std::vector<std::vector<uint8_t>> &vPacket, NV_ENC_PIC_PARAMS *pPicParams = nullptr);
 
+    /**
+    *  @brief  This function is used to encode a frame with sub-frame readback.
+    *  Like EncodeFrame(), but the bitstream is passed to onOutput while it is
+    *  being written, each time it has grown, and once more whole with
+    *  complete set when the frame is done. The encoder must be created
+    *  without output delay (no B frames or lookahead). Partial output needs
+    *  NV_ENC_INITIALIZE_PARAMS::enableSubFrameWrite in sync mode (enableEncodeAsync 0);
+    *  otherwise, or after IsSubFrameReadback() turned false, only the whole frame is passed.
+    */
+    void EncodeFrameSubFrame(const std::function<void(uint8_t *pData, int nSize, bool bComplete)> &onOutput, NV_ENC_PIC_PARAMS *pPicParams = nullptr);
+
     /**
     *  @brief  This function to flush the encoder queue.
     *  The encoder might be queuing frames for B picture encoding or lookahead;
@@ -151,6 +163,12 @@ public:
     */
     NV_ENC_DEVICE_TYPE GetDeviceType() const { return m_eDeviceType; }
 
+    /**
+    *  @brief  This function returns whether EncodeFrameSubFrame() passes partial output.
+    *  It turns false if the encoder does not report frame completion in time.
+    */
+    bool IsSubFrameReadback() const { return m_bSubFrameReadback; }
+
     /**
     *  @brief  This function is used to get the current encode width.
     *  The encode width can be modified by Reconfigure() function.
@@ -318,6 +336,12 @@ private:
     */
     void DoEncode(NV_ENC_INPUT_PTR inputBuffer, std::vector<std::vector<uint8_t>> &vPacket, NV_ENC_PIC_PARAMS *pPicParams);
 
+    /**
+    *  @brief This is a private function which is used to submit a picture
+    *         to the NVENC hardware. Used by DoEncode() and EncodeFrameSubFrame().
+    */
+    NVENCSTATUS SubmitPicture(NV_ENC_INPUT_PTR inputBuffer, NV_ENC_PIC_PARAMS *pPicParams);
+
     /**
     *  @brief This is a private function which is used to submit the encode
     *         commands to the NVENC hardware for ME only mode.
@@ -392,4 +416,12 @@ private:
     int32_t m_iGot = 0;
     int32_t m_nEncoderBuffer = 0;
     int32_t m_nOutputDelay = 0;
+    bool m_bSubFrameReadback = false;
+    // NV_ENC_LOCK_BITSTREAM::hwEncodeStatus of a completely encoded frame. nvEncodeAPI.h does not
+    // define the values. 2 is what the sub-frame readback section of the NVENC programming guide
+    // polls for, but it has not been verified on hardware, so the feature is off by default
+    // (Settings::m_nvencSubFrameReadback) and turns itself off after SUBFRAME_POLL_TIMEOUT_MS.
+    static const uint32_t SUBFRAME_STATUS_COMPLETE = 2;
+    static const int SUBFRAME_POLL_INTERVAL_US = 500;
+    static const int SUBFRAME_POLL_TIMEOUT_MS = 50;
 };
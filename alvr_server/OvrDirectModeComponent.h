@@ -66,10 +66,6 @@ private:
 
 	
 
-	IPCMutex m_poseMutex;
-	struct TrackingHistoryFrame {
-		TrackingInfo info;
-		vr::HmdMatrix34_t rotationMatrix;
-	};
-	std::list<TrackingHistoryFrame> m_poseBuffer;
+	// Used only while matching submitted pose.
+	TrackingInfo m_poseHistory[ClientConnection::TRACKING_HISTORY_SIZE];
 };
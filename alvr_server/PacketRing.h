@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+#include <memory>
+
+#include "packet_types.h"
+
+static const int CACHE_LINE_SIZE = 64;
+
+// Storage for single UDP datagram. Padded to cache line so neighbouring slots written by
+// producer and read by consumer never share a line.
+struct alignas(CACHE_LINE_SIZE) PacketBuffer {
+	static const int CAPACITY = MAX_PACKET_UDP_PACKET_SIZE;
+
+	int len;
+	uint64_t frameIndex;
+	// Time when packet was queued, for deadline of stale frames.
+	uint64_t queuedUs;
+	// Packets queued together (a video frame with any parity interleaved into it) share pushId.
+	uint64_t pushId;
+	// Offset of uint64_t field which is set to GetTimestampUs() right before sendto, or -1.
+	int timestampOffset;
+	char buf[CAPACITY];
+};
+
+// Bounded lock-free single-producer/single-consumer ring of packet slots.
+// Producer fills slots in place with Reserve() and publishes all reserved slots at once with Commit(),
+// so the consumer never sees partially written frames. Reserve() returns NULL when the ring is full;
+// deciding what to drop is up to the producer.
+// Indices increase monotonically and are masked by capacity, which must be a power of two.
+class PacketRing {
+public:
+	explicit PacketRing(int capacity)
+		: mCapacity(capacity)
+		, mMask(capacity - 1)
+		, mStorage(new char[(capacity + 1) * sizeof(PacketBuffer)])
+	{
+		assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+		// operator new does not honor alignas before C++17.
+		uintptr_t p = reinterpret_cast<uintptr_t>(mStorage.get());
+		mSlots = reinterpret_cast<PacketBuffer *>((p + CACHE_LINE_SIZE - 1) & ~static_cast<uintptr_t>(CACHE_LINE_SIZE - 1));
+	}
+
+	// Producer
+
+	PacketBuffer *Reserve() {
+		if (mReserved - mCachedHead >= mCapacity) {
+			mCachedHead = mHead.load(std::memory_order_acquire);
+			if (mReserved - mCachedHead >= mCapacity) {
+				return NULL;
+			}
+		}
+		PacketBuffer *packet = &mSlots[mReserved & mMask];
+		mReserved++;
+		packet->len = 0;
+		packet->frameIndex = 0;
+		packet->queuedUs = 0;
+		packet->pushId = 0;
+		packet->timestampOffset = -1;
+		return packet;
+	}
+
+	void Commit() {
+		mTail.store(mReserved, std::memory_order_release);
+	}
+
+	void Rollback() {
+		mReserved = mTail.load(std::memory_order_relaxed);
+	}
+
+	// Consumer
+
+	PacketBuffer *Front() {
+		uint64_t head = mHead.load(std::memory_order_relaxed);
+		if (head == mCachedTail) {
+			mCachedTail = mTail.load(std::memory_order_acquire);
+			if (head == mCachedTail) {
+				return NULL;
+			}
+		}
+		return &mSlots[head & mMask];
+	}
+
+	// offset-th committed packet from front, or NULL.
+	PacketBuffer *Peek(int offset) {
+		uint64_t head = mHead.load(std::memory_order_relaxed);
+		if (head + offset >= mCachedTail) {
+			mCachedTail = mTail.load(std::memory_order_acquire);
+			if (head + offset >= mCachedTail) {
+				return NULL;
+			}
+		}
+		return &mSlots[(head + offset) & mMask];
+	}
+
+	void Pop() {
+		mHead.store(mHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Either side
+
+	bool IsEmpty() const {
+		return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+	}
+
+	int Size() const {
+		return static_cast<int>(mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire));
+	}
+
+	int GetCapacity() const {
+		return static_cast<int>(mCapacity);
+	}
+private:
+	const uint64_t mCapacity;
+	const uint64_t mMask;
+	std::unique_ptr<char[]> mStorage;
+	PacketBuffer *mSlots;
+
+	// Written by consumer.
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> mHead{ 0 };
+	uint64_t mCachedTail = 0;
+
+	// Written by producer.
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> mTail{ 0 };
+	uint64_t mReserved = 0;
+	uint64_t mCachedHead = 0;
+
+	PacketRing(const PacketRing &) = delete;
+	PacketRing &operator=(const PacketRing &) = delete;
+};
@@ -1,87 +1,115 @@
+#include <algorithm>
+
 #include "Poller.h"
 #include "Logger.h"
 #include "Utils.h"
 
-Poller::Poller() {
-	FD_ZERO(&mOrgReadFDs);
-	FD_ZERO(&mReadFDs);
-	FD_ZERO(&mOrgWriteFDs);
-	FD_ZERO(&mWriteFDs);
+Poller::Poller(SocketIOBackend backend)
+	: mWaiter(backend)
+	, mWakePending(false)
+{
+	LogDriver("Poller::Poller(). Backend=%hs", GetSocketIOBackendName(mWaiter.GetBackend()));
+#ifdef _WIN32
+	// select() timeout is rounded to system timer resolution (15.6ms by default).
+	timeBeginPeriod(1);
+#endif
 	BindQueueSocket();
 }
 
 Poller::~Poller() {
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
 }
 
+// Returns 0 if woken by timer, Wake() or timeout, otherwise number of ready sockets.
 int Poller::Do() {
-	timeval timeout;
-	timeout.tv_sec = 0;
-	timeout.tv_usec = CalculateNextWake();
-	if (timeout.tv_usec == 0) {
-		Log("Poller::Do(). Wake.");
-		ClearNextWake();
+	uint64_t current = GetCounterUs();
+	if (mTimers.RunExpired(current) > 0) {
+		Log("Poller::Do(). Wake by timer.");
 		return 0;
 	}
-	Log("Poller::Do(). Select %ld us", timeout.tv_usec);
-	memcpy(&mReadFDs, &mOrgReadFDs, sizeof(fd_set));
-	memcpy(&mWriteFDs, &mOrgWriteFDs, sizeof(fd_set));
-	int ret = select(0, &mReadFDs, &mWriteFDs, NULL, &timeout);
+	uint64_t timeout = CalculateWaitTime(current);
+	Log("Poller::Do(). Wait %llu us", timeout);
+	int ret = mWaiter.Wait(timeout, &mCounters);
 	if (ret == SOCKET_ERROR) {
-		LogDriver("select error : %d %ls", WSAGetLastError(), GetErrorStr(WSAGetLastError()).c_str());
+		LogDriver("Poller wait error : %d %ls", GetLastSocketError(), GetErrorStr(GetLastSocketError()).c_str());
 		return ret;
 	}
-	Log("Poller::Do(). Select done. %d", ret);
-	ReadQueueSocket();
+	Log("Poller::Do(). Wait done. %d", ret);
+	if (mWaiter.IsReady(mQueueSocket, false)) {
+		ReadQueueSocket();
+		ret--;
+	}
+	mTimers.RunExpired(GetCounterUs());
 	return ret;
 }
 
 void Poller::AddSocket(SOCKET s, PollerSocketType type) {
-	if (type == PollerSocketType::READ) {
-		FD_SET(s, &mOrgReadFDs);
-	}
-	else {
-		FD_SET(s, &mOrgWriteFDs);
-	}
+	mWaiter.Add(s, type == PollerSocketType::WRITE);
 }
 
 bool Poller::IsPending(SOCKET s, PollerSocketType type) {
-	if (type == PollerSocketType::READ) {
-		return FD_ISSET(s, &mReadFDs);
-	}
-	else {
-		return FD_ISSET(s, &mWriteFDs);
-	}
+	return mWaiter.IsReady(s, type == PollerSocketType::WRITE);
 }
 
 void Poller::RemoveSocket(SOCKET s, PollerSocketType type) {
-	if (type == PollerSocketType::READ) {
-		FD_CLR(s, &mOrgReadFDs);
+	mWaiter.Remove(s, type == PollerSocketType::WRITE);
+}
+
+TimerQueue::TimerId Poller::AddTimer(uint64_t deadlineUs, std::function<void()> callback)
+{
+	return mTimers.Add(deadlineUs, callback);
+}
+
+void Poller::CancelTimer(TimerQueue::TimerId id)
+{
+	mTimers.Cancel(id);
+}
+
+void Poller::WakeAt(uint64_t deadlineUs)
+{
+	if (mWakeTimer != TimerQueue::INVALID_TIMER) {
+		if (mWakeDeadline <= deadlineUs) {
+			return;
+		}
+		mTimers.Cancel(mWakeTimer);
 	}
-	else {
-		FD_CLR(s, &mOrgWriteFDs);
+	mWakeDeadline = deadlineUs;
+	mWakeTimer = mTimers.Add(deadlineUs, [this]() { mWakeTimer = TimerQueue::INVALID_TIMER; });
+}
+
+void Poller::Wake()
+{
+	// One datagram is enough until poller thread drains the queue socket.
+	if (mWakePending.exchange(true)) {
+		return;
 	}
+	sendto(mQueueSocket, "1", 1, 0, (sockaddr *)&mQueueAddr, sizeof(mQueueAddr));
 }
 
-void Poller::WakeLater(uint64_t elapsedMs)
+SocketIOBackend Poller::GetBackend()
 {
-	mNextWake = 900LLU + GetTimestampUs();
+	return mWaiter.GetBackend();
+}
 
-	//sendto(mQueueSocket, "1", 1, 0, (sockaddr *)&mQueueAddr, sizeof(mQueueAddr));
+SocketIOCounters &Poller::GetCounters()
+{
+	return mCounters;
 }
 
 bool Poller::BindQueueSocket()
 {
 	mQueueSocket = socket(AF_INET, SOCK_DGRAM, 0);
 	if (mQueueSocket == INVALID_SOCKET) {
-		FatalLog("Poller::BindQueueSocket socket creation error: %d %ls", WSAGetLastError(), GetErrorStr(WSAGetLastError()).c_str());
+		FatalLog("Poller::BindQueueSocket socket creation error: %d %ls", GetLastSocketError(), GetErrorStr(GetLastSocketError()).c_str());
 		return false;
 	}
 
 	int val = 1;
 	setsockopt(mQueueSocket, SOL_SOCKET, SO_REUSEADDR, (const char *)&val, sizeof(val));
 
-	val = 1;
-	ioctlsocket(mQueueSocket, FIONBIO, (u_long *)&val);
+	SetSocketNonBlocking(mQueueSocket);
 
 	sockaddr_in addr = {};
 	addr.sin_family = AF_INET;
@@ -90,15 +118,15 @@ bool Poller::BindQueueSocket()
 
 	int ret = bind(mQueueSocket, (sockaddr *)&addr, sizeof(addr));
 	if (ret != 0) {
-		FatalLog("Poller::BindQueueSocket bind error : %d %ls", WSAGetLastError(), GetErrorStr(WSAGetLastError()).c_str());
+		FatalLog("Poller::BindQueueSocket bind error : %d %ls", GetLastSocketError(), GetErrorStr(GetLastSocketError()).c_str());
 		return false;
 	}
 
 	memset(&mQueueAddr, 0, sizeof(mQueueAddr));
-	int len = sizeof(mQueueAddr);
+	socklen_t len = sizeof(mQueueAddr);
 	ret = getsockname(mQueueSocket, (sockaddr *)&mQueueAddr, &len);
 	if (ret != 0) {
-		FatalLog("Poller::BindQueueSocket getsockname error : %d %ls", WSAGetLastError(), GetErrorStr(WSAGetLastError()).c_str());
+		FatalLog("Poller::BindQueueSocket getsockname error : %d %ls", GetLastSocketError(), GetErrorStr(GetLastSocketError()).c_str());
 		return false;
 	}
 	char buf[30];
@@ -113,8 +141,9 @@ bool Poller::BindQueueSocket()
 void Poller::ReadQueueSocket()
 {
 	sockaddr_in addr;
-	int addrlen = sizeof(addr);
+	socklen_t addrlen = sizeof(addr);
 	char dummyBuf[1000];
+	mWakePending = false;
 	while (true) {
 		int recvret = recvfrom(mQueueSocket, dummyBuf, sizeof(dummyBuf), 0, (sockaddr *)&addr, &addrlen);
 		if (recvret < 0) {
@@ -123,22 +152,14 @@ void Poller::ReadQueueSocket()
 	}
 }
 
-int Poller::CalculateNextWake()
+uint64_t Poller::CalculateWaitTime(uint64_t current)
 {
-	if (mNextWake == 0) {
+	uint64_t deadline = mTimers.GetNextDeadline();
+	if (deadline == 0) {
 		return DEFAULT_WAIT_TIME_US;
 	}
-	uint64_t current = GetTimestampUs();
-	if (mNextWake < current) {
+	if (deadline <= current) {
 		return 0;
 	}
-	if (mNextWake - current > DEFAULT_WAIT_TIME_US) {
-		return DEFAULT_WAIT_TIME_US;
-	}
-	return mNextWake - current;
-}
-
-void Poller::ClearNextWake()
-{
-	mNextWake = 0;
+	return std::min<uint64_t>(deadline - current, DEFAULT_WAIT_TIME_US);
 }
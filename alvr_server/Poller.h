@@ -1,6 +1,10 @@
 #pragma once
 
+#include <atomic>
+
 #include "Utils.h"
+#include "SocketIO.h"
+#include "TimerQueue.h"
 
 enum PollerSocketType {
 	READ, WRITE
@@ -8,7 +12,7 @@ enum PollerSocketType {
 
 class Poller {
 public:
-	Poller();
+	Poller(SocketIOBackend backend = DEFAULT_SOCKET_IO_BACKEND);
 	~Poller();
 
 	int Do();
@@ -16,19 +20,30 @@ public:
 	bool IsPending(SOCKET s, PollerSocketType type);
 	void RemoveSocket(SOCKET s, PollerSocketType type);
 
-	void WakeLater(uint64_t elapsedMs);
+	// Timers run from Do() on poller thread. Deadlines are in GetCounterUs() time.
+	TimerQueue::TimerId AddTimer(uint64_t deadlineUs, std::function<void()> callback);
+	void CancelTimer(TimerQueue::TimerId id);
+	// Make Do() return no later than deadlineUs. Only earliest pending request is kept.
+	void WakeAt(uint64_t deadlineUs);
+	// Make Do() return as soon as possible. Can be called from any thread.
+	void Wake();
+
+	SocketIOBackend GetBackend();
+	SocketIOCounters &GetCounters();
 private:
-	fd_set mOrgReadFDs;
-	fd_set mReadFDs;
-	fd_set mOrgWriteFDs;
-	fd_set mWriteFDs;
+	SocketWaiter mWaiter;
+	SocketIOCounters mCounters;
 	SOCKET mQueueSocket;
 	sockaddr_in mQueueAddr;
-	uint64_t mNextWake = 0;
+	std::atomic<bool> mWakePending;
+
+	TimerQueue mTimers;
+	TimerQueue::TimerId mWakeTimer = TimerQueue::INVALID_TIMER;
+	uint64_t mWakeDeadline = 0;
+	// Upper bound of wait when no timer is pending.
 	static const int DEFAULT_WAIT_TIME_US = 10 * 1000;
 
 	bool BindQueueSocket();
 	void ReadQueueSocket();
-	int CalculateNextWake();
-	void ClearNextWake();
+	uint64_t CalculateWaitTime(uint64_t current);
 };
\ No newline at end of file
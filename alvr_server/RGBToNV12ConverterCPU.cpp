@@ -0,0 +1,362 @@
+#include <algorithm>
+
+#include "RGBToNV12ConverterCPU.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RGB_TO_NV12_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define RGB_TO_NV12_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__)
+#define RGB_TO_NV12_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define RGB_TO_NV12_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define RGB_TO_NV12_TARGET_SSE41
+#define RGB_TO_NV12_TARGET_AVX2
+#endif
+
+namespace {
+	// round(coefficient * 2^14) of RGBToNV12.cu. Fits int16 for _mm_madd_epi16.
+	const int SHIFT = 14;
+	const int Y_R = 4211;
+	const int Y_G = 8258;
+	const int Y_B = 1606;
+	const int U_R = -2425;
+	const int U_G = -4768;
+	const int U_B = 7193;
+	const int V_R = 7193;
+	const int V_G = -6029;
+	const int V_B = -1163;
+
+	// Offset and rounding. UV is the sum of 4 pixels, so it is shifted 2 more bits.
+	const int Y_OFFSET = (16 << SHIFT) + (1 << (SHIFT - 1));
+	const int UV_SHIFT = SHIFT + 2;
+	const int UV_OFFSET = (128 << UV_SHIFT) + (1 << (UV_SHIFT - 1));
+
+	// Results are in 16-240 and need no clamping.
+	uint8_t ToY(int r, int g, int b) {
+		return static_cast<uint8_t>((Y_R * r + Y_G * g + Y_B * b + Y_OFFSET) >> SHIFT);
+	}
+
+	// r, g, b: sums of the 2x2 block.
+	uint8_t ToU(int r, int g, int b) {
+		return static_cast<uint8_t>((U_R * r + U_G * g + U_B * b + UV_OFFSET) >> UV_SHIFT);
+	}
+
+	uint8_t ToV(int r, int g, int b) {
+		return static_cast<uint8_t>((V_R * r + V_G * g + V_B * b + UV_OFFSET) >> UV_SHIFT);
+	}
+
+	// Pixels [x, width) of a row pair.
+	void ConvertTail(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *uv, int x, int width) {
+		for (; x < width; x += 2) {
+			const uint8_t *c00 = row0 + x * 4;
+			const uint8_t *c01 = c00 + 4;
+			const uint8_t *c10 = row1 + x * 4;
+			const uint8_t *c11 = c10 + 4;
+			y0[x] = ToY(c00[0], c00[1], c00[2]);
+			y0[x + 1] = ToY(c01[0], c01[1], c01[2]);
+			y1[x] = ToY(c10[0], c10[1], c10[2]);
+			y1[x + 1] = ToY(c11[0], c11[1], c11[2]);
+			int r = c00[0] + c01[0] + c10[0] + c11[0];
+			int g = c00[1] + c01[1] + c10[1] + c11[1];
+			int b = c00[2] + c01[2] + c10[2] + c11[2];
+			uv[x] = ToU(r, g, b);
+			uv[x + 1] = ToV(r, g, b);
+		}
+	}
+
+#ifdef RGB_TO_NV12_X86
+	bool HasSSE41() {
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 19)) != 0;
+#else
+		return __builtin_cpu_supports("sse4.1") != 0;
+#endif
+	}
+
+	bool HasAVX2() {
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		// OS must save YMM registers on context switch.
+		if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+#endif
+
+	RGBToNV12ConverterCPU::Kernel SelectKernel() {
+		const RGBToNV12ConverterCPU::Kernel order[] = {
+			RGBToNV12ConverterCPU::KERNEL_AVX2,
+			RGBToNV12ConverterCPU::KERNEL_SSE41,
+			RGBToNV12ConverterCPU::KERNEL_NEON,
+		};
+		for (auto kernel : order) {
+			if (RGBToNV12ConverterCPU::IsSupported(kernel)) {
+				return kernel;
+			}
+		}
+		return RGBToNV12ConverterCPU::KERNEL_SCALAR;
+	}
+}
+
+RGBToNV12ConverterCPU::RGBToNV12ConverterCPU(int threadCount, Kernel kernel)
+	: mWorkers(threadCount)
+	, mKernel(kernel)
+{
+	if (mKernel == KERNEL_AUTO) {
+		mKernel = SelectKernel();
+	}
+	mConvertRows = GetConvertRows(mKernel);
+}
+
+void RGBToNV12ConverterCPU::Convert(const CpuFrame &src, CpuFrame &dst)
+{
+	// Bands are made of row pairs.
+	mWorkers.Run(dst.GetHeight() / 2, [&](int band, int bandCount) {
+		ConvertBand(src, dst, band, bandCount);
+	});
+}
+
+int RGBToNV12ConverterCPU::GetThreadCount() const
+{
+	return mWorkers.GetThreadCount();
+}
+
+RGBToNV12ConverterCPU::Kernel RGBToNV12ConverterCPU::GetKernel() const
+{
+	return mKernel;
+}
+
+void RGBToNV12ConverterCPU::ConvertRowsScalar(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *uv, int width)
+{
+	ConvertTail(row0, row1, y0, y1, uv, 0, width);
+}
+
+#ifdef RGB_TO_NV12_X86
+RGB_TO_NV12_TARGET_SSE41
+void RGBToNV12ConverterCPU::ConvertRowsSSE41(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *uv, int width)
+{
+	// Pixels are widened to 16 bit RGBA and multiplied with (R, G, B, 0) coefficients by
+	// _mm_madd_epi16, which leaves two partial sums per pixel for _mm_hadd_epi32 to add.
+	const __m128i yCoef = _mm_setr_epi16(Y_R, Y_G, Y_B, 0, Y_R, Y_G, Y_B, 0);
+	const __m128i uCoef = _mm_setr_epi16(U_R, U_G, U_B, 0, U_R, U_G, U_B, 0);
+	const __m128i vCoef = _mm_setr_epi16(V_R, V_G, V_B, 0, V_R, V_G, V_B, 0);
+	const __m128i yOffset = _mm_set1_epi32(Y_OFFSET);
+	const __m128i uvOffset = _mm_set1_epi32(UV_OFFSET);
+
+	int x = 0;
+	for (; x + 4 <= width; x += 4) {
+		__m128i p0 = _mm_loadu_si128((const __m128i *)(row0 + x * 4));
+		__m128i p1 = _mm_loadu_si128((const __m128i *)(row1 + x * 4));
+		// Pixels 0-1 and 2-3 of each row.
+		__m128i p0a = _mm_cvtepu8_epi16(p0);
+		__m128i p0b = _mm_cvtepu8_epi16(_mm_srli_si128(p0, 8));
+		__m128i p1a = _mm_cvtepu8_epi16(p1);
+		__m128i p1b = _mm_cvtepu8_epi16(_mm_srli_si128(p1, 8));
+
+		__m128i ya = _mm_hadd_epi32(_mm_madd_epi16(p0a, yCoef), _mm_madd_epi16(p0b, yCoef));
+		__m128i yb = _mm_hadd_epi32(_mm_madd_epi16(p1a, yCoef), _mm_madd_epi16(p1b, yCoef));
+		ya = _mm_srai_epi32(_mm_add_epi32(ya, yOffset), SHIFT);
+		yb = _mm_srai_epi32(_mm_add_epi32(yb, yOffset), SHIFT);
+		__m128i y8 = _mm_packus_epi16(_mm_packs_epi32(ya, yb), _mm_setzero_si128());
+		*(int32_t *)(y0 + x) = _mm_cvtsi128_si32(y8);
+		*(int32_t *)(y1 + x) = _mm_extract_epi32(y8, 1);
+
+		// Both rows are added before the pixels, giving the block sums U0, U1, V0, V1.
+		__m128i u = _mm_hadd_epi32(
+			_mm_add_epi32(_mm_madd_epi16(p0a, uCoef), _mm_madd_epi16(p1a, uCoef)),
+			_mm_add_epi32(_mm_madd_epi16(p0b, uCoef), _mm_madd_epi16(p1b, uCoef)));
+		__m128i v = _mm_hadd_epi32(
+			_mm_add_epi32(_mm_madd_epi16(p0a, vCoef), _mm_madd_epi16(p1a, vCoef)),
+			_mm_add_epi32(_mm_madd_epi16(p0b, vCoef), _mm_madd_epi16(p1b, vCoef)));
+		__m128i c = _mm_srai_epi32(_mm_add_epi32(_mm_hadd_epi32(u, v), uvOffset), UV_SHIFT);
+		c = _mm_shuffle_epi32(c, _MM_SHUFFLE(3, 1, 2, 0));
+		__m128i c8 = _mm_packus_epi16(_mm_packs_epi32(c, c), _mm_setzero_si128());
+		*(int32_t *)(uv + x) = _mm_cvtsi128_si32(c8);
+	}
+	ConvertTail(row0, row1, y0, y1, uv, x, width);
+}
+
+RGB_TO_NV12_TARGET_AVX2
+void RGBToNV12ConverterCPU::ConvertRowsAVX2(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *uv, int width)
+{
+	// As SSE4.1 on 8 pixels. Lanes hold pixels 0-1 and 2-3 of the first widened half and 4-5 and 6-7
+	// of the second, so results come in lane order and are permuted back.
+	const __m256i yCoef = _mm256_setr_epi16(Y_R, Y_G, Y_B, 0, Y_R, Y_G, Y_B, 0, Y_R, Y_G, Y_B, 0, Y_R, Y_G, Y_B, 0);
+	const __m256i uCoef = _mm256_setr_epi16(U_R, U_G, U_B, 0, U_R, U_G, U_B, 0, U_R, U_G, U_B, 0, U_R, U_G, U_B, 0);
+	const __m256i vCoef = _mm256_setr_epi16(V_R, V_G, V_B, 0, V_R, V_G, V_B, 0, V_R, V_G, V_B, 0, V_R, V_G, V_B, 0);
+	const __m256i yOffset = _mm256_set1_epi32(Y_OFFSET);
+	const __m256i uvOffset = _mm256_set1_epi32(UV_OFFSET);
+	// Y comes as pixels 0 1 4 5 2 3 6 7, UV as U0 U2 V0 V2 U1 U3 V1 V3.
+	const __m256i yOrder = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+	const __m256i uvOrder = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+	int x = 0;
+	for (; x + 8 <= width; x += 8) {
+		__m256i p0 = _mm256_loadu_si256((const __m256i *)(row0 + x * 4));
+		__m256i p1 = _mm256_loadu_si256((const __m256i *)(row1 + x * 4));
+		__m256i p0a = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(p0));
+		__m256i p0b = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(p0, 1));
+		__m256i p1a = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(p1));
+		__m256i p1b = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(p1, 1));
+
+		__m256i ya = _mm256_hadd_epi32(_mm256_madd_epi16(p0a, yCoef), _mm256_madd_epi16(p0b, yCoef));
+		__m256i yb = _mm256_hadd_epi32(_mm256_madd_epi16(p1a, yCoef), _mm256_madd_epi16(p1b, yCoef));
+		ya = _mm256_permutevar8x32_epi32(_mm256_srai_epi32(_mm256_add_epi32(ya, yOffset), SHIFT), yOrder);
+		yb = _mm256_permutevar8x32_epi32(_mm256_srai_epi32(_mm256_add_epi32(yb, yOffset), SHIFT), yOrder);
+		__m128i ya16 = _mm_packs_epi32(_mm256_castsi256_si128(ya), _mm256_extracti128_si256(ya, 1));
+		__m128i yb16 = _mm_packs_epi32(_mm256_castsi256_si128(yb), _mm256_extracti128_si256(yb, 1));
+		__m128i y8 = _mm_packus_epi16(ya16, yb16);
+		_mm_storel_epi64((__m128i *)(y0 + x), y8);
+		_mm_storel_epi64((__m128i *)(y1 + x), _mm_srli_si128(y8, 8));
+
+		__m256i u = _mm256_hadd_epi32(
+			_mm256_add_epi32(_mm256_madd_epi16(p0a, uCoef), _mm256_madd_epi16(p1a, uCoef)),
+			_mm256_add_epi32(_mm256_madd_epi16(p0b, uCoef), _mm256_madd_epi16(p1b, uCoef)));
+		__m256i v = _mm256_hadd_epi32(
+			_mm256_add_epi32(_mm256_madd_epi16(p0a, vCoef), _mm256_madd_epi16(p1a, vCoef)),
+			_mm256_add_epi32(_mm256_madd_epi16(p0b, vCoef), _mm256_madd_epi16(p1b, vCoef)));
+		__m256i c = _mm256_srai_epi32(_mm256_add_epi32(_mm256_hadd_epi32(u, v), uvOffset), UV_SHIFT);
+		c = _mm256_permutevar8x32_epi32(c, uvOrder);
+		__m128i c16 = _mm_packs_epi32(_mm256_castsi256_si128(c), _mm256_extracti128_si256(c, 1));
+		_mm_storel_epi64((__m128i *)(uv + x), _mm_packus_epi16(c16, c16));
+	}
+	ConvertRowsSSE41(row0 + x * 4, row1 + x * 4, y0 + x, y1 + x, uv + x, width - x);
+}
+#else
+void RGBToNV12ConverterCPU::ConvertRowsSSE41(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *uv, int width)
+{
+	ConvertRowsScalar(row0, row1, y0, y1, uv, width);
+}
+
+void RGBToNV12ConverterCPU::ConvertRowsAVX2(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *uv, int width)
+{
+	ConvertRowsScalar(row0, row1, y0, y1, uv, width);
+}
+#endif
+
+#ifdef RGB_TO_NV12_NEON
+void RGBToNV12ConverterCPU::ConvertRowsNEON(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *uv, int width)
+{
+	int x = 0;
+	for (; x + 8 <= width; x += 8) {
+		uint8x8x4_t p0 = vld4_u8(row0 + x * 4);
+		uint8x8x4_t p1 = vld4_u8(row1 + x * 4);
+		int16x8_t r0 = vreinterpretq_s16_u16(vmovl_u8(p0.val[0]));
+		int16x8_t g0 = vreinterpretq_s16_u16(vmovl_u8(p0.val[1]));
+		int16x8_t b0 = vreinterpretq_s16_u16(vmovl_u8(p0.val[2]));
+		int16x8_t r1 = vreinterpretq_s16_u16(vmovl_u8(p1.val[0]));
+		int16x8_t g1 = vreinterpretq_s16_u16(vmovl_u8(p1.val[1]));
+		int16x8_t b1 = vreinterpretq_s16_u16(vmovl_u8(p1.val[2]));
+
+		int16x8_t rows[2][3] = { { r0, g0, b0 }, { r1, g1, b1 } };
+		uint8_t *yRows[2] = { y0, y1 };
+		for (int i = 0; i < 2; i++) {
+			int32x4_t low = vdupq_n_s32(Y_OFFSET);
+			int32x4_t high = vdupq_n_s32(Y_OFFSET);
+			low = vmlal_n_s16(low, vget_low_s16(rows[i][0]), Y_R);
+			low = vmlal_n_s16(low, vget_low_s16(rows[i][1]), Y_G);
+			low = vmlal_n_s16(low, vget_low_s16(rows[i][2]), Y_B);
+			high = vmlal_n_s16(high, vget_high_s16(rows[i][0]), Y_R);
+			high = vmlal_n_s16(high, vget_high_s16(rows[i][1]), Y_G);
+			high = vmlal_n_s16(high, vget_high_s16(rows[i][2]), Y_B);
+			int16x8_t y16 = vcombine_s16(vshrn_n_s32(low, SHIFT), vshrn_n_s32(high, SHIFT));
+			vst1_u8(yRows[i] + x, vqmovun_s16(y16));
+		}
+
+		// Block sums: rows added, then adjacent pixels.
+		int32x4_t r = vpaddlq_s16(vaddq_s16(r0, r1));
+		int32x4_t g = vpaddlq_s16(vaddq_s16(g0, g1));
+		int32x4_t b = vpaddlq_s16(vaddq_s16(b0, b1));
+		int32x4_t u = vdupq_n_s32(UV_OFFSET);
+		int32x4_t v = vdupq_n_s32(UV_OFFSET);
+		u = vmlaq_n_s32(u, r, U_R);
+		u = vmlaq_n_s32(u, g, U_G);
+		u = vmlaq_n_s32(u, b, U_B);
+		v = vmlaq_n_s32(v, r, V_R);
+		v = vmlaq_n_s32(v, g, V_G);
+		v = vmlaq_n_s32(v, b, V_B);
+		// Each 16 bit lane holds U in the low byte and V in the high byte, so UV is stored interleaved.
+		uint16x4_t u16 = vreinterpret_u16_s16(vshrn_n_s32(u, UV_SHIFT));
+		uint16x4_t v16 = vreinterpret_u16_s16(vshrn_n_s32(v, UV_SHIFT));
+		vst1_u8(uv + x, vreinterpret_u8_u16(vorr_u16(u16, vshl_n_u16(v16, 8))));
+	}
+	ConvertTail(row0, row1, y0, y1, uv, x, width);
+}
+#else
+void RGBToNV12ConverterCPU::ConvertRowsNEON(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *uv, int width)
+{
+	ConvertRowsScalar(row0, row1, y0, y1, uv, width);
+}
+#endif
+
+bool RGBToNV12ConverterCPU::IsSupported(Kernel kernel)
+{
+	switch (kernel) {
+	case KERNEL_AUTO:
+	case KERNEL_SCALAR:
+		return true;
+#ifdef RGB_TO_NV12_X86
+	case KERNEL_SSE41:
+		return HasSSE41();
+	case KERNEL_AVX2:
+		return HasAVX2() && HasSSE41();
+#endif
+#ifdef RGB_TO_NV12_NEON
+	case KERNEL_NEON:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+RGBToNV12ConverterCPU::ConvertRowsFunc RGBToNV12ConverterCPU::GetConvertRows(Kernel kernel)
+{
+	switch (kernel) {
+	case KERNEL_SSE41:
+		return ConvertRowsSSE41;
+	case KERNEL_AVX2:
+		return ConvertRowsAVX2;
+	case KERNEL_NEON:
+		return ConvertRowsNEON;
+	case KERNEL_AUTO:
+		return GetConvertRows(SelectKernel());
+	default:
+		return ConvertRowsScalar;
+	}
+}
+
+void RGBToNV12ConverterCPU::ConvertBand(const CpuFrame &src, CpuFrame &dst, int band, int bandCount)
+{
+	int pairs = dst.GetHeight() / 2;
+	int begin = pairs * band / bandCount * 2;
+	int end = pairs * (band + 1) / bandCount * 2;
+	int width = dst.GetWidth();
+	for (int y = begin; y < end; y += 2) {
+		const uint8_t *row0 = src.GetPlane(0) + src.GetPitch() * y;
+		uint8_t *y0 = dst.GetPlane(0) + dst.GetPitch() * y;
+		mConvertRows(row0, row0 + src.GetPitch(), y0, y0 + dst.GetPitch(), dst.GetPlane(1) + dst.GetPitch() * (y / 2), width);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "CpuFrame.h"
+#include "BandWorkers.h"
+
+// RGBA to NV12 conversion on CPU, for VideoEncoderSW, debug captures and tests. Uses the coefficients
+// of the CUDA kernel (RGBToNV12.cu): studio range Y in 16-235, and U and V of each 2x2 block averaged.
+//
+// Arithmetic is fixed point with 14 bit coefficients, so every kernel gives the same bytes:
+// ConvertRowsScalar is the reference, and the SIMD kernels (SSE4.1 and AVX2 on x86, NEON on ARM)
+// must match it exactly. Results differ from the floating point formula of the CUDA kernel by at
+// most 1.
+//
+// Convert splits the frame into bands of rows, one per thread of BandWorkers.
+class RGBToNV12ConverterCPU {
+public:
+	enum Kernel {
+		// Fastest kernel supported by the CPU.
+		KERNEL_AUTO,
+		KERNEL_SCALAR,
+		KERNEL_SSE41,
+		KERNEL_AVX2,
+		KERNEL_NEON
+	};
+
+	// threadCount: bands per frame, 0 for one per hardware thread up to BandWorkers::MAX_THREADS.
+	explicit RGBToNV12ConverterCPU(int threadCount = 0, Kernel kernel = KERNEL_AUTO);
+
+	// src: FORMAT_RGBA. dst: FORMAT_NV12 of the same size.
+	void Convert(const CpuFrame &src, CpuFrame &dst);
+
+	int GetThreadCount() const;
+	Kernel GetKernel() const;
+
+	// Kernels behind Convert, for tests and benchmarks. Each converts two rows of width pixels (even)
+	// into two rows of Y and one row of interleaved UV. A kernel must only be called if IsSupported.
+	typedef void(*ConvertRowsFunc)(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *uv, int width);
+	static void ConvertRowsScalar(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *uv, int width);
+	static void ConvertRowsSSE41(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *uv, int width);
+	static void ConvertRowsAVX2(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *uv, int width);
+	static void ConvertRowsNEON(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *uv, int width);
+	static bool IsSupported(Kernel kernel);
+	// Function of kernel, KERNEL_AUTO resolved.
+	static ConvertRowsFunc GetConvertRows(Kernel kernel);
+private:
+	BandWorkers mWorkers;
+	Kernel mKernel;
+	ConvertRowsFunc mConvertRows;
+
+	void ConvertBand(const CpuFrame &src, CpuFrame &dst, int band, int bandCount);
+};
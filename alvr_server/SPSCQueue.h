@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+#include <memory>
+
+#include "PacketRing.h"
+
+// Bounded lock-free single-producer/single-consumer queue of fixed size elements, used to hand
+// received packets between threads. Same protocol as PacketRing: producer fills an element in place
+// with Reserve() and publishes it with Commit(), consumer reads Front() in place and releases it with Pop().
+// Capacity must be a power of two.
+template<typename T>
+class SPSCQueue {
+public:
+	explicit SPSCQueue(int capacity)
+		: mCapacity(capacity)
+		, mMask(capacity - 1)
+		, mSlots(new T[capacity])
+	{
+		assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+	}
+
+	// Producer
+
+	// NULL if queue is full.
+	T *Reserve() {
+		if (mReserved - mCachedHead >= mCapacity) {
+			mCachedHead = mHead.load(std::memory_order_acquire);
+			if (mReserved - mCachedHead >= mCapacity) {
+				return NULL;
+			}
+		}
+		return &mSlots[mReserved++ & mMask];
+	}
+
+	void Commit() {
+		mTail.store(mReserved, std::memory_order_release);
+	}
+
+	// Consumer
+
+	T *Front() {
+		uint64_t head = mHead.load(std::memory_order_relaxed);
+		if (head == mCachedTail) {
+			mCachedTail = mTail.load(std::memory_order_acquire);
+			if (head == mCachedTail) {
+				return NULL;
+			}
+		}
+		return &mSlots[head & mMask];
+	}
+
+	void Pop() {
+		mHead.store(mHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Either side
+
+	bool IsEmpty() const {
+		return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+	}
+
+	int Size() const {
+		return static_cast<int>(mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire));
+	}
+private:
+	const uint64_t mCapacity;
+	const uint64_t mMask;
+	std::unique_ptr<T[]> mSlots;
+
+	// Written by consumer.
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> mHead{ 0 };
+	uint64_t mCachedTail = 0;
+
+	// Written by producer.
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> mTail{ 0 };
+	uint64_t mReserved = 0;
+	uint64_t mCachedHead = 0;
+
+	SPSCQueue(const SPSCQueue &) = delete;
+	SPSCQueue &operator=(const SPSCQueue &) = delete;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+// Latest value of a trivially copyable type, published by a single writer to any number of readers.
+// Write never waits. Read copies the value and retries if a write overlapped it, so readers never block
+// the writer and never see a torn value.
+// The value is stored as relaxed atomic words, so overlapping copies are not data races.
+template<typename T>
+class Seqlock {
+	static_assert(std::is_trivially_copyable<T>::value, "Seqlock value must be trivially copyable");
+public:
+	Seqlock() {
+		for (auto &word : mData) {
+			word.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	// Writer
+
+	void Write(const T &value) {
+		uint64_t words[WORDS];
+		words[WORDS - 1] = 0;
+		memcpy(words, &value, sizeof(T));
+
+		uint64_t sequence = mSequence.load(std::memory_order_relaxed);
+		// Odd while writing.
+		mSequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < WORDS; i++) {
+			mData[i].store(words[i], std::memory_order_relaxed);
+		}
+		mSequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	// Readers
+
+	// Returns sequence of the value read, which is twice the number of writes. 0 if never written.
+	uint64_t Read(T &value) const {
+		uint64_t words[WORDS];
+		uint64_t sequence;
+		while (true) {
+			sequence = mSequence.load(std::memory_order_acquire);
+			if (sequence & 1) {
+				// Writer is in the middle of a copy. Let it finish if it was preempted.
+				std::this_thread::yield();
+				continue;
+			}
+			for (size_t i = 0; i < WORDS; i++) {
+				words[i] = mData[i].load(std::memory_order_relaxed);
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (mSequence.load(std::memory_order_relaxed) == sequence) {
+				break;
+			}
+		}
+		memcpy(&value, words, sizeof(T));
+		return sequence;
+	}
+
+	uint64_t GetSequence() const {
+		return mSequence.load(std::memory_order_acquire);
+	}
+private:
+	static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	std::atomic<uint64_t> mSequence{ 0 };
+	std::atomic<uint64_t> mData[WORDS];
+
+	Seqlock(const Seqlock &) = delete;
+	Seqlock &operator=(const Seqlock &) = delete;
+};
+
+// Last N values pushed by a single writer, readable by any number of readers without locks.
+// Each slot is a Seqlock. A reader which is overtaken while reading history simply gets fewer values.
+template<typename T, int N>
+class SeqlockRing {
+public:
+	// Writer
+
+	void Push(const T &value) {
+		uint64_t count = mCount.load(std::memory_order_relaxed);
+		mSlots[count % N].Write(value);
+		mCount.store(count + 1, std::memory_order_release);
+	}
+
+	// Readers
+
+	// Copies up to maxCount most recent values into values, newest first. Returns number copied.
+	int ReadRecent(T *values, int maxCount) const {
+		uint64_t count = mCount.load(std::memory_order_acquire);
+		int copied = 0;
+		while (copied < maxCount && copied < N && static_cast<uint64_t>(copied) < count) {
+			uint64_t index = count - 1 - copied;
+			// Slot holds value index after its (index / N + 1)-th write. Anything else was overwritten by newer pushes.
+			if (mSlots[index % N].Read(values[copied]) != (index / N + 1) * 2) {
+				break;
+			}
+			copied++;
+		}
+		return copied;
+	}
+
+	uint64_t GetCount() const {
+		return mCount.load(std::memory_order_acquire);
+	}
+private:
+	std::atomic<uint64_t> mCount{ 0 };
+	Seqlock<T> mSlots[N];
+};
@@ -2,6 +2,7 @@
 #include "Logger.h"
 #include "ipctools.h"
 #include "resource.h"
+#include "AudioEncoder.h"
 #define PICOJSON_USE_INT64
 #include <picojson.h>
 
@@ -84,6 +85,7 @@ void Settings::Load()
 		m_force3DOF = v.get(k_pch_Settings_Force3DOF_Bool).get<bool>();
 
 		m_nv12 = v.get(k_pch_Settings_Nv12_Bool).get<bool>();
+		m_softwareEncoder = v.get(k_pch_Settings_SoftwareEncoder_Bool).get<bool>();
 
 		m_aggressiveKeyframeResend = v.get(k_pch_Settings_AggressiveKeyframeResend_Bool).get<bool>();
 
@@ -92,14 +94,16 @@ void Settings::Load()
 		m_codec = (int32_t)v.get(k_pch_Settings_Codec_Int32).get<int64_t>();
 		m_refreshRate = (int)v.get(k_pch_Settings_RefreshRate_Int32).get<int64_t>();
 		mEncodeBitrate = Bitrate::fromMiBits((int)v.get(k_pch_Settings_EncodeBitrateInMBits_Int32).get<int64_t>());
+		m_audioCodec = (int)v.get(k_pch_Settings_AudioCodec_Int32).get<int64_t>();
+		m_audioFec = v.get(k_pch_Settings_AudioFec_Bool).get<bool>();
 
 		if (v.get(k_pch_Settings_DisableThrottling_Bool).get<bool>()) {
 			// No throttling
 			mThrottlingBitrate = Bitrate::fromBits(0);
 		}
 		else {
-			// Audio stream: 48kHz * 16bits * 2ch
-			Bitrate audioBitrate = Bitrate::fromMiBits(2);
+			// Audio stream: 48kHz 2ch, plus 1/3 for headers.
+			Bitrate audioBitrate = Bitrate::fromBits(AudioEncoder::GetBytesPerSecond(m_audioCodec, m_audioFec, 48000, 2) * 8 * 4 / 3);
 			// 50% for mergin
 			mThrottlingBitrate = Bitrate::fromBits(mEncodeBitrate.toBits() * 3 / 2 + audioBitrate.toBits());
 		}
@@ -112,6 +116,15 @@ void Settings::Load()
 
 		m_SendingTimeslotUs = (uint64_t)v.get(k_pch_Settings_SendingTimeslotUs_Int32).get<int64_t>();
 		m_LimitTimeslotPackets = (uint64_t)v.get(k_pch_Settings_LimitTimeslotPackets_Int32).get<int64_t>();
+		m_framePacing = v.get(k_pch_Settings_FramePacing_Bool).get<bool>();
+		m_adaptiveFec = v.get(k_pch_Settings_AdaptiveFec_Bool).get<bool>();
+		m_maxFecPercentage = (int)v.get(k_pch_Settings_MaxFecPercentage_Int32).get<int64_t>();
+		m_idrFecPercentage = (int)v.get(k_pch_Settings_IdrFecPercentage_Int32).get<int64_t>();
+		m_fecInterleaveDepth = (int)v.get(k_pch_Settings_FecInterleaveDepth_Int32).get<int64_t>();
+		m_fecInterleaveMaxDelayUs = (uint64_t)v.get(k_pch_Settings_FecInterleaveMaxDelayUs_Int32).get<int64_t>();
+		m_sliceCount = (int)v.get(k_pch_Settings_SliceCount_Int32).get<int64_t>();
+		m_nvencSubFrameReadback = v.get(k_pch_Settings_NvencSubFrameReadback_Bool).get<bool>();
+		m_trackingThread = v.get(k_pch_Settings_TrackingThread_Bool).get<bool>();
 
 		m_ControlHost = v.get(k_pch_Settings_ControlListenHost_String).get<std::string>();
 		m_ControlPort = (int)v.get(k_pch_Settings_ControlListenPort_Int32).get<int64_t>();
@@ -165,6 +178,9 @@ void Settings::Load()
 		m_foveationStrength = (float)v.get(k_pch_Settings_foveationStrength_Float).get<double>();
 		m_foveationShape = (float)v.get(k_pch_Settings_foveationShape_Float).get<double>();
 		m_foveationVerticalOffset = (float)v.get(k_pch_Settings_foveationVerticalOffset_Float).get<double>();
+		m_adaptiveFoveation = v.get(k_pch_Settings_AdaptiveFoveation_Bool).get<bool>();
+		m_foveationMaxStrength = (float)v.get(k_pch_Settings_FoveationMaxStrength_Float).get<double>();
+		m_minEncodeBitrateInMBits = (int)v.get(k_pch_Settings_MinEncodeBitrateInMBits_Int32).get<int64_t>();
 
 		m_enableColorCorrection = v.get(k_pch_Settings_EnableColorCorrection_Bool).get<bool>();
 		m_brightness = (float)v.get(k_pch_Settings_Brightness_Float).get<double>();
@@ -185,6 +201,14 @@ void Settings::Load()
 		LogDriver("Render Target: %d %d", m_renderWidth, m_renderHeight);
 		LogDriver("Seconds from Vsync to Photons: %f", m_flSecondsFromVsyncToPhotons);
 		LogDriver("Refresh Rate: %d", m_refreshRate);
+		LogDriver("Frame Pacing: %d", m_framePacing);
+		LogDriver("Adaptive FEC: %d Max FEC Percentage: %d IDR FEC Percentage: %d", m_adaptiveFec, m_maxFecPercentage, m_idrFecPercentage);
+		LogDriver("FEC Interleave Depth: %d Max Delay: %llu us", m_fecInterleaveDepth, m_fecInterleaveMaxDelayUs);
+		LogDriver("Slice Count: %d NVENC Sub-frame Readback: %d", m_sliceCount, m_nvencSubFrameReadback);
+		LogDriver("Adaptive Foveation: %d Max Strength: %f Min Bitrate: %d Mbps", m_adaptiveFoveation, m_foveationMaxStrength, m_minEncodeBitrateInMBits);
+		LogDriver("Software Encoder: %d", m_softwareEncoder);
+		LogDriver("Tracking Thread: %d", m_trackingThread);
+		LogDriver("Audio Codec: %d FEC: %d", m_audioCodec, m_audioFec);
 		LogDriver("IPD: %f", m_flIPD);
 
 		LogDriver("debugOptions: Log:%d FrameIndex:%d FrameOutput:%d CaptureOutput:%d UseKeyedMutex:%d"
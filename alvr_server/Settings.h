@@ -33,6 +33,7 @@ static const char * const k_pch_Settings_Force60HZ_Bool = "force60HZ";
 
 static const char * const k_pch_Settings_Force3DOF_Bool = "force3DOF";
 static const char* const k_pch_Settings_Nv12_Bool = "nv12";
+static const char * const k_pch_Settings_SoftwareEncoder_Bool = "softwareEncoder";
 
 static const char * const k_pch_Settings_AggressiveKeyframeResend_Bool = "aggressiveKeyframeResend";
 
@@ -61,6 +62,17 @@ static const char * const k_pch_Settings_AdapterIndex_Int32 = "adapterIndex";
 
 static const char * const k_pch_Settings_SendingTimeslotUs_Int32 = "sendingTimeslotUs";
 static const char * const k_pch_Settings_LimitTimeslotPackets_Int32 = "limitTimeslotPackets";
+static const char * const k_pch_Settings_FramePacing_Bool = "framePacing";
+static const char * const k_pch_Settings_AdaptiveFec_Bool = "adaptiveFec";
+static const char * const k_pch_Settings_MaxFecPercentage_Int32 = "maxFecPercentage";
+static const char * const k_pch_Settings_FecInterleaveDepth_Int32 = "fecInterleaveDepth";
+static const char * const k_pch_Settings_FecInterleaveMaxDelayUs_Int32 = "fecInterleaveMaxDelayUs";
+static const char * const k_pch_Settings_IdrFecPercentage_Int32 = "idrFecPercentage";
+static const char * const k_pch_Settings_SliceCount_Int32 = "sliceCount";
+static const char * const k_pch_Settings_NvencSubFrameReadback_Bool = "nvencSubFrameReadback";
+static const char * const k_pch_Settings_TrackingThread_Bool = "trackingThread";
+static const char * const k_pch_Settings_AudioCodec_Int32 = "audioCodec";
+static const char * const k_pch_Settings_AudioFec_Bool = "audioFec";
 
 static const char * const k_pch_Settings_ControllerTrackingSystemName_String = "controllerTrackingSystemName";
 static const char * const k_pch_Settings_ControllerManufacturerName_String = "controllerManufacturerName";
@@ -102,6 +114,9 @@ static const char * const k_pch_Settings_foveationMode_Int32 = "foveationMode";
 static const char * const k_pch_Settings_foveationStrength_Float = "foveationStrength";
 static const char * const k_pch_Settings_foveationShape_Float = "foveationShape";
 static const char * const k_pch_Settings_foveationVerticalOffset_Float = "foveationVerticalOffset";
+static const char * const k_pch_Settings_AdaptiveFoveation_Bool = "adaptiveFoveation";
+static const char * const k_pch_Settings_FoveationMaxStrength_Float = "foveationMaxStrength";
+static const char * const k_pch_Settings_MinEncodeBitrateInMBits_Int32 = "minEncodeBitrateInMBits";
 
 static const char* const k_pch_Settings_EnableColorCorrection_Bool = "enableColorCorrection";
 static const char* const k_pch_Settings_Brightness_Float = "brightness";
@@ -133,6 +148,10 @@ class Settings
 
 public:
 	void Load();
+	// For headless tools which set the members they need instead of Load().
+	void MarkLoaded() {
+		m_loaded = true;
+	}
 	static Settings &Instance() {
 		return m_Instance;
 	}
@@ -177,6 +196,12 @@ public:
 	float m_foveationStrength;
 	float m_foveationShape;
 	float m_foveationVerticalOffset;
+	// Lower the encode bitrate to the bandwidth the link delivers and raise foveation strength with it, up
+	// to m_foveationMaxStrength, to keep the center of the view sharp (FoveationController). Bitrate
+	// stays at or above m_minEncodeBitrateInMBits. Only with foveation enabled.
+	bool m_adaptiveFoveation;
+	float m_foveationMaxStrength;
+	int m_minEncodeBitrateInMBits;
 
 	bool m_enableColorCorrection;
 	float m_brightness;
@@ -211,6 +236,30 @@ public:
 
 	uint64_t m_SendingTimeslotUs;
 	uint64_t m_LimitTimeslotPackets;
+	// Spread packets of each video frame over frame interval and drop stale frames.
+	bool m_framePacing;
+	// Choose FEC percentage per frame from client loss reports (AdaptiveFECPolicy) instead of StepFECPolicy.
+	bool m_adaptiveFec;
+	int m_maxFecPercentage;
+	// Lowest FEC percentage of IDR frames and parameter sets (UnequalFECPolicy). 0 protects them like other frames.
+	int m_idrFecPercentage;
+	// Spread parity of each video frame over this many following frames (FECInterleaver). 0 disables.
+	// Limited so that parity is not delayed more than m_fecInterleaveMaxDelayUs.
+	int m_fecInterleaveDepth;
+	uint64_t m_fecInterleaveMaxDelayUs;
+	// Encode each frame in this many slices and send each slice as soon as it is encoded (SliceStreamer).
+	// 1 sends whole frames.
+	int m_sliceCount;
+	// Read NVENC output while the frame is being encoded, so that slices are sent before the frame is
+	// done. Completion is detected by an hwEncodeStatus value which is not confirmed on hardware yet.
+	bool m_nvencSubFrameReadback;
+	// Receive on a dedicated real-time priority thread (IngressThread) which handles TrackingInfo inline,
+	// instead of on the connection thread between sends and control commands.
+	bool m_trackingThread;
+	// ALVR_AUDIO_CODEC of game audio stream.
+	int m_audioCodec;
+	// Carry previous audio frame in each frame so that client can recover a lost one (ADPCM only).
+	bool m_audioFec;
 
 	uint32_t m_clientRecvBufferSize;
 
@@ -219,6 +268,8 @@ public:
 	bool m_force60HZ;
 
 	bool m_nv12;
+	// Encode on CPU with VideoEncoderSW instead of a GPU encoder. Never chosen automatically.
+	bool m_softwareEncoder;
 
 	// Controller configs
 	std::string m_controllerTrackingSystemName;
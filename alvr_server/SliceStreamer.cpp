@@ -0,0 +1,78 @@
+#include <algorithm>
+
+#include "SliceStreamer.h"
+
+const int SliceStreamer::MAX_SLICE_COUNT;
+
+SliceStreamer::SliceStreamer(int codec, int sliceCount, Callback callback)
+	: mParser(codec)
+	, mSliceCount(std::min(std::max(sliceCount, 1), MAX_SLICE_COUNT))
+	, mCallback(callback)
+{
+	Reset();
+}
+
+void SliceStreamer::Update(uint8_t *buf, int len, bool nalEnd)
+{
+	while (mScan < len) {
+		const uint8_t *start = NalParser::FindStartCode(buf + mScan, buf + len);
+		if (start == buf + len) {
+			// Keep the last two bytes, they may be the beginning of a start code.
+			mScan = std::max(mScan, len - 2);
+			break;
+		}
+		int position = static_cast<int>(start - buf);
+		int header = position + 3;
+		if (header + mParser.GetHeaderSize() > len) {
+			// Type is not known yet.
+			mScan = position;
+			break;
+		}
+
+		if (mHasSlice) {
+			// Units begin with the 4 byte start code, as frames do.
+			Emit(buf, position > mSent && buf[position - 1] == 0 ? position - 1 : position);
+		}
+		if (mParser.IsSlice(mParser.GetType(buf + header))) {
+			mHasSlice = true;
+		}
+		mScan = header + mParser.GetHeaderSize();
+	}
+	if (nalEnd && mHasSlice) {
+		Emit(buf, len);
+	}
+}
+
+void SliceStreamer::End(uint8_t *buf, int len)
+{
+	Update(buf, len);
+	if (len > mSent) {
+		mCallback(buf + mSent, len - mSent, mSliceIndex, mSliceIndex + 1);
+	}
+	Reset();
+}
+
+int SliceStreamer::GetSliceCount() const
+{
+	return mSliceCount;
+}
+
+void SliceStreamer::Emit(uint8_t *buf, int end)
+{
+	if (mSliceIndex >= mSliceCount - 1) {
+		// Last unit takes the rest of the frame.
+		return;
+	}
+	mCallback(buf + mSent, end - mSent, mSliceIndex, mSliceCount);
+	mSent = end;
+	mSliceIndex++;
+	mHasSlice = false;
+}
+
+void SliceStreamer::Reset()
+{
+	mSent = 0;
+	mScan = 0;
+	mSliceIndex = 0;
+	mHasSlice = false;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+#include "NalParser.h"
+
+// Splits an encoded frame into sliceCount units as the encoder writes it, so that each unit can be
+// FEC protected and sent before the rest of the frame is encoded.
+//
+// The encoder is configured for sliceCount slices per frame. Update is called with the bitstream of
+// the current frame written so far, which only grows, and End with the whole frame. A unit is one
+// slice NAL unit with the NAL units before it (parameter sets, SEI). It is complete, and passed to
+// the callback, as soon as the start code of the next NAL unit is visible, or when Update is told
+// that the data ends with a whole NAL unit. The last unit is only passed by End and takes everything
+// left, so there are never more than sliceCount units.
+//
+// Units before the last are passed with the configured sliceCount. The last one is passed with the
+// actual number of units, which is less only if the encoder produced fewer slices than configured.
+//
+// With sliceCount 1 the frame is passed whole by End.
+class SliceStreamer {
+public:
+	// buf, len: unit. Valid during the call.
+	typedef std::function<void(uint8_t *buf, int len, int sliceIndex, int sliceCount)> Callback;
+
+	// codec: ALVR_CODEC
+	SliceStreamer(int codec, int sliceCount, Callback callback);
+
+	// buf holds the first len bytes of the current frame. buf may move between calls, but bytes
+	// already written must not change. nalEnd: len is at the end of a NAL unit, as with encoders
+	// which write whole slices.
+	void Update(uint8_t *buf, int len, bool nalEnd = false);
+	// Passes the rest of the frame and starts the next one.
+	void End(uint8_t *buf, int len);
+
+	int GetSliceCount() const;
+
+	// VideoFrame::sliceCount is 8 bit.
+	static const int MAX_SLICE_COUNT = 255;
+private:
+	NalParser mParser;
+	int mSliceCount;
+	Callback mCallback;
+
+	// Bytes of the frame passed to callback.
+	int mSent;
+	// Start codes before this have been handled.
+	int mScan;
+	int mSliceIndex;
+	// Current unit has a slice NAL unit, so the next NAL unit begins a new one.
+	bool mHasSlice;
+
+	void Emit(uint8_t *buf, int end);
+	void Reset();
+};
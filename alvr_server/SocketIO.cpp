@@ -0,0 +1,428 @@
+#include "SocketIO.h"
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <netinet/udp.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#elif !defined(_WIN32)
+#include <fcntl.h>
+#endif
+
+namespace {
+#ifdef __linux__
+	// Kernel limits for single GSO send.
+	const int GSO_MAX_SEGMENTS = 64;
+	const int GSO_MAX_BYTES = 65000;
+	const int MAX_SEND_MESSAGES = 64;
+	const int MAX_SEND_IOV = 1024;
+
+	bool gGSOAvailable = true;
+
+	int SendBatchMmsg(SOCKET s, const sockaddr_in *addr, const SendDatagram *datagrams, int count, bool gso, SocketIOCounters *counters) {
+		mmsghdr msgs[MAX_SEND_MESSAGES];
+		iovec iovs[MAX_SEND_IOV];
+		int segments[MAX_SEND_MESSAGES];
+		union {
+			char buf[CMSG_SPACE(sizeof(uint16_t))];
+			cmsghdr align;
+		} controls[MAX_SEND_MESSAGES];
+
+		int sent = 0;
+		while (sent < count) {
+			bool useGSO = gso && gGSOAvailable;
+			int messages = 0;
+			int iov = 0;
+			int next = sent;
+			while (next < count && messages < MAX_SEND_MESSAGES && iov < MAX_SEND_IOV) {
+				mmsghdr &msg = msgs[messages];
+				memset(&msg, 0, sizeof(msg));
+				msg.msg_hdr.msg_name = (void *)addr;
+				msg.msg_hdr.msg_namelen = sizeof(*addr);
+				msg.msg_hdr.msg_iov = &iovs[iov];
+
+				int segmentSize = datagrams[next].len;
+				int bytes = 0;
+				int n = 0;
+				// Coalesce run of equal length datagrams. Last segment may be shorter.
+				while (next < count && iov < MAX_SEND_IOV && n < (useGSO ? GSO_MAX_SEGMENTS : 1)) {
+					int len = datagrams[next].len;
+					if (n > 0 && (len > segmentSize || bytes + len > GSO_MAX_BYTES)) {
+						break;
+					}
+					iovs[iov].iov_base = (void *)datagrams[next].buf;
+					iovs[iov].iov_len = len;
+					iov++;
+					next++;
+					n++;
+					bytes += len;
+					if (len < segmentSize) {
+						break;
+					}
+				}
+				msg.msg_hdr.msg_iovlen = n;
+				if (n > 1) {
+					msg.msg_hdr.msg_control = controls[messages].buf;
+					msg.msg_hdr.msg_controllen = sizeof(controls[messages].buf);
+					cmsghdr *cm = CMSG_FIRSTHDR(&msg.msg_hdr);
+					cm->cmsg_level = SOL_UDP;
+					cm->cmsg_type = UDP_SEGMENT;
+					cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+					uint16_t size = static_cast<uint16_t>(segmentSize);
+					memcpy(CMSG_DATA(cm), &size, sizeof(size));
+				}
+				segments[messages] = n;
+				messages++;
+			}
+
+			if (counters) {
+				counters->sendCalls++;
+			}
+			int ret = sendmmsg(s, msgs, messages, 0);
+			if (ret < 0) {
+				if (useGSO && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+					// Kernel or device without UDP GSO. Fall back to one datagram per message.
+					gGSOAvailable = false;
+					continue;
+				}
+				break;
+			}
+			for (int i = 0; i < ret; i++) {
+				sent += segments[i];
+			}
+			if (ret < messages) {
+				break;
+			}
+		}
+		return sent;
+	}
+
+	int RecvBatchMmsg(SOCKET s, RecvDatagram *datagrams, int count, SocketIOCounters *counters) {
+		mmsghdr msgs[SOCKET_IO_MAX_RECV_BATCH];
+		iovec iovs[SOCKET_IO_MAX_RECV_BATCH];
+		count = std::min(count, SOCKET_IO_MAX_RECV_BATCH);
+
+		memset(msgs, 0, sizeof(mmsghdr) * count);
+		for (int i = 0; i < count; i++) {
+			iovs[i].iov_base = datagrams[i].buf;
+			iovs[i].iov_len = sizeof(datagrams[i].buf);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &datagrams[i].addr;
+			msgs[i].msg_hdr.msg_namelen = sizeof(datagrams[i].addr);
+		}
+		if (counters) {
+			counters->recvCalls++;
+		}
+		int ret = recvmmsg(s, msgs, count, MSG_DONTWAIT, NULL);
+		if (ret < 0) {
+			return IsSocketWouldBlock(errno) ? 0 : -1;
+		}
+		for (int i = 0; i < ret; i++) {
+			datagrams[i].len = msgs[i].msg_len;
+		}
+		return ret;
+	}
+#endif
+
+	int SendBatchSelect(SOCKET s, const sockaddr_in *addr, const SendDatagram *datagrams, int count, SocketIOCounters *counters) {
+		int sent = 0;
+		for (; sent < count; sent++) {
+			if (counters) {
+				counters->sendCalls++;
+			}
+			int ret = sendto(s, datagrams[sent].buf, datagrams[sent].len, 0, (const sockaddr *)addr, sizeof(*addr));
+			if (ret < 0) {
+				break;
+			}
+		}
+		return sent;
+	}
+
+	int RecvBatchSelect(SOCKET s, RecvDatagram *datagrams, int count, SocketIOCounters *counters) {
+		int received = 0;
+		for (; received < count; received++) {
+			socklen_t addrlen = sizeof(datagrams[received].addr);
+			if (counters) {
+				counters->recvCalls++;
+			}
+			int ret = recvfrom(s, datagrams[received].buf, sizeof(datagrams[received].buf), 0
+				, (sockaddr *)&datagrams[received].addr, &addrlen);
+			if (ret < 0) {
+				if (received == 0 && !IsSocketWouldBlock(GetLastSocketError())) {
+					return -1;
+				}
+				break;
+			}
+			datagrams[received].len = ret;
+		}
+		return received;
+	}
+}
+
+bool IsSocketIOBackendAvailable(SocketIOBackend backend) {
+#ifdef __linux__
+	(void)backend;
+	return true;
+#else
+	return backend == SOCKET_IO_SELECT;
+#endif
+}
+
+const char *GetSocketIOBackendName(SocketIOBackend backend) {
+	return backend == SOCKET_IO_EPOLL ? "epoll" : "select";
+}
+
+int GetLastSocketError() {
+#ifdef _WIN32
+	return WSAGetLastError();
+#else
+	return errno;
+#endif
+}
+
+bool IsSocketWouldBlock(int error) {
+#ifdef _WIN32
+	return error == WSAEWOULDBLOCK;
+#else
+	return error == EAGAIN || error == EWOULDBLOCK;
+#endif
+}
+
+bool SetSocketNonBlocking(SOCKET s) {
+#ifdef _WIN32
+	u_long val = 1;
+	return ioctlsocket(s, FIONBIO, &val) == 0;
+#else
+	int flags = fcntl(s, F_GETFL, 0);
+	return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+int RecvBatch(SocketIOBackend backend, SOCKET s, RecvDatagram *datagrams, int count, SocketIOCounters *counters) {
+	int ret;
+#ifdef __linux__
+	if (backend == SOCKET_IO_EPOLL) {
+		ret = RecvBatchMmsg(s, datagrams, count, counters);
+	}
+	else
+#endif
+	{
+		ret = RecvBatchSelect(s, datagrams, count, counters);
+	}
+	if (ret > 0 && counters) {
+		counters->datagramsReceived += ret;
+	}
+	return ret;
+}
+
+int SendBatch(SocketIOBackend backend, SOCKET s, const sockaddr_in *addr, const SendDatagram *datagrams, int count
+	, bool gso, SocketIOCounters *counters) {
+	int ret;
+#ifdef __linux__
+	if (backend == SOCKET_IO_EPOLL) {
+		ret = SendBatchMmsg(s, addr, datagrams, count, gso, counters);
+	}
+	else
+#endif
+	{
+		ret = SendBatchSelect(s, addr, datagrams, count, counters);
+	}
+	if (counters) {
+		counters->datagramsSent += ret;
+	}
+	return ret;
+}
+
+SocketWaiter::SocketWaiter(SocketIOBackend backend)
+	: mBackend(IsSocketIOBackendAvailable(backend) ? backend : SOCKET_IO_SELECT)
+{
+	FD_ZERO(&mOrgReadFDs);
+	FD_ZERO(&mReadFDs);
+	FD_ZERO(&mOrgWriteFDs);
+	FD_ZERO(&mWriteFDs);
+#ifdef __linux__
+	if (mBackend == SOCKET_IO_EPOLL) {
+		mEpollFD = epoll_create1(EPOLL_CLOEXEC);
+		if (mEpollFD < 0) {
+			mBackend = SOCKET_IO_SELECT;
+		}
+		else {
+			// epoll_wait timeout is in milliseconds. Timer fd gives us microsecond deadlines.
+			mTimerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+			if (mTimerFD >= 0) {
+				epoll_event ev = {};
+				ev.events = EPOLLIN;
+				ev.data.fd = mTimerFD;
+				epoll_ctl(mEpollFD, EPOLL_CTL_ADD, mTimerFD, &ev);
+			}
+		}
+	}
+#endif
+}
+
+SocketWaiter::~SocketWaiter() {
+#ifdef __linux__
+	if (mTimerFD >= 0) {
+		close(mTimerFD);
+	}
+	if (mEpollFD >= 0) {
+		close(mEpollFD);
+	}
+#endif
+}
+
+void SocketWaiter::Add(SOCKET s, bool write) {
+#ifdef __linux__
+	if (mBackend == SOCKET_IO_EPOLL) {
+		uint32_t flag = write ? EPOLLOUT : EPOLLIN;
+		Interest *interest = FindInterest(s);
+		epoll_event ev = {};
+		ev.data.fd = s;
+		if (interest == NULL) {
+			mInterests.push_back({ s, flag, 0 });
+			ev.events = flag;
+			epoll_ctl(mEpollFD, EPOLL_CTL_ADD, s, &ev);
+		}
+		else {
+			interest->events |= flag;
+			ev.events = interest->events;
+			epoll_ctl(mEpollFD, EPOLL_CTL_MOD, s, &ev);
+		}
+		return;
+	}
+#endif
+	FD_SET(s, write ? &mOrgWriteFDs : &mOrgReadFDs);
+	if (std::find(mSockets.begin(), mSockets.end(), s) == mSockets.end()) {
+		mSockets.push_back(s);
+	}
+}
+
+void SocketWaiter::Remove(SOCKET s, bool write) {
+#ifdef __linux__
+	if (mBackend == SOCKET_IO_EPOLL) {
+		Interest *interest = FindInterest(s);
+		if (interest == NULL) {
+			return;
+		}
+		interest->events &= ~(write ? EPOLLOUT : EPOLLIN);
+		interest->ready &= ~(write ? EPOLLOUT : EPOLLIN);
+		epoll_event ev = {};
+		ev.data.fd = s;
+		ev.events = interest->events;
+		if (interest->events == 0) {
+			epoll_ctl(mEpollFD, EPOLL_CTL_DEL, s, &ev);
+			mInterests.erase(mInterests.begin() + (interest - &mInterests[0]));
+		}
+		else {
+			epoll_ctl(mEpollFD, EPOLL_CTL_MOD, s, &ev);
+		}
+		return;
+	}
+#endif
+	FD_CLR(s, write ? &mOrgWriteFDs : &mOrgReadFDs);
+	FD_CLR(s, write ? &mWriteFDs : &mReadFDs);
+	if (!FD_ISSET(s, &mOrgReadFDs) && !FD_ISSET(s, &mOrgWriteFDs)) {
+		mSockets.erase(std::remove(mSockets.begin(), mSockets.end(), s), mSockets.end());
+	}
+}
+
+int SocketWaiter::Wait(uint64_t timeoutUs, SocketIOCounters *counters) {
+	if (counters) {
+		counters->waitCalls++;
+	}
+#ifdef __linux__
+	if (mBackend == SOCKET_IO_EPOLL) {
+		for (auto &interest : mInterests) {
+			interest.ready = 0;
+		}
+		epoll_event events[16];
+		// Round up so we never wake before the deadline.
+		int timeoutMs = static_cast<int>((timeoutUs + 999) / 1000);
+		if (timeoutUs > 0 && mTimerFD >= 0) {
+			// Re-arming also clears expiration left from previous wait.
+			itimerspec spec = {};
+			spec.it_value.tv_sec = static_cast<time_t>(timeoutUs / 1000000);
+			spec.it_value.tv_nsec = static_cast<long>(timeoutUs % 1000000) * 1000;
+			if (timerfd_settime(mTimerFD, 0, &spec, NULL) == 0) {
+				timeoutMs = -1;
+			}
+		}
+		int ret = epoll_wait(mEpollFD, events, 16, timeoutMs);
+		if (ret < 0) {
+			return errno == EINTR ? 0 : -1;
+		}
+		int ready = 0;
+		for (int i = 0; i < ret; i++) {
+			if (events[i].data.fd == mTimerFD) {
+				continue;
+			}
+			ready++;
+			Interest *interest = FindInterest(events[i].data.fd);
+			if (interest != NULL) {
+				// Errors and hangups are reported as readable so that caller sees them on recv.
+				uint32_t flags = events[i].events;
+				if (flags & (EPOLLERR | EPOLLHUP)) {
+					flags |= interest->events;
+				}
+				interest->ready = flags & interest->events;
+			}
+		}
+		return ready;
+	}
+#endif
+	timeval timeout;
+	timeout.tv_sec = static_cast<long>(timeoutUs / 1000000);
+	timeout.tv_usec = static_cast<long>(timeoutUs % 1000000);
+	memcpy(&mReadFDs, &mOrgReadFDs, sizeof(fd_set));
+	memcpy(&mWriteFDs, &mOrgWriteFDs, sizeof(fd_set));
+	int nfds = 0;
+#ifndef _WIN32
+	for (SOCKET s : mSockets) {
+		nfds = std::max(nfds, s + 1);
+	}
+#endif
+	int ret = select(nfds, &mReadFDs, &mWriteFDs, NULL, &timeout);
+	if (ret == SOCKET_ERROR) {
+		FD_ZERO(&mReadFDs);
+		FD_ZERO(&mWriteFDs);
+	}
+	return ret;
+}
+
+bool SocketWaiter::IsReady(SOCKET s, bool write) {
+#ifdef __linux__
+	if (mBackend == SOCKET_IO_EPOLL) {
+		Interest *interest = FindInterest(s);
+		return interest != NULL && (interest->ready & (write ? EPOLLOUT : EPOLLIN)) != 0;
+	}
+#endif
+	return FD_ISSET(s, write ? &mWriteFDs : &mReadFDs) != 0;
+}
+
+SocketIOBackend SocketWaiter::GetBackend() {
+	return mBackend;
+}
+
+#ifdef __linux__
+SocketWaiter::Interest *SocketWaiter::FindInterest(SOCKET s) {
+	for (auto &interest : mInterests) {
+		if (interest.s == s) {
+			return &interest;
+		}
+	}
+	return NULL;
+}
+#endif
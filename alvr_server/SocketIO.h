@@ -0,0 +1,124 @@
+#pragma once
+
+// Thin platform layer for UDP datagram I/O used by Poller and UdpSocket.
+// SOCKET_IO_SELECT is the portable select() + recvfrom()/sendto() path.
+// SOCKET_IO_EPOLL (Linux only) uses epoll for waiting, recvmmsg to drain all pending datagrams
+// and sendmmsg (optionally with UDP GSO) to send a whole frame in a few system calls.
+
+#include <stdint.h>
+#include <vector>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+typedef int SOCKET;
+static const SOCKET INVALID_SOCKET = -1;
+static const int SOCKET_ERROR = -1;
+
+inline int closesocket(SOCKET s) {
+	return close(s);
+}
+#endif
+
+#include "packet_types.h"
+
+enum SocketIOBackend {
+	SOCKET_IO_SELECT,
+	SOCKET_IO_EPOLL,
+};
+
+#ifdef __linux__
+static const SocketIOBackend DEFAULT_SOCKET_IO_BACKEND = SOCKET_IO_EPOLL;
+#else
+static const SocketIOBackend DEFAULT_SOCKET_IO_BACKEND = SOCKET_IO_SELECT;
+#endif
+
+bool IsSocketIOBackendAvailable(SocketIOBackend backend);
+const char *GetSocketIOBackendName(SocketIOBackend backend);
+
+// System calls made through this layer. Used by benchmark.
+struct SocketIOCounters {
+	uint64_t waitCalls = 0;
+	uint64_t recvCalls = 0;
+	uint64_t sendCalls = 0;
+	uint64_t datagramsReceived = 0;
+	uint64_t datagramsSent = 0;
+};
+
+struct RecvDatagram {
+	char buf[MAX_PACKET_UDP_PACKET_SIZE];
+	int len;
+	sockaddr_in addr;
+};
+
+struct SendDatagram {
+	const char *buf;
+	int len;
+};
+
+// Maximum datagrams per RecvBatch call.
+static const int SOCKET_IO_MAX_RECV_BATCH = 64;
+
+int GetLastSocketError();
+bool IsSocketWouldBlock(int error);
+bool SetSocketNonBlocking(SOCKET s);
+
+// Receive up to count pending datagrams without blocking.
+// Returns number of datagrams received (0 if nothing is pending) or -1 on error.
+int RecvBatch(SocketIOBackend backend, SOCKET s, RecvDatagram *datagrams, int count, SocketIOCounters *counters = NULL);
+
+// Send datagrams in order without blocking. Returns number of datagrams sent.
+// Fewer than count means socket buffer is full or an error occurred (see GetLastSocketError).
+// With gso, consecutive datagrams of equal length are coalesced into single UDP GSO send.
+// GSO is disabled for the process on first failure (needs Linux 4.18 or later).
+int SendBatch(SocketIOBackend backend, SOCKET s, const sockaddr_in *addr, const SendDatagram *datagrams, int count
+	, bool gso, SocketIOCounters *counters = NULL);
+
+// Waits until registered sockets become readable or writable.
+class SocketWaiter {
+public:
+	SocketWaiter(SocketIOBackend backend = DEFAULT_SOCKET_IO_BACKEND);
+	~SocketWaiter();
+
+	void Add(SOCKET s, bool write);
+	void Remove(SOCKET s, bool write);
+
+	// Returns number of ready sockets, 0 on timeout or -1 on error.
+	int Wait(uint64_t timeoutUs, SocketIOCounters *counters = NULL);
+	// Result of last Wait.
+	bool IsReady(SOCKET s, bool write);
+
+	SocketIOBackend GetBackend();
+private:
+	SocketIOBackend mBackend;
+
+	fd_set mOrgReadFDs;
+	fd_set mReadFDs;
+	fd_set mOrgWriteFDs;
+	fd_set mWriteFDs;
+	std::vector<SOCKET> mSockets;
+
+#ifdef __linux__
+	struct Interest {
+		SOCKET s;
+		uint32_t events;
+		uint32_t ready;
+	};
+	int mEpollFD = -1;
+	int mTimerFD = -1;
+	std::vector<Interest> mInterests;
+
+	Interest *FindInterest(SOCKET s);
+#endif
+
+	SocketWaiter(const SocketWaiter &) = delete;
+	SocketWaiter &operator=(const SocketWaiter &) = delete;
+};
@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <time.h>
 
+#include "NetworkTelemetry.h"
+
 class Statistics {
 public:
 	Statistics() {
@@ -29,6 +31,14 @@ public:
 		m_encodeLatencyAveragePrev = 0;
 		m_encodeLatencyMinPrev = 0;
 		m_encodeLatencyMaxPrev = 0;
+
+		m_staleFramesDroppedTotal = 0;
+		m_staleFramesDroppedInSecond = 0;
+		m_staleFramesDroppedInSecondPrev = 0;
+		m_stalePacketsDroppedTotal = 0;
+		m_overflowDropsTotal = 0;
+
+		m_telemetry.Reset();
 	}
 
 	void CountPacket(int bytes) {
@@ -50,6 +60,20 @@ public:
 		m_encodeSampleCount++;
 	}
 
+	// Video frame discarded from send queue because its deadline passed and newer frame was waiting.
+	void CountStaleFrameDrop(int packets) {
+		CheckAndResetSecond();
+
+		m_staleFramesDroppedTotal++;
+		m_staleFramesDroppedInSecond++;
+		m_stalePacketsDroppedTotal += packets;
+	}
+
+	// Packets or frames which could not be queued because send queue was full.
+	void CountOverflowDrop(uint64_t count) {
+		m_overflowDropsTotal += count;
+	}
+
 	uint64_t GetPacketsSentTotal() {
 		return m_packetsSentTotal;
 	}
@@ -74,6 +98,21 @@ public:
 	uint64_t GetEncodeLatencyMax() {
 		return m_encodeLatencyMaxPrev;
 	}
+	uint64_t GetStaleFramesDroppedTotal() {
+		return m_staleFramesDroppedTotal;
+	}
+	uint64_t GetStaleFramesDroppedInSecond() {
+		return m_staleFramesDroppedInSecondPrev;
+	}
+	uint64_t GetStalePacketsDroppedTotal() {
+		return m_stalePacketsDroppedTotal;
+	}
+	uint64_t GetOverflowDropsTotal() {
+		return m_overflowDropsTotal;
+	}
+	NetworkTelemetry &GetNetworkTelemetry() {
+		return m_telemetry;
+	}
 private:
 	void ResetSecond() {
 		m_packetsSentInSecondPrev = m_packetsSentInSecond;
@@ -84,6 +123,9 @@ private:
 		m_framesPrevious = m_framesInSecond;
 		m_framesInSecond = 0;
 
+		m_staleFramesDroppedInSecondPrev = m_staleFramesDroppedInSecond;
+		m_staleFramesDroppedInSecond = 0;
+
 		m_encodeLatencyMinPrev = m_encodeLatencyMin;
 		m_encodeLatencyMaxPrev = m_encodeLatencyMax;
 		if (m_encodeSampleCount == 0) {
@@ -124,5 +166,13 @@ private:
 	uint64_t m_encodeLatencyMinPrev;
 	uint64_t m_encodeLatencyMaxPrev;
 
+	uint64_t m_staleFramesDroppedTotal;
+	uint64_t m_staleFramesDroppedInSecond;
+	uint64_t m_staleFramesDroppedInSecondPrev;
+	uint64_t m_stalePacketsDroppedTotal;
+	uint64_t m_overflowDropsTotal;
+
+	NetworkTelemetry m_telemetry;
+
 	time_t m_current;
 };
\ No newline at end of file
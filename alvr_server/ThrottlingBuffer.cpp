@@ -1,9 +1,21 @@
+#include <algorithm>
+
 #include "ThrottlingBuffer.h"
 #include "Utils.h"
 #include "Logger.h"
 
-ThrottlingBuffer::ThrottlingBuffer(const Bitrate &bitrate) : mBitrate(bitrate)
+const int ThrottlingBuffer::MAX_SEND_BATCH;
+
+ThrottlingBuffer::ThrottlingBuffer(const Bitrate &bitrate, std::shared_ptr<Statistics> statistics, int capacity)
+	: mBitrate(bitrate)
+	, mStatistics(statistics)
+	, mClock(GetCounterUs)
+	, mTimestampClock(GetTimestampUs)
+	, mRing(capacity)
 {
+	for (auto &ring : mPriorityRings) {
+		ring.reset(new PacketRing(PRIORITY_CAPACITY));
+	}
 	// mWindow bytes can be sent at a time.
 	mWindow = mBitrate.toBytes() / (1000 * 1000 / BURST_US);
 	if (mWindow < 2000) {
@@ -17,46 +29,199 @@ ThrottlingBuffer::~ThrottlingBuffer()
 {
 }
 
-void ThrottlingBuffer::Push(char *buf, int len, uint64_t frameIndex)
+void ThrottlingBuffer::SetFramePacing(int refreshRate)
+{
+	mFrameIntervalUs = refreshRate > 0 ? 1000 * 1000 / refreshRate : 0;
+	LogDriver("ThrottlingBuffer::SetFramePacing(). FrameInterval=%llu us", mFrameIntervalUs);
+}
+
+void ThrottlingBuffer::SetClock(std::function<uint64_t()> clock)
+{
+	mClock = clock;
+}
+
+void ThrottlingBuffer::SetTimestampClock(std::function<uint64_t()> clock)
+{
+	mTimestampClock = clock;
+}
+
+void ThrottlingBuffer::BeginPush()
+{
+	mProducerCS.Lock();
+	mPushTime = mClock();
+	mPushId++;
+}
+
+PacketBuffer *ThrottlingBuffer::Allocate()
 {
-	IPCCriticalSectionLock lock(mCS);
-	SendBuffer buffer;
-	buffer.buf.reset(new char[len]);
-	buffer.len = len;
-	buffer.frameIndex = frameIndex;
-	memcpy(buffer.buf.get(), buf, len);
-	mQueue.push_back(buffer);
-	mBuffered += len;
+	PacketBuffer *packet = mRing.Reserve();
+	if (packet != NULL) {
+		packet->queuedUs = mPushTime;
+		packet->pushId = mPushId;
+	}
+	return packet;
+}
+
+void ThrottlingBuffer::EndPush(bool commit)
+{
+	if (commit) {
+		mRing.Commit();
+	}
+	else {
+		mRing.Rollback();
+		mDropped++;
+	}
+	mProducerCS.Unlock();
+}
+
+bool ThrottlingBuffer::Push(char *buf, int len, uint64_t frameIndex, Priority priority, int timestampOffset)
+{
+	if (len > PacketBuffer::CAPACITY) {
+		LogDriver("ThrottlingBuffer::Push(). Packet is too large. Length=%d", len);
+		return false;
+	}
+	if (priority != PRIORITY_VIDEO) {
+		return PushPriority(buf, len, frameIndex, priority, timestampOffset);
+	}
+	BeginPush();
+	PacketBuffer *packet = Allocate();
+	if (packet == NULL) {
+		EndPush(false);
+		Log("ThrottlingBuffer::Push(). Ring is full. Packet dropped. Length=%d", len);
+		return false;
+	}
+	memcpy(packet->buf, buf, len);
+	packet->len = len;
+	packet->frameIndex = frameIndex;
+	packet->timestampOffset = timestampOffset;
+	EndPush(true);
+	return true;
+}
+
+bool ThrottlingBuffer::PushPriority(char *buf, int len, uint64_t frameIndex, Priority priority, int timestampOffset)
+{
+	IPCCriticalSectionLock lock(mPriorityProducerCS[priority]);
+	PacketRing &ring = *mPriorityRings[priority];
+	PacketBuffer *packet = ring.Reserve();
+	if (packet == NULL) {
+		mDropped++;
+		Log("ThrottlingBuffer::Push(). Ring is full. Packet dropped. Priority=%d Length=%d", priority, len);
+		return false;
+	}
+	memcpy(packet->buf, buf, len);
+	packet->len = len;
+	packet->frameIndex = frameIndex;
+	packet->queuedUs = mClock();
+	packet->timestampOffset = timestampOffset;
+	ring.Commit();
+	return true;
 }
 
 bool ThrottlingBuffer::Send(std::function<bool(char*, int)> sendFunc)
 {
-	IPCCriticalSectionLock lock(mCS);
-	uint64_t current = GetCounterUs();
-	if (CanSend(current)) {
-		SendBuffer &buffer = mQueue.front();
-		if (sendFunc(buffer.buf.get(), buffer.len)) {
-			mByteCount += buffer.len;
-			mBuffered -= buffer.len;
-			mQueue.pop_front();
-			return true;
+	return SendBatch([&sendFunc](PacketBuffer *const *packets, int count) {
+		return sendFunc(packets[0]->buf, packets[0]->len) ? 1 : 0;
+	}, 1) > 0;
+}
+
+int ThrottlingBuffer::SendBatch(std::function<int(PacketBuffer *const *, int)> sendFunc, int maxCount)
+{
+	uint64_t current = mClock();
+	mNextSendUs = 0;
+	ReportDrops();
+	if (mFrameIntervalUs != 0) {
+		DropStaleFrames(current);
+	}
+	if (IsEmpty()) {
+		return 0;
+	}
+	bool underLimit = CanSend(current);
+
+	// Select packets as if each previous one in the batch had been sent.
+	PacketBuffer *packets[MAX_SEND_BATCH];
+	PacketRing *rings[MAX_SEND_BATCH];
+	maxCount = std::min(maxCount, MAX_SEND_BATCH);
+	int count = 0;
+	int64_t bytes = 0;
+	for (auto &ring : mPriorityRings) {
+		PacketBuffer *packet;
+		for (int offset = 0; count < maxCount && (packet = ring->Peek(offset)) != NULL; offset++) {
+			packets[count] = packet;
+			rings[count] = ring.get();
+			bytes += packet->len;
+			count++;
 		}
 	}
-	return false;
+	int paced = 0;
+	for (int offset = 0; underLimit && count < maxCount; offset++) {
+		PacketBuffer *packet = mRing.Peek(offset);
+		if (packet == NULL) {
+			break;
+		}
+		if (count > 0 && mBitrate.toBits() != 0 && mByteCount + bytes > static_cast<int64_t>(mWindow)) {
+			break;
+		}
+		if (mFrameIntervalUs != 0 && !CheckPacing(packet, current, offset, paced)) {
+			break;
+		}
+		packets[count] = packet;
+		rings[count] = &mRing;
+		bytes += packet->len;
+		count++;
+	}
+	if (count == 0) {
+		return 0;
+	}
+
+	uint64_t timestamp = 0;
+	for (int i = 0; i < count; i++) {
+		if (packets[i]->timestampOffset >= 0) {
+			if (timestamp == 0) {
+				timestamp = mTimestampClock();
+			}
+			memcpy(packets[i]->buf + packets[i]->timestampOffset, &timestamp, sizeof(timestamp));
+		}
+	}
+	int sent = sendFunc(packets, count);
+	if (sent < count) {
+		mNextSendUs = current;
+	}
+	for (int i = 0; i < sent; i++) {
+		mByteCount += packets[i]->len;
+		if (mStatistics) {
+			mStatistics->GetNetworkTelemetry().RecordQueueDelay(current - packets[i]->queuedUs);
+		}
+		if (mPacing && IsVideoPacket(packets[i]) && packets[i]->pushId == mPacingFrame) {
+			mPacingSent++;
+		}
+		rings[i]->Pop();
+	}
+	return sent;
 }
 
-bool ThrottlingBuffer::IsEmpty()
+uint64_t ThrottlingBuffer::GetNextSendTime()
 {
-	IPCCriticalSectionLock lock(mCS);
-	return mQueue.empty();
+	return mNextSendUs;
 }
 
-bool ThrottlingBuffer::CanSend(uint64_t current)
+bool ThrottlingBuffer::IsEmpty()
 {
-	if (mQueue.empty()) {
-		return false;
+	for (auto &ring : mPriorityRings) {
+		if (!ring->IsEmpty()) {
+			return false;
+		}
 	}
+	return mRing.IsEmpty();
+}
+
+uint64_t ThrottlingBuffer::GetDropCount()
+{
+	return mDropped;
+}
 
+// Whether video may be sent now. Refills the bucket and sets mNextSendUs when over limit.
+bool ThrottlingBuffer::CanSend(uint64_t current)
+{
 	if (mBitrate.toBits() == 0) {
 		// No limit.
 		return true;
@@ -70,10 +235,143 @@ bool ThrottlingBuffer::CanSend(uint64_t current)
 
 	mLastSent = current;
 
-	Log("ThrottlingBuffer::CanSend(). %03llu.%03llu Check %llu <= %llu: %d Buffered=%llu Fillup=%llu", (current / 1000) % 1000, current % 1000
-		, mByteCount, mWindow, mByteCount <= mWindow, mBuffered, fullup);
+	Log("ThrottlingBuffer::CanSend(). %03llu.%03llu Check %llu <= %llu: %d Buffered=%d packets Fillup=%llu", (current / 1000) % 1000, current % 1000
+		, mByteCount, mWindow, mByteCount <= mWindow, mRing.Size(), fullup);
 	if (mByteCount <= mWindow) {
 		return true;
 	}
+	// Rounded up so that the bucket has drained enough when we wake.
+	mNextSendUs = current + (mByteCount - mWindow) * 1000000 / mBitrate.toBytes() + 1;
+	return false;
+}
+
+// packet is at offset from front. paced is number of packets of current frame already selected for this batch.
+bool ThrottlingBuffer::CheckPacing(PacketBuffer *packet, uint64_t current, int offset, int &paced)
+{
+	if (!IsVideoPacket(packet)) {
+		return true;
+	}
+	if (!mPacing || mPacingFrame != packet->pushId) {
+		mPacing = true;
+		mPacingFrame = packet->pushId;
+		mPacingStartUs = current;
+		mPacingIntervalUs = mFrameIntervalUs / GetSliceCount(packet);
+		mPacingPackets = CountFramePackets(offset);
+		mPacingSent = 0;
+		paced = 0;
+	}
+	int index = mPacingSent + paced;
+	if (HasVideoPacket(offset + mPacingPackets - index)) {
+		// Next frame is already waiting. Don't delay this one further.
+		paced++;
+		return true;
+	}
+	uint64_t due = mPacingStartUs + mPacingIntervalUs * index / mPacingPackets;
+	if (current < due) {
+		mNextSendUs = due;
+		return false;
+	}
+	paced++;
+	return true;
+}
+
+void ThrottlingBuffer::DropStaleFrames(uint64_t current)
+{
+	while (true) {
+		PacketBuffer *packet = mRing.Front();
+		if (packet == NULL || !IsVideoPacket(packet) || current <= packet->queuedUs + mFrameIntervalUs) {
+			return;
+		}
+		if (GetSliceIndex(packet) != 0) {
+			// Earlier parts of the picture were sent. Dropping the rest would waste them.
+			return;
+		}
+		int packets = CountPicturePackets(0);
+		if (!HasVideoPacket(packets)) {
+			// Latest picture. Late is better than never.
+			return;
+		}
+
+		Log("ThrottlingBuffer::DropStaleFrames(). Dropping videoFrameIndex=%llu packets=%d delay=%llu us"
+			, GetVideoFrameIndex(packet), packets, current - packet->queuedUs);
+		for (int i = 0; i < packets; i++) {
+			mRing.Pop();
+		}
+		mPacing = false;
+		if (mStatistics) {
+			mStatistics->CountStaleFrameDrop(packets);
+		}
+	}
+}
+
+void ThrottlingBuffer::ReportDrops()
+{
+	uint64_t dropped = mDropped;
+	if (dropped != mDroppedReported) {
+		if (mStatistics) {
+			mStatistics->CountOverflowDrop(dropped - mDroppedReported);
+		}
+		mDroppedReported = dropped;
+	}
+}
+
+// Number of consecutive packets of the video frame (same pushId) at offset.
+int ThrottlingBuffer::CountFramePackets(int offset)
+{
+	PacketBuffer *first = mRing.Peek(offset);
+	int count = 1;
+	PacketBuffer *packet;
+	while ((packet = mRing.Peek(offset + count)) != NULL && IsVideoPacket(packet) && packet->pushId == first->pushId) {
+		count++;
+	}
+	return count;
+}
+
+// Number of packets of the consecutive pushes from offset which carry parts of the same picture.
+// Each part (VideoFrame::sliceIndex) is pushed on its own. Offset must be at the start of a push.
+int ThrottlingBuffer::CountPicturePackets(int offset)
+{
+	PacketBuffer *first = mRing.Peek(offset);
+	uint64_t picture = GetVideoFrameIndex(first) - GetSliceIndex(first);
+	int count = CountFramePackets(offset);
+	PacketBuffer *packet;
+	while ((packet = mRing.Peek(offset + count)) != NULL && IsVideoPacket(packet) && GetSliceIndex(packet) != 0
+		&& GetVideoFrameIndex(packet) - GetSliceIndex(packet) == picture) {
+		count += CountFramePackets(offset + count);
+	}
+	return count;
+}
+
+// Whether any video packet is queued at offset or later.
+bool ThrottlingBuffer::HasVideoPacket(int offset)
+{
+	PacketBuffer *packet;
+	while ((packet = mRing.Peek(offset)) != NULL) {
+		if (IsVideoPacket(packet)) {
+			return true;
+		}
+		offset++;
+	}
 	return false;
 }
+
+bool ThrottlingBuffer::IsVideoPacket(const PacketBuffer *packet)
+{
+	return packet->len >= static_cast<int>(sizeof(VideoFrame))
+		&& reinterpret_cast<const VideoFrame *>(packet->buf)->type == ALVR_PACKET_TYPE_VIDEO_FRAME;
+}
+
+uint64_t ThrottlingBuffer::GetVideoFrameIndex(const PacketBuffer *packet)
+{
+	return reinterpret_cast<const VideoFrame *>(packet->buf)->videoFrameIndex;
+}
+
+int ThrottlingBuffer::GetSliceIndex(const PacketBuffer *packet)
+{
+	return reinterpret_cast<const VideoFrame *>(packet->buf)->sliceIndex;
+}
+
+int ThrottlingBuffer::GetSliceCount(const PacketBuffer *packet)
+{
+	return std::max(static_cast<int>(reinterpret_cast<const VideoFrame *>(packet->buf)->sliceCount), 1);
+}
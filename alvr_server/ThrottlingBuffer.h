@@ -1,46 +1,133 @@
 #pragma once
 
-#include <list>
-#include <memory>
 #include <functional>
+#include <atomic>
+#include <memory>
 
 #include "Bitrate.h"
 #include "ipctools.h"
+#include "PacketRing.h"
+#include "Statistics.h"
 
-struct SendBuffer {
-	std::shared_ptr<char> buf;
-	int len;
-	uint64_t frameIndex;
-
-	SendBuffer() : buf(NULL, [](char *p) { delete[] p; }) {
-	}
-};
-
+// Send queue between packet producers (encoder, audio, connection and receive threads) and the socket thread.
+// Packets live in a lock-free SPSC ring. The socket thread consumes without locking.
+// Producers are serialized by mProducerCS, which they only contend on among themselves.
+//
+// Each priority class has its own ring and producer lock. SendBatch serves classes in strict priority
+// order, so control, time sync, haptics and audio never wait behind a queued video frame, and their
+// producers never wait for the encoder packetizing a frame. Classes above PRIORITY_VIDEO are small and
+// not held back by the bitrate limit, but their bytes are counted, so video yields to them.
+//
+// When a ring is full, the packet being pushed is dropped and counted. Queued packets are never
+// overwritten. A video frame is pushed between BeginPush and EndPush, so it is queued or dropped
+// as a whole. The client then sees a gap in packetCounter and requests IDR, as with network loss.
+//
+// With frame pacing enabled, packets of a video frame are spread evenly over the frame interval
+// instead of being sent in bursts. Each part of a frame sent in parts (VideoFrame::sliceCount) is
+// spread over its share of the interval. A queued video frame becomes stale one frame interval after
+// it was pushed. If a stale frame is at the front and a newer video frame is already waiting, its
+// remaining packets are discarded. A picture sent in parts is discarded as a whole, with all of its
+// queued parts, unless a later part is at the front, as earlier ones were sent then. Other packets
+// (audio, haptics, control) are never paced or discarded.
 class ThrottlingBuffer
 {
 public:
-	ThrottlingBuffer(const Bitrate &bitrate);
+	// Highest first.
+	enum Priority {
+		// Connection, settings and time sync messages.
+		PRIORITY_CONTROL,
+		PRIORITY_HAPTICS,
+		PRIORITY_AUDIO,
+		// Video frames pushed with BeginPush, and default for Push.
+		PRIORITY_VIDEO,
+		PRIORITY_COUNT
+	};
+
+	ThrottlingBuffer(const Bitrate &bitrate, std::shared_ptr<Statistics> statistics = nullptr, int capacity = DEFAULT_CAPACITY);
 	~ThrottlingBuffer();
 
-	void Push(char *buf, int len, uint64_t frameIndex);
+	// 0 disables frame pacing. Must be called before use.
+	void SetFramePacing(int refreshRate);
+	// Replace GetCounterUs for simulation.
+	void SetClock(std::function<uint64_t()> clock);
+	// Replace GetTimestampUs, used for timestampOffset, for simulation.
+	void SetTimestampClock(std::function<uint64_t()> clock);
+
+	// Producer side.
+	void BeginPush();
+	// Get empty packet to be filled in place. Returns NULL if ring is full.
+	PacketBuffer *Allocate();
+	// Publish packets allocated after BeginPush (commit=true) or discard them.
+	void EndPush(bool commit);
+	// Copy and queue single packet. Returns false if it was dropped.
+	// If timestampOffset is not -1, uint64_t at that offset is set to GetTimestampUs() when the packet is sent.
+	bool Push(char *buf, int len, uint64_t frameIndex, Priority priority = PRIORITY_VIDEO, int timestampOffset = -1);
+
+	// Consumer side. Must be called from single thread.
 	bool Send(std::function<bool(char *, int)> sendFunc);
+	// Pass up to maxCount packets which may be sent now to sendFunc, which returns how many of them it sent.
+	// Unsent packets stay queued. Returns number of packets sent.
+	int SendBatch(std::function<int(PacketBuffer *const *, int)> sendFunc, int maxCount = MAX_SEND_BATCH);
+	// When SendBatch returned 0, time at which it can send next because of bitrate limit or pacing.
+	// Current time if sendFunc did not send everything. 0 if nothing is queued.
+	uint64_t GetNextSendTime();
 
 	bool IsEmpty();
+	// Number of pushes (single packets or whole video frames) dropped because ring was full.
+	uint64_t GetDropCount();
+
+	static const int DEFAULT_CAPACITY = 2048;
+	// Capacity of each class above PRIORITY_VIDEO.
+	static const int PRIORITY_CAPACITY = 256;
+	static const int MAX_SEND_BATCH = 64;
 private:
 	Bitrate mBitrate;
-	uint64_t mBuffered = 0;
-	std::list<SendBuffer> mQueue;
-	IPCCriticalSection mCS;
+	std::shared_ptr<Statistics> mStatistics;
+	std::function<uint64_t()> mClock;
+	std::function<uint64_t()> mTimestampClock;
+	std::atomic<uint64_t> mDropped{ 0 };
+	uint64_t mDroppedReported = 0;
+	uint64_t mPushTime = 0;
+	uint64_t mPushId = 0;
+	// PRIORITY_VIDEO ring.
+	PacketRing mRing;
+	IPCCriticalSection mProducerCS;
+	// Rings of classes above PRIORITY_VIDEO.
+	std::unique_ptr<PacketRing> mPriorityRings[PRIORITY_VIDEO];
+	IPCCriticalSection mPriorityProducerCS[PRIORITY_VIDEO];
 
 	uint64_t mWindow;
 	int64_t mByteCount = 0;
 	uint64_t mCurrentTimeSlotUs = 0;
 	uint64_t mLastSent = 0;
+	uint64_t mNextSendUs = 0;
 
 	// Permit burst sending for performance (or implementation) reason.
 	// Maximum size we can send at a time is mBitrate * BurstTime.
 	static const uint64_t BURST_US = 1000;
 
+	// Frame pacing. Only touched by consumer.
+	uint64_t mFrameIntervalUs = 0;
+	bool mPacing = false;
+	// pushId of the video frame being paced.
+	uint64_t mPacingFrame = 0;
+	uint64_t mPacingStartUs = 0;
+	uint64_t mPacingIntervalUs = 0;
+	int mPacingPackets = 0;
+	int mPacingSent = 0;
+
+	bool PushPriority(char *buf, int len, uint64_t frameIndex, Priority priority, int timestampOffset);
 	bool CanSend(uint64_t current);
+	bool CheckPacing(PacketBuffer *packet, uint64_t current, int offset, int &paced);
+	void DropStaleFrames(uint64_t current);
+	void ReportDrops();
+	int CountFramePackets(int offset);
+	int CountPicturePackets(int offset);
+	bool HasVideoPacket(int offset);
+
+	static bool IsVideoPacket(const PacketBuffer *packet);
+	static uint64_t GetVideoFrameIndex(const PacketBuffer *packet);
+	static int GetSliceIndex(const PacketBuffer *packet);
+	static int GetSliceCount(const PacketBuffer *packet);
 };
 
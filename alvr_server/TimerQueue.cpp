@@ -0,0 +1,74 @@
+#include <algorithm>
+
+#include "TimerQueue.h"
+
+TimerQueue::TimerId TimerQueue::Add(uint64_t deadlineUs, std::function<void()> callback)
+{
+	TimerId id = mNextId++;
+	mCallbacks[id] = callback;
+	mHeap.push_back({ deadlineUs, id });
+	std::push_heap(mHeap.begin(), mHeap.end(), std::greater<Entry>());
+	return id;
+}
+
+bool TimerQueue::Cancel(TimerId id)
+{
+	return mCallbacks.erase(id) != 0;
+}
+
+uint64_t TimerQueue::GetNextDeadline()
+{
+	PopCancelled();
+	if (mHeap.empty()) {
+		return 0;
+	}
+	return mHeap.front().deadline;
+}
+
+int TimerQueue::RunExpired(uint64_t current)
+{
+	TimerId limit = mNextId;
+	std::vector<Entry> deferred;
+	int count = 0;
+	while (true) {
+		PopCancelled();
+		if (mHeap.empty() || mHeap.front().deadline > current) {
+			break;
+		}
+		Entry entry = PopTop();
+		if (entry.id >= limit) {
+			deferred.push_back(entry);
+			continue;
+		}
+		auto it = mCallbacks.find(entry.id);
+		std::function<void()> callback = std::move(it->second);
+		mCallbacks.erase(it);
+		callback();
+		count++;
+	}
+	for (auto &entry : deferred) {
+		mHeap.push_back(entry);
+		std::push_heap(mHeap.begin(), mHeap.end(), std::greater<Entry>());
+	}
+	return count;
+}
+
+size_t TimerQueue::Size()
+{
+	return mCallbacks.size();
+}
+
+void TimerQueue::PopCancelled()
+{
+	while (!mHeap.empty() && mCallbacks.find(mHeap.front().id) == mCallbacks.end()) {
+		PopTop();
+	}
+}
+
+TimerQueue::Entry TimerQueue::PopTop()
+{
+	std::pop_heap(mHeap.begin(), mHeap.end(), std::greater<Entry>());
+	Entry entry = mHeap.back();
+	mHeap.pop_back();
+	return entry;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+// Min-heap of deadlines used by Poller to decide how long to wait and what to run on wake.
+// Cancelled timers are removed lazily when they reach the top of the heap.
+// Not thread safe. All methods must be called from the poller thread.
+class TimerQueue {
+public:
+	typedef uint64_t TimerId;
+	static const TimerId INVALID_TIMER = 0;
+
+	// Run callback from RunExpired at or after deadlineUs.
+	TimerId Add(uint64_t deadlineUs, std::function<void()> callback);
+	// Returns false if timer has already fired or been cancelled.
+	bool Cancel(TimerId id);
+
+	// Earliest pending deadline, or 0 if there is no pending timer.
+	uint64_t GetNextDeadline();
+	// Run all timers with deadline <= current in deadline order. Returns number of callbacks run.
+	// Callbacks may add or cancel timers. Timers added by callbacks never run in the same call.
+	int RunExpired(uint64_t current);
+
+	size_t Size();
+private:
+	struct Entry {
+		uint64_t deadline;
+		TimerId id;
+
+		// Ties run in order of Add.
+		bool operator>(const Entry &a) const {
+			return deadline != a.deadline ? deadline > a.deadline : id > a.id;
+		}
+	};
+	std::vector<Entry> mHeap;
+	std::unordered_map<TimerId, std::function<void()>> mCallbacks;
+	TimerId mNextId = 1;
+
+	void PopCancelled();
+	Entry PopTop();
+};
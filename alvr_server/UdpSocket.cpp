@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "UdpSocket.h"
 #include "Logger.h"
 #include "Utils.h"
@@ -9,10 +11,13 @@ UdpSocket::UdpSocket(std::string host, int port, std::shared_ptr<Poller> poller,
 	, mSocket(INVALID_SOCKET)
 	, mPoller(poller)
 	, mStatistics(statistics)
-	, mBuffer(bitrate)
-	
+	, mBuffer(bitrate, statistics)
+	, mRecvBatch(RECV_BATCH_SIZE)
 {
 	mClientAddr.sin_family = 0;
+	if (Settings::Instance().m_framePacing) {
+		mBuffer.SetFramePacing(Settings::Instance().m_refreshRate);
+	}
 }
 
 
@@ -20,7 +25,7 @@ UdpSocket::~UdpSocket()
 {
 }
 
-bool UdpSocket::Startup() {
+bool UdpSocket::Startup(bool recvThread) {
 	WSADATA wsaData;
 
 	WSAStartup(MAKEWORD(2, 0), &wsaData);
@@ -29,9 +34,15 @@ bool UdpSocket::Startup() {
 		return false;
 	}
 
-	mPoller->AddSocket(mSocket, PollerSocketType::READ);
+	if (recvThread) {
+		mRecvWaiter.reset(new SocketWaiter(mPoller->GetBackend()));
+		mRecvWaiter->Add(mSocket, false);
+	}
+	else {
+		mPoller->AddSocket(mSocket, PollerSocketType::READ);
+	}
 
-	LogDriver("UdpSocket::Startup success");
+	LogDriver("UdpSocket::Startup success. RecvThread=%d", recvThread);
 
 	return true;
 }
@@ -60,36 +71,100 @@ void UdpSocket::InvalidateClient()
 	mClientAddr.sin_family = 0;
 }
 
-bool UdpSocket::Recv(char *buf, int *buflen, sockaddr_in *addr, int addrlen) {
-	bool ret = false;
-	if (mPoller->IsPending(mSocket, PollerSocketType::READ)){
-		ret = true;
-
-		recvfrom(mSocket, buf, *buflen, 0, (sockaddr *)addr, &addrlen);
+// Returns one datagram per call. All pending datagrams are read at once with RecvBatch,
+// so caller should call repeatedly until false.
+bool UdpSocket::Recv(char *buf, int *buflen, sockaddr_in *addr, int addrlen, uint64_t *receivedUs) {
+	if (mRecvIndex == mRecvCount) {
+		mRecvIndex = 0;
+		mRecvCount = 0;
+		int ret;
+		if (mRecvWaiter) {
+			if (!mRecvWaiter->IsReady(mSocket, false)) {
+				return false;
+			}
+			ret = RecvBatch(mRecvWaiter->GetBackend(), mSocket, &mRecvBatch[0], RECV_BATCH_SIZE, &mRecvCounters);
+		}
+		else {
+			if (!mPoller->IsPending(mSocket, PollerSocketType::READ)) {
+				return false;
+			}
+			ret = RecvBatch(mPoller->GetBackend(), mSocket, &mRecvBatch[0], RECV_BATCH_SIZE, &mPoller->GetCounters());
+		}
+		if (ret <= 0) {
+			return false;
+		}
+		mRecvCount = ret;
+		mRecvTimeUs = GetCounterUs();
 	}
+	RecvDatagram &datagram = mRecvBatch[mRecvIndex++];
+	*buflen = std::min(*buflen, datagram.len);
+	memcpy(buf, datagram.buf, *buflen);
+	memcpy(addr, &datagram.addr, std::min(addrlen, static_cast<int>(sizeof(datagram.addr))));
+	if (receivedUs != NULL) {
+		*receivedUs = mRecvTimeUs;
+	}
+
+	return true;
+}
 
-	return ret;
+int UdpSocket::WaitRecv(uint64_t timeoutUs) {
+	return mRecvWaiter->Wait(timeoutUs, &mRecvCounters);
 }
 
 void UdpSocket::Run()
 {
 	Log("Try to send.");
-	while (mBuffer.Send([this](char *buf, int len) {return DoSend(buf, len); })) {}
+	if (mWaitingWritable) {
+		mPoller->RemoveSocket(mSocket, PollerSocketType::WRITE);
+		mWaitingWritable = false;
+	}
+	mSendFailed = false;
+	while (mBuffer.SendBatch([this](PacketBuffer *const *packets, int count) { return DoSend(packets, count); }) > 0) {}
 
-	if (!mBuffer.IsEmpty()) {
-		mPoller->WakeLater(1);
+	if (mWaitingWritable) {
+		// Socket buffer is full. Retry when it drains.
+		mPoller->AddSocket(mSocket, PollerSocketType::WRITE);
+	}
+	else if (!mBuffer.IsEmpty()) {
+		uint64_t next = mBuffer.GetNextSendTime();
+		if (mSendFailed) {
+			next = std::max(next, GetCounterUs() + SEND_ERROR_RETRY_US);
+		}
+		mPoller->WakeAt(next);
 	}
 }
 
-bool UdpSocket::Send(char *buf, int len, uint64_t frameIndex) {
+bool UdpSocket::Send(char *buf, int len, uint64_t frameIndex, ThrottlingBuffer::Priority priority, int timestampOffset) {
 	if (!IsClientValid()) {
 		return false;
 	}
-	mBuffer.Push(buf, len, frameIndex);
-
+	if (!mBuffer.Push(buf, len, frameIndex, priority, timestampOffset)) {
+		return false;
+	}
+	mPoller->Wake();
 	return true;
 }
 
+void UdpSocket::BeginSend() {
+	mBuffer.BeginPush();
+}
+
+PacketBuffer *UdpSocket::AllocatePacket() {
+	return mBuffer.Allocate();
+}
+
+bool UdpSocket::EndSend(bool commit) {
+	if (!IsClientValid()) {
+		commit = false;
+	}
+	mBuffer.EndPush(commit);
+	if (commit) {
+		mPoller->Wake();
+	}
+
+	return commit;
+}
+
 void UdpSocket::Shutdown() {
 	if (mSocket != INVALID_SOCKET) {
 		closesocket(mSocket);
@@ -113,8 +188,7 @@ bool UdpSocket::BindSocket()
 	int val = 1;
 	setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, (const char *)&val, sizeof(val));
 
-	val = 1;
-	ioctlsocket(mSocket, FIONBIO, (u_long *)&val);
+	SetSocketNonBlocking(mSocket);
 
 	sockaddr_in addr;
 	addr.sin_family = AF_INET;
@@ -131,15 +205,26 @@ bool UdpSocket::BindSocket()
 	return true;
 }
 
-bool UdpSocket::DoSend(char * buf, int len)
+int UdpSocket::DoSend(PacketBuffer *const *packets, int count)
 {
-	int ret2 = sendto(mSocket, buf, len, 0, (sockaddr *)&mClientAddr, sizeof(mClientAddr));
-	if (ret2 >= 0) {
-		mStatistics->CountPacket(len);
-		return true;
+	SendDatagram datagrams[ThrottlingBuffer::MAX_SEND_BATCH];
+	for (int i = 0; i < count; i++) {
+		datagrams[i].buf = packets[i]->buf;
+		datagrams[i].len = packets[i]->len;
+	}
+	int sent = SendBatch(mPoller->GetBackend(), mSocket, &mClientAddr, datagrams, count, USE_UDP_GSO, &mPoller->GetCounters());
+	for (int i = 0; i < sent; i++) {
+		mStatistics->CountPacket(datagrams[i].len);
 	}
-	if (WSAGetLastError() != WSAEWOULDBLOCK) {
-		LogDriver("UdpSocket::DoSend() Error on sendto. %d %ls", WSAGetLastError(), GetErrorStr(WSAGetLastError()).c_str());
+	if (sent < count) {
+		int error = GetLastSocketError();
+		if (IsSocketWouldBlock(error)) {
+			mWaitingWritable = true;
+		}
+		else {
+			mSendFailed = true;
+			LogDriver("UdpSocket::DoSend() Error on send. %d %ls", error, GetErrorStr(error).c_str());
+		}
 	}
-	return false;
+	return sent;
 }
@@ -8,6 +8,7 @@
 #include "Statistics.h"
 #include "Utils.h"
 #include "ThrottlingBuffer.h"
+#include "SocketIO.h"
 
 #define CONTROL_NAMED_PIPE "\\\\.\\pipe\\RemoteGlass_Control"
 
@@ -17,10 +18,22 @@ public:
 	UdpSocket(std::string host, int port, std::shared_ptr<Poller> poller, std::shared_ptr<Statistics> statistics, const Bitrate &bitrate);
 	virtual ~UdpSocket();
 
-	virtual bool Startup();
-	virtual bool Recv(char *buf, int *buflen, sockaddr_in *addr, int addrlen);
+	// With recvThread, socket is not registered to poller. Receiving is done by a dedicated thread
+	// which waits with WaitRecv and then calls Recv. Otherwise Recv is called from poller thread after Do.
+	virtual bool Startup(bool recvThread = false);
+	// receivedUs, if not NULL, is set to GetCounterUs() when the datagram was read from socket.
+	virtual bool Recv(char *buf, int *buflen, sockaddr_in *addr, int addrlen, uint64_t *receivedUs = NULL);
+	// Receive thread only. Returns number of ready sockets, 0 on timeout or -1 on error.
+	int WaitRecv(uint64_t timeoutUs);
 	void Run();
-	virtual bool Send(char *buf, int len, uint64_t frameIndex = 0);
+	// See ThrottlingBuffer::Push.
+	virtual bool Send(char *buf, int len, uint64_t frameIndex = 0
+		, ThrottlingBuffer::Priority priority = ThrottlingBuffer::PRIORITY_VIDEO, int timestampOffset = -1);
+	// Zero-copy send. Packets obtained by AllocatePacket between BeginSend and EndSend are queued together.
+	// AllocatePacket returns NULL if send queue is full, in which case caller should EndSend(false).
+	void BeginSend();
+	PacketBuffer *AllocatePacket();
+	bool EndSend(bool commit);
 	virtual void Shutdown();
 	void SetClientAddr(const sockaddr_in *addr);
 	virtual sockaddr_in GetClientAddr()const;
@@ -42,6 +55,23 @@ private:
 
 	ThrottlingBuffer mBuffer;
 
-	bool DoSend(char *buf, int len);
+	// Datagrams received by last RecvBatch and not yet returned by Recv.
+	std::vector<RecvDatagram> mRecvBatch;
+	int mRecvCount = 0;
+	int mRecvIndex = 0;
+	uint64_t mRecvTimeUs = 0;
+	// Own waiter and counters of receive thread, so that it never touches poller state.
+	std::unique_ptr<SocketWaiter> mRecvWaiter;
+	SocketIOCounters mRecvCounters;
+	static const int RECV_BATCH_SIZE = 32;
+	// UDP GSO for sendmmsg backend. Falls back automatically if unsupported.
+	static const bool USE_UDP_GSO = true;
+	// Last send would block. Waiting for socket to become writable.
+	bool mWaitingWritable = false;
+	// Last send failed with other error. Retry after SEND_ERROR_RETRY_US.
+	bool mSendFailed = false;
+	static const uint64_t SEND_ERROR_RETRY_US = 1000;
+
+	int DoSend(PacketBuffer *const *packets, int count);
 };
 
@@ -1,19 +1,18 @@
 #include <ScreenGrab.h>
 #include "VideoEncoder.h"
+#include "NalParser.h"
 
 void VideoEncoder::SaveDebugOutput(std::shared_ptr<CD3DRender> m_pD3DRender, std::vector<std::vector<uint8_t>> &vPacket, ID3D11Texture2D *texture, uint64_t frameIndex) {
 	if (vPacket.size() == 0) {
 		return;
 	}
-	if (vPacket[0].size() < 10) {
-		return;
-	}
-	int type = vPacket[0][4] & 0x1F;
-	if (type == 7) {
+	NalParser parser(Settings::Instance().m_codec);
+	if (parser.Classify(vPacket[0].data(), (int)vPacket[0].size()).frameType == ALVR_FRAME_TYPE_IDR) {
 		// SPS, PPS, IDR
 		char filename[1000];
 		wchar_t filename2[1000];
-		snprintf(filename, sizeof(filename), "%s\\%llu.h264", Settings::Instance().m_DebugOutputDir.c_str(), frameIndex);
+		snprintf(filename, sizeof(filename), "%s\\%llu.%s", Settings::Instance().m_DebugOutputDir.c_str(), frameIndex
+			, Settings::Instance().m_codec == ALVR_CODEC_H265 ? "h265" : "h264");
 		_snwprintf_s(filename2, sizeof(filename2), L"%hs\\%llu.dds", Settings::Instance().m_DebugOutputDir.c_str(), frameIndex);
 		FILE *fp;
 		fopen_s(&fp, filename, "wb");
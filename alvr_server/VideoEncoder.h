@@ -14,6 +14,7 @@ public:
 
 	virtual void Transmit(ID3D11Texture2D *pTexture, uint64_t presentationTime, uint64_t frameIndex, uint64_t frameIndex2, uint64_t clientTime, bool insertIDR) = 0;
 
+	// 0 keeps a value. A change of bitrate only updates rate control, others restart the stream with an IDR frame.
 	virtual void Reconfigure(int refreshRate, int renderWidth, int renderHeight, int bitrateInMBits) = 0;
 protected:
 	void SaveDebugOutput(std::shared_ptr<CD3DRender> m_pD3DRender, std::vector<std::vector<uint8_t>> &vPacket, ID3D11Texture2D *texture, uint64_t frameIndex);
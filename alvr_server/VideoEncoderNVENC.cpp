@@ -1,4 +1,6 @@
 
+#include <algorithm>
+
 #include "VideoEncoderNVENC.h"
 #include "NvCodecUtils.h"
 #include "nvencoderclioptions.h"
@@ -80,6 +82,15 @@ void VideoEncoderNVENC::Initialize()
 		throw MakeException(L"NvEnc CreateEncoder failed. Code=%d %hs", e.getErrorCode(), e.what());
 	}
 
+	if (Settings::Instance().m_sliceCount > 1) {
+		m_sliceStreamer.reset(new SliceStreamer(m_codec, Settings::Instance().m_sliceCount
+			, [this](uint8_t *buf, int len, int sliceIndex, int sliceCount) {
+			if (m_Listener) {
+				m_Listener->SendVideoSlice(buf, len, m_sliceFrameIndex, sliceIndex, sliceCount, m_sliceInsertIDR);
+			}
+		}));
+	}
+
 	//
 	// Initialize debug video output
 	//
@@ -97,59 +108,91 @@ void VideoEncoderNVENC::Initialize()
 
 void VideoEncoderNVENC::Reconfigure(int refreshRate, int renderWidth, int renderHeight, int bitrateInMBits)
 {
-	if ((refreshRate != 0 && refreshRate != m_refreshRate) ||
-		(renderWidth != 0 && renderWidth != m_renderWidth) ||
-		(renderHeight != 0 && renderHeight != m_renderHeight) ||
-		(bitrateInMBits != 0 && bitrateInMBits != m_bitrateInMBits)) {
-		NV_ENC_RECONFIGURE_PARAMS reconfigureParams = { NV_ENC_RECONFIGURE_PARAMS_VER };
-		NV_ENC_CONFIG encodeConfig = { NV_ENC_CONFIG_VER };
-
-		reconfigureParams.resetEncoder = 1; // Needed?
-		reconfigureParams.forceIDR = 1;
-		reconfigureParams.reInitEncodeParams.version = NV_ENC_INITIALIZE_PARAMS_VER;
-		reconfigureParams.reInitEncodeParams.encodeConfig = &encodeConfig;
-
-		FillEncodeConfig(reconfigureParams.reInitEncodeParams, refreshRate, renderWidth, renderHeight, Bitrate::fromMiBits(bitrateInMBits));
-
-		reconfigureParams.reInitEncodeParams.maxEncodeWidth = renderWidth;
-		reconfigureParams.reInitEncodeParams.maxEncodeHeight = renderHeight;
+	if (refreshRate == 0) {
+		refreshRate = m_refreshRate;
+	}
+	if (renderWidth == 0) {
+		renderWidth = m_renderWidth;
+	}
+	if (renderHeight == 0) {
+		renderHeight = m_renderHeight;
+	}
+	if (bitrateInMBits == 0) {
+		bitrateInMBits = m_bitrateInMBits;
+	}
+	if (refreshRate == m_refreshRate && renderWidth == m_renderWidth && renderHeight == m_renderHeight
+		&& bitrateInMBits == m_bitrateInMBits) {
+		return;
+	}
 
-		bool ret = false;
-		try {
-			ret = m_NvNecoder->Reconfigure(&reconfigureParams);
-		}
-		catch (NVENCException e) {
-			FatalLog("NvEnc Reconfigure failed with exception. Code=%d %hs. (%dHz %dx%d %dMbits) -> (%dHz %dx%d %dMbits)", e.getErrorCode(), e.what()
-				, m_refreshRate, m_renderWidth, m_renderHeight, m_bitrateInMBits
-				, refreshRate, renderWidth, renderHeight, bitrateInMBits
-			);
-			return;
-		}
-		if (!ret) {
-			FatalLog("NvEnc Reconfigure failed. Return code=%d. (%dHz %dx%d %dMbits) -> (%dHz %dx%d %dMbits)", ret
-				, m_refreshRate, m_renderWidth, m_renderHeight, m_bitrateInMBits
-				, refreshRate, renderWidth, renderHeight, bitrateInMBits
-			);
-			return;
-		}
-		LogDriver("NvEnc Reconfigure succeeded. (%dHz %dx%d %dMbits) -> (%dHz %dx%d %dMbits)"
+	if (!m_NvNecoder || renderWidth != m_renderWidth || renderHeight != m_renderHeight) {
+		// Input buffers and CudaConverter are allocated for the size at Initialize,
+		// and NvEnc can not grow beyond maxEncodeWidth/Height. Recreate the encoder.
+		// Also retry if the last recreation failed.
+		LogDriver("NvEnc: Recreate encoder for new size. (%dHz %dx%d %dMbits) -> (%dHz %dx%d %dMbits)"
 			, m_refreshRate, m_renderWidth, m_renderHeight, m_bitrateInMBits
 			, refreshRate, renderWidth, renderHeight, bitrateInMBits
 		);
+		try {
+			Shutdown();
 
-		if (refreshRate != 0) {
 			m_refreshRate = refreshRate;
-		}
-		if (renderWidth != 0) {
 			m_renderWidth = renderWidth;
-		}
-		if (renderHeight != 0) {
 			m_renderHeight = renderHeight;
-		}
-		if (bitrateInMBits != 0) {
 			m_bitrateInMBits = bitrateInMBits;
+
+			Initialize();
+		}
+		catch (Exception &e) {
+			FatalLog("NvEnc: Failed to recreate encoder. %ls", e.what());
+			// Transmit skips frames until a later Reconfigure succeeds.
+			m_NvNecoder.reset();
 		}
+		return;
+	}
+
+	NV_ENC_RECONFIGURE_PARAMS reconfigureParams = { NV_ENC_RECONFIGURE_PARAMS_VER };
+	NV_ENC_CONFIG encodeConfig = { NV_ENC_CONFIG_VER };
+
+	// A bitrate change only updates rate control, without reset or IDR frame.
+	bool restart = refreshRate != m_refreshRate;
+	reconfigureParams.resetEncoder = restart;
+	reconfigureParams.forceIDR = restart;
+	reconfigureParams.reInitEncodeParams.version = NV_ENC_INITIALIZE_PARAMS_VER;
+	reconfigureParams.reInitEncodeParams.encodeConfig = &encodeConfig;
+
+	FillEncodeConfig(reconfigureParams.reInitEncodeParams, refreshRate, renderWidth, renderHeight, Bitrate::fromMiBits(bitrateInMBits));
+
+	reconfigureParams.reInitEncodeParams.maxEncodeWidth = renderWidth;
+	reconfigureParams.reInitEncodeParams.maxEncodeHeight = renderHeight;
+
+	bool ret = false;
+	try {
+		ret = m_NvNecoder->Reconfigure(&reconfigureParams);
 	}
+	catch (NVENCException e) {
+		FatalLog("NvEnc Reconfigure failed with exception. Code=%d %hs. (%dHz %dx%d %dMbits) -> (%dHz %dx%d %dMbits)", e.getErrorCode(), e.what()
+			, m_refreshRate, m_renderWidth, m_renderHeight, m_bitrateInMBits
+			, refreshRate, renderWidth, renderHeight, bitrateInMBits
+		);
+		return;
+	}
+	if (!ret) {
+		FatalLog("NvEnc Reconfigure failed. Return code=%d. (%dHz %dx%d %dMbits) -> (%dHz %dx%d %dMbits)", ret
+			, m_refreshRate, m_renderWidth, m_renderHeight, m_bitrateInMBits
+			, refreshRate, renderWidth, renderHeight, bitrateInMBits
+		);
+		return;
+	}
+	LogDriver("NvEnc Reconfigure succeeded. (%dHz %dx%d %dMbits) -> (%dHz %dx%d %dMbits)"
+		, m_refreshRate, m_renderWidth, m_renderHeight, m_bitrateInMBits
+		, refreshRate, renderWidth, renderHeight, bitrateInMBits
+	);
+
+	m_refreshRate = refreshRate;
+	m_renderWidth = renderWidth;
+	m_renderHeight = renderHeight;
+	m_bitrateInMBits = bitrateInMBits;
 }
 
 void VideoEncoderNVENC::Shutdown()
@@ -178,6 +221,10 @@ void VideoEncoderNVENC::Shutdown()
 
 void VideoEncoderNVENC::Transmit(ID3D11Texture2D *pTexture, uint64_t presentationTime, uint64_t frameIndex, uint64_t frameIndex2, uint64_t clientTime, bool insertIDR)
 {
+	if (!m_NvNecoder) {
+		// Initialize failed in Reconfigure.
+		return;
+	}
 	std::vector<std::vector<uint8_t>> vPacket;
 
 	const NvEncInputFrame* encoderInputFrame = m_NvNecoder->GetNextInputFrame();
@@ -202,7 +249,29 @@ void VideoEncoderNVENC::Transmit(ID3D11Texture2D *pTexture, uint64_t presentatio
 		LogDriver("Inserting IDR frame.");
 		picParams.encodePicFlags = NV_ENC_PIC_FLAG_FORCEIDR;
 	}
-	m_NvNecoder->EncodeFrame(vPacket, &picParams);
+	if (m_sliceStreamer) {
+		// Slices are sent from the callback as soon as NVENC has written them.
+		m_sliceFrameIndex = frameIndex;
+		m_sliceInsertIDR = insertIDR;
+		m_NvNecoder->EncodeFrameSubFrame([&](uint8_t *data, int size, bool complete) {
+			if (!complete) {
+				// NVENC writes whole slices.
+				m_sliceStreamer->Update(data, size, true);
+				return;
+			}
+			m_sliceStreamer->End(data, size);
+			if (fpOut || Settings::Instance().m_DebugFrameOutput) {
+				vPacket.push_back(std::vector<uint8_t>(data, data + size));
+			}
+		}, &picParams);
+		if (!m_NvNecoder->IsSubFrameReadback() && !m_loggedNoSubFrameReadback) {
+			LogDriver("VideoEncoderNVENC: Sub-frame readback is unavailable. Slices are sent when the whole frame is encoded.");
+			m_loggedNoSubFrameReadback = true;
+		}
+	}
+	else {
+		m_NvNecoder->EncodeFrame(vPacket, &picParams);
+	}
 
 	Log("Tracking info delay: %lld us FrameIndex=%llu", GetTimestampUs() - m_Listener->clientToServerTime(clientTime), frameIndex);
 	Log("Encoding delay: %lld us FrameIndex=%llu", GetTimestampUs() - presentationTime, frameIndex);
@@ -217,8 +286,8 @@ void VideoEncoderNVENC::Transmit(ID3D11Texture2D *pTexture, uint64_t presentatio
 		if (fpOut) {
 			fpOut.write(reinterpret_cast<char*>(packet.data()), packet.size());
 		}
-		if (m_Listener) {
-			m_Listener->SendVideo(packet.data(), (int)packet.size(), frameIndex);
+		if (m_Listener && !m_sliceStreamer) {
+			m_Listener->SendVideo(packet.data(), (int)packet.size(), frameIndex, insertIDR);
 		}
 	}
 
@@ -262,6 +331,16 @@ void VideoEncoderNVENC::FillEncodeConfig(NV_ENC_INITIALIZE_PARAMS &initializePar
 	// Now, use 0 (use default).
 	int maxNumRefFrames = 0;
 
+	// Write out each slice as soon as it is encoded, for SliceStreamer. Partial output is locked
+	// without waiting, which needs sync mode. Without it, slices are sent when the frame is done.
+	int sliceCount = std::min(Settings::Instance().m_sliceCount, SliceStreamer::MAX_SLICE_COUNT);
+	if (sliceCount > 1 && Settings::Instance().m_nvencSubFrameReadback) {
+		bool supportsSubFrameReadback = m_NvNecoder->GetCapabilityValue(EncoderGUID, NV_ENC_CAPS_SUPPORT_SUBFRAME_READBACK) != 0;
+		initializeParams.enableSubFrameWrite = supportsSubFrameReadback;
+		initializeParams.enableEncodeAsync = !supportsSubFrameReadback;
+		LogDriver("VideoEncoderNVENC: SupportsSubFrameReadback: %d", supportsSubFrameReadback);
+	}
+
 	if (m_codec == ALVR_CODEC_H264) {
 		auto &config = encodeConfig.encodeCodecConfig.h264Config;
 		config.repeatSPSPPS = 1;
@@ -273,6 +352,11 @@ void VideoEncoderNVENC::FillEncodeConfig(NV_ENC_INITIALIZE_PARAMS &initializePar
 		//}
 		config.maxNumRefFrames = maxNumRefFrames;
 		config.idrPeriod = NVENC_INFINITE_GOPLENGTH;
+		if (sliceCount > 1) {
+			// sliceModeData is the number of slices per picture.
+			config.sliceMode = 3;
+			config.sliceModeData = sliceCount;
+		}
 	}
 	else {
 		auto &config = encodeConfig.encodeCodecConfig.hevcConfig;
@@ -285,6 +369,10 @@ void VideoEncoderNVENC::FillEncodeConfig(NV_ENC_INITIALIZE_PARAMS &initializePar
 		//}
 		config.maxNumRefFramesInDPB = maxNumRefFrames;
 		config.idrPeriod = NVENC_INFINITE_GOPLENGTH;
+		if (sliceCount > 1) {
+			config.sliceMode = 3;
+			config.sliceModeData = sliceCount;
+		}
 	}
 
 	// According to the document, NVIDIA Video Encoder Interface 5.0,
@@ -7,6 +7,7 @@
 #include "NvEncoderD3D11.h"
 #include "NvEncoderCuda.h"
 #include "CudaConverter.h"
+#include "SliceStreamer.h"
 #include "ipctools.h"
 
 // Video encoder for NVIDIA NvEnc.
@@ -39,6 +40,12 @@ private:
 	std::shared_ptr<CudaConverter> m_Converter;
 	bool mSupportsReferenceFrameInvalidation = false;
 
+	// Set if frames are sent in slices. Frame being encoded is passed to the callback in members.
+	std::unique_ptr<SliceStreamer> m_sliceStreamer;
+	uint64_t m_sliceFrameIndex = 0;
+	bool m_sliceInsertIDR = false;
+	bool m_loggedNoSubFrameReadback = false;
+
 	int m_codec;
 	int m_refreshRate;
 	int m_renderWidth;
@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <mferror.h>
+#include <codecapi.h>
+#include <wmcodecdsp.h>
+
+#include "VideoEncoderSW.h"
+
+using Microsoft::WRL::ComPtr;
+
+VideoEncoderSW::VideoEncoderSW(std::shared_ptr<CD3DRender> d3dRender
+	, std::shared_ptr<ClientConnection> listener
+	, int width, int height)
+	: m_d3dRender(d3dRender)
+	, m_Listener(listener)
+	, m_codec(Settings::Instance().m_codec)
+	, m_nalParser(Settings::Instance().m_codec)
+	, m_refreshRate(Settings::Instance().m_refreshRate)
+	, m_renderWidth(width)
+	, m_renderHeight(height)
+	, m_bitrateInMBits(Settings::Instance().mEncodeBitrate.toMiBits())
+{
+}
+
+VideoEncoderSW::~VideoEncoderSW()
+{
+	// CoUninitialize must run on the thread which initialized COM. Otherwise the process keeps it.
+	if (m_comInitialized && GetCurrentThreadId() == m_comThreadId) {
+		CoUninitialize();
+	}
+}
+
+void VideoEncoderSW::Initialize()
+{
+	LogDriver("Initializing VideoEncoderSW. Width=%d Height=%d", m_renderWidth, m_renderHeight);
+	if (m_codec != ALVR_CODEC_H264) {
+		throw MakeException(L"VideoEncoderSW only supports H.264.");
+	}
+
+	// COM is initialized once, by the thread of the first Initialize, and stays until destruction.
+	// Reconfigure calls Shutdown and Initialize from another thread, which is in the multithreaded
+	// apartment implicitly while it exists. S_FALSE (already initialized on this thread) is balanced by CoUninitialize too.
+	if (!m_comInitialized) {
+		m_comInitialized = SUCCEEDED(CoInitializeEx(NULL, COINIT_MULTITHREADED));
+		m_comThreadId = GetCurrentThreadId();
+	}
+	HRESULT hr = MFStartup(MF_VERSION, MFSTARTUP_LITE);
+	if (FAILED(hr)) {
+		Shutdown();
+		throw MakeException(L"MFStartup failed: hr = 0x%08x", hr);
+	}
+	m_mfStarted = true;
+
+	try {
+		CreateTransform();
+	}
+	catch (Exception &) {
+		Shutdown();
+		throw;
+	}
+
+	m_nv12 = std::make_unique<CpuFrame>(CpuFrame::FORMAT_NV12, m_renderWidth, m_renderHeight);
+	m_sampleTime = 0;
+
+	if (Settings::Instance().m_sliceCount > 1) {
+		// The encoder only outputs whole frames, so slices are not sent before the frame is encoded, but
+		// each one is still protected and paced on its own.
+		m_sliceStreamer.reset(new SliceStreamer(m_codec, Settings::Instance().m_sliceCount
+			, [this](uint8_t *buf, int len, int sliceIndex, int sliceCount) {
+				m_Listener->SendVideoSlice(buf, len, m_sliceFrameIndex, sliceIndex, sliceCount, m_sliceInsertIDR);
+			}));
+	}
+
+	if (Settings::Instance().m_DebugCaptureOutput) {
+		fpOut = std::ofstream(Settings::Instance().GetVideoOutput(), std::ios::out | std::ios::binary);
+		if (!fpOut)
+		{
+			LogDriver("Unable to open output file %hs", Settings::Instance().GetVideoOutput().c_str());
+		}
+	}
+
+	LogDriver("Successfully initialized VideoEncoderSW.");
+}
+
+void VideoEncoderSW::Reconfigure(int refreshRate, int renderWidth, int renderHeight, int bitrateInMBits)
+{
+	bool restart = (refreshRate != 0 && refreshRate != m_refreshRate) ||
+		(renderWidth != 0 && renderWidth != m_renderWidth) ||
+		(renderHeight != 0 && renderHeight != m_renderHeight);
+	if (!restart && bitrateInMBits != 0 && bitrateInMBits != m_bitrateInMBits) {
+		// Mean bitrate can be changed during encoding. Rate control follows it without IDR frame.
+		if (m_transform && SetCodecValue(CODECAPI_AVEncCommonMeanBitRate, bitrateInMBits * 1000000)) {
+			LogDriver("VideoEncoderSW: Bitrate changed. %dMbits -> %dMbits", m_bitrateInMBits, bitrateInMBits);
+			m_bitrateInMBits = bitrateInMBits;
+			return;
+		}
+		restart = true;
+	}
+	if (restart) {
+
+		LogDriver("VideoEncoderSW: Start to reconfigure. (%dHz %dx%d %dMbits) -> (%dHz %dx%d %dMbits)"
+			, m_refreshRate, m_renderWidth, m_renderHeight, m_bitrateInMBits
+			, refreshRate, renderWidth, renderHeight, bitrateInMBits
+		);
+
+		try {
+			Shutdown();
+
+			if (refreshRate != 0) {
+				m_refreshRate = refreshRate;
+			}
+			if (renderWidth != 0) {
+				m_renderWidth = renderWidth;
+			}
+			if (renderHeight != 0) {
+				m_renderHeight = renderHeight;
+			}
+			if (bitrateInMBits != 0) {
+				m_bitrateInMBits = bitrateInMBits;
+			}
+
+			// New stream starts with IDR frame.
+			Initialize();
+		}
+		catch (Exception &e) {
+			FatalLog("VideoEncoderSW: Failed to reconfigure. %ls"
+				, e.what()
+			);
+			return;
+		}
+	}
+}
+
+void VideoEncoderSW::Shutdown()
+{
+	LogDriver("Shutting down VideoEncoderSW.");
+
+	if (m_transform) {
+		m_transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_OF_STREAM, 0);
+		m_transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_STREAMING, 0);
+	}
+	m_codecAPI.Reset();
+	m_transform.Reset();
+	m_stagingTexture.Reset();
+	m_sliceStreamer.reset();
+	m_sequenceHeader.clear();
+	if (m_mfStarted) {
+		MFShutdown();
+		m_mfStarted = false;
+	}
+
+	if (fpOut) {
+		fpOut.close();
+	}
+	LogDriver("Successfully shutdown VideoEncoderSW.");
+}
+
+void VideoEncoderSW::Transmit(ID3D11Texture2D *pTexture, uint64_t presentationTime, uint64_t frameIndex, uint64_t frameIndex2, uint64_t clientTime, bool insertIDR)
+{
+	if (!m_transform) {
+		// Initialize failed in Reconfigure.
+		return;
+	}
+	ID3D11DeviceContext *context = m_d3dRender->GetContext();
+	if (!m_stagingTexture) {
+		D3D11_TEXTURE2D_DESC desc;
+		pTexture->GetDesc(&desc);
+		desc.Usage = D3D11_USAGE_STAGING;
+		desc.BindFlags = 0;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		desc.MiscFlags = 0;
+		HRESULT hr = m_d3dRender->GetDevice()->CreateTexture2D(&desc, NULL, &m_stagingTexture);
+		if (FAILED(hr)) {
+			FatalLog("VideoEncoderSW: CreateTexture2D failed: hr = 0x%08x", hr);
+			return;
+		}
+	}
+	context->CopyResource(m_stagingTexture.Get(), pTexture);
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HRESULT hr = context->Map(m_stagingTexture.Get(), 0, D3D11_MAP_READ, 0, &mapped);
+	if (FAILED(hr)) {
+		FatalLog("VideoEncoderSW: Map failed: hr = 0x%08x", hr);
+		return;
+	}
+	// Composited texture is RGBA (sRGB), as the CUDA converter expects.
+	CpuFrame frame(CpuFrame::FORMAT_RGBA, m_renderWidth, m_renderHeight, reinterpret_cast<uint8_t *>(mapped.pData)
+		, static_cast<int>(mapped.RowPitch));
+	Log("Tracking info delay: %lld us FrameIndex=%llu", GetTimestampUs() - m_Listener->clientToServerTime(clientTime), frameIndex);
+	Encode(frame, presentationTime, frameIndex, insertIDR);
+	context->Unmap(m_stagingTexture.Get(), 0);
+}
+
+void VideoEncoderSW::Encode(const CpuFrame &frame, uint64_t presentationTime, uint64_t frameIndex, bool insertIDR)
+{
+	if (!m_transform) {
+		// Initialize failed in Reconfigure.
+		return;
+	}
+	const CpuFrame *nv12 = &frame;
+	if (frame.GetFormat() == CpuFrame::FORMAT_RGBA) {
+		m_converter.Convert(frame, *m_nv12);
+		nv12 = m_nv12.get();
+	}
+
+	ComPtr<IMFMediaBuffer> buffer;
+	int width = m_renderWidth;
+	int size = width * m_renderHeight * 3 / 2;
+	HRESULT hr = MFCreateMemoryBuffer(size, &buffer);
+	if (FAILED(hr)) {
+		FatalLog("VideoEncoderSW: MFCreateMemoryBuffer failed: hr = 0x%08x", hr);
+		return;
+	}
+	BYTE *data;
+	buffer->Lock(&data, NULL, NULL);
+	for (int plane = 0; plane < 2; plane++) {
+		for (int y = 0; y < nv12->GetPlaneHeight(plane); y++) {
+			memcpy(data, nv12->GetPlane(plane) + nv12->GetPitch() * y, width);
+			data += width;
+		}
+	}
+	buffer->Unlock();
+	buffer->SetCurrentLength(size);
+
+	ComPtr<IMFSample> sample;
+	MFCreateSample(&sample);
+	sample->AddBuffer(buffer.Get());
+	// 100 ns units.
+	int64_t duration = 10 * 1000 * 1000 / m_refreshRate;
+	sample->SetSampleTime(m_sampleTime);
+	sample->SetSampleDuration(duration);
+	m_sampleTime += duration;
+
+	if (insertIDR) {
+		LogDriver("Inserting IDR frame.");
+		SetCodecValue(CODECAPI_AVEncVideoForceKeyFrame, 1);
+	}
+
+	hr = m_transform->ProcessInput(0, sample.Get(), 0);
+	if (FAILED(hr)) {
+		FatalLog("VideoEncoderSW: ProcessInput failed: hr = 0x%08x", hr);
+		return;
+	}
+	// Low latency mode outputs each frame before taking the next one.
+	while (ReadOutput()) {
+		if (m_Listener) {
+			m_Listener->GetStatistics()->EncodeOutput(GetTimestampUs() - presentationTime);
+		}
+		Send(frameIndex, insertIDR);
+	}
+}
+
+void VideoEncoderSW::CreateTransform()
+{
+	// Created directly rather than with MFTEnumEx, which may return a hardware encoder.
+	HRESULT hr = CoCreateInstance(CLSID_MSH264EncoderMFT, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&m_transform));
+	if (FAILED(hr)) {
+		throw MakeException(L"CoCreateInstance(CLSID_MSH264EncoderMFT) failed: hr = 0x%08x", hr);
+	}
+	hr = m_transform.As(&m_codecAPI);
+	if (FAILED(hr)) {
+		throw MakeException(L"QueryInterface(ICodecAPI) failed: hr = 0x%08x", hr);
+	}
+
+	// Must be set before the media types.
+	VARIANT lowLatency;
+	VariantInit(&lowLatency);
+	lowLatency.vt = VT_BOOL;
+	lowLatency.boolVal = VARIANT_TRUE;
+	hr = m_codecAPI->SetValue(&CODECAPI_AVLowLatencyMode, &lowLatency);
+	if (FAILED(hr)) {
+		throw MakeException(L"ICodecAPI::SetValue(CODECAPI_AVLowLatencyMode) failed: hr = 0x%08x", hr);
+	}
+	SetCodecValue(CODECAPI_AVEncCommonRateControlMode, eAVEncCommonRateControlMode_CBR);
+	SetCodecValue(CODECAPI_AVEncCommonMeanBitRate, m_bitrateInMBits * 1000000);
+	SetCodecValue(CODECAPI_AVEncMPVDefaultBPictureCount, 0);
+	int sliceCount = std::min(Settings::Instance().m_sliceCount, SliceStreamer::MAX_SLICE_COUNT);
+	if (sliceCount > 1) {
+		// Slice size in macroblock rows.
+		int rows = (m_renderHeight + 15) / 16;
+		SetCodecValue(CODECAPI_AVEncSliceControlMode, 2);
+		SetCodecValue(CODECAPI_AVEncSliceControlSize, (rows + sliceCount - 1) / sliceCount);
+	}
+
+	// Output type must be set before input type.
+	ComPtr<IMFMediaType> outputType;
+	MFCreateMediaType(&outputType);
+	outputType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+	outputType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_H264);
+	outputType->SetUINT32(MF_MT_AVG_BITRATE, m_bitrateInMBits * 1000000);
+	outputType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+	outputType->SetUINT32(MF_MT_MPEG2_PROFILE, eAVEncH264VProfile_Main);
+	MFSetAttributeSize(outputType.Get(), MF_MT_FRAME_SIZE, m_renderWidth, m_renderHeight);
+	MFSetAttributeRatio(outputType.Get(), MF_MT_FRAME_RATE, m_refreshRate, 1);
+	MFSetAttributeRatio(outputType.Get(), MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+	hr = m_transform->SetOutputType(0, outputType.Get(), 0);
+	if (FAILED(hr)) {
+		throw MakeException(L"IMFTransform::SetOutputType failed: hr = 0x%08x", hr);
+	}
+
+	ComPtr<IMFMediaType> inputType;
+	MFCreateMediaType(&inputType);
+	inputType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+	inputType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12);
+	inputType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+	MFSetAttributeSize(inputType.Get(), MF_MT_FRAME_SIZE, m_renderWidth, m_renderHeight);
+	MFSetAttributeRatio(inputType.Get(), MF_MT_FRAME_RATE, m_refreshRate, 1);
+	MFSetAttributeRatio(inputType.Get(), MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+	hr = m_transform->SetInputType(0, inputType.Get(), 0);
+	if (FAILED(hr)) {
+		throw MakeException(L"IMFTransform::SetInputType failed: hr = 0x%08x", hr);
+	}
+
+	ReadSequenceHeader();
+
+	m_transform->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, 0);
+	m_transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, 0);
+}
+
+bool VideoEncoderSW::SetCodecValue(const GUID &api, uint32_t value)
+{
+	VARIANT variant;
+	VariantInit(&variant);
+	variant.vt = VT_UI4;
+	variant.ulVal = value;
+	HRESULT hr = m_codecAPI->SetValue(&api, &variant);
+	if (FAILED(hr)) {
+		LogDriver("VideoEncoderSW: ICodecAPI::SetValue failed: hr = 0x%08x", hr);
+		return false;
+	}
+	return true;
+}
+
+bool VideoEncoderSW::ReadOutput()
+{
+	MFT_OUTPUT_STREAM_INFO info = {};
+	m_transform->GetOutputStreamInfo(0, &info);
+
+	ComPtr<IMFSample> sample;
+	if (!(info.dwFlags & MFT_OUTPUT_STREAM_PROVIDES_SAMPLES)) {
+		ComPtr<IMFMediaBuffer> buffer;
+		MFCreateMemoryBuffer(info.cbSize, &buffer);
+		MFCreateSample(&sample);
+		sample->AddBuffer(buffer.Get());
+	}
+
+	MFT_OUTPUT_DATA_BUFFER output = {};
+	output.pSample = sample.Get();
+	DWORD status = 0;
+	HRESULT hr = m_transform->ProcessOutput(0, 1, &output, &status);
+	if (output.pEvents) {
+		output.pEvents->Release();
+	}
+	if (hr == MF_E_TRANSFORM_NEED_MORE_INPUT) {
+		return false;
+	}
+	if (FAILED(hr)) {
+		FatalLog("VideoEncoderSW: ProcessOutput failed: hr = 0x%08x", hr);
+		return false;
+	}
+	if (!sample) {
+		// Provided by the encoder.
+		sample.Attach(output.pSample);
+	}
+
+	ComPtr<IMFMediaBuffer> buffer;
+	sample->ConvertToContiguousBuffer(&buffer);
+	BYTE *data;
+	DWORD length;
+	buffer->Lock(&data, NULL, &length);
+	m_output.assign(data, data + length);
+	buffer->Unlock();
+	return true;
+}
+
+void VideoEncoderSW::ReadSequenceHeader()
+{
+	m_sequenceHeader.clear();
+	ComPtr<IMFMediaType> type;
+	if (FAILED(m_transform->GetOutputCurrentType(0, &type))) {
+		return;
+	}
+	UINT32 size = 0;
+	if (FAILED(type->GetBlobSize(MF_MT_MPEG_SEQUENCE_HEADER, &size)) || size == 0) {
+		return;
+	}
+	m_sequenceHeader.resize(size);
+	type->GetBlob(MF_MT_MPEG_SEQUENCE_HEADER, m_sequenceHeader.data(), size, NULL);
+}
+
+void VideoEncoderSW::Send(uint64_t frameIndex, bool insertIDR)
+{
+	NalParser::FrameInfo info = m_nalParser.Classify(m_output.data(), static_cast<int>(m_output.size()));
+	if (info.frameType == ALVR_FRAME_TYPE_IDR && !info.parameterSets) {
+		// Client needs parameter sets with each IDR frame to start decoding.
+		m_output.insert(m_output.begin(), m_sequenceHeader.begin(), m_sequenceHeader.end());
+	}
+	uint8_t *p = m_output.data();
+	int length = static_cast<int>(m_output.size());
+
+	Log("VideoEncoderSW: Encoded frame. Size=%d bytes frameIndex=%llu frameType=%d", length, frameIndex, info.frameType);
+
+	if (fpOut) {
+		fpOut.write(reinterpret_cast<char *>(p), length);
+	}
+	if (m_Listener) {
+		if (m_sliceStreamer) {
+			m_sliceFrameIndex = frameIndex;
+			m_sliceInsertIDR = insertIDR;
+			m_sliceStreamer->End(p, length);
+		}
+		else {
+			m_Listener->SendVideo(p, length, frameIndex, insertIDR);
+		}
+	}
+}
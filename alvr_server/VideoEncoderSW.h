@@ -0,0 +1,77 @@
+#pragma once
+
+#include <memory>
+#include <fstream>
+#include <mfapi.h>
+#include <mftransform.h>
+#include <strmif.h>
+#include <wrl.h>
+
+#include "VideoEncoder.h"
+#include "CpuFrame.h"
+#include "RGBToNV12ConverterCPU.h"
+#include "SliceStreamer.h"
+
+// Video encoder running on CPU, for hosts without a supported GPU encoder and for reproducible
+// benchmarks of the whole encode, FEC and send pipeline.
+//
+// Uses the H.264 encoder of Media Foundation (CLSID_MSH264EncoderMFT), which is software only and
+// comes with Windows, in low latency mode: CBR, no B frames and one output per input. H.265 is not
+// supported.
+//
+// Frames are encoded synchronously by the calling thread. Transmit reads the composited texture back
+// through a staging texture. Encode takes a frame already in system memory, so no D3D device is needed.
+class VideoEncoderSW : public VideoEncoder
+{
+public:
+	// d3dRender may be null if only Encode is used.
+	VideoEncoderSW(std::shared_ptr<CD3DRender> d3dRender
+		, std::shared_ptr<ClientConnection> listener
+		, int width, int height);
+	~VideoEncoderSW();
+
+	void Initialize();
+	void Reconfigure(int refreshRate, int renderWidth, int renderHeight, int bitrateInMBits);
+	void Shutdown();
+
+	void Transmit(ID3D11Texture2D *pTexture, uint64_t presentationTime, uint64_t frameIndex, uint64_t frameIndex2, uint64_t clientTime, bool insertIDR);
+	// frame: FORMAT_RGBA or FORMAT_NV12 of encoding resolution. presentationTime is for encode latency statistics.
+	void Encode(const CpuFrame &frame, uint64_t presentationTime, uint64_t frameIndex, bool insertIDR);
+private:
+	std::shared_ptr<CD3DRender> m_d3dRender;
+	std::shared_ptr<ClientConnection> m_Listener;
+
+	Microsoft::WRL::ComPtr<IMFTransform> m_transform;
+	Microsoft::WRL::ComPtr<ICodecAPI> m_codecAPI;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> m_stagingTexture;
+	bool m_mfStarted = false;
+	bool m_comInitialized = false;
+	DWORD m_comThreadId = 0;
+
+	RGBToNV12ConverterCPU m_converter;
+	std::unique_ptr<CpuFrame> m_nv12;
+	// SPS and PPS, prepended to IDR frames which come without them.
+	std::vector<uint8_t> m_sequenceHeader;
+	std::vector<uint8_t> m_output;
+	int64_t m_sampleTime = 0;
+
+	std::ofstream fpOut;
+
+	// Not null when frames are sent in slices.
+	std::unique_ptr<SliceStreamer> m_sliceStreamer;
+	uint64_t m_sliceFrameIndex = 0;
+	bool m_sliceInsertIDR = false;
+
+	int m_codec;
+	NalParser m_nalParser;
+	int m_refreshRate;
+	int m_renderWidth;
+	int m_renderHeight;
+	int m_bitrateInMBits;
+
+	void CreateTransform();
+	bool SetCodecValue(const GUID &api, uint32_t value);
+	bool ReadOutput();
+	void ReadSequenceHeader();
+	void Send(uint64_t frameIndex, bool insertIDR);
+};
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "VideoEncoderVCE.h"
 
 #define AMF_THROW_IF(expr) {AMF_RESULT res = expr;\
@@ -5,6 +7,7 @@ if(res != AMF_OK){throw MakeException(L"AMF Error %d. %s", res, L#expr);}}
 
 const wchar_t *VideoEncoderVCE::START_TIME_PROPERTY = L"StartTimeProperty";
 const wchar_t *VideoEncoderVCE::FRAME_INDEX_PROPERTY = L"FrameIndexProperty";
+const wchar_t *VideoEncoderVCE::INSERT_IDR_PROPERTY = L"InsertIDRProperty";
 
 //
 // AMFTextureEncoder
@@ -14,11 +17,13 @@ AMFTextureEncoder::AMFTextureEncoder(const amf::AMFContextPtr &amfContext
 	, int codec, int width, int height, int refreshRate, int bitrateInMbits
 	, amf::AMF_SURFACE_FORMAT inputFormat
 	, AMFTextureReceiver receiver) : m_receiver(receiver)
+	, m_codec(codec)
 {
 	const wchar_t *pCodec;
 
 	amf_int32 frameRateIn = refreshRate;
 	amf_int64 bitRateIn = bitrateInMbits * 1000000L; // in bits
+	amf_int64 sliceCount = std::min(Settings::Instance().m_sliceCount, SliceStreamer::MAX_SLICE_COUNT);
 
 	switch (codec) {
 	case ALVR_CODEC_H264:
@@ -44,6 +49,9 @@ AMFTextureEncoder::AMFTextureEncoder(const amf::AMFContextPtr &amfContext
 		m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_TARGET_BITRATE, bitRateIn);
 		m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_FRAMESIZE, ::AMFConstructSize(width, height));
 		m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_FRAMERATE, ::AMFConstructRate(frameRateIn, 1));
+		if (sliceCount > 1) {
+			m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_SLICES_PER_FRAME, sliceCount);
+		}
 
 		//m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_PROFILE, AMF_VIDEO_ENCODER_PROFILE_HIGH);
 		//m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_PROFILE_LEVEL, 51);
@@ -57,6 +65,9 @@ AMFTextureEncoder::AMFTextureEncoder(const amf::AMFContextPtr &amfContext
 		m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_HEVC_TARGET_BITRATE, bitRateIn);
 		m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_HEVC_FRAMESIZE, ::AMFConstructSize(width, height));
 		m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_HEVC_FRAMERATE, ::AMFConstructRate(frameRateIn, 1));
+		if (sliceCount > 1) {
+			m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_HEVC_SLICES_PER_FRAME, sliceCount);
+		}
 
 		//m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_HEVC_TIER, AMF_VIDEO_ENCODER_HEVC_TIER_HIGH);
 		//m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_HEVC_PROFILE_LEVEL, AMF_LEVEL_5);
@@ -86,6 +97,19 @@ void AMFTextureEncoder::Shutdown()
 	m_thread = NULL;
 }
 
+void AMFTextureEncoder::SetBitrate(int bitrateInMbits)
+{
+	amf_int64 bitRateIn = bitrateInMbits * 1000000L; // in bits
+	if (m_codec == ALVR_CODEC_H264)
+	{
+		AMF_THROW_IF(m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_TARGET_BITRATE, bitRateIn));
+	}
+	else
+	{
+		AMF_THROW_IF(m_amfEncoder->SetProperty(AMF_VIDEO_ENCODER_HEVC_TARGET_BITRATE, bitRateIn));
+	}
+}
+
 void AMFTextureEncoder::Submit(amf::AMFData *data)
 {
 	while (true)
@@ -218,6 +242,7 @@ VideoEncoderVCE::VideoEncoderVCE(std::shared_ptr<CD3DRender> d3dRender
 	: m_d3dRender(d3dRender)
 	, m_Listener(listener)
 	, m_codec(Settings::Instance().m_codec)
+	, m_nalParser(Settings::Instance().m_codec)
 	, m_refreshRate(Settings::Instance().m_refreshRate)
 	, m_renderWidth(width)
 	, m_renderHeight(height)
@@ -246,6 +271,15 @@ void VideoEncoderVCE::Initialize()
 		, CONVERTER_INPUT_FORMAT, ENCODER_INPUT_FORMAT
 		, std::bind(&AMFTextureEncoder::Submit, m_encoder.get(), std::placeholders::_1));
 
+	if (Settings::Instance().m_sliceCount > 1) {
+		// AMF only outputs whole frames, so slices are not sent before the frame is encoded, but each
+		// one is still protected and paced on its own.
+		m_sliceStreamer.reset(new SliceStreamer(m_codec, Settings::Instance().m_sliceCount
+			, [this](uint8_t *buf, int len, int sliceIndex, int sliceCount) {
+				m_Listener->SendVideoSlice(buf, len, m_sliceFrameIndex, sliceIndex, sliceCount, m_sliceInsertIDR);
+			}));
+	}
+
 	m_encoder->Start();
 	m_converter->Start();
 
@@ -266,10 +300,23 @@ void VideoEncoderVCE::Initialize()
 
 void VideoEncoderVCE::Reconfigure(int refreshRate, int renderWidth, int renderHeight, int bitrateInMBits)
 {
-	if ((refreshRate != 0 && refreshRate != m_refreshRate) ||
+	bool restart = (refreshRate != 0 && refreshRate != m_refreshRate) ||
 		(renderWidth != 0 && renderWidth != m_renderWidth) ||
-		(renderHeight != 0 && renderHeight != m_renderHeight) ||
-		(bitrateInMBits != 0 && bitrateInMBits != m_bitrateInMBits)) {
+		(renderHeight != 0 && renderHeight != m_renderHeight);
+	if (!restart && bitrateInMBits != 0 && bitrateInMBits != m_bitrateInMBits) {
+		// Target bitrate is a dynamic property. Rate control follows it without restart or IDR frame.
+		try {
+			m_encoder->SetBitrate(bitrateInMBits);
+			LogDriver("VideoEncoderVCE: Bitrate changed. %dMbits -> %dMbits", m_bitrateInMBits, bitrateInMBits);
+			m_bitrateInMBits = bitrateInMBits;
+			return;
+		}
+		catch (Exception &e) {
+			LogDriver("VideoEncoderVCE: Failed to change bitrate. Restart encoder. %ls", e.what());
+			restart = true;
+		}
+	}
+	if (restart) {
 
 		LogDriver("VideoEncoderVCE: Start to reconfigure. (%dHz %dx%d %dMbits) -> (%dHz %dx%d %dMbits)"
 			, m_refreshRate, m_renderWidth, m_renderHeight, m_bitrateInMBits
@@ -295,7 +342,7 @@ void VideoEncoderVCE::Reconfigure(int refreshRate, int renderWidth, int renderHe
 			Initialize();
 		}
 		catch (Exception &e) {
-			FatalLog("VideoEncoderVCE: Failed to reconfigure. %hs"
+			FatalLog("VideoEncoderVCE: Failed to reconfigure. %ls"
 				, e.what()
 			);
 			return;
@@ -329,6 +376,7 @@ void VideoEncoderVCE::Transmit(ID3D11Texture2D *pTexture, uint64_t presentationT
 	amf_pts start_time = amf_high_precision_clock();
 	surface->SetProperty(START_TIME_PROPERTY, start_time);
 	surface->SetProperty(FRAME_INDEX_PROPERTY, frameIndex);
+	surface->SetProperty(INSERT_IDR_PROPERTY, insertIDR);
 
 	ApplyFrameProperties(surface, insertIDR);
 
@@ -341,8 +389,10 @@ void VideoEncoderVCE::Receive(amf::AMFData *data)
 	amf_pts current_time = amf_high_precision_clock();
 	amf_pts start_time = 0;
 	uint64_t frameIndex;
+	bool insertIDR = false;
 	data->GetProperty(START_TIME_PROPERTY, &start_time);
 	data->GetProperty(FRAME_INDEX_PROPERTY, &frameIndex);
+	data->GetProperty(INSERT_IDR_PROPERTY, &insertIDR);
 
 	amf::AMFBufferPtr buffer(data); // query for buffer interface
 
@@ -353,16 +403,24 @@ void VideoEncoderVCE::Receive(amf::AMFData *data)
 		m_Listener->GetStatistics()->EncodeOutput((current_time - start_time) / MICROSEC_TIME);
 	}
 
-	char *p = reinterpret_cast<char *>(buffer->GetNative());
+	uint8_t *p = reinterpret_cast<uint8_t *>(buffer->GetNative());
 	int length = static_cast<int>(buffer->GetSize());
 
-	SkipAUD(&p, &length);
+	// H.265 encoder always produces AUD NAL even if AMF_VIDEO_ENCODER_HEVC_INSERT_AUD is set. But it is not needed.
+	m_nalParser.StripAUD(&p, &length);
 
 	if (fpOut) {
-		fpOut.write(p, length);
+		fpOut.write(reinterpret_cast<char *>(p), length);
 	}
 	if (m_Listener) {
-		m_Listener->SendVideo(reinterpret_cast<uint8_t *>(p), length, frameIndex);
+		if (m_sliceStreamer) {
+			m_sliceFrameIndex = frameIndex;
+			m_sliceInsertIDR = insertIDR;
+			m_sliceStreamer->End(p, length);
+		}
+		else {
+			m_Listener->SendVideo(p, length, frameIndex, insertIDR);
+		}
 	}
 }
 
@@ -392,27 +450,3 @@ void VideoEncoderVCE::ApplyFrameProperties(const amf::AMFSurfacePtr &surface, bo
 		break;
 	}
 }
-
-void VideoEncoderVCE::SkipAUD(char **buffer, int *length) {
-	// H.265 encoder always produces AUD NAL even if AMF_VIDEO_ENCODER_HEVC_INSERT_AUD is set. But it is not needed.
-	static const int AUD_NAL_SIZE = 7;
-
-	if (m_codec != ALVR_CODEC_H265) {
-		return;
-	}
-
-	if (*length < AUD_NAL_SIZE + 4) {
-		return;
-	}
-
-	// Check if start with AUD NAL.
-	if (memcmp(*buffer, "\x00\x00\x00\x01\x46", 5) != 0) {
-		return;
-	}
-	// Check if AUD NAL size is AUD_NAL_SIZE bytes.
-	if (memcmp(*buffer + AUD_NAL_SIZE, "\x00\x00\x00\x01", 4) != 0) {
-		return;
-	}
-	*buffer += AUD_NAL_SIZE;
-	*length -= AUD_NAL_SIZE;
-}
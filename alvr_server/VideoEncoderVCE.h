@@ -1,5 +1,7 @@
 #pragma once
 #include "VideoEncoder.h"
+#include "NalParser.h"
+#include "SliceStreamer.h"
 
 #include "amf/common/AMFFactory.h"
 #include "amf/include/components/VideoEncoderVCE.h"
@@ -21,8 +23,11 @@ public:
 	void Start();
 	void Shutdown();
 	void Submit(amf::AMFData *data);
+	// Changes the target bitrate of the running encoder, without IDR frame.
+	void SetBitrate(int bitrateInMbits);
 private:
 	amf::AMFComponentPtr m_amfEncoder;
+	int m_codec;
 	std::thread *m_thread = NULL;
 	AMFTextureReceiver m_receiver;
 
@@ -69,6 +74,7 @@ private:
 	
 	static const wchar_t *START_TIME_PROPERTY;
 	static const wchar_t *FRAME_INDEX_PROPERTY;
+	static const wchar_t *INSERT_IDR_PROPERTY;
 
 	const uint64_t MILLISEC_TIME = 10000;
 	const uint64_t MICROSEC_TIME = 10;
@@ -83,12 +89,16 @@ private:
 	std::shared_ptr<ClientConnection> m_Listener;
 
 	int m_codec;
+	NalParser m_nalParser;
+	// Not null when frames are sent in slices.
+	std::unique_ptr<SliceStreamer> m_sliceStreamer;
+	uint64_t m_sliceFrameIndex = 0;
+	bool m_sliceInsertIDR = false;
 	int m_refreshRate;
 	int m_renderWidth;
 	int m_renderHeight;
 	int m_bitrateInMBits;
 
 	void ApplyFrameProperties(const amf::AMFSurfacePtr &surface, bool insertIDR);
-	void SkipAUD(char **buffer, int *length);
 };
 
@@ -0,0 +1,11 @@
+# Builds libopus for alvr_server. Run on Windows in Git Bash with CMake and Visual Studio 2019.
+# alvr_server and gtest use Opus (opus_frames.h) if libopus/include/opus/opus.h exists, ADPCM otherwise.
+git clone https://github.com/xiph/opus.git
+cd opus
+git checkout v1.3.1
+# static library, dynamic CRT as alvr_server
+cmake -S . -B build -G "Visual Studio 16 2019" -A x64 -DOPUS_BUILD_SHARED_LIBRARY=OFF -DOPUS_STACK_PROTECTOR=OFF -DCMAKE_INSTALL_PREFIX="$PWD/installdirs"
+cmake --build build --config Release --target install
+mkdir -p ../include ../lib
+cp -r installdirs/include/opus ../include/
+cp installdirs/lib/opus.lib ../lib/
@@ -0,0 +1,383 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../alvr_server/AudioEncoder.h"
+#include "../../ALVR-common/adpcm.h"
+#include "../../ALVR-common/opus_frames.h"
+
+// Game audio codec tests and benchmark. AudioCapture is replaced by a WAV file, so no WASAPI device
+// is needed: set ALVR_BENCH_WAV to a 48 kHz 16-bit PCM WAV file (mono or stereo). Without it,
+// 10 seconds of synthetic music (chords, noise bursts) are used.
+namespace {
+	static const int SAMPLE_RATE = 48000;
+	static const int CHANNELS = 2;
+	static const int FRAME_SAMPLES = SAMPLE_RATE * AudioEncoder::FRAME_MS / 1000;
+	static const double PI = 3.14159265358979323846;
+
+	std::vector<int16_t> SyntheticMusic(int seconds) {
+		std::vector<int16_t> pcm(SAMPLE_RATE * seconds * CHANNELS);
+		std::mt19937 random(3);
+		std::normal_distribution<double> noise(0, 1);
+		const double chords[4][3] = { { 261.6, 329.6, 392.0 }, { 220.0, 261.6, 329.6 }, { 174.6, 220.0, 261.6 }, { 196.0, 246.9, 293.7 } };
+		for (int i = 0; i < SAMPLE_RATE * seconds; i++) {
+			double t = (double)i / SAMPLE_RATE;
+			const double *chord = chords[(i / (SAMPLE_RATE / 2)) % 4];
+			double tone = 0;
+			for (int n = 0; n < 3; n++) {
+				for (int h = 1; h <= 4; h++) {
+					tone += sin(2 * PI * chord[n] * h * t) / h;
+				}
+			}
+			// Percussion every 250 ms.
+			double beat = fmod(t, 0.25);
+			double drum = noise(random) * exp(-beat * 40);
+			double left = 2500 * tone + 6000 * drum;
+			double right = 2500 * tone * 0.8 + 6000 * drum * 1.1;
+			pcm[i * 2] = (int16_t)std::min(std::max(left, -32768.0), 32767.0);
+			pcm[i * 2 + 1] = (int16_t)std::min(std::max(right, -32768.0), 32767.0);
+		}
+		return pcm;
+	}
+
+	// Returns false if file is missing or not 48 kHz 16-bit PCM.
+	bool LoadWav(const char *path, std::vector<int16_t> &pcm) {
+		std::ifstream file(path, std::ios::binary);
+		std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (data.size() < 12 || memcmp(&data[0], "RIFF", 4) != 0 || memcmp(&data[8], "WAVE", 4) != 0) {
+			return false;
+		}
+		uint16_t channels = 0;
+		size_t pos = 12;
+		while (pos + 8 <= data.size()) {
+			uint32_t size;
+			memcpy(&size, &data[pos + 4], 4);
+			const char *body = &data[pos + 8];
+			size = (uint32_t)std::min<size_t>(size, data.size() - pos - 8);
+			if (memcmp(&data[pos], "fmt ", 4) == 0 && size >= 16) {
+				uint16_t format, bits;
+				uint32_t rate;
+				memcpy(&format, body, 2);
+				memcpy(&channels, body + 2, 2);
+				memcpy(&rate, body + 4, 4);
+				memcpy(&bits, body + 14, 2);
+				if (format != 1 || rate != SAMPLE_RATE || bits != 16 || channels < 1 || channels > 2) {
+					return false;
+				}
+			}
+			else if (memcmp(&data[pos], "data", 4) == 0 && channels != 0) {
+				int samples = size / 2 / channels;
+				pcm.resize(samples * CHANNELS);
+				for (int i = 0; i < samples; i++) {
+					for (int c = 0; c < CHANNELS; c++) {
+						memcpy(&pcm[i * CHANNELS + c], body + (i * channels + std::min(c, channels - 1)) * 2, 2);
+					}
+				}
+				return samples > 0;
+			}
+			pos += 8 + size + (size & 1);
+		}
+		return false;
+	}
+
+	double Snr(const int16_t *reference, const int16_t *decoded, int count) {
+		double signal = 0;
+		double error = 0;
+		for (int i = 0; i < count; i++) {
+			signal += (double)reference[i] * reference[i];
+			error += (double)(reference[i] - decoded[i]) * (reference[i] - decoded[i]);
+		}
+		return error == 0 ? 99 : 10 * log10(signal / error);
+	}
+
+	std::vector<int16_t> Downmix(const int16_t *pcm, int samples) {
+		std::vector<int16_t> mono(samples * CHANNELS);
+		for (int i = 0; i < samples; i++) {
+			int16_t m = (int16_t)((pcm[i * 2] + pcm[i * 2 + 1]) / 2);
+			mono[i * 2] = mono[i * 2 + 1] = m;
+		}
+		return mono;
+	}
+
+	// Encodes whole pcm into ADPCM frames.
+	std::vector<std::vector<uint8_t>> EncodeFrames(const std::vector<int16_t> &pcm, bool fec) {
+		AdpcmEncoder encoder(CHANNELS, FRAME_SAMPLES, fec);
+		std::vector<std::vector<uint8_t>> frames;
+		std::vector<uint8_t> out(AdpcmEncoder::GetMaxFrameBytes(CHANNELS, FRAME_SAMPLES, fec));
+		for (size_t pos = 0; pos + FRAME_SAMPLES * CHANNELS <= pcm.size(); pos += FRAME_SAMPLES * CHANNELS) {
+			int len = encoder.Encode(&pcm[pos], &out[0]);
+			frames.emplace_back(out.begin(), out.begin() + len);
+		}
+		return frames;
+	}
+
+#ifdef ALVR_OPUS
+	// Encodes whole pcm into Opus frames.
+	std::vector<std::vector<uint8_t>> EncodeOpusFrames(const std::vector<int16_t> &pcm, bool fec) {
+		std::unique_ptr<OpusFrameEncoder> encoder(OpusFrameEncoder::Create(SAMPLE_RATE, CHANNELS, FRAME_SAMPLES, fec));
+		std::vector<std::vector<uint8_t>> frames;
+		std::vector<uint8_t> out(OpusFrameEncoder::GetMaxFrameBytes(SAMPLE_RATE, FRAME_SAMPLES, fec));
+		for (size_t pos = 0; pos + FRAME_SAMPLES * CHANNELS <= pcm.size(); pos += FRAME_SAMPLES * CHANNELS) {
+			int len = encoder->Encode(&pcm[pos], &out[0]);
+			frames.emplace_back(out.begin(), out.begin() + len);
+		}
+		return frames;
+	}
+#endif
+}
+
+TEST(audio_codec_test, adpcm_round_trip) {
+	std::vector<int16_t> pcm = SyntheticMusic(2);
+	auto frames = EncodeFrames(pcm, false);
+	AdpcmDecoder decoder(CHANNELS, FRAME_SAMPLES);
+	std::vector<int16_t> decoded(pcm.size());
+	for (size_t i = 0; i < frames.size(); i++) {
+		EXPECT_EQ(FRAME_SAMPLES, decoder.Decode(&frames[i][0], (int)frames[i].size(), &decoded[i * FRAME_SAMPLES * CHANNELS]));
+	}
+	double snr = Snr(&pcm[0], &decoded[0], (int)pcm.size());
+	printf("ADPCM SNR %.1f dB, %d bytes/frame (PCM %d)\n", snr, (int)frames[0].size(), FRAME_SAMPLES * CHANNELS * 2);
+	EXPECT_GT(snr, 18.0);
+	EXPECT_LT(frames[0].size() * 3, (size_t)FRAME_SAMPLES * CHANNELS * 2);
+}
+
+TEST(audio_codec_test, frames_decode_independently) {
+	std::vector<int16_t> pcm = SyntheticMusic(1);
+	auto frames = EncodeFrames(pcm, true);
+	std::vector<int16_t> sequential(FRAME_SAMPLES * CHANNELS);
+	std::vector<int16_t> alone(FRAME_SAMPLES * CHANNELS);
+
+	AdpcmDecoder decoder(CHANNELS, FRAME_SAMPLES);
+	for (int i = 0; i <= 20; i++) {
+		decoder.Decode(&frames[i][0], (int)frames[i].size(), &sequential[0]);
+	}
+	AdpcmDecoder fresh(CHANNELS, FRAME_SAMPLES);
+	fresh.Decode(&frames[20][0], (int)frames[20].size(), &alone[0]);
+	EXPECT_TRUE(sequential == alone);
+
+	// Malformed payloads are rejected.
+	EXPECT_EQ(-1, fresh.Decode(&frames[20][0], 10, &alone[0]));
+	AdpcmDecoder mono(1, FRAME_SAMPLES);
+	EXPECT_EQ(-1, mono.Decode(&frames[20][0], (int)frames[20].size(), &alone[0]));
+}
+
+TEST(audio_codec_test, fec_recovers_lost_frame) {
+	std::vector<int16_t> pcm = SyntheticMusic(1);
+	auto frames = EncodeFrames(pcm, true);
+	auto plain = EncodeFrames(pcm, false);
+	EXPECT_EQ(0, frames[0][3]);
+	EXPECT_EQ(1, frames[1][3]);
+	EXPECT_EQ(frames[1].size(), plain[1].size() + sizeof(AdpcmChannelState) + FRAME_SAMPLES / 2);
+
+	const int lost = 30;
+	const int16_t *original = &pcm[lost * FRAME_SAMPLES * CHANNELS];
+	std::vector<int16_t> mono = Downmix(original, FRAME_SAMPLES);
+	std::vector<int16_t> recovered(FRAME_SAMPLES * CHANNELS);
+	std::vector<int16_t> concealed(FRAME_SAMPLES * CHANNELS);
+
+	AdpcmDecoder decoder(CHANNELS, FRAME_SAMPLES);
+	std::vector<int16_t> out(FRAME_SAMPLES * CHANNELS);
+	for (int i = 0; i < lost; i++) {
+		decoder.Decode(&frames[i][0], (int)frames[i].size(), &out[0]);
+	}
+	AdpcmDecoder concealer = decoder;
+	EXPECT_EQ(FRAME_SAMPLES, concealer.Conceal(&concealed[0]));
+	EXPECT_EQ(FRAME_SAMPLES, decoder.DecodeRedundant(&frames[lost + 1][0], (int)frames[lost + 1].size(), &recovered[0]));
+	std::vector<int16_t> none(FRAME_SAMPLES * CHANNELS);
+	EXPECT_EQ(0, decoder.DecodeRedundant(&plain[lost + 1][0], (int)plain[lost + 1].size(), &none[0]));
+
+	double recoveredSnr = Snr(&mono[0], &recovered[0], FRAME_SAMPLES * CHANNELS);
+	double concealedSnr = Snr(original, &concealed[0], FRAME_SAMPLES * CHANNELS);
+	printf("Lost frame: recovered from FEC %.1f dB (vs mono), concealed %.1f dB\n", recoveredSnr, concealedSnr);
+	EXPECT_GT(recoveredSnr, 15.0);
+	EXPECT_GT(recoveredSnr, concealedSnr + 10);
+}
+
+TEST(audio_codec_test, conceal_fades_out) {
+	std::vector<int16_t> pcm = SyntheticMusic(1);
+	auto frames = EncodeFrames(pcm, false);
+	AdpcmDecoder decoder(CHANNELS, FRAME_SAMPLES);
+	std::vector<int16_t> last(FRAME_SAMPLES * CHANNELS);
+	std::vector<int16_t> out(FRAME_SAMPLES * CHANNELS);
+	decoder.Decode(&frames[10][0], (int)frames[10].size(), &last[0]);
+
+	decoder.Conceal(&out[0]);
+	EXPECT_EQ(last[0], out[0]);
+	double previousEnergy = 1e300;
+	for (int i = 1; i < AdpcmDecoder::CONCEAL_FRAMES; i++) {
+		decoder.Conceal(&out[0]);
+		double energy = 0;
+		for (auto s : out) {
+			energy += (double)s * s;
+		}
+		EXPECT_LT(energy, previousEnergy);
+		previousEnergy = energy;
+	}
+	decoder.Conceal(&out[0]);
+	for (auto s : out) {
+		EXPECT_EQ(0, s);
+	}
+	// Next good frame ends concealment.
+	EXPECT_EQ(FRAME_SAMPLES, decoder.Decode(&frames[11][0], (int)frames[11].size(), &out[0]));
+	decoder.Conceal(&out[0]);
+	EXPECT_NE(0, out[0] | out[1] | out[2]);
+}
+
+TEST(audio_codec_test, encoder_frames_irregular_input) {
+	std::vector<int16_t> pcm = SyntheticMusic(1);
+	std::vector<int16_t> output;
+	std::vector<uint64_t> times;
+	AudioEncoder encoder(ALVR_AUDIO_CODEC_PCM, false, SAMPLE_RATE, CHANNELS, [&](uint8_t *buf, int len, uint64_t presentationTime) {
+		EXPECT_EQ(FRAME_SAMPLES * CHANNELS * 2, len);
+		output.insert(output.end(), (int16_t *)buf, (int16_t *)(buf + len));
+		times.push_back(presentationTime);
+	});
+	EXPECT_EQ(FRAME_SAMPLES, encoder.GetFrameSamples());
+
+	// 44.1 kHz device periods resampled to 48 kHz do not align with frames.
+	const int chunk = 441;
+	uint64_t time = 1000000;
+	for (size_t pos = 0; pos + chunk * CHANNELS <= pcm.size(); pos += chunk * CHANNELS) {
+		time += (uint64_t)chunk * 1000000 / SAMPLE_RATE;
+		encoder.Feed((uint8_t *)&pcm[pos], chunk * CHANNELS * 2, time);
+	}
+	EXPECT_EQ((size_t)(pcm.size() / chunk / CHANNELS * chunk / FRAME_SAMPLES), times.size());
+	EXPECT_TRUE(memcmp(&pcm[0], &output[0], output.size() * 2) == 0);
+	for (size_t i = 1; i < times.size(); i++) {
+		EXPECT_NEAR((double)AudioEncoder::FRAME_MS * 1000, (double)(times[i] - times[i - 1]), 30);
+	}
+
+	AudioEncoder unknown(100, false, SAMPLE_RATE, CHANNELS, [](uint8_t *, int, uint64_t) {});
+	EXPECT_EQ(ALVR_AUDIO_CODEC_PCM, unknown.GetCodec());
+}
+
+TEST(audio_codec_test, opus_falls_back_to_adpcm) {
+	AudioEncoder encoder(ALVR_AUDIO_CODEC_OPUS, true, SAMPLE_RATE, CHANNELS, [](uint8_t *, int, uint64_t) {});
+#ifdef ALVR_OPUS
+	EXPECT_EQ(ALVR_AUDIO_CODEC_OPUS, encoder.GetCodec());
+	// Opus does not support 44.1 kHz.
+	AudioEncoder unsupported(ALVR_AUDIO_CODEC_OPUS, true, 44100, CHANNELS, [](uint8_t *, int, uint64_t) {});
+	EXPECT_EQ(ALVR_AUDIO_CODEC_ADPCM, unsupported.GetCodec());
+#else
+	EXPECT_EQ(ALVR_AUDIO_CODEC_ADPCM, encoder.GetCodec());
+	EXPECT_EQ(AudioEncoder::GetBytesPerSecond(ALVR_AUDIO_CODEC_ADPCM, true, SAMPLE_RATE, CHANNELS)
+		, AudioEncoder::GetBytesPerSecond(ALVR_AUDIO_CODEC_OPUS, true, SAMPLE_RATE, CHANNELS));
+#endif
+}
+
+#ifdef ALVR_OPUS
+TEST(audio_codec_test, opus_round_trip) {
+	std::vector<int16_t> pcm = SyntheticMusic(2);
+	auto frames = EncodeOpusFrames(pcm, false);
+	std::unique_ptr<OpusFrameDecoder> decoder(OpusFrameDecoder::Create(SAMPLE_RATE, CHANNELS, FRAME_SAMPLES));
+	std::vector<int16_t> decoded(pcm.size());
+	for (size_t i = 0; i < frames.size(); i++) {
+		EXPECT_EQ(frames[0].size(), frames[i].size());
+		EXPECT_EQ(FRAME_SAMPLES, decoder->Decode(&frames[i][0], (int)frames[i].size(), &decoded[i * FRAME_SAMPLES * CHANNELS]));
+	}
+	// Restricted low delay mode delays output by 2.5 ms.
+	const int delay = SAMPLE_RATE / 400 * CHANNELS;
+	double snr = Snr(&pcm[0], &decoded[delay], (int)pcm.size() - delay);
+	printf("Opus SNR %.1f dB, %d bytes/frame (ADPCM %d)\n", snr, (int)frames[0].size()
+		, AdpcmEncoder::GetMaxFrameBytes(CHANNELS, FRAME_SAMPLES, false));
+	EXPECT_GT(snr, 10.0);
+	EXPECT_EQ(OpusFrameEncoder::GetMaxFrameBytes(SAMPLE_RATE, FRAME_SAMPLES, false), (int)frames[0].size());
+
+	// Malformed payloads are rejected.
+	EXPECT_EQ(-1, decoder->Decode(&frames[0][0], 1, &decoded[0]));
+	EXPECT_EQ(-1, decoder->Decode(&frames[0][0], (int)frames[0].size() - 1, &decoded[0]));
+}
+
+TEST(audio_codec_test, opus_redundancy_recovers_lost_frame) {
+	std::vector<int16_t> pcm = SyntheticMusic(1);
+	auto frames = EncodeOpusFrames(pcm, true);
+	auto plain = EncodeOpusFrames(pcm, false);
+	EXPECT_EQ(frames[0].size(), plain[0].size());
+	EXPECT_EQ(frames[1].size(), plain[1].size() + plain[0].size() - sizeof(OpusFrameHeader));
+
+	const int lost = 30;
+	std::vector<std::vector<int16_t>> reference(lost + 3, std::vector<int16_t>(FRAME_SAMPLES * CHANNELS));
+	std::unique_ptr<OpusFrameDecoder> inOrder(OpusFrameDecoder::Create(SAMPLE_RATE, CHANNELS, FRAME_SAMPLES));
+	for (int i = 0; i < lost + 3; i++) {
+		inOrder->Decode(&frames[i][0], (int)frames[i].size(), &reference[i][0]);
+	}
+
+	// Redundant copy decodes exactly as the lost frame, so later frames are unaffected.
+	std::unique_ptr<OpusFrameDecoder> decoder(OpusFrameDecoder::Create(SAMPLE_RATE, CHANNELS, FRAME_SAMPLES));
+	std::vector<int16_t> out(FRAME_SAMPLES * CHANNELS);
+	for (int i = 0; i < lost; i++) {
+		decoder->Decode(&frames[i][0], (int)frames[i].size(), &out[0]);
+	}
+	std::vector<int16_t> none(FRAME_SAMPLES * CHANNELS);
+	EXPECT_EQ(0, decoder->DecodeRedundant(&plain[lost + 1][0], (int)plain[lost + 1].size(), &none[0]));
+	EXPECT_EQ(FRAME_SAMPLES, decoder->DecodeRedundant(&frames[lost + 1][0], (int)frames[lost + 1].size(), &out[0]));
+	EXPECT_TRUE(out == reference[lost]);
+	for (int i = lost + 1; i < lost + 3; i++) {
+		decoder->Decode(&frames[i][0], (int)frames[i].size(), &out[0]);
+		EXPECT_TRUE(out == reference[i]);
+	}
+
+	// Without redundancy, Opus conceals the lost frame.
+	std::unique_ptr<OpusFrameDecoder> concealer(OpusFrameDecoder::Create(SAMPLE_RATE, CHANNELS, FRAME_SAMPLES));
+	for (int i = 0; i < lost; i++) {
+		concealer->Decode(&frames[i][0], (int)frames[i].size(), &out[0]);
+	}
+	EXPECT_EQ(FRAME_SAMPLES, concealer->Conceal(&out[0]));
+}
+#endif
+
+TEST(audio_codec_test, benchmark) {
+	std::vector<int16_t> pcm;
+	const char *wav = getenv("ALVR_BENCH_WAV");
+	if (wav == NULL || !LoadWav(wav, pcm)) {
+		if (wav != NULL) {
+			printf("Can not load %s as 48 kHz 16-bit PCM WAV. Use synthetic music.\n", wav);
+		}
+		pcm = SyntheticMusic(10);
+	}
+	double seconds = (double)pcm.size() / CHANNELS / SAMPLE_RATE;
+
+	struct {
+		const char *name;
+		int codec;
+		bool fec;
+	} configs[] = {
+		{ "PCM", ALVR_AUDIO_CODEC_PCM, false },
+		{ "ADPCM", ALVR_AUDIO_CODEC_ADPCM, false },
+		{ "ADPCM+FEC", ALVR_AUDIO_CODEC_ADPCM, true },
+#ifdef ALVR_OPUS
+		{ "Opus", ALVR_AUDIO_CODEC_OPUS, false },
+		{ "Opus+FEC", ALVR_AUDIO_CODEC_OPUS, true },
+#endif
+	};
+	double pcmBytes = 0;
+	for (auto &config : configs) {
+		uint64_t bytes = 0;
+		uint64_t packets = 0;
+		AudioEncoder encoder(config.codec, config.fec, SAMPLE_RATE, CHANNELS, [&](uint8_t *buf, int len, uint64_t presentationTime) {
+			bytes += len;
+			// Fragments of ClientConnection::SendAudio
+			packets += (len + 1400 - 1) / 1400;
+		});
+		// 10 ms WASAPI periods.
+		auto start = std::chrono::steady_clock::now();
+		for (size_t pos = 0; pos + FRAME_SAMPLES * CHANNELS <= pcm.size(); pos += FRAME_SAMPLES * CHANNELS) {
+			encoder.Feed((uint8_t *)&pcm[pos], FRAME_SAMPLES * CHANNELS * 2, 0);
+		}
+		double cpuUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		if (config.codec == ALVR_AUDIO_CODEC_PCM) {
+			pcmBytes = (double)bytes;
+		}
+		printf("[%s] %.0f kbps, %.1f packets/s, saved %.0f%%, encode %.1f us CPU per second of audio\n", config.name
+			, bytes * 8 / seconds / 1000, packets / seconds, 100 - 100 * bytes / pcmBytes, cpuUs / seconds);
+		EXPECT_LE(bytes / seconds, AudioEncoder::GetBytesPerSecond(config.codec, config.fec, SAMPLE_RATE, CHANNELS) + 1);
+		if (config.codec != ALVR_AUDIO_CODEC_PCM) {
+			EXPECT_LT(bytes * 2, pcmBytes);
+		}
+	}
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <random>
+
+#include "../../alvr_server/ClockSync.h"
+
+// Simulated TimeSync exchange between server clock and a drifting client clock over a link with
+// asymmetric base delay, exponential jitter and occasional retry spikes.
+namespace {
+	struct SimulatedLink {
+		// Client clock = clientEpoch + serverTime * (1 + drift) - serverEpoch
+		uint64_t serverEpoch = 1600000000ULL * 1000 * 1000;
+		uint64_t clientEpoch = 12345678901ULL;
+		double drift = 80e-6;
+		// Downlink (server to client) and uplink base delay.
+		double downUs = 1500;
+		double upUs = 4000;
+		double jitterUs = 1000;
+		double spikeProbability = 0.05;
+		double spikeUs = 60000;
+		std::mt19937 random{ 11 };
+
+		uint64_t ClientTime(uint64_t serverTime) {
+			return clientEpoch + (uint64_t)llround((serverTime - serverEpoch) * (1 + drift));
+		}
+		// True server - client at serverTime.
+		double Offset(uint64_t serverTime) {
+			return (double)(int64_t)(serverTime - ClientTime(serverTime));
+		}
+		double Delay(double base) {
+			std::exponential_distribution<double> jitter(1 / jitterUs);
+			std::uniform_real_distribution<double> uniform;
+			double delay = base + jitter(random);
+			if (uniform(random) < spikeProbability) {
+				delay += uniform(random) * spikeUs;
+			}
+			return delay;
+		}
+		// Returns naive single sample offset.
+		double Exchange(ClockSync &sync, uint64_t sendTime) {
+			double down = Delay(downUs);
+			double up = Delay(upUs);
+			uint64_t clientTime = ClientTime(sendTime + (uint64_t)down);
+			uint64_t receiveTime = sendTime + (uint64_t)(down + up);
+			sync.AddSample(sendTime, clientTime, receiveTime);
+			uint64_t rtt = receiveTime - sendTime;
+			return (double)(int64_t)(receiveTime - (clientTime + rtt / 2));
+		}
+	};
+
+	static const uint64_t SECOND = 1000 * 1000;
+	// Longer than any simulated round trip.
+	static const uint64_t QUERY_DELAY_US = 100 * 1000;
+}
+
+TEST(clock_sync_test, drifting_clock_asymmetric_delay) {
+	SimulatedLink link;
+	ClockSync sync;
+
+	double maxNaiveError = 0;
+	double maxError = 0;
+	int uncovered = 0;
+	uint64_t now = link.serverEpoch;
+	for (int i = 0; i < 300; i++) {
+		now += SECOND;
+		double naive = link.Exchange(sync, now);
+		uint64_t receive = now + QUERY_DELAY_US;
+		double truth = link.Offset(receive);
+		if (i < 30) {
+			continue;
+		}
+		const ClockSyncEstimate &estimate = sync.GetEstimate();
+		maxNaiveError = std::max(maxNaiveError, fabs(naive - link.Offset(now)));
+		double error = fabs(estimate.GetOffset(receive) - truth);
+		maxError = std::max(maxError, error);
+		if (error > estimate.GetUncertainty(receive)) {
+			uncovered++;
+		}
+	}
+	const ClockSyncEstimate &estimate = sync.GetEstimate();
+	printf("Naive max error %.0f us, filtered max error %.0f us, uncertainty %.0f us, skew %.1f ppm\n"
+		, maxNaiveError, maxError, estimate.uncertainty, estimate.skew * 1e6);
+
+	// Asymmetry alone is (upUs - downUs) / 2 = 1250 us and no estimator can see it.
+	EXPECT_LT(maxError, 2000);
+	EXPECT_GT(maxNaiveError, 10000);
+	EXPECT_EQ(0, uncovered);
+	// Client clock runs fast, so server - client decreases.
+	EXPECT_NEAR(-link.drift * 1e6, estimate.skew * 1e6, 10);
+}
+
+TEST(clock_sync_test, conversions) {
+	SimulatedLink link;
+	link.jitterUs = 1;
+	link.spikeProbability = 0;
+	link.downUs = link.upUs = 1000;
+	ClockSync sync;
+
+	EXPECT_FALSE(sync.GetEstimate().valid);
+	uint64_t now = link.serverEpoch;
+	for (int i = 0; i < 60; i++) {
+		now += SECOND;
+		link.Exchange(sync, now);
+	}
+	const ClockSyncEstimate &estimate = sync.GetEstimate();
+	EXPECT_TRUE(estimate.valid);
+	uint64_t later = now + 5 * SECOND;
+	uint64_t client = link.ClientTime(later);
+	EXPECT_NEAR(0, (double)(int64_t)(estimate.ClientToServer(client) - later), 10);
+	EXPECT_NEAR(0, (double)(int64_t)(estimate.ServerToClient(later) - client), 10);
+
+	// Receive before send is ignored.
+	EXPECT_FALSE(sync.AddSample(now + 10, link.ClientTime(now), now));
+}
+
+TEST(clock_sync_test, slews_without_steps) {
+	SimulatedLink link;
+	ClockSync sync;
+
+	// Slew rate of applied offset, sampled every 10 ms across sample updates. Readers convert current
+	// times, which are after receive of the last sample.
+	uint64_t now = link.serverEpoch;
+	double previous = 0;
+	uint64_t previousTime = 0;
+	double maxRate = 0;
+	for (int i = 0; i < 120; i++) {
+		now += SECOND;
+		link.Exchange(sync, now);
+		for (uint64_t t = now + QUERY_DELAY_US; t < now + SECOND; t += 10 * 1000) {
+			double offset = sync.GetEstimate().GetOffset(t);
+			// Estimate steps while warming up.
+			if (i >= ClockSync::MIN_FIT_SAMPLES) {
+				maxRate = std::max(maxRate, fabs(offset - previous) / (t - previousTime));
+			}
+			previous = offset;
+			previousTime = t;
+		}
+	}
+	printf("Max rate %.0f ppm\n", maxRate * 1e6);
+	EXPECT_LE(maxRate, ClockSync::MAX_SLEW + ClockSync::MAX_SKEW + 1e-6);
+}
+
+TEST(clock_sync_test, steps_on_clock_jump) {
+	SimulatedLink link;
+	ClockSync sync;
+
+	uint64_t now = link.serverEpoch;
+	for (int i = 0; i < 60; i++) {
+		now += SECOND;
+		link.Exchange(sync, now);
+	}
+	// Client clock set by 10 seconds.
+	link.clientEpoch += 10 * SECOND;
+	for (int i = 0; i < 3; i++) {
+		now += SECOND;
+		link.Exchange(sync, now);
+	}
+	EXPECT_NEAR(link.Offset(now), sync.GetEstimate().GetOffset(now), 70000);
+	EXPECT_LE(sync.GetSampleCount(), 3);
+}
+
+TEST(clock_sync_test, reset) {
+	SimulatedLink link;
+	ClockSync sync;
+	link.Exchange(sync, link.serverEpoch);
+	EXPECT_TRUE(sync.GetEstimate().valid);
+	sync.Reset();
+	EXPECT_FALSE(sync.GetEstimate().valid);
+	EXPECT_EQ(0, sync.GetSampleCount());
+	EXPECT_EQ(0.0, sync.GetEstimate().GetOffset(link.serverEpoch));
+}
@@ -0,0 +1,295 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <random>
+#include <math.h>
+
+#include "../../alvr_server/FECInterleaver.h"
+#include "../../alvr_server/FECPolicy.h"
+#include "../../ALVR-common/reedsolomon/rs_cache.h"
+#include "loss-model.h"
+
+namespace {
+	static const int REFRESH_RATE = 72;
+	static const uint64_t FRAME_INTERVAL_US = 1000 * 1000 / REFRESH_RATE;
+	// IDRScheduler::MIN_IDR_FRAME_INTERVAL
+	static const uint64_t MIN_IDR_INTERVAL_US = 100 * 1000;
+
+	struct SentPacket {
+		uint64_t videoFrameIndex;
+		uint32_t packetCounter;
+		uint32_t fecIndex;
+		uint8_t fecInterleaveDepth;
+		uint64_t pushFrame;
+	};
+
+	// Packetize frames through FECInterleaver and return packets in sending order.
+	std::vector<SentPacket> Send(FECInterleaver &interleaver, const std::vector<int> &frameSizes, int fecPercentage, uint64_t frameIntervalUs) {
+		static std::vector<uint8_t> frame(500 * 1000, 0x5a);
+		PacketRing ring(8192);
+		FECPacketizer packetizer;
+		uint32_t packetCounter = 0;
+		std::vector<SentPacket> sent;
+		for (size_t i = 0; i < frameSizes.size(); i++) {
+			VideoFrame header = {};
+			header.type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+			header.trackingFrameIndex = i + 1;
+			header.videoFrameIndex = i + 1;
+			header.frameByteSize = frameSizes[i];
+			header.fecPercentage = fecPercentage;
+			bool ok = interleaver.Packetize(packetizer, &frame[0], frameSizes[i], header, packetCounter
+				, [&]() { return ring.Reserve(); }, i * frameIntervalUs);
+			EXPECT_TRUE(ok);
+			ring.Commit();
+			PacketBuffer *packet;
+			while ((packet = ring.Front()) != NULL) {
+				auto *h = reinterpret_cast<VideoFrame *>(packet->buf);
+				sent.push_back({ h->videoFrameIndex, h->packetCounter, h->fecIndex, h->fecInterleaveDepth, i + 1 });
+				ring.Pop();
+			}
+		}
+		return sent;
+	}
+
+	struct SimResult {
+		uint64_t frames = 0;
+		uint64_t framesLost = 0;
+		// Recovered only with parity sent with following frames.
+		uint64_t framesLate = 0;
+		uint64_t frozenFrames = 0;
+		uint64_t idrs = 0;
+		uint64_t dataPackets = 0;
+		uint64_t parityPackets = 0;
+
+		double IdrPerMinute() const {
+			return frames == 0 ? 0 : idrs * 60.0 * REFRESH_RATE / frames;
+		}
+		double Overhead() const {
+			return dataPackets == 0 ? 0 : 100.0 * parityPackets / dataPackets;
+		}
+	};
+
+	// Client side model. A frame is judged once packets of frame videoFrameIndex + depth have arrived.
+	// Each packet stripe is recovered if at least as many packets as its data packets arrived.
+	// Lost frame requests IDR as IDRScheduler does. Frames until the IDR are frozen.
+	class ClientModel {
+	public:
+		SimResult result;
+		// Layout of each frame, recorded by simulation.
+		std::map<uint64_t, FECLayout> layouts;
+
+		void OnPacket(const SentPacket &packet, bool lost) {
+			Frame &frame = GetFrame(packet.videoFrameIndex, packet.fecInterleaveDepth);
+			if (!lost) {
+				int stripe = packet.fecIndex % frame.layout.shardPackets;
+				frame.received[stripe]++;
+				if (packet.pushFrame == packet.videoFrameIndex) {
+					frame.receivedOnTime[stripe]++;
+				}
+			}
+			mCurrentFrame = packet.pushFrame;
+			while (!mFrames.empty() && mFrames.begin()->first + mFrames.begin()->second.depth < mCurrentFrame) {
+				Judge(mFrames.begin()->second);
+				mFrames.erase(mFrames.begin());
+			}
+		}
+
+		void Finish() {
+			for (auto &frame : mFrames) {
+				Judge(frame.second);
+			}
+			mFrames.clear();
+		}
+	private:
+		struct Frame {
+			FECLayout layout;
+			int depth;
+			std::vector<int> dataInStripe;
+			std::vector<int> received;
+			std::vector<int> receivedOnTime;
+		};
+		std::map<uint64_t, Frame> mFrames;
+		uint64_t mCurrentFrame = 0;
+		bool mWaitingIdr = false;
+		uint64_t mIdrTime = 0;
+		uint64_t mLastIdr = 0;
+
+		Frame &GetFrame(uint64_t videoFrameIndex, int depth) {
+			auto it = mFrames.find(videoFrameIndex);
+			if (it != mFrames.end()) {
+				return it->second;
+			}
+			Frame &frame = mFrames[videoFrameIndex];
+			frame.layout = layouts[videoFrameIndex];
+			frame.depth = depth;
+			frame.dataInStripe.assign(frame.layout.shardPackets, 0);
+			for (int i = 0; i < frame.layout.dataPackets; i++) {
+				frame.dataInStripe[i % frame.layout.shardPackets]++;
+			}
+			frame.received.assign(frame.layout.shardPackets, 0);
+			frame.receivedOnTime.assign(frame.layout.shardPackets, 0);
+			return frame;
+		}
+
+		void Judge(const Frame &frame) {
+			bool onTime = true;
+			bool recovered = true;
+			for (int i = 0; i < frame.layout.shardPackets; i++) {
+				onTime &= frame.receivedOnTime[i] >= frame.dataInStripe[i];
+				recovered &= frame.received[i] >= frame.dataInStripe[i];
+			}
+			result.frames++;
+			result.framesLate += recovered && !onTime ? 1 : 0;
+			result.dataPackets += frame.layout.dataPackets;
+			result.parityPackets += frame.layout.parityPackets;
+
+			uint64_t now = mCurrentFrame * FRAME_INTERVAL_US;
+			if (mWaitingIdr && now >= mIdrTime) {
+				mWaitingIdr = false;
+				mLastIdr = mIdrTime;
+			}
+			if (!recovered) {
+				result.framesLost++;
+				if (!mWaitingIdr) {
+					mWaitingIdr = true;
+					mIdrTime = std::max(now + FRAME_INTERVAL_US, mLastIdr + MIN_IDR_INTERVAL_US);
+					result.idrs++;
+				}
+			}
+			result.frozenFrames += mWaitingIdr ? 1 : 0;
+		}
+	};
+
+	std::vector<int> MakeFrameSizes(int frames) {
+		std::mt19937 random(11);
+		std::vector<int> sizes;
+		for (int i = 0; i < frames; i++) {
+			sizes.push_back(std::min(static_cast<int>(LogNormal(random, log(48000.0), 0.3)), 400 * 1000));
+		}
+		return sizes;
+	}
+
+	SimResult Simulate(int depth, int fecPercentage, const std::vector<int> &frameSizes, const std::vector<uint8_t> &trace) {
+		FECInterleaver interleaver;
+		interleaver.Configure(depth, 50 * 1000);
+		std::vector<SentPacket> sent = Send(interleaver, frameSizes, fecPercentage, FRAME_INTERVAL_US);
+
+		ClientModel client;
+		for (size_t i = 0; i < frameSizes.size(); i++) {
+			client.layouts[i + 1] = FECLayout::Calculate(frameSizes[i], fecPercentage);
+		}
+		for (size_t i = 0; i < sent.size(); i++) {
+			client.OnPacket(sent[i], trace[i % trace.size()] != 0);
+		}
+		client.Finish();
+		return client.result;
+	}
+}
+
+TEST(fec_interleave_test, send_order) {
+	reed_solomon_init();
+
+	FECInterleaver interleaver;
+	interleaver.Configure(2, 1000 * 1000);
+	std::vector<int> sizes = { 40000, 40000, 40000, 40000 };
+	std::vector<SentPacket> sent = Send(interleaver, sizes, 20, FRAME_INTERVAL_US);
+	FECLayout layout = FECLayout::Calculate(40000, 20);
+	ASSERT_GE(layout.parityShards, 3);
+
+	std::map<uint64_t, int> packets;
+	for (size_t i = 0; i < sent.size(); i++) {
+		// Counter is continuous in sending order.
+		ASSERT_EQ(sent[i].packetCounter, i);
+		ASSERT_EQ(sent[i].fecInterleaveDepth, 2);
+		ASSERT_LE(sent[i].pushFrame - sent[i].videoFrameIndex, 2u);
+		if (sent[i].fecIndex >= static_cast<uint32_t>(layout.dataShards * layout.shardPackets)) {
+			int shard = sent[i].fecIndex / layout.shardPackets - layout.dataShards;
+			// Parity shard k is sent with frame k % (depth + 1) later.
+			ASSERT_EQ(sent[i].pushFrame - sent[i].videoFrameIndex, static_cast<uint64_t>(shard % 3));
+		}
+		packets[sent[i].videoFrameIndex]++;
+	}
+	// Parity of first two frames is complete. Rest is still deferred.
+	ASSERT_EQ(packets[1], layout.dataPackets + layout.parityPackets);
+	ASSERT_EQ(packets[2], layout.dataPackets + layout.parityPackets);
+	ASSERT_GT(interleaver.GetDeferredPackets(), 0);
+
+	// Deferred parity is spread among data packets of the following frame, not appended.
+	size_t firstOfFrame2 = 0;
+	while (sent[firstOfFrame2].pushFrame != 2) {
+		firstOfFrame2++;
+	}
+	ASSERT_EQ(sent[firstOfFrame2].videoFrameIndex, 2u);
+	ASSERT_EQ(sent[firstOfFrame2 + 1].videoFrameIndex, 1u);
+}
+
+TEST(fec_interleave_test, expired_parity_is_dropped) {
+	FECInterleaver interleaver;
+	interleaver.Configure(1, FRAME_INTERVAL_US / 2);
+	std::vector<int> sizes = { 40000, 40000 };
+	std::vector<SentPacket> sent = Send(interleaver, sizes, 20, FRAME_INTERVAL_US);
+	for (auto &packet : sent) {
+		ASSERT_EQ(packet.pushFrame, packet.videoFrameIndex);
+	}
+	ASSERT_GT(interleaver.GetExpiredPackets(), 0u);
+}
+
+TEST(fec_interleave_test, depth_zero_is_unchanged) {
+	FECInterleaver interleaver;
+	std::vector<int> sizes = { 1, 40000, 123456 };
+	std::vector<SentPacket> sent = Send(interleaver, sizes, 10, FRAME_INTERVAL_US);
+	size_t i = 0;
+	for (size_t frame = 0; frame < sizes.size(); frame++) {
+		FECLayout layout = FECLayout::Calculate(sizes[frame], 10);
+		for (int j = 0; j < layout.dataPackets + layout.parityPackets; j++, i++) {
+			ASSERT_EQ(sent[i].videoFrameIndex, frame + 1);
+			ASSERT_EQ(sent[i].fecInterleaveDepth, 0);
+		}
+	}
+	ASSERT_EQ(i, sent.size());
+}
+
+// IDR frequency under Gilbert-Elliott burst loss, with and without interleaving at equal parity overhead.
+TEST(fec_interleave_test, simulate_idr_frequency) {
+	std::vector<int> frameSizes = MakeFrameSizes(60 * REFRESH_RATE);
+	static const size_t PACKETS = 60 * REFRESH_RATE * 60;
+	struct Model {
+		const char *name;
+		double goodToBad;
+		double badToGood;
+		// Bursts mostly shorter than parity of a frame. Longer ones are lost either way.
+		bool shortBursts;
+	};
+	Model models[] = {
+		{ "burst 4", 0.002, 0.25, true },
+		{ "burst 10", 0.001, 0.1, true },
+		{ "burst 25", 0.0005, 0.04, false },
+	};
+	printf("%-10s %5s %5s %10s %8s %10s %10s %8s\n", "model", "fec%", "depth", "overhead%", "lost", "late", "frozen", "IDR/min");
+	for (auto &model : models) {
+		std::vector<uint8_t> trace;
+		AppendGilbertElliott(trace, PACKETS, model.goodToBad, model.badToGood, 0.0005, 0.8, 3);
+		for (int fecPercentage : { 10, 20 }) {
+			std::vector<SimResult> results;
+			for (int depth : { 0, 1, 2 }) {
+				SimResult r = Simulate(depth, fecPercentage, frameSizes, trace);
+				printf("%-10s %5d %5d %10.2f %8llu %10llu %10llu %8.1f\n", model.name, fecPercentage, depth, r.Overhead()
+					, (unsigned long long)r.framesLost, (unsigned long long)r.framesLate, (unsigned long long)r.frozenFrames, r.IdrPerMinute());
+				results.push_back(r);
+			}
+			// Same parity, so interleaving costs no bandwidth.
+			ASSERT_EQ(results[0].parityPackets, results[1].parityPackets);
+			if (model.shortBursts && fecPercentage == 20) {
+				ASSERT_LE(results[1].idrs, results[0].idrs);
+				ASSERT_LE(results[2].idrs, results[0].idrs);
+			}
+			else if (model.shortBursts) {
+				// Most frames have one or two parity shards at 10%, too few to spread a burst over.
+				// Interleaving then recovers about as many frames as it delivers late: within a few IDRs.
+				ASSERT_LE(results[1].idrs, results[0].idrs * 11 / 10);
+				ASSERT_LE(results[2].idrs, results[0].idrs * 11 / 10);
+			}
+		}
+	}
+}
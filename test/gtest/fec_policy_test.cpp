@@ -0,0 +1,390 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <random>
+#include <fstream>
+#include <memory>
+#include <stdlib.h>
+
+#include "../../alvr_server/FECPolicy.h"
+#include "loss-model.h"
+
+// Offline FEC simulator. Replays per-packet loss trace (1 = lost) through the same shard layout
+// as FECPacketizer and feeds the client's feedback (loss runs, per-second loss reports, FEC failures)
+// back to the policy. A frame is lost if any packet stripe lost more packets than parity shards.
+//
+// Set ALVR_LOSS_TRACE to a text file of '0'/'1' characters (one per packet, other characters ignored)
+// to replay a recorded trace in addition to the synthetic ones.
+namespace {
+	struct SimResult {
+		uint64_t frames = 0;
+		uint64_t framesLost = 0;
+		uint64_t dataPackets = 0;
+		uint64_t parityPackets = 0;
+
+		double Overhead() const {
+			return dataPackets == 0 ? 0 : 100.0 * parityPackets / dataPackets;
+		}
+		double ResidualLoss() const {
+			return frames == 0 ? 0 : 100.0 * framesLost / frames;
+		}
+	};
+
+	static const int REFRESH_RATE = 72;
+	// Feedback reaches server about one frame later.
+	static const uint64_t FRAME_INTERVAL_US = 1000 * 1000 / REFRESH_RATE;
+
+	SimResult Simulate(FECPolicy &policy, const std::vector<uint8_t> &trace, std::vector<SimResult> *perSecond = NULL) {
+		SimResult result;
+		SimResult second;
+		// 30 Mbps average with IDR-like spikes.
+		std::mt19937 random(7);
+
+		uint64_t now = 0;
+		uint64_t nextReport = 1000 * 1000;
+		uint64_t sentInSecond = 0;
+		uint64_t lostInSecond = 0;
+		int run = 0;
+		size_t pos = 0;
+		while (true) {
+			int len = std::min(static_cast<int>(LogNormal(random, log(48000.0), 0.3)), 400 * 1000);
+			int percentage = policy.GetFecPercentage(len);
+			FECLayout layout = FECLayout::Calculate(len, percentage);
+			int packets = layout.dataPackets + layout.parityPackets;
+			if (pos + packets > trace.size()) {
+				break;
+			}
+
+			std::vector<int> stripeLoss(layout.shardPackets);
+			for (int i = 0; i < packets; i++) {
+				bool lost = trace[pos + i] != 0;
+				if (lost) {
+					int index = i < layout.dataPackets ? i : layout.dataShards * layout.shardPackets + (i - layout.dataPackets);
+					stripeLoss[index % layout.shardPackets]++;
+					run++;
+					lostInSecond++;
+				}
+				else if (run != 0) {
+					policy.OnLossRun(now, run);
+					run = 0;
+				}
+			}
+			pos += packets;
+			sentInSecond += packets;
+
+			bool frameLost = false;
+			for (int loss : stripeLoss) {
+				frameLost |= loss > layout.parityShards;
+			}
+			for (SimResult *r : { &result, &second }) {
+				r->frames++;
+				r->framesLost += frameLost ? 1 : 0;
+				r->dataPackets += layout.dataPackets;
+				r->parityPackets += layout.parityPackets;
+			}
+			if (frameLost) {
+				policy.OnFecFailure(now);
+			}
+
+			now += FRAME_INTERVAL_US;
+			if (now >= nextReport) {
+				policy.OnReport(now, sentInSecond, lostInSecond);
+				sentInSecond = 0;
+				lostInSecond = 0;
+				nextReport += 1000 * 1000;
+				if (perSecond) {
+					perSecond->push_back(second);
+				}
+				second = SimResult();
+			}
+		}
+		return result;
+	}
+
+	struct Trace {
+		const char *name;
+		std::vector<uint8_t> packets;
+	};
+
+	std::vector<Trace> MakeTraces() {
+		// About 80 s of video at 72 fps.
+		static const size_t PACKETS = 80 * REFRESH_RATE * 40;
+		std::vector<Trace> traces(4);
+		traces[0].name = "clean 0.05%";
+		AppendGilbertElliott(traces[0].packets, PACKETS, 0, 1, 0.0005, 0, 1);
+		traces[1].name = "random 2%";
+		AppendGilbertElliott(traces[1].packets, PACKETS, 0, 1, 0.02, 0, 2);
+		traces[2].name = "bursty wifi";
+		AppendGilbertElliott(traces[2].packets, PACKETS, 0.002, 0.25, 0.0005, 0.6, 3);
+		traces[3].name = "clean/bursty/clean";
+		AppendGilbertElliott(traces[3].packets, PACKETS / 4, 0, 1, 0.0005, 0, 4);
+		AppendGilbertElliott(traces[3].packets, PACKETS / 4, 0.002, 0.25, 0.0005, 0.6, 5);
+		AppendGilbertElliott(traces[3].packets, PACKETS / 2, 0, 1, 0.0005, 0, 6);
+
+		const char *path = getenv("ALVR_LOSS_TRACE");
+		if (path != NULL) {
+			std::ifstream file(path);
+			Trace recorded;
+			recorded.name = "recorded";
+			char c;
+			while (file.get(c)) {
+				if (c == '0' || c == '1') {
+					recorded.packets.push_back(c == '1' ? 1 : 0);
+				}
+			}
+			traces.push_back(recorded);
+		}
+		return traces;
+	}
+
+	std::vector<std::unique_ptr<FECPolicy>> MakePolicies() {
+		std::vector<std::unique_ptr<FECPolicy>> policies;
+		policies.push_back(std::unique_ptr<FECPolicy>(new FixedFECPolicy(5)));
+		policies.push_back(std::unique_ptr<FECPolicy>(new FixedFECPolicy(10)));
+		policies.push_back(std::unique_ptr<FECPolicy>(new StepFECPolicy()));
+		policies.push_back(CreateFECPolicy(true, 20));
+		policies.push_back(CreateFECPolicy(true, 50));
+		return policies;
+	}
+}
+
+TEST(fec_policy_test, layout_matches_packetizer_limits) {
+	for (int percentage = 1; percentage <= AdaptiveFECPolicy::MAX_FEC_PERCENTAGE; percentage++) {
+		for (int len = 1; len < 500 * 1000; len += 997) {
+			FECLayout layout = FECLayout::Calculate(len, percentage);
+			ASSERT_LE(layout.dataShards + layout.parityShards, ALVR_FEC_SHARDS_MAX);
+			ASSERT_GE(layout.parityShards, 1);
+			ASSERT_GE(layout.dataShards * layout.shardPackets, layout.dataPackets);
+		}
+	}
+}
+
+// ClientConnection asks for the percentage before the first frame is encoded.
+TEST(fec_policy_test, empty_frame) {
+	FECLayout layout = FECLayout::Calculate(0, 20);
+	ASSERT_EQ(0, layout.dataPackets);
+	ASSERT_EQ(0, layout.parityPackets);
+	ASSERT_EQ(AdaptiveFECPolicy::MIN_FEC_PERCENTAGE, CreateFECPolicy(true, 20)->GetFecPercentage(0));
+	ASSERT_EQ(30, CreateFECPolicy(true, 20, 30)->GetImportantFecPercentage(0));
+	AdaptiveFECPolicy lossy(5, 50);
+	lossy.OnReport(1000, 1000, 100);
+	lossy.OnLossRun(1000, 8);
+	ASSERT_EQ(5, lossy.GetFecPercentage(0));
+	ASSERT_EQ(5, lossy.GetFecPercentage(-1));
+}
+
+TEST(fec_policy_test, adaptive_hysteresis) {
+	AdaptiveFECPolicy policy(1, 50);
+	int len = 50000;
+	int clean = policy.GetFecPercentage(len);
+	ASSERT_EQ(clean, 1);
+
+	uint64_t now = 0;
+	// Burst of 8 packets needs more parity immediately.
+	policy.OnLossRun(now, 8);
+	policy.OnReport(now, 3000, 8);
+	int protectedPercentage = policy.GetFecPercentage(len);
+	FECLayout layout = FECLayout::Calculate(len, protectedPercentage);
+	ASSERT_GE(layout.parityShards * layout.shardPackets, 8);
+
+	// Clean reports: protection is held while burst is in window, then falls back.
+	for (int i = 1; i <= 20; i++) {
+		now = i * 1000 * 1000;
+		policy.OnReport(now, 3000, 0);
+		ASSERT_EQ(policy.GetFecPercentage(len), protectedPercentage);
+	}
+	for (int i = 21; i <= 120; i++) {
+		now = i * 1000 * 1000;
+		policy.OnReport(now, 3000, 0);
+	}
+	ASSERT_EQ(policy.GetFecPercentage(len), clean);
+
+	// Isolated failure is residual loss the layout is sized for. Repeated one adds margin which decays.
+	policy.OnFecFailure(now);
+	ASSERT_EQ(policy.GetFecPercentage(len), clean);
+	now += 1000 * 1000;
+	policy.OnFecFailure(now);
+	ASSERT_GT(policy.GetFecPercentage(len), clean);
+	for (int i = 122; i <= 141; i++) {
+		now = i * 1000 * 1000;
+		policy.OnReport(now, 3000, 0);
+	}
+	ASSERT_EQ(policy.GetFecPercentage(len), clean);
+}
+
+TEST(fec_policy_test, simulate_traces) {
+	std::vector<Trace> traces = MakeTraces();
+	printf("%-20s %-14s %12s %16s %12s\n", "trace", "policy", "overhead %", "frame loss %", "frames lost");
+	for (auto &trace : traces) {
+		std::vector<SimResult> results;
+		for (auto &policy : MakePolicies()) {
+			SimResult result = Simulate(*policy, trace.packets);
+			char name[32];
+			snprintf(name, sizeof(name), "%s %d", policy->GetName(), policy->GetFecPercentage(48000));
+			printf("%-20s %-14s %12.2f %16.3f %12llu\n", trace.name, name, result.Overhead(), result.ResidualLoss()
+				, (unsigned long long)result.framesLost);
+			results.push_back(result);
+		}
+		if (trace.name == std::string("recorded")) {
+			continue;
+		}
+		const SimResult &step = results[2];
+		const SimResult &adaptive = results[3];
+		// Adaptive never loses more frames than the old step policy,
+		ASSERT_LE(adaptive.framesLost, step.framesLost);
+		if (std::string(trace.name) == "clean 0.05%") {
+			// and does not pay more overhead for it on clean link.
+			ASSERT_LE(adaptive.Overhead(), step.Overhead());
+		}
+	}
+}
+
+// After bursty period, adaptive policy returns to low overhead.
+TEST(fec_policy_test, recovers_overhead) {
+	std::vector<Trace> traces = MakeTraces();
+	std::vector<SimResult> perSecond;
+	auto policy = CreateFECPolicy(true, 20);
+	Simulate(*policy, traces[3].packets, &perSecond);
+	ASSERT_GT(perSecond.size(), 50u);
+	double bursty = perSecond[perSecond.size() * 3 / 8].Overhead();
+	double end = perSecond.back().Overhead();
+	printf("overhead first second %.1f%% middle %.1f%% last %.1f%%\n", perSecond[0].Overhead(), bursty, end);
+	ASSERT_LT(end, bursty);
+}
+
+namespace {
+	struct IdrSimResult {
+		SimResult all;
+		uint64_t idrFrames = 0;
+		// Lost IDR frames, each of which costs another IDR request round trip.
+		uint64_t idrRetries = 0;
+	};
+
+	// Client requests IDR after every unrecoverable frame, and next frame sent is IDR, about
+	// IDR_SIZE_RATIO times larger than P frame. Important frames are protected by GetImportantFecPercentage.
+	IdrSimResult SimulateIdr(FECPolicy &policy, const std::vector<uint8_t> &trace) {
+		static const int IDR_SIZE_RATIO = 4;
+		IdrSimResult result;
+		std::mt19937 random(8);
+
+		uint64_t now = 0;
+		size_t pos = 0;
+		bool sendIdr = true;
+		while (true) {
+			int len = static_cast<int>(LogNormal(random, log(48000.0), 0.3));
+			bool idr = sendIdr;
+			if (idr) {
+				len *= IDR_SIZE_RATIO;
+			}
+			int percentage = idr ? policy.GetImportantFecPercentage(len) : policy.GetFecPercentage(len);
+			FECLayout layout = FECLayout::Calculate(len, percentage);
+			int packets = layout.dataPackets + layout.parityPackets;
+			if (pos + packets > trace.size()) {
+				break;
+			}
+
+			std::vector<int> stripeLoss(layout.shardPackets);
+			for (int i = 0; i < packets; i++) {
+				if (trace[pos + i] != 0) {
+					int index = i < layout.dataPackets ? i : layout.dataShards * layout.shardPackets + (i - layout.dataPackets);
+					stripeLoss[index % layout.shardPackets]++;
+				}
+			}
+			pos += packets;
+
+			bool frameLost = false;
+			for (int loss : stripeLoss) {
+				frameLost |= loss > layout.parityShards;
+			}
+			result.all.frames++;
+			result.all.framesLost += frameLost ? 1 : 0;
+			result.all.dataPackets += layout.dataPackets;
+			result.all.parityPackets += layout.parityPackets;
+			if (idr) {
+				result.idrFrames++;
+				result.idrRetries += frameLost ? 1 : 0;
+			}
+			if (frameLost) {
+				policy.OnFecFailure(now);
+			}
+			// Stream can only continue from a received IDR frame.
+			sendIdr = frameLost;
+			now += FRAME_INTERVAL_US;
+		}
+		return result;
+	}
+}
+
+// Unequal error protection compared with uniform protection at matched overhead: the lowest fixed
+// percentage whose overhead is not below that of the unequal policy.
+// UEP never loses more IDR frames, and saves IDR retries where uniform parity is thin (random 2%,
+// Fixed+UEP 5/20 at 10.6% overhead retries 3 IDR frames, Fixed 7 at 10.8% retries 15).
+// But it does not lose fewer frames in total: IDR parity is paid by P frames, and every lost P frame
+// costs an IDR. With 5% for P frames, Fixed+UEP 5/30 (14.8% overhead) loses almost 9 times as many
+// frames as Fixed 12 (15.2%) on random 2% loss, and 1.5 times on bursty wifi. That is why
+// idrFecPercentage is off by default. Frames lost are printed, not asserted.
+TEST(fec_policy_test, unequal_protection_reduces_idr_retries) {
+	static const int MAX_UNIFORM_PERCENTAGE = 30;
+	std::vector<Trace> traces = MakeTraces();
+	printf("%-20s %-18s %12s %12s %12s %12s\n", "trace", "policy", "overhead %", "frames lost", "IDR frames", "IDR retries");
+	uint64_t uniformRetries = 0;
+	uint64_t unequalRetries = 0;
+	for (int t : { 1, 2 }) {
+		std::vector<IdrSimResult> uniformResults;
+		for (int percentage = 1; percentage <= MAX_UNIFORM_PERCENTAGE; percentage++) {
+			FixedFECPolicy uniform(percentage);
+			uniformResults.push_back(SimulateIdr(uniform, traces[t].packets));
+		}
+		auto print = [&](const char *name, const IdrSimResult &result) {
+			printf("%-20s %-18s %12.2f %12llu %12llu %12llu\n", traces[t].name, name, result.all.Overhead()
+				, (unsigned long long)result.all.framesLost, (unsigned long long)result.idrFrames, (unsigned long long)result.idrRetries);
+		};
+		for (int percentage : { 5, 10 }) {
+			for (int important : { 20, 30 }) {
+				UnequalFECPolicy unequal(std::unique_ptr<FECPolicy>(new FixedFECPolicy(percentage)), important);
+				IdrSimResult unequalResult = SimulateIdr(unequal, traces[t].packets);
+				int matched = 0;
+				while (uniformResults[matched].all.Overhead() < unequalResult.all.Overhead()) {
+					matched++;
+					ASSERT_LT(matched, MAX_UNIFORM_PERCENTAGE);
+				}
+				const IdrSimResult &uniformResult = uniformResults[matched];
+				char name[32];
+				snprintf(name, sizeof(name), "Fixed+UEP %d/%d", percentage, important);
+				print(name, unequalResult);
+				snprintf(name, sizeof(name), "Fixed %d", matched + 1);
+				print(name, uniformResult);
+
+				ASSERT_LE(unequalResult.idrRetries, uniformResult.idrRetries);
+				// Much cheaper than protecting all frames like IDR frames.
+				ASSERT_LT(unequalResult.all.Overhead(), uniformResults[important - 1].all.Overhead());
+				uniformRetries += uniformResult.idrRetries;
+				unequalRetries += unequalResult.idrRetries;
+			}
+		}
+	}
+	ASSERT_LT(unequalRetries, uniformRetries);
+}
+
+TEST(fec_policy_test, unequal_forwards_feedback) {
+	UnequalFECPolicy policy(std::unique_ptr<FECPolicy>(new StepFECPolicy(20)), 30);
+	ASSERT_EQ(StepFECPolicy::INITIAL_FEC_PERCENTAGE, policy.GetFecPercentage(48000));
+	ASSERT_EQ(30, policy.GetImportantFecPercentage(48000));
+	policy.OnFecFailure(1000);
+	policy.OnFecFailure(2000);
+	ASSERT_EQ(StepFECPolicy::INITIAL_FEC_PERCENTAGE + 5, policy.GetFecPercentage(48000));
+	ASSERT_EQ(30, policy.GetImportantFecPercentage(48000));
+	ASSERT_EQ(std::string("Step+UEP"), policy.GetName());
+
+	// Never less than ordinary frames get.
+	UnequalFECPolicy low(std::unique_ptr<FECPolicy>(new FixedFECPolicy(20)), 10);
+	ASSERT_EQ(20, low.GetImportantFecPercentage(48000));
+	// 0 keeps equal protection.
+	ASSERT_EQ(std::string("Step"), CreateFECPolicy(false, 20, 0)->GetName());
+	// Step policy is not raised to the adaptive cap.
+	auto step = CreateFECPolicy(false, 20, 0);
+	for (uint64_t now = 1000; now < 10000; now += 1000) {
+		step->OnFecFailure(now);
+	}
+	ASSERT_EQ(StepFECPolicy::MAX_FEC_PERCENTAGE, step->GetFecPercentage(48000));
+	ASSERT_EQ(std::string("Step+UEP"), CreateFECPolicy(false, 20, 30)->GetName());
+}
@@ -0,0 +1,311 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+#include "../../alvr_server/FECPacketizer.h"
+#include "../../ALVR-common/fec_reassembler.h"
+
+typedef std::vector<std::vector<uint8_t>> Datagrams;
+
+static std::vector<uint8_t> MakeFrame(int len, std::mt19937 &random) {
+	std::vector<uint8_t> frame(len);
+	for (auto &b : frame) {
+		b = static_cast<uint8_t>(random());
+	}
+	return frame;
+}
+
+static Datagrams Packetize(const std::vector<uint8_t> &frame, uint64_t videoFrameIndex, int fecPercentage) {
+	static PacketRing ring(2048);
+	static FECPacketizer packetizer;
+
+	VideoFrame header = {};
+	header.type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+	header.trackingFrameIndex = videoFrameIndex + 1000;
+	header.videoFrameIndex = videoFrameIndex;
+	header.sentTime = videoFrameIndex * 10;
+	header.frameByteSize = static_cast<uint32_t>(frame.size());
+	header.fecPercentage = fecPercentage;
+
+	uint32_t packetCounter = 0;
+	auto &packets = packetizer.Packetize(&frame[0], static_cast<int>(frame.size()), header, packetCounter, []() { return ring.Reserve(); });
+	Datagrams datagrams;
+	for (auto packet : packets) {
+		datagrams.push_back(std::vector<uint8_t>(packet->buf, packet->buf + packet->len));
+	}
+	ring.Rollback();
+	return datagrams;
+}
+
+static bool Add(FECReassembler &reassembler, const std::vector<uint8_t> &datagram, ReassembledFrame &frame) {
+	return reassembler.AddPacket(&datagram[0], static_cast<int>(datagram.size()), frame);
+}
+
+TEST(fec_reassembler_test, complete_frames) {
+	reed_solomon_init();
+	std::mt19937 random(1);
+	FECReassembler reassembler(4, 600000);
+
+	int sizes[] = { 1, 100, ALVR_MAX_VIDEO_BUFFER_SIZE, ALVR_MAX_VIDEO_BUFFER_SIZE + 1, 20000, 123456, 500000 };
+	uint64_t index = 1;
+	for (int len : sizes) {
+		auto data = MakeFrame(len, random);
+		auto datagrams = Packetize(data, index, 10);
+		ReassembledFrame frame;
+		int completed = 0;
+		for (auto &datagram : datagrams) {
+			if (Add(reassembler, datagram, frame)) {
+				completed++;
+				ASSERT_EQ(frame.videoFrameIndex, index);
+				ASSERT_EQ(frame.trackingFrameIndex, index + 1000);
+				ASSERT_EQ(frame.sentTime, index * 10);
+				ASSERT_EQ(frame.len, len);
+				ASSERT_FALSE(frame.recovered);
+				ASSERT_EQ(memcmp(frame.data, &data[0], len), 0);
+			}
+		}
+		ASSERT_EQ(completed, 1);
+		index++;
+	}
+	auto stats = reassembler.GetStats();
+	ASSERT_EQ(stats.framesComplete, 7u);
+	ASSERT_EQ(stats.framesLost, 0u);
+}
+
+TEST(fec_reassembler_test, recovers_lost_data) {
+	reed_solomon_init();
+	std::mt19937 random(2);
+	FECReassembler reassembler(4, 300000);
+
+	int sizes[] = { 100, 5000, 50000, 200000 };
+	uint64_t index = 1;
+	for (int len : sizes) {
+		for (int fecPercentage : { 5, 10, 20 }) {
+			auto data = MakeFrame(len, random);
+			auto datagrams = Packetize(data, index, fecPercentage);
+			int shardPackets = CalculateFECShardPackets(len, fecPercentage);
+			int blockSize = shardPackets * ALVR_MAX_VIDEO_BUFFER_SIZE;
+			int parityShards = CalculateParityShards((len + blockSize - 1) / blockSize, fecPercentage);
+			int dataPackets = (len + ALVR_MAX_VIDEO_BUFFER_SIZE - 1) / ALVR_MAX_VIDEO_BUFFER_SIZE;
+
+			// Lose a burst as long as the parity from the end of frame, so last data packet is rebuilt too.
+			int lost = std::min(parityShards * shardPackets, dataPackets);
+			ReassembledFrame frame;
+			int completed = 0;
+			for (int i = 0; i < static_cast<int>(datagrams.size()); i++) {
+				if (i >= dataPackets - lost && i < dataPackets) {
+					continue;
+				}
+				if (Add(reassembler, datagrams[i], frame)) {
+					completed++;
+					ASSERT_TRUE(frame.recovered);
+					ASSERT_EQ(frame.len, len);
+					ASSERT_EQ(memcmp(frame.data, &data[0], len), 0);
+				}
+			}
+			ASSERT_EQ(completed, 1);
+			index++;
+		}
+	}
+	ASSERT_EQ(reassembler.GetStats().framesRecovered, 12u);
+}
+
+TEST(fec_reassembler_test, out_of_order_and_duplicates) {
+	reed_solomon_init();
+	std::mt19937 random(3);
+	FECReassembler reassembler(4, 100000);
+
+	auto data1 = MakeFrame(60000, random);
+	auto data2 = MakeFrame(30000, random);
+	Datagrams datagrams = Packetize(data1, 1, 10);
+	Datagrams datagrams2 = Packetize(data2, 2, 10);
+	datagrams.insert(datagrams.end(), datagrams2.begin(), datagrams2.end());
+	// Every packet twice, all shuffled together.
+	int unique = static_cast<int>(datagrams.size());
+	Datagrams copies = datagrams;
+	datagrams.insert(datagrams.end(), copies.begin(), copies.end());
+	std::shuffle(datagrams.begin(), datagrams.end(), random);
+
+	bool done1 = false, done2 = false;
+	for (auto &datagram : datagrams) {
+		ReassembledFrame frame;
+		if (Add(reassembler, datagram, frame)) {
+			auto &data = frame.videoFrameIndex == 1 ? data1 : data2;
+			bool &done = frame.videoFrameIndex == 1 ? done1 : done2;
+			ASSERT_FALSE(done);
+			done = true;
+			ASSERT_EQ(frame.len, static_cast<int>(data.size()));
+			ASSERT_EQ(memcmp(frame.data, &data[0], data.size()), 0);
+		}
+	}
+	ASSERT_TRUE(done1);
+	ASSERT_TRUE(done2);
+	auto stats = reassembler.GetStats();
+	ASSERT_EQ(stats.packets, datagrams.size());
+	// Second copies before completion are duplicates, all packets after completion are ignored.
+	ASSERT_GT(stats.duplicatePackets, 0u);
+	ASSERT_LE(stats.packets - stats.duplicatePackets - stats.ignoredPackets, static_cast<uint64_t>(unique));
+	ASSERT_EQ(stats.framesLost, 0u);
+}
+
+TEST(fec_reassembler_test, expire_and_evict) {
+	reed_solomon_init();
+	std::mt19937 random(4);
+	FECReassembler reassembler(2, 100000);
+	ReassembledFrame frame;
+
+	// Frame 1 loses more than its parity.
+	auto data = MakeFrame(50000, random);
+	auto datagrams = Packetize(data, 1, 5);
+	for (size_t i = 10; i < datagrams.size(); i++) {
+		ASSERT_FALSE(Add(reassembler, datagrams[i], frame));
+	}
+	ASSERT_EQ(reassembler.Expire(1), 0);
+	ASSERT_EQ(reassembler.Expire(2), 1);
+	// Late packets of given up frame are ignored.
+	ASSERT_FALSE(Add(reassembler, datagrams[0], frame));
+	ASSERT_EQ(reassembler.GetStats().ignoredPackets, 1u);
+
+	// Frame 2 is incomplete and evicted by frame 4.
+	auto datagrams2 = Packetize(data, 2, 5);
+	ASSERT_FALSE(Add(reassembler, datagrams2[0], frame));
+	auto datagrams4 = Packetize(data, 4, 5);
+	int completed = 0;
+	for (auto &datagram : datagrams4) {
+		completed += Add(reassembler, datagram, frame) ? 1 : 0;
+	}
+	ASSERT_EQ(completed, 1);
+	ASSERT_EQ(reassembler.GetStats().framesLost, 2u);
+	ASSERT_FALSE(Add(reassembler, datagrams2[1], frame));
+
+	// Frame index restarts after reconnect.
+	reassembler.Reset();
+	completed = 0;
+	for (auto &datagram : datagrams) {
+		completed += Add(reassembler, datagram, frame) ? 1 : 0;
+	}
+	ASSERT_EQ(completed, 1);
+	ASSERT_EQ(memcmp(frame.data, &data[0], data.size()), 0);
+}
+
+TEST(fec_reassembler_test, rejects_malformed_packets) {
+	reed_solomon_init();
+	std::mt19937 random(5);
+	FECReassembler reassembler(2, 10000);
+	ReassembledFrame frame;
+
+	auto datagrams = Packetize(MakeFrame(20000, random), 1, 5);
+	ASSERT_FALSE(Add(reassembler, datagrams[0], frame));
+
+	datagrams = Packetize(MakeFrame(5000, random), 2, 5);
+	auto truncated = datagrams[0];
+	truncated.resize(truncated.size() - 1);
+	ASSERT_FALSE(Add(reassembler, truncated, frame));
+	auto badIndex = datagrams[0];
+	reinterpret_cast<VideoFrame *>(&badIndex[0])->fecIndex = 1000;
+	ASSERT_FALSE(Add(reassembler, badIndex, frame));
+	ASSERT_EQ(reassembler.GetStats().ignoredPackets, 3u);
+}
+
+// Previous way of decoding. Shards are copied into per frame buffers and reed_solomon_reconstruct inverts
+// decode matrix again for each stripe.
+static bool ReferenceDecode(const Datagrams &datagrams, const std::vector<bool> &lost, std::vector<uint8_t> &out) {
+	const VideoFrame *header = reinterpret_cast<const VideoFrame *>(&datagrams[0][0]);
+	int len = header->frameByteSize;
+	int fecPercentage = header->fecPercentage;
+	int shardPackets = CalculateFECShardPackets(len, fecPercentage);
+	int blockSize = shardPackets * ALVR_MAX_VIDEO_BUFFER_SIZE;
+	int dataShards = (len + blockSize - 1) / blockSize;
+	int parityShards = CalculateParityShards(dataShards, fecPercentage);
+	int totalShards = dataShards + parityShards;
+	int dataPackets = (len + ALVR_MAX_VIDEO_BUFFER_SIZE - 1) / ALVR_MAX_VIDEO_BUFFER_SIZE;
+
+	std::vector<uint8_t> payload(totalShards * blockSize, 0);
+	std::vector<bool> received(totalShards * shardPackets, false);
+	for (size_t i = 0; i < datagrams.size(); i++) {
+		if (lost[i]) {
+			continue;
+		}
+		const VideoFrame *packet = reinterpret_cast<const VideoFrame *>(&datagrams[i][0]);
+		memcpy(&payload[packet->fecIndex * ALVR_MAX_VIDEO_BUFFER_SIZE], packet + 1, datagrams[i].size() - sizeof(VideoFrame));
+		received[packet->fecIndex] = true;
+	}
+	reed_solomon *rs = ReedSolomonCache::Instance().Get(dataShards, parityShards);
+	std::vector<uint8_t *> shards(totalShards);
+	std::vector<uint8_t> marks(totalShards);
+	for (int j = 0; j < shardPackets; j++) {
+		int available = 0;
+		for (int i = 0; i < totalShards; i++) {
+			int index = i * shardPackets + j;
+			shards[i] = &payload[index * ALVR_MAX_VIDEO_BUFFER_SIZE];
+			marks[i] = received[index] || (i < dataShards && index >= dataPackets) ? 0 : 1;
+			available += marks[i] ? 0 : 1;
+		}
+		if (available < dataShards) {
+			return false;
+		}
+		reed_solomon_reconstruct(rs, &shards[0], &marks[0], totalShards, ALVR_MAX_VIDEO_BUFFER_SIZE);
+	}
+	out.assign(payload.begin(), payload.begin() + len);
+	return true;
+}
+
+TEST(fec_reassembler_test, benchmark) {
+	reed_solomon_init();
+	std::mt19937 random(6);
+	const int FRAMES = 200;
+	const int FRAME_SIZE = 200000;
+	const int FEC_PERCENTAGE = 20;
+	const double lossRates[] = { 0, 0.01, 0.02, 0.05, 0.1 };
+
+	std::vector<std::vector<uint8_t>> frames;
+	std::vector<Datagrams> datagrams;
+	for (int i = 0; i < FRAMES; i++) {
+		frames.push_back(MakeFrame(FRAME_SIZE - random() % 20000, random));
+		datagrams.push_back(Packetize(frames.back(), i + 1, FEC_PERCENTAGE));
+	}
+
+	for (double lossRate : lossRates) {
+		std::bernoulli_distribution lose(lossRate);
+		std::vector<std::vector<bool>> lost(FRAMES);
+		for (int i = 0; i < FRAMES; i++) {
+			for (size_t j = 0; j < datagrams[i].size(); j++) {
+				lost[i].push_back(lose(random));
+			}
+		}
+
+		FECReassembler reassembler(4, FRAME_SIZE);
+		int completed = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < FRAMES; i++) {
+			ReassembledFrame frame;
+			for (size_t j = 0; j < datagrams[i].size(); j++) {
+				if (!lost[i][j] && Add(reassembler, datagrams[i][j], frame)) {
+					completed++;
+				}
+			}
+		}
+		auto middle = std::chrono::high_resolution_clock::now();
+		int referenceCompleted = 0;
+		std::vector<uint8_t> out;
+		for (int i = 0; i < FRAMES; i++) {
+			if (ReferenceDecode(datagrams[i], lost[i], out)) {
+				referenceCompleted++;
+				ASSERT_TRUE(out == frames[i]);
+			}
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		ASSERT_EQ(completed, referenceCompleted);
+
+		auto stats = reassembler.GetStats();
+		double reassemblerUs = std::chrono::duration<double, std::micro>(middle - start).count() / FRAMES;
+		double referenceUs = std::chrono::duration<double, std::micro>(end - middle).count() / FRAMES;
+		printf("loss %4.1f%% FEC %d%% frame %d bytes: reassembler %8.2f us/frame reference %8.2f us/frame"
+			" recovered %3llu lost %3llu matrix hits %llu misses %llu\n"
+			, lossRate * 100, FEC_PERCENTAGE, FRAME_SIZE, reassemblerUs, referenceUs
+			, (unsigned long long)stats.framesRecovered, (unsigned long long)(FRAMES - completed)
+			, (unsigned long long)stats.decodeMatrixHits, (unsigned long long)stats.decodeMatrixMisses);
+	}
+}
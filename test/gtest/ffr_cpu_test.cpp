@@ -0,0 +1,370 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../alvr_server/FFRCPU.h"
+
+// CPU FFR tests and benchmark.
+//
+// The golden images are rendered pixel by pixel by a transliteration of CompressSlicesPixelShader.hlsl
+// and VertBlurDistortionPixelShader.hlsl sampling as D3D11 does with the pipelines of FFR: sRGB
+// decode, bilinear filtering with 8 bits of subtexel precision, clamp addressing and sRGB encode of
+// the render target, all in float without tables. FFRCPU must be within 1 of them.
+//
+// The benchmark renders a 2880x1600 frame for a range of strength and shape settings and prints the
+// optimized resolution, the share of pixels left to encode and the render time.
+namespace {
+	struct float2 {
+		float x;
+		float y;
+	};
+
+	float2 operator+(float2 a, float2 b) { return { a.x + b.x, a.y + b.y }; }
+	float2 operator-(float2 a, float2 b) { return { a.x - b.x, a.y - b.y }; }
+	float2 operator*(float2 a, float2 b) { return { a.x * b.x, a.y * b.y }; }
+	float2 operator/(float2 a, float2 b) { return { a.x / b.x, a.y / b.y }; }
+	float2 operator+(float a, float2 b) { return { a + b.x, a + b.y }; }
+	float2 operator+(float2 a, float b) { return { a.x + b, a.y + b }; }
+	float2 operator*(float a, float2 b) { return { a * b.x, a * b.y }; }
+	float2 operator*(float2 a, float b) { return { a.x * b, a.y * b }; }
+	float2 operator/(float2 a, float b) { return { a.x / b, a.y / b }; }
+	float2 operator/(float a, float2 b) { return { a / b.x, a / b.y }; }
+
+	float saturate(float a) { return std::min(std::max(a, 0.f), 1.f); }
+	float2 saturate(float2 a) { return { saturate(a.x), saturate(a.y) }; }
+	float2 fmod(float2 a, float b) { return { fmodf(a.x, b), fmodf(a.y, b) }; }
+	float length(float2 a) { return sqrtf(a.x * a.x + a.y * a.y); }
+
+	// cbuffer FoveationVars
+	struct Shader {
+		float2 targetResolution;
+		float2 optimizedResolution;
+		float2 focusPosition;
+		float2 foveationScale;
+		float2 boundStart;
+		float2 distortedSize;
+
+		explicit Shader(const FoveationVars &vars)
+			: targetResolution{ (float)vars.targetEyeWidth, (float)vars.targetEyeHeight }
+			, optimizedResolution{ (float)vars.optimizedEyeWidth, (float)vars.optimizedEyeHeight }
+			, focusPosition{ vars.focusPositionX, vars.focusPositionY }
+			, foveationScale{ vars.foveationScaleX, vars.foveationScaleY }
+			, boundStart{ vars.boundStartX, vars.boundStartY }
+			, distortedSize{ vars.distortedWidth, vars.distortedHeight }
+		{
+		}
+
+		float2 RadialDistortion(float2 xy) const {
+			float radius = length(xy);
+			if (radius == 0) {
+				return xy / foveationScale;
+			}
+			return (tanf(radius) * xy / radius) / foveationScale;
+		}
+
+		float2 Distort(float2 uv) const {
+			return RadialDistortion(uv * distortedSize + boundStart) + focusPosition;
+		}
+
+		float2 TextureToEyeUV(float2 textureUV, bool isRightEye) const {
+			return { (textureUV.x + float(isRightEye) * (1.f - 2.f * textureUV.x)) * 2.f, textureUV.y };
+		}
+
+		float2 EyeToTextureUV(float2 eyeUV, bool isRightEye) const {
+			float2 clampedUV = saturate(eyeUV);
+			return { clampedUV.x / 2.f + float(isRightEye) * (1.f - clampedUV.x), clampedUV.y };
+		}
+
+		// CompressSlicesPixelShader.hlsl, returning the coordinates given to Sample.
+		float2 CompressSlices(float2 uv) const {
+			const float2 COMPRESSED_TO_SOURCE = optimizedResolution / targetResolution;
+			const float2 PADDING = 1.f / targetResolution;
+
+			bool isRightEye = uv.x > 0.5f;
+			float2 eyeUV = TextureToEyeUV(uv, isRightEye);
+
+			float2 alignedUV = eyeUV * COMPRESSED_TO_SOURCE;
+			float2 edge = foveationScale + 4.f * PADDING;
+
+			float2 overEdge = { float(alignedUV.x > edge.x), float(alignedUV.y > edge.y) };
+			float2 overHalfEdge = { float(alignedUV.x > edge.x / 2.f), float(alignedUV.y > edge.y / 2.f) };
+
+			float sourceScale = (overEdge.x + 1.f) * (overEdge.y + 1.f);
+
+			float2 compressedOffset = 1.f / 2.f * float2{ overEdge.x * (1.f - overHalfEdge.y),
+				overEdge.y * (1.f - overHalfEdge.x) };
+
+			float2 foveationRescale =
+				1.f / 2.f +
+				3.f * compressedOffset +
+				overEdge.x * overHalfEdge.y + overEdge.y * overHalfEdge.x +
+				overEdge.x * overEdge.y;
+
+			float2 paddingCount =
+				2.f +
+				overEdge.x * float2{ 3, -1.f + 2.f * overHalfEdge.y - overEdge.y } +
+				overEdge.y * float2{ -1.f + 2.f * overHalfEdge.x - overEdge.x, 3 };
+
+			float2 compressedUV = (alignedUV - paddingCount * PADDING) * sourceScale +
+				focusPosition - foveationRescale * foveationScale - compressedOffset;
+
+			return EyeToTextureUV(fmod(compressedUV + 1.f, 1), isRightEye);
+		}
+
+		// VertBlurDistortionPixelShader.hlsl
+		float2 Warp(float2 uv) const {
+			bool isRightEye = uv.x > 0.5f;
+			float2 distEyeUV = Distort(TextureToEyeUV(uv, isRightEye));
+			return EyeToTextureUV(distEyeUV, isRightEye);
+		}
+	};
+
+	float SRGBToLinear(float c) {
+		return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	float LinearToSRGB(float l) {
+		return l <= 0.0031308f ? 12.92f * l : 1.055f * powf(l, 1.f / 2.4f) - 0.055f;
+	}
+
+	// D3D11 default sampler on an R8G8B8A8_UNORM_SRGB texture, written to an sRGB render target.
+	void Sample(const CpuFrame &texture, float2 uv, uint8_t *out) {
+		int size[2] = { texture.GetWidth(), texture.GetHeight() };
+		float coord[2] = { uv.x, uv.y };
+		int texel[2][2];
+		float weight[2];
+		for (int axis = 0; axis < 2; axis++) {
+			float t = coord[axis] * size[axis] - 0.5f;
+			float base = floorf(t);
+			weight[axis] = roundf((t - base) * 256.f) / 256.f;
+			texel[axis][0] = std::min(std::max((int)base, 0), size[axis] - 1);
+			texel[axis][1] = std::min(std::max((int)base + 1, 0), size[axis] - 1);
+		}
+		for (int c = 0; c < 4; c++) {
+			float value = 0;
+			for (int j = 0; j < 2; j++) {
+				for (int i = 0; i < 2; i++) {
+					uint8_t byte = texture.GetPlane(0)[texture.GetPitch() * texel[1][j] + texel[0][i] * 4 + c];
+					float w = (i ? weight[0] : 1.f - weight[0]) * (j ? weight[1] : 1.f - weight[1]);
+					value += w * (c < 3 ? SRGBToLinear(byte / 255.f) : byte / 255.f);
+				}
+			}
+			out[c] = (uint8_t)std::min((int)((c < 3 ? LinearToSRGB(value) : value) * 255.f + 0.5f), 255);
+		}
+	}
+
+	void RenderGolden(FOVEATION_MODE mode, const FoveationVars &vars, const CpuFrame &src, CpuFrame &dst) {
+		Shader shader(vars);
+		for (int y = 0; y < dst.GetHeight(); y++) {
+			for (int x = 0; x < dst.GetWidth(); x++) {
+				float2 uv = { (x + 0.5f) / dst.GetWidth(), (y + 0.5f) / dst.GetHeight() };
+				uint8_t *out = dst.GetPlane(0) + dst.GetPitch() * y + x * 4;
+				if (mode == FOVEATION_MODE_SLICES) {
+					Sample(src, shader.CompressSlices(uv), out);
+				}
+				else {
+					Sample(src, shader.Warp(uv), out);
+					out[3] = 255;
+				}
+			}
+		}
+	}
+
+	// Smooth gradients with sharp edges and noise, which show any misplaced or misfiltered pixel.
+	void FillPicture(CpuFrame &frame, uint32_t seed) {
+		std::mt19937 random(seed);
+		for (int y = 0; y < frame.GetHeight(); y++) {
+			uint8_t *row = frame.GetPlane(0) + frame.GetPitch() * y;
+			for (int x = 0; x < frame.GetWidth(); x++) {
+				uint8_t *c = row + x * 4;
+				c[0] = (uint8_t)(x * 3);
+				c[1] = (uint8_t)(y * 5);
+				c[2] = ((x / 16 + y / 16) & 1) ? 230 : 20;
+				c[3] = (uint8_t)random();
+				if ((x / 64 + y / 64) % 3 == 0) {
+					c[0] = (uint8_t)random();
+					c[1] = (uint8_t)random();
+				}
+			}
+		}
+	}
+
+	// Largest difference, and number of bytes which differ.
+	void Compare(const CpuFrame &a, const CpuFrame &b, int &maxDiff, int &diffCount) {
+		maxDiff = 0;
+		diffCount = 0;
+		for (int y = 0; y < a.GetHeight(); y++) {
+			const uint8_t *rowA = a.GetPlane(0) + a.GetPitch() * y;
+			const uint8_t *rowB = b.GetPlane(0) + b.GetPitch() * y;
+			for (int i = 0; i < a.GetWidth() * 4; i++) {
+				int diff = abs(rowA[i] - rowB[i]);
+				maxDiff = std::max(maxDiff, diff);
+				diffCount += diff != 0;
+			}
+		}
+	}
+
+	// Asymmetric fov as on Oculus Quest, so the focus is off center.
+	const EyeFov LEFT_EYE_FOV = { 52, 42, 53, 47 };
+	const EyeFov SYMMETRIC_FOV = { 45, 45, 45, 45 };
+}
+
+TEST(ffr_cpu_test, foveation_vars) {
+	// Launcher defaults: strength 2, shape 1.5.
+	FoveationVars slices = CalculateFoveationVars(FOVEATION_MODE_SLICES, 2880, 1600, SYMMETRIC_FOV, 2, 1.5f, 0);
+	EXPECT_EQ(1440u, slices.targetEyeWidth);
+	EXPECT_EQ(1600u, slices.targetEyeHeight);
+	EXPECT_EQ(1120u, slices.optimizedEyeWidth);
+	EXPECT_EQ(896u, slices.optimizedEyeHeight);
+	EXPECT_EQ(0.5f, slices.focusPositionX);
+	EXPECT_EQ(0.5f, slices.focusPositionY);
+	// Aligned to 4 pixels.
+	EXPECT_EQ(976.f, slices.foveationScaleX * 1440);
+	EXPECT_EQ(652.f, slices.foveationScaleY * 1600);
+
+	FoveationVars warp = CalculateFoveationVars(FOVEATION_MODE_WARP, 2880, 1600, LEFT_EYE_FOV, 2, 1.5f, 0);
+	EXPECT_EQ(0u, warp.optimizedEyeWidth % 32);
+	EXPECT_EQ(0u, warp.optimizedEyeHeight % 32);
+	EXPECT_LT(warp.optimizedEyeWidth, 1440u);
+	EXPECT_LT(warp.optimizedEyeHeight, 1600u);
+	// Focus is towards the nose and up.
+	EXPECT_GT(warp.focusPositionX, 0.5f);
+	EXPECT_LT(warp.focusPositionY, 0.5f);
+	EXPECT_LT(warp.boundStartX, 0.f);
+	EXPECT_GT(warp.distortedWidth, 0.f);
+}
+
+TEST(ffr_cpu_test, golden_images) {
+	struct {
+		FOVEATION_MODE mode;
+		EyeFov fov;
+		float strength;
+		float shape;
+		float verticalOffset;
+	} cases[] = {
+		{ FOVEATION_MODE_SLICES, SYMMETRIC_FOV, 2, 1.5f, 0 },
+		{ FOVEATION_MODE_SLICES, LEFT_EYE_FOV, 4, 1.5f, 0.1f },
+		{ FOVEATION_MODE_WARP, SYMMETRIC_FOV, 2, 1.5f, 0 },
+		{ FOVEATION_MODE_WARP, LEFT_EYE_FOV, 3, 2, -0.05f },
+	};
+	// Smaller than a headset, so the per pixel reference is quick.
+	const int WIDTH = 960;
+	const int HEIGHT = 544;
+	CpuFrame src(CpuFrame::FORMAT_RGBA, WIDTH, HEIGHT);
+	FillPicture(src, 1);
+	for (auto &c : cases) {
+		FoveationVars vars = CalculateFoveationVars(c.mode, WIDTH, HEIGHT, c.fov, c.strength, c.shape, c.verticalOffset);
+		FFRCPU ffr(c.mode, vars);
+		uint32_t width, height;
+		ffr.GetOptimizedResolution(&width, &height);
+		EXPECT_EQ(vars.optimizedEyeWidth * 2, width);
+		EXPECT_EQ(vars.optimizedEyeHeight, height);
+
+		CpuFrame golden(CpuFrame::FORMAT_RGBA, width, height);
+		CpuFrame actual(CpuFrame::FORMAT_RGBA, width, height);
+		RenderGolden(c.mode, vars, src, golden);
+		ffr.Render(src, actual);
+
+		int maxDiff;
+		int diffCount;
+		Compare(golden, actual, maxDiff, diffCount);
+		printf("mode %d strength %.1f shape %.1f: %ux%u, max diff %d, %.3f%% bytes differ\n", c.mode, c.strength
+			, c.shape, width, height, maxDiff, 100.0 * diffCount / (width * height * 4));
+		EXPECT_LE(maxDiff, 1);
+		EXPECT_LT(diffCount, (int)(width * height * 4 / 100));
+	}
+}
+
+TEST(ffr_cpu_test, implementations_agree) {
+	CpuFrame src(CpuFrame::FORMAT_RGBA, 1440, 800);
+	FillPicture(src, 2);
+	FOVEATION_MODE modes[] = { FOVEATION_MODE_SLICES, FOVEATION_MODE_WARP };
+	for (auto mode : modes) {
+		FoveationVars vars = CalculateFoveationVars(mode, 1440, 800, LEFT_EYE_FOV, 2, 1.5f, 0);
+		FFRCPU single(mode, vars, 1);
+		FFRCPU threaded(mode, vars, 5);
+		EXPECT_EQ(5, threaded.GetThreadCount());
+		uint32_t width, height;
+		single.GetOptimizedResolution(&width, &height);
+
+		// Rows of each kernel must be identical.
+		std::vector<uint8_t> scalar(width * 4);
+		std::vector<uint8_t> sse2(width * 4);
+		for (uint32_t y = 0; y < height; y++) {
+			FFRCPU::RenderRowScalar(src.GetPlane(0), src.GetPitch(), single.GetTaps(y), scalar.data(), width);
+			FFRCPU::RenderRowSSE2(src.GetPlane(0), src.GetPitch(), single.GetTaps(y), sse2.data(), width);
+			ASSERT_EQ(scalar, sse2);
+		}
+
+		CpuFrame expected(CpuFrame::FORMAT_RGBA, width, height);
+		CpuFrame actual(CpuFrame::FORMAT_RGBA, width, height);
+		single.Render(src, expected);
+		// Workers are reused between frames.
+		for (int frame = 0; frame < 3; frame++) {
+			memset(actual.GetPlane(0), 0, actual.GetSize());
+			threaded.Render(src, actual);
+			EXPECT_EQ(0, memcmp(expected.GetPlane(0), actual.GetPlane(0), expected.GetSize()));
+		}
+	}
+}
+
+TEST(ffr_cpu_test, copied_texels_are_exact) {
+	// Center of the slices is not filtered.
+	CpuFrame src(CpuFrame::FORMAT_RGBA, 1440, 800);
+	FillPicture(src, 3);
+	FoveationVars vars = CalculateFoveationVars(FOVEATION_MODE_SLICES, 1440, 800, SYMMETRIC_FOV, 2, 1.5f, 0);
+	FFRCPU ffr(FOVEATION_MODE_SLICES, vars, 1);
+	const FFRCPU::Tap *taps = ffr.GetTaps(vars.optimizedEyeHeight / 2);
+	const FFRCPU::Tap &center = taps[vars.optimizedEyeWidth / 2];
+	EXPECT_EQ(0, center.fx);
+	EXPECT_EQ(0, center.fy);
+
+	// Both weights whole in either direction give back the texel bytes.
+	FFRCPU::Tap whole[] = { { 10, 10, 0, 0 }, { 9, 10, 256, 0 }, { 10, 9, 0, 256 }, { 9, 9, 256, 256 } };
+	for (auto &tap : whole) {
+		uint8_t out[4];
+		FFRCPU::RenderRowSSE2(src.GetPlane(0), src.GetPitch(), &tap, out, 1);
+		EXPECT_EQ(0, memcmp(src.GetPlane(0) + src.GetPitch() * 10 + 40, out, 4));
+	}
+}
+
+TEST(ffr_cpu_test, benchmark) {
+	const int WIDTH = 2880;
+	const int HEIGHT = 1600;
+	const int FRAMES = 10;
+	CpuFrame src(CpuFrame::FORMAT_RGBA, WIDTH, HEIGHT);
+	FillPicture(src, 4);
+	FOVEATION_MODE modes[] = { FOVEATION_MODE_SLICES, FOVEATION_MODE_WARP };
+	const float strengths[] = { 1, 2, 3, 5 };
+	const float shapes[] = { 1, 1.5f, 2 };
+	printf("%dx%d, left eye fov %.0f %.0f %.0f %.0f\n", WIDTH, HEIGHT, LEFT_EYE_FOV.left, LEFT_EYE_FOV.right
+		, LEFT_EYE_FOV.top, LEFT_EYE_FOV.bottom);
+	for (auto mode : modes) {
+		for (float strength : strengths) {
+			for (float shape : shapes) {
+				FoveationVars vars = CalculateFoveationVars(mode, WIDTH, HEIGHT, LEFT_EYE_FOV, strength, shape, 0);
+				FFRCPU ffr(mode, vars);
+				uint32_t width, height;
+				ffr.GetOptimizedResolution(&width, &height);
+				CpuFrame dst(CpuFrame::FORMAT_RGBA, width, height);
+				ffr.Render(src, dst);
+				auto start = std::chrono::steady_clock::now();
+				for (int frame = 0; frame < FRAMES; frame++) {
+					ffr.Render(src, dst);
+				}
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				printf("  %-6s strength %.1f shape %.1f: %4ux%-4u %5.1f%% pixels, %6.2f ms/frame %5.2f Gpixels/s (%d threads)\n"
+					, mode == FOVEATION_MODE_SLICES ? "slices" : "warp", strength, shape, width, height
+					, 100.0 * width * height / (WIDTH * HEIGHT), seconds / FRAMES * 1e3
+					, (double)width * height * FRAMES / seconds / 1e9, ffr.GetThreadCount());
+				EXPECT_LT(width * height, (uint32_t)(WIDTH * HEIGHT));
+			}
+		}
+	}
+}
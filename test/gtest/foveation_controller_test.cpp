@@ -0,0 +1,380 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <random>
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../alvr_server/FoveationController.h"
+#include "loss-model.h"
+
+// Trace-driven simulation of the foveation controller. Each second of a link capacity trace (Mbit/s)
+// carries the stream of the current decision: encode bitrate plus WIRE_OVERHEAD for FEC, headers and
+// audio. What does not fit is lost, and frames are lost once loss exceeds what FEC recovers. The client
+// report of the second goes back to the controller and its decision applies from the next second.
+//
+// Center quality of a second is the bits per encoded pixel relative to the configured stream, capped at
+// 1, times the share of frames delivered. FFR keeps the center of the view at about full resolution, so
+// its quality follows the bits per pixel while the periphery is downsampled harder.
+//
+// Set ALVR_FOVEATION_TRACE to a text file of capacities in Mbit/s, one second per line, to replay a
+// recorded trace in addition to the synthetic ones.
+namespace {
+	static const int REFRESH_RATE = 72;
+	static const int PACKET_BYTES = 1400;
+	static constexpr double WIRE_OVERHEAD = 1.15;
+	static constexpr double BASE_LOSS = 0.002;
+	// Loss FEC recovers without frame loss, as AdaptiveFECPolicy sizes parity for it.
+	static constexpr double FEC_RECOVERABLE_LOSS = 0.03;
+	static const int BITRATE = 60;
+	static const int MIN_BITRATE = 10;
+
+	FoveationController::Config GetConfig(FOVEATION_MODE mode, float maxStrength) {
+		FoveationController::Config config;
+		config.mode = mode;
+		config.renderWidth = 2880;
+		config.renderHeight = 1600;
+		config.leftEyeFov = { 52, 42, 53, 47 };
+		config.strength = 2;
+		config.maxStrength = maxStrength;
+		config.shape = 1.5f;
+		config.verticalOffset = 0;
+		config.bitrateInMBits = BITRATE;
+		config.minBitrateInMBits = MIN_BITRATE;
+		return config;
+	}
+
+	struct SimResult {
+		int seconds = 0;
+		double centerQuality = 0;
+		double frameLoss = 0;
+		double bitrate = 0;
+		double strength = 0;
+		int changes = 0;
+		int strengthChanges = 0;
+		int bitrateChanges = 0;
+		// Smallest change of bitrate relative to the previous one, except to a bound.
+		double smallestStep = 1;
+		FoveationController::Decision last;
+
+		double Mean(double sum) const {
+			return seconds == 0 ? 0 : sum / seconds;
+		}
+	};
+
+	// adaptive false keeps the configured decision, as without the controller.
+	SimResult Simulate(FoveationController &controller, bool adaptive, const std::vector<double> &capacity
+		, std::vector<double> *quality = NULL) {
+		SimResult result;
+		FoveationController::Decision decision = controller.GetDecision();
+		double configuredBpp = decision.bitrateInMBits / (static_cast<double>(decision.width) * decision.height);
+		uint64_t now = 0;
+		for (double linkMbps : capacity) {
+			double wireMbps = decision.bitrateInMBits * WIRE_OVERHEAD;
+			double loss = wireMbps > linkMbps ? 1 - linkMbps / wireMbps : BASE_LOSS;
+			double packetsPerFrame = wireMbps * 1000 * 1000 / 8 / PACKET_BYTES / REFRESH_RATE;
+			double frameLoss = loss <= FEC_RECOVERABLE_LOSS ? 0 : 1 - pow(1 - loss, packetsPerFrame);
+
+			double bpp = decision.bitrateInMBits / (static_cast<double>(decision.width) * decision.height);
+			double relativeBpp = std::min(1.0, bpp / configuredBpp);
+			double q = relativeBpp * (1 - frameLoss);
+
+			result.seconds++;
+			result.centerQuality += q;
+			result.frameLoss += frameLoss;
+			result.bitrate += decision.bitrateInMBits;
+			result.strength += decision.strength;
+			if (quality) {
+				quality->push_back(q);
+			}
+
+			now += 1000 * 1000;
+			uint64_t packetsSent = static_cast<uint64_t>(packetsPerFrame * REFRESH_RATE);
+			uint64_t packetsLost = static_cast<uint64_t>(packetsSent * loss);
+			if (adaptive && controller.OnReport(now, packetsSent, packetsLost, 1000)) {
+				const FoveationController::Decision &next = controller.GetDecision();
+				result.changes++;
+				result.strengthChanges += next.strength != decision.strength ? 1 : 0;
+				if (next.bitrateInMBits != decision.bitrateInMBits) {
+					result.bitrateChanges++;
+					if (next.bitrateInMBits != BITRATE && next.bitrateInMBits != MIN_BITRATE) {
+						result.smallestStep = std::min(result.smallestStep
+							, fabs(next.bitrateInMBits - decision.bitrateInMBits) / decision.bitrateInMBits);
+					}
+				}
+				decision = next;
+			}
+		}
+		result.centerQuality = result.Mean(result.centerQuality);
+		result.frameLoss = result.Mean(result.frameLoss);
+		result.bitrate = result.Mean(result.bitrate);
+		result.strength = result.Mean(result.strength);
+		result.last = decision;
+		return result;
+	}
+
+	struct Trace {
+		const char *name;
+		std::vector<double> capacity;
+	};
+
+	void Append(std::vector<double> &capacity, int seconds, double mbps) {
+		capacity.insert(capacity.end(), seconds, mbps);
+	}
+
+	std::vector<Trace> MakeTraces() {
+		std::vector<Trace> traces(4);
+		traces[0].name = "clean";
+		Append(traces[0].capacity, 180, 200);
+
+		traces[1].name = "drop to 40";
+		Append(traces[1].capacity, 30, 200);
+		Append(traces[1].capacity, 90, 40);
+		Append(traces[1].capacity, 120, 200);
+
+		// Someone walking between headset and access point.
+		traces[2].name = "fluctuating";
+		std::mt19937 random(11);
+		double mbps = 90;
+		for (int i = 0; i < 300; i++) {
+			mbps = std::max(20.0, std::min(160.0, mbps + 8 * Normal(random)));
+			traces[2].capacity.push_back(mbps);
+		}
+
+		traces[3].name = "oscillating";
+		for (int i = 0; i < 30; i++) {
+			Append(traces[3].capacity, 3, 200);
+			Append(traces[3].capacity, 3, 45);
+		}
+
+		const char *path = getenv("ALVR_FOVEATION_TRACE");
+		if (path != NULL) {
+			std::ifstream file(path);
+			Trace recorded;
+			recorded.name = "recorded";
+			double value;
+			while (file >> value) {
+				recorded.capacity.push_back(value);
+			}
+			traces.push_back(recorded);
+		}
+		return traces;
+	}
+}
+
+TEST(foveation_controller_test, ladder) {
+	for (FOVEATION_MODE mode : { FOVEATION_MODE_SLICES, FOVEATION_MODE_WARP }) {
+		FoveationController controller(GetConfig(mode, 5));
+		const FoveationController::Decision &decision = controller.GetDecision();
+		EXPECT_EQ(decision.bitrateInMBits, BITRATE);
+		EXPECT_EQ(decision.strength, 2);
+		FoveationVars vars = CalculateFoveationVars(mode, 2880, 1600, GetConfig(mode, 5).leftEyeFov, 2, 1.5f, 0);
+		EXPECT_EQ(decision.width, vars.optimizedEyeWidth * 2);
+		EXPECT_EQ(decision.height, vars.optimizedEyeHeight);
+
+		// Stronger foveation encodes fewer pixels.
+		EXPECT_LT(controller.GetPixels(5), controller.GetPixels(3));
+		EXPECT_LT(controller.GetPixels(3), controller.GetPixels(2));
+	}
+	// Last step is maxStrength even if off the grid.
+	FoveationController controller(GetConfig(FOVEATION_MODE_SLICES, 3.2f));
+	EXPECT_GT(controller.GetPixels(3.2f), 0u);
+	EXPECT_EQ(controller.GetPixels(3.5f), 0u);
+}
+
+TEST(foveation_controller_test, congestion_raises_strength) {
+	FoveationController controller(GetConfig(FOVEATION_MODE_SLICES, 5));
+	uint64_t now = 0;
+	for (int i = 0; i < 10; i++) {
+		now += 1000 * 1000;
+		EXPECT_FALSE(controller.OnReport(now, 6000, 3, 1000));
+	}
+
+	// A quarter of the packets lost: budget follows the delivered share.
+	now += 1000 * 1000;
+	EXPECT_TRUE(controller.OnReport(now, 6000, 1500, 1000));
+	const FoveationController::Decision &decision = controller.GetDecision();
+	EXPECT_EQ(decision.bitrateInMBits, static_cast<int>(BITRATE * 0.75 * FoveationController::DECREASE));
+	EXPECT_GT(decision.strength, 2);
+	// Bits per pixel are kept.
+	double configured = static_cast<double>(BITRATE) / controller.GetPixels(2);
+	EXPECT_GE(decision.bitrateInMBits / static_cast<double>(decision.width * decision.height)
+		, configured * FoveationController::BPP_TARGET);
+	// Lower step would not keep them.
+	float lower = decision.strength - FoveationController::STRENGTH_STEP;
+	EXPECT_LT(decision.bitrateInMBits / static_cast<double>(controller.GetPixels(lower))
+		, configured * FoveationController::BPP_TARGET);
+
+	// Reports still carrying the old rate do not lower it again.
+	int bitrate = decision.bitrateInMBits;
+	now += 1000 * 1000;
+	EXPECT_FALSE(controller.OnReport(now, 6000, 1500, 1000));
+	EXPECT_EQ(controller.GetDecision().bitrateInMBits, bitrate);
+
+	// Send queue delay counts as congestion too.
+	now += 1000 * 1000;
+	EXPECT_TRUE(controller.OnReport(now, 3000, 0, 50 * 1000));
+	EXPECT_LT(controller.GetDecision().bitrateInMBits, bitrate);
+}
+
+TEST(foveation_controller_test, recovery_hysteresis) {
+	FoveationController controller(GetConfig(FOVEATION_MODE_WARP, 5));
+	uint64_t now = 1000 * 1000;
+	controller.OnReport(now, 6000, 4000, 1000);
+	float raised = controller.GetDecision().strength;
+	ASSERT_GT(raised, 2);
+
+	// Budget climbs one step per RECOVER_REPORTS clean reports. Strength is held for STRENGTH_HOLD_US
+	// even when the bitrate would allow less.
+	int changes = 0;
+	uint64_t start = now;
+	while (controller.GetDecision().bitrateInMBits < BITRATE) {
+		now += 1000 * 1000;
+		int before = controller.GetDecision().bitrateInMBits;
+		if (controller.OnReport(now, 3000, 0, 1000)) {
+			changes++;
+			EXPECT_GT(controller.GetDecision().bitrateInMBits, before);
+		}
+		if (now - start < FoveationController::STRENGTH_HOLD_US) {
+			EXPECT_EQ(controller.GetDecision().strength, raised);
+		}
+		ASSERT_LT(now - start, 200 * 1000 * 1000ULL);
+	}
+	EXPECT_GE(now - start, 1000 * 1000ULL * FoveationController::RECOVER_REPORTS * changes);
+	// Strength follows once the last raise held.
+	uint64_t raisedAt = now;
+	while (controller.GetDecision().strength != 2) {
+		now += 1000 * 1000;
+		controller.OnReport(now, 6000, 0, 1000);
+		ASSERT_LE(now - raisedAt, static_cast<uint64_t>(FoveationController::PROBE_FAILURE_US));
+	}
+
+	// Clean link at the configured bitrate changes nothing.
+	for (int i = 0; i < 60; i++) {
+		now += 1000 * 1000;
+		EXPECT_FALSE(controller.OnReport(now, 6000, 0, 1000));
+	}
+}
+
+TEST(foveation_controller_test, failed_probes_back_off) {
+	FoveationController controller(GetConfig(FOVEATION_MODE_SLICES, 5));
+	// Link carries about 35 Mbit/s of video. Each raise above it is congested on the next report.
+	uint64_t now = 0;
+	std::vector<uint64_t> probes;
+	for (int i = 0; i < 600; i++) {
+		now += 1000 * 1000;
+		int bitrate = controller.GetDecision().bitrateInMBits;
+		bool congested = bitrate > 35;
+		int before = bitrate;
+		controller.OnReport(now, 6000, congested ? 600 : 0, 1000);
+		if (controller.GetDecision().bitrateInMBits > before) {
+			probes.push_back(now);
+		}
+	}
+	ASSERT_GE(probes.size(), 3u);
+	// Intervals between probes grow up to MAX_RECOVER_REPORTS, so there are far fewer probes than one
+	// per RECOVER_REPORTS and failure.
+	uint64_t longest = 0;
+	for (size_t i = 1; i < probes.size(); i++) {
+		longest = std::max(longest, probes[i] - probes[i - 1]);
+	}
+	EXPECT_GE(longest, 1000 * 1000ULL * FoveationController::MAX_RECOVER_REPORTS);
+	EXPECT_LT(probes.size(), 600u / (2 * FoveationController::RECOVER_REPORTS));
+	EXPECT_LE(controller.GetDecision().bitrateInMBits, 35);
+	EXPECT_GE(controller.GetDecision().bitrateInMBits, 25);
+}
+
+TEST(foveation_controller_test, bounds) {
+	FoveationController controller(GetConfig(FOVEATION_MODE_SLICES, 4));
+	uint64_t now = 0;
+	for (int i = 0; i < 60; i++) {
+		now += 1000 * 1000;
+		controller.OnReport(now, 6000, 5000, 100 * 1000);
+	}
+	EXPECT_EQ(controller.GetDecision().bitrateInMBits, 10);
+	EXPECT_EQ(controller.GetDecision().strength, 4);
+
+	// Without foveation steps only the bitrate adapts.
+	FoveationController bitrateOnly(GetConfig(FOVEATION_MODE_SLICES, 2));
+	now = 0;
+	for (int i = 0; i < 5; i++) {
+		now += 1000 * 1000;
+		bitrateOnly.OnReport(now, 6000, 3000, 1000);
+	}
+	EXPECT_LT(bitrateOnly.GetDecision().bitrateInMBits, BITRATE);
+	EXPECT_EQ(bitrateOnly.GetDecision().strength, 2);
+}
+
+TEST(foveation_controller_test, simulate_traces) {
+	std::vector<Trace> traces = MakeTraces();
+	printf("%-12s %-14s %9s %9s %9s %9s %8s %8s %8s %8s\n", "trace", "policy", "center q", "loss %", "Mbit/s"
+		, "strength", "changes", "bitrate", "smallest", "strength");
+	printf("%-12s %-14s %9s %9s %9s %9s %8s %8s %8s %8s\n", "", "", "", "frames", "mean", "mean", "", "changes", "step %"
+		, "changes");
+	for (FOVEATION_MODE mode : { FOVEATION_MODE_SLICES, FOVEATION_MODE_WARP }) {
+		for (auto &trace : traces) {
+			const char *names[] = { "fixed", "bitrate only", "foveation" };
+			SimResult results[3];
+			for (int policy = 0; policy < 3; policy++) {
+				FoveationController controller(GetConfig(mode, policy == 2 ? 5.0f : 2.0f));
+				results[policy] = Simulate(controller, policy != 0, trace.capacity);
+				char name[32];
+				snprintf(name, sizeof(name), "%s %s", mode == FOVEATION_MODE_SLICES ? "S" : "W", names[policy]);
+				printf("%-12s %-14s %9.3f %9.2f %9.1f %9.2f %8d %8d %8.1f %8d\n", trace.name, name
+					, results[policy].centerQuality, results[policy].frameLoss * 100, results[policy].bitrate
+					, results[policy].strength, results[policy].changes, results[policy].bitrateChanges
+					, results[policy].smallestStep * 100, results[policy].strengthChanges);
+			}
+			if (trace.name == std::string("recorded")) {
+				continue;
+			}
+			const SimResult &fixed = results[0];
+			const SimResult &bitrateOnly = results[1];
+			const SimResult &foveation = results[2];
+			if (trace.name == std::string("clean")) {
+				EXPECT_EQ(foveation.changes, 0);
+				EXPECT_EQ(foveation.centerQuality, fixed.centerQuality);
+				continue;
+			}
+			// Center of the view is better with strength following the budget than with bitrate alone,
+			// which is better than streaming into a link that can not carry it.
+			EXPECT_GT(foveation.centerQuality, bitrateOnly.centerQuality);
+			EXPECT_GT(bitrateOnly.centerQuality, fixed.centerQuality);
+			// Each strength change costs an IDR frame, so they are bounded by the hold time.
+			int seconds = static_cast<int>(trace.capacity.size());
+			EXPECT_LE(foveation.strengthChanges, 2 * seconds / static_cast<int>(FoveationController::STRENGTH_HOLD_US / 1000 / 1000) + 2);
+			// Bitrate changes are coarse and rate limited, so the encoder does not chase 1 Mbit steps.
+			int settleSeconds = static_cast<int>(FoveationController::SETTLE_US / 1000 / 1000);
+			for (const SimResult *result : { &bitrateOnly, &foveation }) {
+				EXPECT_GE(result->smallestStep, 0.1);
+				EXPECT_LE(result->bitrateChanges, seconds / settleSeconds + seconds / FoveationController::RECOVER_REPORTS);
+			}
+			if (trace.name == std::string("drop to 40")) {
+				// Back to the configured stream once the link recovered.
+				EXPECT_EQ(foveation.last.bitrateInMBits, BITRATE);
+				EXPECT_EQ(foveation.last.strength, 2);
+			}
+		}
+	}
+}
+
+// Per second center quality over the drop, for plotting.
+TEST(foveation_controller_test, drop_timeline) {
+	std::vector<Trace> traces = MakeTraces();
+	const Trace &drop = traces[1];
+	std::vector<double> quality[3];
+	for (int policy = 0; policy < 3; policy++) {
+		FoveationController controller(GetConfig(FOVEATION_MODE_SLICES, policy == 2 ? 5.0f : 2.0f));
+		Simulate(controller, policy != 0, drop.capacity, &quality[policy]);
+	}
+	printf("%6s %9s %9s %9s %9s\n", "second", "capacity", "fixed", "bitrate", "foveation");
+	for (size_t i = 0; i < drop.capacity.size(); i += 5) {
+		printf("%6d %9.0f %9.3f %9.3f %9.3f\n", static_cast<int>(i), drop.capacity[i], quality[0][i], quality[1][i], quality[2][i]);
+	}
+	// Settled within the drop: foveation keeps most of the center quality.
+	EXPECT_GT(quality[2][100], 0.8);
+	EXPECT_LT(quality[1][100], quality[2][100]);
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include "../../alvr_server/FrameLossTracker.h"
+
+namespace {
+	// Sends frame of len bytes and returns number of packets it took.
+	uint32_t Send(FrameLossTracker &tracker, uint8_t frameType, uint32_t &packetCounter, int len, int fecPercentage) {
+		FECLayout layout = FECLayout::Calculate(len, fecPercentage);
+		uint32_t packets = layout.dataPackets + layout.parityPackets;
+		tracker.OnFrameSent(frameType, packetCounter, packets, layout);
+		packetCounter += packets;
+		return packets;
+	}
+}
+
+TEST(frame_loss_tracker_test, counts_per_type) {
+	FrameLossTracker tracker;
+	uint32_t counter = 100;
+	Send(tracker, ALVR_FRAME_TYPE_IDR, counter, 200000, 30);
+	uint32_t first = counter;
+	Send(tracker, ALVR_FRAME_TYPE_REFERENCE, counter, 48000, 10);
+	Send(tracker, ALVR_FRAME_TYPE_REFERENCE, counter, 48000, 10);
+	Send(tracker, ALVR_FRAME_TYPE_NON_REFERENCE, counter, 48000, 10);
+
+	ASSERT_EQ(1u, tracker.GetStats(ALVR_FRAME_TYPE_IDR).frames);
+	ASSERT_EQ(2u, tracker.GetStats(ALVR_FRAME_TYPE_REFERENCE).frames);
+	ASSERT_EQ(1u, tracker.GetStats(ALVR_FRAME_TYPE_NON_REFERENCE).frames);
+
+	// One packet of the IDR frame: recoverable.
+	tracker.OnLossRun(110, 110);
+	ASSERT_EQ(1u, tracker.GetStats(ALVR_FRAME_TYPE_IDR).recovered);
+	ASSERT_EQ(0u, tracker.GetStats(ALVR_FRAME_TYPE_IDR).lost);
+
+	// Whole first P frame: lost.
+	FECLayout layout = FECLayout::Calculate(48000, 10);
+	tracker.OnLossRun(first, first + layout.dataPackets + layout.parityPackets - 1);
+	ASSERT_EQ(1u, tracker.GetStats(ALVR_FRAME_TYPE_REFERENCE).lost);
+	ASSERT_EQ(0u, tracker.GetStats(ALVR_FRAME_TYPE_REFERENCE).recovered);
+
+	// Repeated single losses hit the IDR frame until parity is exhausted. Recovered turns into lost.
+	FECLayout idr = FECLayout::Calculate(200000, 30);
+	for (int i = 0; i < idr.parityShards; i++) {
+		tracker.OnLossRun(101 + i, 101 + i);
+	}
+	ASSERT_EQ(0u, tracker.GetStats(ALVR_FRAME_TYPE_IDR).recovered);
+	ASSERT_EQ(1u, tracker.GetStats(ALVR_FRAME_TYPE_IDR).lost);
+
+	// Reversed range is ignored.
+	tracker.OnLossRun(counter - 1, first);
+	ASSERT_EQ(0u, tracker.GetStats(ALVR_FRAME_TYPE_NON_REFERENCE).recovered + tracker.GetStats(ALVR_FRAME_TYPE_NON_REFERENCE).lost);
+
+	tracker.Reset();
+	ASSERT_EQ(0u, tracker.GetStats(ALVR_FRAME_TYPE_IDR).frames);
+}
+
+TEST(frame_loss_tracker_test, counter_wrap_around) {
+	FrameLossTracker tracker;
+	uint32_t counter = 0xFFFFFFF0;
+	uint32_t packets = Send(tracker, ALVR_FRAME_TYPE_REFERENCE, counter, 48000, 10);
+	ASSERT_GT(packets, 16u);
+	tracker.OnLossRun(2, 2);
+	ASSERT_EQ(1u, tracker.GetStats(ALVR_FRAME_TYPE_REFERENCE).recovered);
+	// Run starting before the frame.
+	tracker.OnLossRun(0xFFFFFFE0, 0xFFFFFFF0);
+	ASSERT_EQ(1u, tracker.GetStats(ALVR_FRAME_TYPE_REFERENCE).recovered);
+}
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <deque>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+#include "../../alvr_server/SocketIO.h"
+#include "../../alvr_server/NetworkTelemetry.h"
+#include "../../alvr_server/Utils.h"
+#include "../../ALVR-common/packet_types.h"
+#include "../../ALVR-common/fec_reassembler.h"
+
+// Synthetic encoder bitstream. Starts with Annex-B start code and NAL header of IDR or non-IDR slice,
+// followed by a pattern derived from frameIndex so the receiver can verify the frame byte by byte.
+inline void FillSyntheticFrame(uint8_t *buf, int len, uint64_t frameIndex, bool idr) {
+	uint32_t x = static_cast<uint32_t>(frameIndex * 2654435761u) | 1;
+	for (int i = 0; i < len; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		buf[i] = static_cast<uint8_t>(x);
+	}
+	static const uint8_t START_CODE[] = { 0, 0, 0, 1 };
+	memcpy(buf, START_CODE, std::min(len, 4));
+	if (len > 4) {
+		buf[4] = idr ? 0x65 : 0x41;
+	}
+}
+
+inline bool VerifySyntheticFrame(const uint8_t *buf, int len, uint64_t frameIndex) {
+	std::vector<uint8_t> expected(len);
+	FillSyntheticFrame(&expected[0], len, frameIndex, len > 4 && buf[4] == 0x65);
+	return memcmp(&expected[0], buf, len) == 0;
+}
+
+struct LoopbackClientConfig {
+	// Average packet loss injected on receive. Losses come in runs of burstLength packets on average
+	// (Gilbert-Elliott with lossless good state). 1 is independent loss.
+	double lossRate = 0;
+	double burstLength = 1;
+	// Fixed one-way delay injected on receive.
+	uint64_t delayUs = 0;
+	int refreshRate = 72;
+	int maxFrameBytes = 1024 * 1024;
+	// Frames are made by FillSyntheticFrame. False for bitstream of a real encoder.
+	bool syntheticFrames = true;
+};
+
+struct LoopbackClientStats {
+	uint64_t videoPackets = 0;
+	uint64_t audioPackets = 0;
+	uint64_t droppedPackets = 0;
+	uint64_t lostPackets = 0;
+	// Frames received without parity, recovered with parity, lost and recovered with wrong content.
+	uint64_t framesComplete = 0;
+	uint64_t framesRecovered = 0;
+	uint64_t framesLost = 0;
+	uint64_t framesCorrupt = 0;
+	// Bytes of complete and recovered frames.
+	uint64_t videoBytes = 0;
+	// sentTime to reassembly, in microseconds.
+	LatencyHistogram::Snapshot latency;
+};
+
+// Client side of the streaming protocol for headless benchmarks. Keeps sending HelloMessage until
+// the server connects, starts the stream, reassembles VideoFrame packets with FECReassembler,
+// answers TimeSync and reports unrecoverable frames with PacketErrorReport like the headset client.
+class LoopbackClient {
+public:
+	LoopbackClient(const LoopbackClientConfig &config)
+		: mConfig(config)
+		, mRandom(1)
+		, mReassembler(REASSEMBLER_FRAMES, config.maxFrameBytes)
+	{
+#ifdef _WIN32
+		WSADATA wsaData;
+		WSAStartup(MAKEWORD(2, 0), &wsaData);
+#endif
+		mSocket = socket(AF_INET, SOCK_DGRAM, 0);
+		int size = 16 * 1024 * 1024;
+		setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, (const char *)&size, sizeof(size));
+		SetSocketNonBlocking(mSocket);
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+		bind(mSocket, (sockaddr *)&addr, sizeof(addr));
+		socklen_t len = sizeof(addr);
+		getsockname(mSocket, (sockaddr *)&addr, &len);
+		mPort = ntohs(addr.sin_port);
+		mWaiter.Add(mSocket, false);
+
+		// Good -> bad probability keeps the average loss rate at lossRate.
+		mBadToGood = 1.0 / std::max(1.0, mConfig.burstLength);
+		mGoodToBad = mConfig.lossRate >= 1 ? 1 : mConfig.lossRate * mBadToGood / (1 - mConfig.lossRate);
+		reed_solomon_init();
+	}
+
+	~LoopbackClient() {
+		Stop();
+		closesocket(mSocket);
+	}
+
+	int GetPort() {
+		return mPort;
+	}
+
+	void Start(int serverPort) {
+		mServer = {};
+		mServer.sin_family = AF_INET;
+		mServer.sin_port = htons(serverPort);
+		inet_pton(AF_INET, "127.0.0.1", &mServer.sin_addr);
+		mExiting = false;
+		mThread = std::thread([this]() { Run(); });
+	}
+
+	void Stop() {
+		mExiting = true;
+		if (mThread.joinable()) {
+			mThread.join();
+		}
+	}
+
+	bool IsStreaming() {
+		return mStreaming;
+	}
+
+	LoopbackClientStats GetStats() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		LoopbackClientStats stats = mStats;
+		mLatency.Read(stats.latency);
+		return stats;
+	}
+private:
+	struct Delayed {
+		uint64_t releaseUs;
+		std::vector<char> buf;
+	};
+
+	LoopbackClientConfig mConfig;
+	SOCKET mSocket;
+	int mPort;
+	sockaddr_in mServer;
+	SocketWaiter mWaiter;
+	std::thread mThread;
+	std::atomic<bool> mExiting{ false };
+	std::atomic<bool> mStreaming{ false };
+
+	std::mt19937 mRandom;
+	double mGoodToBad;
+	double mBadToGood;
+	bool mBad = false;
+	std::deque<Delayed> mDelayed;
+
+	std::mutex mMutex;
+	LoopbackClientStats mStats;
+	LatencyHistogram mLatency;
+
+	// Frames in flight. Enough for fecInterleaveDepth and reordering by injected delay.
+	static const int REASSEMBLER_FRAMES = 8;
+	FECReassembler mReassembler;
+	uint64_t mFramesLost = 0;
+	uint32_t mNextCounter = 0;
+	uint32_t mLastLossFrom = 0;
+	uint32_t mLastLossTo = 0;
+
+	// Per-second report.
+	uint64_t mLostInSecond = 0;
+	uint64_t mFecFailureInSecond = 0;
+	uint64_t mFramesInSecond = 0;
+	uint64_t mLatencySumInSecond = 0;
+	uint64_t mLatencyMaxInSecond = 0;
+	uint64_t mLatencyCountInSecond = 0;
+	bool mFecFailure = false;
+	uint64_t mTimeSyncSequence = 0;
+
+	void Run() {
+		RecvDatagram datagrams[SOCKET_IO_MAX_RECV_BATCH];
+		uint64_t nextHello = 0;
+		uint64_t nextTracking = 0;
+		uint64_t nextReport = GetCounterUs() + 1000 * 1000;
+		uint64_t trackingFrameIndex = 0;
+		while (!mExiting) {
+			uint64_t now = GetCounterUs();
+			if (!mStreaming && now >= nextHello) {
+				SendHello();
+				nextHello = now + 100 * 1000;
+			}
+			if (mStreaming && now >= nextTracking) {
+				SendTracking(++trackingFrameIndex);
+				nextTracking = now + 1000 * 1000 / mConfig.refreshRate;
+			}
+			if (mStreaming && now >= nextReport) {
+				SendReport();
+				nextReport += 1000 * 1000;
+			}
+
+			uint64_t wait = 1000;
+			if (!mDelayed.empty()) {
+				wait = mDelayed.front().releaseUs > now ? std::min(wait, mDelayed.front().releaseUs - now) : 0;
+			}
+			if (mWaiter.Wait(wait) > 0) {
+				int count;
+				while ((count = RecvBatch(mWaiter.GetBackend(), mSocket, datagrams, SOCKET_IO_MAX_RECV_BATCH)) > 0) {
+					for (int i = 0; i < count; i++) {
+						Receive(datagrams[i].buf, datagrams[i].len);
+					}
+				}
+			}
+			now = GetCounterUs();
+			while (!mDelayed.empty() && mDelayed.front().releaseUs <= now) {
+				ProcessPacket(&mDelayed.front().buf[0], static_cast<int>(mDelayed.front().buf.size()));
+				mDelayed.pop_front();
+			}
+		}
+	}
+
+	void Receive(char *buf, int len) {
+		uint32_t type = *(uint32_t *)buf;
+		if (type == ALVR_PACKET_TYPE_VIDEO_FRAME || type == ALVR_PACKET_TYPE_AUDIO_FRAME_START || type == ALVR_PACKET_TYPE_AUDIO_FRAME) {
+			// Only streamed media is subject to injected loss.
+			std::uniform_real_distribution<double> uniform(0, 1);
+			mBad = mBad ? uniform(mRandom) >= mBadToGood : uniform(mRandom) < mGoodToBad;
+			if (mBad) {
+				std::lock_guard<std::mutex> lock(mMutex);
+				mStats.droppedPackets++;
+				return;
+			}
+		}
+		if (mConfig.delayUs == 0) {
+			ProcessPacket(buf, len);
+			return;
+		}
+		mDelayed.push_back({ GetCounterUs() + mConfig.delayUs, std::vector<char>(buf, buf + len) });
+	}
+
+	void ProcessPacket(char *buf, int len) {
+		uint32_t type = *(uint32_t *)buf;
+		if (type == ALVR_PACKET_TYPE_CONNECTION_MESSAGE && len >= static_cast<int>(sizeof(ConnectionMessage))) {
+			if (!mStreaming) {
+				StreamControlMessage message = {};
+				message.type = ALVR_PACKET_TYPE_STREAM_CONTROL_MESSAGE;
+				message.mode = 1;
+				Send(&message, sizeof(message));
+				mStreaming = true;
+			}
+		}
+		else if (type == ALVR_PACKET_TYPE_TIME_SYNC && len >= static_cast<int>(sizeof(TimeSync))) {
+			TimeSync *timeSync = (TimeSync *)buf;
+			if (timeSync->mode == 1) {
+				TimeSync reply = *timeSync;
+				reply.mode = 2;
+				reply.clientTime = GetTimestampUs();
+				Send(&reply, sizeof(reply));
+			}
+		}
+		else if (type == ALVR_PACKET_TYPE_VIDEO_FRAME && len >= static_cast<int>(sizeof(VideoFrame))) {
+			ProcessVideo((VideoFrame *)buf, len);
+		}
+		else if (type == ALVR_PACKET_TYPE_AUDIO_FRAME_START || type == ALVR_PACKET_TYPE_AUDIO_FRAME) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStats.audioPackets++;
+		}
+	}
+
+	void ProcessVideo(VideoFrame *header, int len) {
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStats.videoPackets++;
+			if (header->packetCounter > mNextCounter) {
+				mLastLossFrom = mNextCounter;
+				mLastLossTo = header->packetCounter - 1;
+				mStats.lostPackets += mLastLossTo - mLastLossFrom + 1;
+				mLostInSecond += mLastLossTo - mLastLossFrom + 1;
+			}
+		}
+		mNextCounter = std::max(mNextCounter, header->packetCounter + 1);
+
+		// Frames which can no longer get packets are lost.
+		if (header->videoFrameIndex > header->fecInterleaveDepth) {
+			mReassembler.Expire(header->videoFrameIndex - header->fecInterleaveDepth);
+		}
+		ReassembledFrame frame;
+		bool complete = mReassembler.AddPacket(reinterpret_cast<const uint8_t *>(header), len, frame);
+		ReportLostFrames();
+		if (complete) {
+			Complete(frame);
+		}
+	}
+
+	void Complete(const ReassembledFrame &frame) {
+		bool ok = !mConfig.syntheticFrames || VerifySyntheticFrame(frame.data, frame.len, frame.trackingFrameIndex);
+		uint64_t latency = GetTimestampUs() - frame.sentTime;
+		mLatency.Record(latency);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (frame.recovered) {
+			mStats.framesRecovered++;
+		}
+		else {
+			mStats.framesComplete++;
+		}
+		if (!ok) {
+			mStats.framesCorrupt++;
+		}
+		mStats.videoBytes += frame.len;
+		mFramesInSecond++;
+		mLatencySumInSecond += latency;
+		mLatencyMaxInSecond = std::max(mLatencyMaxInSecond, latency);
+		mLatencyCountInSecond++;
+	}
+
+	void ReportLostFrames() {
+		uint64_t lost = mReassembler.GetStats().framesLost;
+		while (mFramesLost < lost) {
+			mFramesLost++;
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mStats.framesLost++;
+			}
+			mFecFailureInSecond++;
+			mFecFailure = true;
+			PacketErrorReport report = {};
+			report.type = ALVR_PACKET_TYPE_PACKET_ERROR_REPORT;
+			report.lostFrameType = ALVR_LOST_FRAME_TYPE_VIDEO;
+			report.fromPacketCounter = mLastLossFrom;
+			report.toPacketCounter = mLastLossTo;
+			Send(&report, sizeof(report));
+		}
+	}
+
+	void SendHello() {
+		HelloMessage message = {};
+		message.type = ALVR_PACKET_TYPE_HELLO_MESSAGE;
+		memcpy(message.signature, ALVR_HELLO_PACKET_SIGNATURE, sizeof(message.signature));
+		message.version = ALVR_PROTOCOL_VERSION;
+		strcpy(message.deviceName, "loopback");
+		message.refreshRate[0] = static_cast<uint8_t>(mConfig.refreshRate);
+		message.renderWidth = 2880;
+		message.renderHeight = 1600;
+		Send(&message, sizeof(message));
+	}
+
+	void SendTracking(uint64_t frameIndex) {
+		TrackingInfo info = {};
+		info.type = ALVR_PACKET_TYPE_TRACKING_INFO;
+		info.FrameIndex = frameIndex;
+		info.clientTime = GetTimestampUs();
+		info.HeadPose_Pose_Orientation.w = 1;
+		Send(&info, sizeof(info));
+	}
+
+	void SendReport() {
+		TimeSync report = {};
+		report.type = ALVR_PACKET_TYPE_TIME_SYNC;
+		report.mode = 0;
+		report.sequence = ++mTimeSyncSequence;
+		report.clientTime = GetTimestampUs();
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			report.packetsLostTotal = mStats.lostPackets;
+			report.fecFailureTotal = mStats.framesLost;
+		}
+		report.packetsLostInSecond = mLostInSecond;
+		if (mLatencyCountInSecond != 0) {
+			report.averageTransportLatency = static_cast<uint32_t>(mLatencySumInSecond / mLatencyCountInSecond);
+			report.maxTransportLatency = static_cast<uint32_t>(mLatencyMaxInSecond);
+			report.averageTotalLatency = report.averageTransportLatency;
+			report.maxTotalLatency = report.maxTransportLatency;
+		}
+		report.fecFailure = mFecFailure ? 1 : 0;
+		report.fecFailureInSecond = mFecFailureInSecond;
+		report.fps = static_cast<uint32_t>(mFramesInSecond);
+		Send(&report, sizeof(report));
+
+		mLostInSecond = 0;
+		mFecFailureInSecond = 0;
+		mFramesInSecond = 0;
+		mLatencySumInSecond = 0;
+		mLatencyMaxInSecond = 0;
+		mLatencyCountInSecond = 0;
+		mFecFailure = false;
+	}
+
+	void Send(const void *buf, int len) {
+		sendto(mSocket, (const char *)buf, len, 0, (const sockaddr *)&mServer, sizeof(mServer));
+	}
+
+	LoopbackClient(const LoopbackClient &) = delete;
+	LoopbackClient &operator=(const LoopbackClient &) = delete;
+};
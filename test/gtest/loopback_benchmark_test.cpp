@@ -0,0 +1,339 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#include "../../alvr_server/ClientConnection.h"
+#include "../../alvr_server/IDRScheduler.h"
+#include "../../alvr_server/VideoEncoderSW.h"
+#include "loopback-client.h"
+
+// Headless benchmark of the network half of the pipeline. Synthetic bitstream is streamed through
+// ClientConnection::SendVideo/SendAudio over loopback UDP to LoopbackClient, which reassembles and
+// verifies each frame, answers TimeSync and reports FEC failures. No SteamVR, GPU or headset is needed.
+// The software_encoder test encodes synthetic pictures with VideoEncoderSW instead, so the whole
+// encode, FEC and send pipeline runs on CPU with the same input every time.
+//
+// Parameters can be changed from environment without rebuilding:
+//   ALVR_BENCH_SECONDS (5), ALVR_BENCH_FPS (72), ALVR_BENCH_FRAME_SIZE (bytes, 50000),
+//   ALVR_BENCH_IDR_INTERVAL (frames between IDR frames, 0 = only on request, 0),
+//   ALVR_BENCH_BITRATE (throttling Mbps, 1000), ALVR_BENCH_LOSS (%, 0), ALVR_BENCH_BURST (packets, 1),
+//   ALVR_BENCH_DELAY_MS (one-way, 0), ALVR_BENCH_PORT (server UDP port, 19944),
+//   ALVR_BENCH_TRACKING_THREAD (receive on IngressThread, 1),
+//   ALVR_BENCH_WIDTH (1440), ALVR_BENCH_HEIGHT (800), ALVR_BENCH_ENCODE_BITRATE (Mbps, 30) for software_encoder.
+// ControlSocket binds its fixed port, so the driver must not be running.
+namespace {
+	// IDR frames are this many times larger than other frames.
+	static const int IDR_SIZE_RATIO = 4;
+
+	double GetEnv(const char *name, double defaultValue) {
+		const char *value = getenv(name);
+		return value != NULL ? atof(value) : defaultValue;
+	}
+
+	uint64_t GetThreadCpuUs() {
+#ifdef _WIN32
+		FILETIME creation, exitTime, kernel, user;
+		GetThreadTimes(GetCurrentThread(), &creation, &exitTime, &kernel, &user);
+		uint64_t k = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+		uint64_t u = (static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+		return (k + u) / 10;
+#else
+		timespec ts;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+#endif
+	}
+
+	uint64_t GetProcessCpuUs() {
+#ifdef _WIN32
+		FILETIME creation, exitTime, kernel, user;
+		GetProcessTimes(GetCurrentProcess(), &creation, &exitTime, &kernel, &user);
+		uint64_t k = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+		uint64_t u = (static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+		return (k + u) / 10;
+#else
+		timespec ts;
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+		return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+#endif
+	}
+
+	struct BenchmarkConfig {
+		const char *name;
+		int seconds;
+		int refreshRate;
+		int frameSize;
+		int idrInterval;
+		int bitrateMbps;
+		int port;
+		bool trackingThread;
+		// Encode synthetic pictures of width x height with VideoEncoderSW instead of sending synthetic bitstream.
+		bool softwareEncoder;
+		int width;
+		int height;
+		int encodeBitrateMbps;
+		LoopbackClientConfig client;
+	};
+
+	BenchmarkConfig GetConfig(const char *name, double lossPercentage, double burstLength, double delayMs) {
+		BenchmarkConfig config;
+		config.name = name;
+		config.seconds = static_cast<int>(GetEnv("ALVR_BENCH_SECONDS", 5));
+		config.refreshRate = static_cast<int>(GetEnv("ALVR_BENCH_FPS", 72));
+		config.frameSize = static_cast<int>(GetEnv("ALVR_BENCH_FRAME_SIZE", 50000));
+		config.idrInterval = static_cast<int>(GetEnv("ALVR_BENCH_IDR_INTERVAL", 0));
+		config.bitrateMbps = static_cast<int>(GetEnv("ALVR_BENCH_BITRATE", 1000));
+		config.port = static_cast<int>(GetEnv("ALVR_BENCH_PORT", 19944));
+		config.trackingThread = GetEnv("ALVR_BENCH_TRACKING_THREAD", 1) != 0;
+		config.softwareEncoder = false;
+		config.width = static_cast<int>(GetEnv("ALVR_BENCH_WIDTH", 1440));
+		config.height = static_cast<int>(GetEnv("ALVR_BENCH_HEIGHT", 800));
+		config.encodeBitrateMbps = static_cast<int>(GetEnv("ALVR_BENCH_ENCODE_BITRATE", 30));
+		config.client.lossRate = GetEnv("ALVR_BENCH_LOSS", lossPercentage) / 100.0;
+		config.client.burstLength = GetEnv("ALVR_BENCH_BURST", burstLength);
+		config.client.delayUs = static_cast<uint64_t>(GetEnv("ALVR_BENCH_DELAY_MS", delayMs) * 1000);
+		config.client.refreshRate = config.refreshRate;
+		return config;
+	}
+
+	// Members of Settings used by ClientConnection, UdpSocket and IDRScheduler. Normally loaded from launcher.
+	void ConfigureServer(const BenchmarkConfig &config, int clientPort) {
+		Settings &settings = Settings::Instance();
+		settings.m_DebugLog = false;
+		settings.m_Host = "127.0.0.1";
+		settings.m_Port = config.port;
+		settings.m_AutoConnectHost = "127.0.0.1";
+		settings.m_AutoConnectPort = clientPort;
+		settings.mThrottlingBitrate = Bitrate::fromMiBits(config.bitrateMbps);
+		settings.mEncodeBitrate = Bitrate::fromMiBits(config.encodeBitrateMbps);
+		settings.m_refreshRate = config.refreshRate;
+		settings.m_framePacing = false;
+		settings.m_adaptiveFec = true;
+		settings.m_maxFecPercentage = 20;
+		settings.m_idrFecPercentage = 0;
+		settings.m_fecInterleaveDepth = 0;
+		settings.m_fecInterleaveMaxDelayUs = 30000;
+		settings.m_sliceCount = 1;
+		settings.m_nvencSubFrameReadback = false;
+		settings.m_softwareEncoder = config.softwareEncoder;
+		settings.m_trackingThread = config.trackingThread;
+		settings.m_codec = ALVR_CODEC_H264;
+		settings.m_renderWidth = 2880;
+		settings.m_renderHeight = 1600;
+		settings.m_clientRecvBufferSize = 60000;
+		settings.m_frameQueueSize = 1;
+		settings.m_streamMic = false;
+		settings.m_foveationMode = FOVEATION_MODE_DISABLED;
+		settings.m_foveationStrength = 0;
+		settings.m_foveationShape = 0;
+		settings.m_foveationVerticalOffset = 0;
+		settings.m_adaptiveFoveation = false;
+		settings.m_foveationMaxStrength = 0;
+		settings.m_minEncodeBitrateInMBits = 0;
+		settings.m_force3DOF = false;
+		settings.m_aggressiveKeyframeResend = false;
+		settings.MarkLoaded();
+	}
+
+	struct BenchmarkResult {
+		uint64_t framesSent = 0;
+		uint64_t idrFrames = 0;
+		uint64_t sendCpuUs = 0;
+		uint64_t processCpuUs = 0;
+		double seconds = 0;
+		// TrackingInfo receive to return of pose callback, over last NetworkTelemetry::WINDOW_SECONDS.
+		NetworkTelemetry::Percentiles poseLatency = {};
+		// Wall time of VideoEncoderSW::Encode (conversion, encode and send) per frame.
+		std::vector<uint64_t> encodeUs;
+		LoopbackClientStats client;
+
+		uint64_t EncodePercentile(int p) const {
+			std::vector<uint64_t> v = encodeUs;
+			std::sort(v.begin(), v.end());
+			return v.empty() ? 0 : v[std::min(v.size() - 1, v.size() * p / 100)];
+		}
+	};
+
+	// Deterministic RGBA picture with gradients moving at different speeds and a noisy square, so that
+	// each frame has both predictable motion and detail.
+	void FillSyntheticPicture(CpuFrame &picture, uint64_t frameIndex) {
+		int width = picture.GetWidth();
+		int height = picture.GetHeight();
+		int squareX = static_cast<int>(frameIndex * 7 % std::max(width - height / 4, 1));
+		int squareY = height / 3;
+		uint32_t noise = static_cast<uint32_t>(frameIndex * 2654435761u) | 1;
+		for (int y = 0; y < height; y++) {
+			uint8_t *row = picture.GetPlane(0) + picture.GetPitch() * y;
+			for (int x = 0; x < width; x++) {
+				uint8_t *c = row + x * 4;
+				c[0] = static_cast<uint8_t>(x + frameIndex * 4);
+				c[1] = static_cast<uint8_t>(y + frameIndex * 2);
+				c[2] = static_cast<uint8_t>((x ^ y) + frameIndex);
+				c[3] = 255;
+				if (x >= squareX && x < squareX + height / 4 && y >= squareY && y < squareY + height / 4) {
+					noise ^= noise << 13;
+					noise ^= noise >> 17;
+					noise ^= noise << 5;
+					c[0] = c[1] = c[2] = static_cast<uint8_t>(noise);
+				}
+			}
+		}
+	}
+
+	BenchmarkResult RunBenchmark(const BenchmarkConfig &config) {
+		BenchmarkResult result;
+		LoopbackClient client(config.client);
+		ConfigureServer(config, client.GetPort());
+
+		IDRScheduler idrScheduler;
+		auto connection = std::make_shared<ClientConnection>();
+		connection->SetLauncherCallback([]() {});
+		connection->SetCommandCallback([](std::string, std::string) {});
+		connection->SetPoseUpdatedCallback([]() {});
+		connection->SetNewClientCallback([]() {});
+		connection->SetStreamStartCallback([&]() { idrScheduler.OnStreamStart(); });
+		connection->SetPacketLossCallback([&]() { idrScheduler.OnPacketLoss(); });
+		connection->SetShutdownCallback([]() {});
+		EXPECT_TRUE(connection->Startup());
+
+		client.Start(config.port);
+		for (int i = 0; i < 200 && !(client.IsStreaming() && connection->IsStreaming()); i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		EXPECT_TRUE(connection->IsStreaming());
+
+		std::unique_ptr<VideoEncoderSW> encoder;
+		std::unique_ptr<CpuFrame> picture;
+		if (config.softwareEncoder) {
+			encoder = std::make_unique<VideoEncoderSW>(nullptr, connection, config.width, config.height);
+			encoder->Initialize();
+			picture = std::make_unique<CpuFrame>(CpuFrame::FORMAT_RGBA, config.width, config.height);
+		}
+
+		std::vector<uint8_t> frame(config.frameSize * IDR_SIZE_RATIO);
+		// 16-bit stereo 48 kHz for one frame interval.
+		std::vector<uint8_t> audio(48000 * 4 / config.refreshRate);
+		auto interval = std::chrono::microseconds(1000 * 1000 / config.refreshRate);
+		int frames = config.seconds * config.refreshRate;
+
+		uint64_t processCpuStart = GetProcessCpuUs();
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; i++) {
+			std::this_thread::sleep_until(start + interval * i);
+			bool idr = idrScheduler.CheckIDRInsertion() || (config.idrInterval > 0 && i % config.idrInterval == 0);
+			int len = idr ? config.frameSize * IDR_SIZE_RATIO : config.frameSize;
+			uint64_t trackingFrameIndex = i + 1;
+			if (encoder) {
+				FillSyntheticPicture(*picture, trackingFrameIndex);
+			}
+			else {
+				FillSyntheticFrame(&frame[0], len, trackingFrameIndex, idr);
+			}
+
+			uint64_t cpuStart = GetThreadCpuUs();
+			if (encoder) {
+				uint64_t encodeStart = GetCounterUs();
+				encoder->Encode(*picture, GetTimestampUs(), trackingFrameIndex, idr);
+				result.encodeUs.push_back(GetCounterUs() - encodeStart);
+			}
+			else {
+				connection->SendVideo(&frame[0], len, trackingFrameIndex);
+			}
+			connection->SendAudio(&audio[0], static_cast<int>(audio.size()), GetTimestampUs());
+			result.sendCpuUs += GetThreadCpuUs() - cpuStart;
+			result.framesSent++;
+			result.idrFrames += idr ? 1 : 0;
+		}
+		// Let the last frames arrive.
+		std::this_thread::sleep_for(std::chrono::milliseconds(200) + std::chrono::microseconds(config.client.delayUs));
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		result.processCpuUs = GetProcessCpuUs() - processCpuStart;
+		result.client = client.GetStats();
+
+		client.Stop();
+		if (encoder) {
+			encoder->Shutdown();
+		}
+		connection->Stop();
+		result.poseLatency = connection->GetStatistics()->GetNetworkTelemetry().Get(NetworkTelemetry::POSE_LATENCY
+			, NetworkTelemetry::WINDOW_SECONDS);
+		return result;
+	}
+
+	void Print(const BenchmarkConfig &config, const BenchmarkResult &r) {
+		const LoopbackClientStats &c = r.client;
+		uint64_t delivered = c.framesComplete + c.framesRecovered;
+		uint64_t damaged = c.framesRecovered + c.framesLost;
+		printf("[%s] %d fps, %d bytes/frame, loss %.2f%% burst %.1f, delay %.1f ms, tracking thread %d\n", config.name
+			, config.refreshRate, config.frameSize, config.client.lossRate * 100, config.client.burstLength
+			, config.client.delayUs / 1000.0, config.trackingThread);
+		printf("  frames/s         %.1f (sent %llu, IDR %llu)\n", delivered / r.seconds
+			, (unsigned long long)r.framesSent, (unsigned long long)r.idrFrames);
+		printf("  latency          p50 %.2f p95 %.2f p99 %.2f max %.2f ms\n", c.latency.ValueAtPercentile(50) / 1000.0
+			, c.latency.ValueAtPercentile(95) / 1000.0, c.latency.ValueAtPercentile(99) / 1000.0, c.latency.ValueAtPercentile(100) / 1000.0);
+		printf("  pose latency     p50 %llu p95 %llu p99 %llu max %llu us (%llu poses)\n", (unsigned long long)r.poseLatency.p50
+			, (unsigned long long)r.poseLatency.p95, (unsigned long long)r.poseLatency.p99, (unsigned long long)r.poseLatency.max
+			, (unsigned long long)r.poseLatency.count);
+		printf("  CPU/frame        send %.1f us, process %.1f us\n", r.sendCpuUs / static_cast<double>(r.framesSent)
+			, r.processCpuUs / static_cast<double>(r.framesSent));
+		printf("  packets          video %llu audio %llu dropped %llu lost %llu\n", (unsigned long long)c.videoPackets
+			, (unsigned long long)c.audioPackets, (unsigned long long)c.droppedPackets, (unsigned long long)c.lostPackets);
+		printf("  video bitrate    %.1f Mbps\n", c.videoBytes * 8 / r.seconds / 1000000);
+		if (!r.encodeUs.empty()) {
+			printf("  encode           %dx%d p50 %.2f p99 %.2f max %.2f ms\n", config.width, config.height
+				, r.EncodePercentile(50) / 1000.0, r.EncodePercentile(99) / 1000.0, r.EncodePercentile(100) / 1000.0);
+		}
+		printf("  FEC              complete %llu recovered %llu lost %llu corrupt %llu recovery rate %.1f%%\n"
+			, (unsigned long long)c.framesComplete, (unsigned long long)c.framesRecovered, (unsigned long long)c.framesLost
+			, (unsigned long long)c.framesCorrupt, damaged == 0 ? 100.0 : 100.0 * c.framesRecovered / damaged);
+	}
+}
+
+TEST(loopback_benchmark, clean) {
+	BenchmarkConfig config = GetConfig("clean", 0, 1, 0);
+	BenchmarkResult result = RunBenchmark(config);
+	Print(config, result);
+	ASSERT_GT(result.client.framesComplete, result.framesSent * 9 / 10);
+	ASSERT_EQ(result.client.framesCorrupt, 0u);
+}
+
+TEST(loopback_benchmark, lossy) {
+	BenchmarkConfig config = GetConfig("lossy", 1, 2, 5);
+	BenchmarkResult result = RunBenchmark(config);
+	Print(config, result);
+	ASSERT_GT(result.client.framesRecovered, 0u);
+	ASSERT_EQ(result.client.framesCorrupt, 0u);
+}
+
+// Pose receive to pose callback latency with receiving on the connection thread, between video sends,
+// and on IngressThread.
+TEST(loopback_benchmark, pose_latency) {
+	for (int trackingThread = 0; trackingThread < 2; trackingThread++) {
+		BenchmarkConfig config = GetConfig(trackingThread ? "pose ingress thread" : "pose connection thread", 0, 1, 0);
+		config.trackingThread = trackingThread != 0;
+		BenchmarkResult result = RunBenchmark(config);
+		Print(config, result);
+		ASSERT_GT(result.poseLatency.count, 0u);
+	}
+}
+
+// Whole pipeline on CPU: VideoEncoderSW encodes the same synthetic pictures on every run, so encode
+// latency and bitrate can be compared between builds and machines without a GPU.
+TEST(loopback_benchmark, software_encoder) {
+	BenchmarkConfig config = GetConfig("software encoder", 0, 1, 0);
+	config.softwareEncoder = true;
+	config.client.syntheticFrames = false;
+	BenchmarkResult result = RunBenchmark(config);
+	Print(config, result);
+	ASSERT_EQ(result.encodeUs.size(), result.framesSent);
+	ASSERT_GT(result.client.framesComplete, result.framesSent * 9 / 10);
+	ASSERT_GT(result.client.videoBytes, 0u);
+}
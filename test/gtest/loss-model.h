@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <random>
+
+// Output of std::mt19937 is specified, but that of the standard distributions depends on the library.
+// Simulations compare policies by exact counts, so they draw only through these.
+
+// Uniform in [0, 1).
+inline double UniformReal(std::mt19937 &random) {
+	return random() / 4294967296.0;
+}
+
+// Standard normal, by Box-Muller transform.
+inline double Normal(std::mt19937 &random) {
+	static const double PI = 3.14159265358979323846;
+	double u1 = 1.0 - UniformReal(random);
+	double u2 = UniformReal(random);
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * PI * u2);
+}
+
+inline double LogNormal(std::mt19937 &random, double mu, double sigma) {
+	return exp(mu + sigma * Normal(random));
+}
+
+// Gilbert-Elliott two-state loss model. Appends packets entries to trace (1 = lost).
+// Mean burst of bad state is 1 / badToGood packets.
+inline void AppendGilbertElliott(std::vector<uint8_t> &trace, size_t packets, double goodToBad, double badToGood
+	, double goodLoss, double badLoss, uint32_t seed) {
+	std::mt19937 random(seed);
+	bool bad = false;
+	for (size_t i = 0; i < packets; i++) {
+		bad = bad ? UniformReal(random) >= badToGood : UniformReal(random) < goodToBad;
+		trace.push_back(UniformReal(random) < (bad ? badLoss : goodLoss) ? 1 : 0);
+	}
+}
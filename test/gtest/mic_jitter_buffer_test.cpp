@@ -0,0 +1,262 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../alvr_server/MicJitterBuffer.h"
+#include "../../alvr_server/AudioSink.h"
+
+namespace {
+	static const int SAMPLE_RATE = 48000;
+	// 10ms packets.
+	static const int PACKET_SAMPLES = 480;
+	static const uint64_t PACKET_US = 10 * 1000;
+	// Output lags input by the two samples of the interpolator.
+	static const int DELAY_SAMPLES = 2;
+
+	int16_t SampleAt(uint64_t index) {
+		return (int16_t)((index * 7) % 20000 - 10000);
+	}
+
+	std::vector<int16_t> MakePacket(uint32_t packetIndex) {
+		std::vector<int16_t> samples(PACKET_SAMPLES);
+		for (int i = 0; i < PACKET_SAMPLES; i++) {
+			samples[i] = SampleAt((uint64_t)packetIndex * PACKET_SAMPLES + i);
+		}
+		return samples;
+	}
+
+	void Push(MicJitterBuffer &buffer, uint32_t packetIndex, uint64_t arrivalTime) {
+		std::vector<int16_t> samples = MakePacket(packetIndex);
+		buffer.Push(packetIndex, &samples[0], PACKET_SAMPLES, arrivalTime);
+	}
+
+	// Pushes packets in given order, one per 10ms pull, starting to pull after preroll packets.
+	// Returns output.
+	std::vector<int16_t> Play(MicJitterBuffer &buffer, const std::vector<uint32_t> &order, size_t preroll = 2) {
+		std::vector<int16_t> output;
+		std::vector<int16_t> pulled(PACKET_SAMPLES);
+		for (size_t i = 0; i < order.size(); i++) {
+			Push(buffer, order[i], i * PACKET_US);
+			if (i + 1 >= preroll) {
+				buffer.Pull(&pulled[0], PACKET_SAMPLES);
+				output.insert(output.end(), pulled.begin(), pulled.end());
+			}
+		}
+		return output;
+	}
+
+	bool MatchesInput(const std::vector<int16_t> &output, uint32_t fromPacket, uint32_t toPacket) {
+		for (uint64_t i = (uint64_t)fromPacket * PACKET_SAMPLES; i < (uint64_t)toPacket * PACKET_SAMPLES; i++) {
+			if (i + DELAY_SAMPLES >= output.size() || output[i + DELAY_SAMPLES] != SampleAt(i)) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+TEST(mic_jitter_buffer_test, in_order) {
+	MicJitterBuffer buffer(SAMPLE_RATE);
+	std::vector<uint32_t> order;
+	for (uint32_t i = 0; i < 100; i++) {
+		order.push_back(i);
+	}
+	std::vector<int16_t> output = Play(buffer, order);
+	EXPECT_TRUE(MatchesInput(output, 0, 98));
+	EXPECT_EQ(1.0, buffer.GetRatio());
+	EXPECT_EQ(0u, buffer.GetStats().lostPackets);
+	EXPECT_EQ(0u, buffer.GetStats().underruns);
+}
+
+TEST(mic_jitter_buffer_test, reorders) {
+	MicJitterBuffer buffer(SAMPLE_RATE);
+	// 0 1 2 4 3 6 5 ... One more packet buffered than the minimum target, so a swapped packet is still
+	// in time. Output is exact until the jitter of the swaps raises the target and the ratio moves.
+	std::vector<uint32_t> order;
+	for (uint32_t i = 0; i < 100; i++) {
+		order.push_back(i < 3 ? i : (i % 2 == 1 ? i + 1 : i - 1));
+	}
+	std::vector<int16_t> output = Play(buffer, order, 3);
+	EXPECT_TRUE(MatchesInput(output, 0, 5));
+	EXPECT_GT(buffer.GetTargetSamples(), 2 * PACKET_SAMPLES);
+	EXPECT_EQ(48u, buffer.GetStats().reorderedPackets);
+	EXPECT_EQ(0u, buffer.GetStats().latePackets);
+	EXPECT_EQ(0u, buffer.GetStats().lostPackets);
+}
+
+TEST(mic_jitter_buffer_test, conceals_lost_packet) {
+	MicJitterBuffer buffer(SAMPLE_RATE);
+	std::vector<uint32_t> order;
+	for (uint32_t i = 0; i < 40; i++) {
+		if (i != 20) {
+			order.push_back(i);
+		}
+	}
+	// Keep the pull count.
+	order.push_back(40);
+	std::vector<int16_t> output = Play(buffer, order);
+	EXPECT_TRUE(MatchesInput(output, 0, 20));
+	EXPECT_TRUE(MatchesInput(output, 21, 38));
+	EXPECT_EQ(1u, buffer.GetStats().lostPackets);
+	EXPECT_EQ((uint64_t)PACKET_SAMPLES, buffer.GetStats().concealedSamples);
+
+	// Concealment repeats packet 19 with decaying gain.
+	std::vector<int16_t> previous = MakePacket(19);
+	int start = 20 * PACKET_SAMPLES + DELAY_SAMPLES;
+	EXPECT_EQ(previous[0], output[start]);
+	EXPECT_LT(abs(output[start + PACKET_SAMPLES - 1]), abs(previous[PACKET_SAMPLES - 1]));
+}
+
+TEST(mic_jitter_buffer_test, late_and_duplicate) {
+	MicJitterBuffer buffer(SAMPLE_RATE);
+	std::vector<int16_t> pulled(PACKET_SAMPLES);
+	for (uint32_t i = 0; i < 4; i++) {
+		Push(buffer, i, 0);
+	}
+	// Reads all of packet 0.
+	buffer.Pull(&pulled[0], PACKET_SAMPLES);
+	Push(buffer, 0, 0);
+	Push(buffer, 1, 0);
+	Push(buffer, 3, 0);
+	EXPECT_EQ(1u, buffer.GetStats().latePackets);
+	EXPECT_EQ(2u, buffer.GetStats().duplicatePackets);
+	EXPECT_EQ(3 * PACKET_SAMPLES, buffer.GetBufferedSamples());
+}
+
+TEST(mic_jitter_buffer_test, underrun_fades_and_rebuffers) {
+	MicJitterBuffer buffer(SAMPLE_RATE);
+	std::vector<int16_t> pulled(PACKET_SAMPLES);
+	for (uint32_t i = 0; i < 10; i++) {
+		Push(buffer, i, i * PACKET_US);
+		if (i >= 1) {
+			buffer.Pull(&pulled[0], PACKET_SAMPLES);
+		}
+	}
+	// Packets stop arriving. Receiver keeps pulling without blocking.
+	for (int i = 0; i < 10; i++) {
+		buffer.Pull(&pulled[0], PACKET_SAMPLES);
+	}
+	EXPECT_EQ(1u, buffer.GetStats().underruns);
+	for (auto s : pulled) {
+		EXPECT_EQ(0, s);
+	}
+	EXPECT_EQ((uint64_t)MicJitterBuffer::CONCEAL_PACKETS * PACKET_SAMPLES, buffer.GetStats().concealedSamples);
+
+	// Resumes after target delay is buffered again.
+	Push(buffer, 10, 100 * 1000);
+	buffer.Pull(&pulled[0], PACKET_SAMPLES);
+	EXPECT_EQ(0, pulled[PACKET_SAMPLES - 1]);
+	Push(buffer, 11, 110 * 1000);
+	buffer.Pull(&pulled[0], PACKET_SAMPLES);
+	EXPECT_EQ(SampleAt(10 * PACKET_SAMPLES + PACKET_SAMPLES - 1 - DELAY_SAMPLES), pulled[PACKET_SAMPLES - 1]);
+
+	// Counter restart of a new client.
+	Push(buffer, 5000, 120 * 1000);
+	Push(buffer, 5001, 130 * 1000);
+	buffer.Pull(&pulled[0], PACKET_SAMPLES);
+	EXPECT_EQ(0u, buffer.GetStats().latePackets);
+}
+
+TEST(mic_jitter_buffer_test, target_follows_jitter) {
+	int targets[2];
+	for (int jittery = 0; jittery < 2; jittery++) {
+		MicJitterBuffer buffer(SAMPLE_RATE);
+		std::mt19937 random(1);
+		std::exponential_distribution<double> jitter(1.0 / (jittery ? 15000 : 200));
+		for (uint32_t i = 0; i < 200; i++) {
+			Push(buffer, i, i * PACKET_US + (uint64_t)jitter(random));
+		}
+		targets[jittery] = buffer.GetTargetSamples();
+		printf("Jitter %.2f ms, target %.1f ms\n", buffer.GetJitterUs() / 1000, targets[jittery] * 1000.0 / SAMPLE_RATE);
+	}
+	EXPECT_EQ(MicJitterBuffer::MIN_DELAY_US / 1000 * SAMPLE_RATE / 1000, targets[0]);
+	EXPECT_GT(targets[1], targets[0] * 2);
+	EXPECT_LE(targets[1], MicJitterBuffer::MAX_DELAY_US / 1000 * SAMPLE_RATE / 1000);
+}
+
+// Client clock runs fast against the output device, with network jitter. Without resampling the
+// buffer would grow by 300 us per second until it overflows.
+TEST(mic_jitter_buffer_test, drift_compensation) {
+	const double drift = 300e-6;
+	const uint64_t seconds = 120;
+	std::mt19937 random(5);
+	std::exponential_distribution<double> jitter(1.0 / 1000);
+
+	// Packet arrival times in output device clock.
+	std::vector<uint64_t> arrivals;
+	for (uint32_t i = 0; (double)i * PACKET_US / (1 + drift) < seconds * 1000 * 1000; i++) {
+		arrivals.push_back((uint64_t)(i * PACKET_US / (1 + drift) + jitter(random)));
+	}
+
+	uint64_t now = 0;
+	MicJitterBuffer buffer(SAMPLE_RATE);
+	NullAudioSink sink(SAMPLE_RATE, 512, [&]() { return now; });
+	std::vector<int16_t> pulled(512);
+	size_t next = 0;
+	double ratioSum = 0;
+	int ratioCount = 0;
+	int maxLevel = 0;
+	uint64_t starvedAfterStart = 0;
+	for (now = 0; now < seconds * 1000 * 1000; now += 5000) {
+		while (next < arrivals.size() && arrivals[next] <= now) {
+			Push(buffer, (uint32_t)next, arrivals[next]);
+			next++;
+		}
+		int writable = sink.GetWritableSamples();
+		buffer.Pull(&pulled[0], writable);
+		sink.Write(&pulled[0], writable);
+		if (now > 60 * 1000 * 1000) {
+			ratioSum += buffer.GetRatio();
+			ratioCount++;
+			maxLevel = std::max(maxLevel, buffer.GetBufferedSamples());
+		}
+		if (now == 1000 * 1000) {
+			starvedAfterStart = sink.GetStarvedSamples();
+		}
+	}
+	const MicJitterBuffer::Stats &stats = buffer.GetStats();
+	double ratio = ratioSum / ratioCount;
+	printf("Drift %.0f ppm: mean ratio %+.0f ppm, max level %.1f ms, target %.1f ms, underruns %llu\n", drift * 1e6
+		, (ratio - 1) * 1e6, maxLevel * 1000.0 / SAMPLE_RATE, buffer.GetTargetSamples() * 1000.0 / SAMPLE_RATE
+		, (unsigned long long)stats.underruns);
+	EXPECT_EQ(0u, stats.overflowPackets);
+	EXPECT_EQ(0u, stats.lostPackets);
+	EXPECT_LE(stats.underruns, 1u);
+	EXPECT_NEAR(drift, ratio - 1, 100e-6);
+	EXPECT_LT(maxLevel, buffer.GetTargetSamples() * 3);
+	EXPECT_EQ(starvedAfterStart, sink.GetStarvedSamples());
+}
+
+TEST(mic_jitter_buffer_test, wav_file_sink) {
+	uint64_t now = 0;
+	std::string path = "mic_jitter_buffer_test.wav";
+	{
+		WavFileAudioSink sink(path, SAMPLE_RATE, 480, [&]() { return now; });
+		EXPECT_TRUE(sink.IsOpen());
+		EXPECT_EQ(480, sink.GetWritableSamples());
+		std::vector<int16_t> samples = MakePacket(0);
+		sink.Write(&samples[0], 480);
+		EXPECT_EQ(0, sink.GetWritableSamples());
+		now += 5000;
+		EXPECT_EQ(240, sink.GetWritableSamples());
+		sink.Write(&samples[0], 240);
+		// Queue ran dry at 15ms. Device played silence for the remaining 15ms.
+		now += 25000;
+		EXPECT_EQ(480, sink.GetWritableSamples());
+		EXPECT_EQ(720u, sink.GetStarvedSamples());
+	}
+	FILE *file = fopen(path.c_str(), "rb");
+	ASSERT_TRUE(file != NULL);
+	uint8_t header[44];
+	EXPECT_EQ(sizeof(header), fread(header, 1, sizeof(header), file));
+	fclose(file);
+	remove(path.c_str());
+	uint32_t dataBytes;
+	memcpy(&dataBytes, header + 40, 4);
+	EXPECT_EQ(0, memcmp(header, "RIFF", 4));
+	EXPECT_EQ(0, memcmp(header + 36, "data", 4));
+	EXPECT_EQ(720u * 2, dataBytes);
+}
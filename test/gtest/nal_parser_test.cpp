@@ -0,0 +1,272 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../alvr_server/NalParser.h"
+
+// Annex-B parser tests and start code scan benchmark. The benchmark scans 100 MB: set ALVR_BENCH_NAL
+// to a recorded H.264/H.265 Annex-B stream (e.g. from m_DebugOutputDir or the encoder's fpOut), which
+// is repeated up to that size. Without it, a synthetic stream of 40 KB frames is used.
+namespace {
+	typedef const uint8_t *(*FindFunc)(const uint8_t *begin, const uint8_t *end);
+
+	std::vector<uint8_t> Stream(std::initializer_list<std::vector<uint8_t>> parts) {
+		std::vector<uint8_t> stream;
+		for (auto &part : parts) {
+			stream.insert(stream.end(), part.begin(), part.end());
+		}
+		return stream;
+	}
+
+	const std::vector<uint8_t> SC4 = { 0, 0, 0, 1 };
+	const std::vector<uint8_t> SC3 = { 0, 0, 1 };
+
+	// Random NAL payload with emulation prevention applied, as an encoder would output.
+	void AppendPayload(std::vector<uint8_t> &out, std::mt19937 &random, int size) {
+		int zeros = 0;
+		for (int i = 0; i < size; i++) {
+			uint8_t b = (uint8_t)random();
+			// Encoders output long zero runs (zero residuals), make them likely.
+			if (random() % 64 == 0) {
+				b = 0;
+			}
+			if (zeros >= 2 && b <= 3) {
+				out.push_back(3);
+				zeros = 0;
+			}
+			out.push_back(b);
+			zeros = b == 0 ? zeros + 1 : 0;
+		}
+		// rbsp_trailing_bits never ends a NAL with zero.
+		out.push_back(0x80);
+	}
+
+	std::vector<uint8_t> SyntheticStream(size_t bytes, int &nalCount) {
+		std::vector<uint8_t> stream;
+		stream.reserve(bytes + 100 * 1000);
+		std::mt19937 random(7);
+		nalCount = 0;
+		for (int frame = 0; stream.size() < bytes; frame++) {
+			if (frame % 60 == 0) {
+				stream.insert(stream.end(), SC4.begin(), SC4.end());
+				stream.push_back(0x67);
+				AppendPayload(stream, random, 20);
+				stream.insert(stream.end(), SC4.begin(), SC4.end());
+				stream.push_back(0x68);
+				AppendPayload(stream, random, 5);
+				nalCount += 2;
+			}
+			stream.insert(stream.end(), SC4.begin(), SC4.end());
+			stream.push_back(frame % 60 == 0 ? 0x65 : 0x41);
+			AppendPayload(stream, random, 30000 + random() % 20000);
+			nalCount++;
+		}
+		return stream;
+	}
+
+	int CountStartCodes(FindFunc find, const uint8_t *begin, const uint8_t *end) {
+		int count = 0;
+		for (const uint8_t *p = find(begin, end); p != end; p = find(p + 3, end)) {
+			count++;
+		}
+		return count;
+	}
+}
+
+TEST(nal_parser_test, find_start_code_implementations_agree) {
+	std::vector<FindFunc> funcs = { NalParser::FindStartCodeScalar, NalParser::FindStartCodeSSE2 };
+	if (NalParser::HasAVX2()) {
+		funcs.push_back(NalParser::FindStartCodeAVX2);
+	}
+	std::mt19937 random(1);
+	for (int round = 0; round < 2000; round++) {
+		// Mostly 0 and 1 so start codes appear at every alignment, including across block boundaries.
+		std::vector<uint8_t> buf(1 + random() % 200);
+		for (auto &b : buf) {
+			int r = random() % 8;
+			b = r < 5 ? 0 : r < 7 ? 1 : (uint8_t)random();
+		}
+		const uint8_t *begin = buf.data() + random() % buf.size();
+		const uint8_t *end = buf.data() + buf.size();
+		for (const uint8_t *p = begin; ; p += 3) {
+			const uint8_t *expected = NalParser::FindStartCodeScalar(p, end);
+			for (auto find : funcs) {
+				EXPECT_EQ(expected, find(p, end));
+			}
+			EXPECT_EQ(expected, NalParser::FindStartCode(p, end));
+			if (expected == end) {
+				break;
+			}
+			p = expected;
+		}
+	}
+	const uint8_t none[3] = { 0, 0, 0 };
+	EXPECT_EQ(none + 3, NalParser::FindStartCode(none, none + 3));
+	EXPECT_EQ(none, NalParser::FindStartCode(none, none));
+}
+
+TEST(nal_parser_test, h264_idr_frame) {
+	// Bytes before the first start code, 3 and 4 byte start codes, trailing zero after PPS.
+	std::vector<uint8_t> frame = Stream({ { 0xFF }, SC4, { 0x67, 0x42, 0x00, 0x1F }, SC3, { 0x68, 0xCE, 0x00 }, SC4, { 0x65, 0x88, 0x84, 0x00, 0x03, 0x01 } });
+	NalParser parser(ALVR_CODEC_H264);
+	std::vector<NalUnit> nals;
+	parser.Parse(frame.data(), (int)frame.size(), nals);
+	ASSERT_EQ(3u, nals.size());
+	EXPECT_EQ(7, nals[0].type);
+	EXPECT_EQ(4, nals[0].size);
+	EXPECT_EQ(4, nals[0].startCodeSize);
+	EXPECT_EQ(frame.data() + 5, nals[0].data);
+	EXPECT_EQ(8, nals[1].type);
+	EXPECT_EQ(2, nals[1].size);
+	EXPECT_EQ(3, nals[1].startCodeSize);
+	EXPECT_EQ(5, nals[2].type);
+	EXPECT_EQ(6, nals[2].size);
+	EXPECT_EQ(4, nals[2].startCodeSize);
+
+	NalParser::FrameInfo info = parser.Classify(frame.data(), (int)frame.size());
+	EXPECT_EQ(ALVR_FRAME_TYPE_IDR, info.frameType);
+	EXPECT_TRUE(info.parameterSets);
+	EXPECT_EQ(3, info.nalCount);
+}
+
+TEST(nal_parser_test, h264_reference_types) {
+	NalParser parser(ALVR_CODEC_H264);
+	std::vector<uint8_t> reference = Stream({ SC4, { 0x41, 0x9A, 0x02 } });
+	std::vector<uint8_t> nonReference = Stream({ SC4, { 0x01, 0x9A, 0x02 } });
+	std::vector<uint8_t> empty;
+
+	NalParser::FrameInfo info = parser.Classify(reference.data(), (int)reference.size());
+	EXPECT_EQ(ALVR_FRAME_TYPE_REFERENCE, info.frameType);
+	EXPECT_FALSE(info.parameterSets);
+	info = parser.Classify(nonReference.data(), (int)nonReference.size());
+	EXPECT_EQ(ALVR_FRAME_TYPE_NON_REFERENCE, info.frameType);
+	info = parser.Classify(empty.data(), 0);
+	EXPECT_EQ(0, info.nalCount);
+}
+
+TEST(nal_parser_test, h265_types) {
+	NalParser parser(ALVR_CODEC_H265);
+	// AUD, VPS, SPS, PPS, IDR_W_RADL
+	std::vector<uint8_t> idr = Stream({ SC4, { 0x46, 0x01, 0x50 }, SC4, { 0x40, 0x01, 0x0C }, SC4, { 0x42, 0x01, 0x01 }, SC4, { 0x44, 0x01, 0xC1 }, SC4, { 0x26, 0x01, 0xAF } });
+	// TRAIL_R
+	std::vector<uint8_t> trailR = Stream({ SC4, { 0x02, 0x01, 0xD0 } });
+	// TRAIL_N
+	std::vector<uint8_t> trailN = Stream({ SC4, { 0x00, 0x01, 0xD0 } });
+
+	std::vector<NalUnit> nals;
+	parser.Parse(idr.data(), (int)idr.size(), nals);
+	ASSERT_EQ(5u, nals.size());
+	int types[] = { 35, 32, 33, 34, 19 };
+	for (int i = 0; i < 5; i++) {
+		EXPECT_EQ(types[i], nals[i].type);
+	}
+	NalParser::FrameInfo info = parser.Classify(nals);
+	EXPECT_EQ(ALVR_FRAME_TYPE_IDR, info.frameType);
+	EXPECT_TRUE(info.parameterSets);
+	EXPECT_EQ(ALVR_FRAME_TYPE_REFERENCE, parser.Classify(trailR.data(), (int)trailR.size()).frameType);
+	EXPECT_EQ(ALVR_FRAME_TYPE_NON_REFERENCE, parser.Classify(trailN.data(), (int)trailN.size()).frameType);
+}
+
+TEST(nal_parser_test, strip_aud) {
+	NalParser parser(ALVR_CODEC_H265);
+	std::vector<uint8_t> aud = Stream({ SC4, { 0x46, 0x01, 0x50 } });
+	std::vector<uint8_t> slice = Stream({ SC4, { 0x02, 0x01, 0xD0, 0x11 } });
+
+	// Leading AUD, as VCE outputs: only the pointer moves.
+	std::vector<uint8_t> frame = Stream({ aud, slice });
+	std::vector<uint8_t> original = frame;
+	uint8_t *buf = frame.data();
+	int len = (int)frame.size();
+	parser.StripAUD(&buf, &len);
+	EXPECT_EQ(frame.data() + aud.size(), buf);
+	EXPECT_EQ((int)slice.size(), len);
+	EXPECT_TRUE(frame == original);
+
+	// AUD between slices is removed in place.
+	frame = Stream({ aud, slice, aud, slice, slice });
+	buf = frame.data();
+	len = (int)frame.size();
+	parser.StripAUD(&buf, &len);
+	std::vector<uint8_t> expected = Stream({ slice, slice, slice });
+	ASSERT_EQ((int)expected.size(), len);
+	EXPECT_EQ(0, memcmp(expected.data(), buf, len));
+
+	// No AUD: unchanged.
+	frame = slice;
+	buf = frame.data();
+	len = (int)frame.size();
+	parser.StripAUD(&buf, &len);
+	EXPECT_EQ(frame.data(), buf);
+	EXPECT_EQ((int)slice.size(), len);
+}
+
+TEST(nal_parser_test, benchmark) {
+	const size_t BENCH_BYTES = 100 * 1000 * 1000;
+	std::vector<uint8_t> stream;
+	int nalCount = -1;
+	const char *path = getenv("ALVR_BENCH_NAL");
+	if (path != NULL) {
+		FILE *fp = fopen(path, "rb");
+		if (fp != NULL) {
+			std::vector<uint8_t> recorded;
+			uint8_t chunk[64 * 1024];
+			size_t read;
+			while ((read = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+				recorded.insert(recorded.end(), chunk, chunk + read);
+			}
+			fclose(fp);
+			while (!recorded.empty() && stream.size() < BENCH_BYTES) {
+				stream.insert(stream.end(), recorded.begin(), recorded.end());
+			}
+		}
+		if (stream.empty()) {
+			printf("Can not load %s. Use synthetic stream.\n", path);
+		}
+	}
+	if (stream.empty()) {
+		stream = SyntheticStream(BENCH_BYTES, nalCount);
+	}
+	const uint8_t *begin = stream.data();
+	const uint8_t *end = begin + stream.size();
+
+	struct {
+		const char *name;
+		FindFunc find;
+	} scanners[] = {
+		{ "Scalar", NalParser::FindStartCodeScalar },
+		{ "SSE2", NalParser::FindStartCodeSSE2 },
+		{ "AVX2", NalParser::FindStartCodeAVX2 },
+	};
+	int expected = CountStartCodes(NalParser::FindStartCodeScalar, begin, end);
+	if (nalCount >= 0) {
+		EXPECT_EQ(nalCount, expected);
+	}
+	printf("%.1f MB, %d start codes\n", stream.size() / 1e6, expected);
+	for (auto &scanner : scanners) {
+		if (scanner.find == NalParser::FindStartCodeAVX2 && !NalParser::HasAVX2()) {
+			printf("%-8s not supported by CPU\n", scanner.name);
+			continue;
+		}
+		double best = 1e9;
+		for (int run = 0; run < 3; run++) {
+			auto start = std::chrono::steady_clock::now();
+			EXPECT_EQ(expected, CountStartCodes(scanner.find, begin, end));
+			best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+		printf("%-8s %8.0f MB/s\n", scanner.name, stream.size() / best / 1e6);
+	}
+
+	// Whole parser through the dispatcher, as used per frame.
+	NalParser parser(ALVR_CODEC_H264);
+	std::vector<NalUnit> nals;
+	auto start = std::chrono::steady_clock::now();
+	parser.Parse(begin, (int)stream.size(), nals);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	EXPECT_EQ((size_t)expected, nals.size());
+	printf("Parse    %8.0f MB/s\n", stream.size() / seconds / 1e6);
+}
@@ -0,0 +1,472 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "../../alvr_server/ThrottlingBuffer.h"
+
+// Fake clock driven simulation of ThrottlingBuffer.
+// Encoder produces 72 fps video and audio is sent every 10 ms over 30 Mbps link.
+// From 1 s to 3 s frames are too large for the link, so send queue builds up.
+struct PacingResult {
+	uint64_t framesPushed = 0;
+	uint64_t framesCompleted = 0;
+	uint64_t audioPushed = 0;
+	uint64_t audioSent = 0;
+	std::vector<uint64_t> packetDelays;
+	std::vector<uint64_t> frameDelays;
+	uint64_t staleFramesDropped = 0;
+	uint64_t overflowDrops = 0;
+
+	uint64_t Percentile(std::vector<uint64_t> v, int p) {
+		std::sort(v.begin(), v.end());
+		return v[v.size() * p / 100];
+	}
+};
+
+static PacingResult SimulatePacing(bool pacing) {
+	static const int REFRESH_RATE = 72;
+	static const uint64_t FRAME_INTERVAL_US = 1000 * 1000 / REFRESH_RATE;
+	static const uint64_t AUDIO_INTERVAL_US = 10 * 1000;
+	static const uint64_t DURATION_US = 5 * 1000 * 1000;
+	static const uint64_t STEP_US = 50;
+
+	uint64_t now = 0;
+	auto statistics = std::make_shared<Statistics>();
+	ThrottlingBuffer buffer(Bitrate::fromMiBits(30), statistics);
+	buffer.SetClock([&now]() { return now; });
+	if (pacing) {
+		buffer.SetFramePacing(REFRESH_RATE);
+	}
+
+	PacingResult result;
+	std::map<uint64_t, uint64_t> framePushTime;
+	std::map<uint64_t, int> frameRemain;
+	uint64_t nextFrame = 0;
+	uint64_t nextAudio = 0;
+	uint64_t videoFrameIndex = 0;
+
+	for (now = 0; now < DURATION_US; now += STEP_US) {
+		if (now >= nextFrame) {
+			bool congested = now >= 1000 * 1000 && now < 3000 * 1000;
+			int frameSize = congested ? 80 * 1000 : 30 * 1000;
+			int packets = (frameSize + ALVR_MAX_VIDEO_BUFFER_SIZE - 1) / ALVR_MAX_VIDEO_BUFFER_SIZE;
+
+			buffer.BeginPush();
+			bool queued = true;
+			for (int i = 0; i < packets; i++) {
+				PacketBuffer *packet = buffer.Allocate();
+				if (packet == NULL) {
+					queued = false;
+					break;
+				}
+				VideoFrame *header = (VideoFrame *)packet->buf;
+				header->type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+				header->videoFrameIndex = videoFrameIndex;
+				header->sliceIndex = 0;
+				header->sliceCount = 1;
+				header->fecIndex = i;
+				packet->len = ALVR_MAX_PACKET_SIZE;
+			}
+			buffer.EndPush(queued);
+			framePushTime[videoFrameIndex] = now;
+			frameRemain[videoFrameIndex] = packets;
+			videoFrameIndex++;
+			result.framesPushed++;
+			nextFrame += FRAME_INTERVAL_US;
+		}
+		if (now >= nextAudio) {
+			char packet[200] = {};
+			AudioFrame *header = (AudioFrame *)packet;
+			header->type = ALVR_PACKET_TYPE_AUDIO_FRAME;
+			memcpy(packet + sizeof(AudioFrame), &now, sizeof(now));
+			if (buffer.Push(packet, sizeof(packet), 0)) {
+				result.audioPushed++;
+			}
+			nextAudio += AUDIO_INTERVAL_US;
+		}
+
+		while (buffer.Send([&](char *buf, int len) {
+			uint32_t type = *(uint32_t *)buf;
+			if (type == ALVR_PACKET_TYPE_VIDEO_FRAME) {
+				VideoFrame *header = (VideoFrame *)buf;
+				uint64_t pushTime = framePushTime[header->videoFrameIndex];
+				result.packetDelays.push_back(now - pushTime);
+				if (--frameRemain[header->videoFrameIndex] == 0) {
+					result.framesCompleted++;
+					result.frameDelays.push_back(now - pushTime);
+				}
+			}
+			else {
+				uint64_t pushTime;
+				memcpy(&pushTime, buf + sizeof(AudioFrame), sizeof(pushTime));
+				result.packetDelays.push_back(now - pushTime);
+				result.audioSent++;
+			}
+			return true;
+		})) {}
+	}
+	// Pick up overflow count.
+	buffer.Send([](char *buf, int len) { return false; });
+	result.staleFramesDropped = statistics->GetStaleFramesDroppedTotal();
+	result.overflowDrops = statistics->GetOverflowDropsTotal();
+	return result;
+}
+
+TEST(pacing_test, stale_frames_dropped) {
+	PacingResult burst = SimulatePacing(false);
+	PacingResult paced = SimulatePacing(true);
+
+	printf("mode   frames sent/pushed  stale drops  overflow  packet delay p50/p99 (ms)  frame delay p50/p99 (ms)\n");
+	PacingResult *results[] = { &burst, &paced };
+	const char *names[] = { "burst", "paced" };
+	for (int i = 0; i < 2; i++) {
+		PacingResult &r = *results[i];
+		printf("%-6s %6llu/%-6llu %12llu %9llu %12.1f/%-12.1f %12.1f/%.1f\n", names[i]
+			, (unsigned long long)r.framesCompleted, (unsigned long long)r.framesPushed
+			, (unsigned long long)r.staleFramesDropped, (unsigned long long)r.overflowDrops
+			, r.Percentile(r.packetDelays, 50) / 1000.0, r.Percentile(r.packetDelays, 99) / 1000.0
+			, r.Percentile(r.frameDelays, 50) / 1000.0, r.Percentile(r.frameDelays, 99) / 1000.0);
+	}
+
+	// Audio is never dropped by pacing.
+	ASSERT_EQ(burst.audioSent, burst.audioPushed);
+	ASSERT_EQ(paced.audioSent, paced.audioPushed);
+
+	// Without pacing queue keeps growing during congestion until it overflows.
+	ASSERT_EQ(burst.staleFramesDropped, 0);
+	ASSERT_GT(paced.staleFramesDropped, 0);
+	ASSERT_EQ(paced.overflowDrops, 0);
+	// Every frame is either completed or counted as dropped (frames still queued at the end are neither).
+	ASSERT_LE(paced.framesCompleted + paced.staleFramesDropped, paced.framesPushed);
+	ASSERT_GE(paced.framesCompleted + paced.staleFramesDropped + 3, paced.framesPushed);
+
+	// Queueing delay stays bounded by a few frame intervals.
+	ASSERT_LT(paced.Percentile(paced.packetDelays, 99), burst.Percentile(burst.packetDelays, 99) / 4);
+	ASSERT_LT(paced.Percentile(paced.frameDelays, 99), 3 * 1000 * 1000 / 72);
+}
+
+TEST(pacing_test, spread_over_frame_interval) {
+	uint64_t now = 0;
+	ThrottlingBuffer buffer(Bitrate::fromBits(0));
+	buffer.SetClock([&now]() { return now; });
+	buffer.SetFramePacing(100);
+
+	buffer.BeginPush();
+	for (int i = 0; i < 10; i++) {
+		PacketBuffer *packet = buffer.Allocate();
+		VideoFrame *header = (VideoFrame *)packet->buf;
+		header->type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+		header->videoFrameIndex = 1;
+		header->sliceIndex = 0;
+		header->sliceCount = 1;
+		packet->len = sizeof(VideoFrame) + 100;
+	}
+	buffer.EndPush(true);
+	char control[sizeof(VideoFrame)] = {};
+	*(uint32_t *)control = ALVR_PACKET_TYPE_CHANGE_SETTINGS;
+	buffer.Push(control, sizeof(control), 0);
+
+	// 10 packets over 10 ms: one packet per millisecond.
+	std::vector<uint64_t> sentTimes;
+	for (now = 0; now < 20 * 1000; now += 100) {
+		while (buffer.Send([&](char *buf, int len) { sentTimes.push_back(now); return true; })) {}
+	}
+	ASSERT_EQ(sentTimes.size(), 11);
+	for (int i = 0; i < 10; i++) {
+		ASSERT_EQ(sentTimes[i], i * 1000);
+	}
+	// Control packet is not paced.
+	ASSERT_EQ(sentTimes[10], 9000);
+}
+
+// Consumer sleeping until GetNextSendTime() must neither wake early nor miss pacing or bitrate slots.
+// Parts of a picture sent in slices are dropped together, and the picture counts as one stale frame.
+TEST(pacing_test, stale_picture_dropped_whole) {
+	uint64_t now = 0;
+	auto statistics = std::make_shared<Statistics>();
+	ThrottlingBuffer buffer(Bitrate::fromBits(0), statistics);
+	buffer.SetClock([&now]() { return now; });
+	buffer.SetFramePacing(100);
+
+	// Pictures 0 and 1 in 3 parts of 4 packets. videoFrameIndex 0-2 and 3-5.
+	auto pushPicture = [&](int picture) {
+		for (int slice = 0; slice < 3; slice++) {
+			buffer.BeginPush();
+			for (int i = 0; i < 4; i++) {
+				PacketBuffer *packet = buffer.Allocate();
+				VideoFrame *header = (VideoFrame *)packet->buf;
+				header->type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+				header->videoFrameIndex = picture * 3 + slice;
+				header->sliceIndex = slice;
+				header->sliceCount = 3;
+				packet->len = sizeof(VideoFrame) + 100;
+			}
+			buffer.EndPush(true);
+		}
+	};
+	std::vector<uint64_t> sent;
+	auto sendFunc = [&](PacketBuffer *const *packets, int count) {
+		for (int i = 0; i < count; i++) {
+			sent.push_back(((VideoFrame *)packets[i]->buf)->videoFrameIndex);
+		}
+		return count;
+	};
+
+	pushPicture(0);
+	pushPicture(1);
+	now = 20 * 1000;
+	while (buffer.SendBatch(sendFunc) > 0) {}
+	ASSERT_EQ(statistics->GetStaleFramesDroppedTotal(), 1);
+	ASSERT_EQ(statistics->GetStalePacketsDroppedTotal(), 12);
+	ASSERT_FALSE(sent.empty());
+	for (uint64_t index : sent) {
+		ASSERT_GE(index, 3);
+	}
+
+	// Once its first part is sent, the rest of a stale picture is sent too.
+	for (now = 40 * 1000; !buffer.IsEmpty(); now += 100) {
+		while (buffer.SendBatch(sendFunc) > 0) {}
+	}
+	pushPicture(2);
+	sent.clear();
+	for (; sent.size() < 4; now += 100) {
+		buffer.SendBatch(sendFunc, 1);
+	}
+	pushPicture(3);
+	now += 20 * 1000;
+	for (; !buffer.IsEmpty(); now += 100) {
+		while (buffer.SendBatch(sendFunc) > 0) {}
+	}
+	ASSERT_EQ(statistics->GetStaleFramesDroppedTotal(), 1);
+	ASSERT_EQ(sent.size(), 24);
+	ASSERT_EQ(sent[4], 7);
+}
+
+TEST(pacing_test, next_send_time) {
+	uint64_t now = 0;
+	ThrottlingBuffer buffer(Bitrate::fromBits(0));
+	buffer.SetClock([&now]() { return now; });
+	buffer.SetFramePacing(100);
+
+	buffer.BeginPush();
+	for (int i = 0; i < 10; i++) {
+		PacketBuffer *packet = buffer.Allocate();
+		VideoFrame *header = (VideoFrame *)packet->buf;
+		header->type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+		header->videoFrameIndex = 1;
+		header->sliceIndex = 0;
+		header->sliceCount = 1;
+		packet->len = sizeof(VideoFrame) + 100;
+	}
+	buffer.EndPush(true);
+
+	std::vector<uint64_t> sentTimes;
+	int wakes = 0;
+	auto sendFunc = [&](PacketBuffer *const *packets, int count) {
+		for (int i = 0; i < count; i++) {
+			sentTimes.push_back(now);
+		}
+		return count;
+	};
+	while (true) {
+		while (buffer.SendBatch(sendFunc) > 0) {}
+		if (buffer.GetNextSendTime() == 0) {
+			break;
+		}
+		ASSERT_GT(buffer.GetNextSendTime(), now);
+		now = buffer.GetNextSendTime();
+		wakes++;
+	}
+	ASSERT_EQ(sentTimes.size(), 10);
+	ASSERT_EQ(wakes, 9);
+	for (int i = 0; i < 10; i++) {
+		ASSERT_EQ(sentTimes[i], i * 1000);
+	}
+
+	// Token bucket refill.
+	ThrottlingBuffer limited(Bitrate::fromMiBits(8));
+	limited.SetClock([&now]() { return now; });
+	now = 1000;
+	char payload[1000] = {};
+	for (int i = 0; i < 20; i++) {
+		limited.Push(payload, sizeof(payload), 0);
+	}
+	sentTimes.clear();
+	wakes = 0;
+	while (true) {
+		size_t before = sentTimes.size();
+		while (limited.SendBatch(sendFunc) > 0) {}
+		// Every wake sends something.
+		ASSERT_GT(sentTimes.size(), before);
+		if (limited.GetNextSendTime() == 0) {
+			break;
+		}
+		ASSERT_GT(limited.GetNextSendTime(), now);
+		now = limited.GetNextSendTime();
+		wakes++;
+	}
+	ASSERT_EQ(sentTimes.size(), 20);
+	// Last packet may go once queued bytes before it (19000) minus drained bytes fit 2000 byte window.
+	uint64_t expected = 1000 + 17000ull * 1000000 / Bitrate::fromMiBits(8).toBytes();
+	ASSERT_GE(sentTimes.back(), expected);
+	ASSERT_LT(sentTimes.back(), expected + 1000);
+}
+
+TEST(pacing_test, priority_classes) {
+	uint64_t now = 0;
+	ThrottlingBuffer buffer(Bitrate::fromMiBits(8));
+	buffer.SetClock([&now]() { return now; });
+	buffer.SetTimestampClock([&now]() { return now + 5; });
+
+	buffer.BeginPush();
+	for (int i = 0; i < 10; i++) {
+		PacketBuffer *packet = buffer.Allocate();
+		VideoFrame *header = (VideoFrame *)packet->buf;
+		header->type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+		header->videoFrameIndex = 1;
+		header->sliceIndex = 0;
+		header->sliceCount = 1;
+		packet->len = ALVR_MAX_PACKET_SIZE;
+	}
+	buffer.EndPush(true);
+	char audio[100] = {};
+	*(uint32_t *)audio = ALVR_PACKET_TYPE_AUDIO_FRAME;
+	ASSERT_TRUE(buffer.Push(audio, sizeof(audio), 0, ThrottlingBuffer::PRIORITY_AUDIO));
+	HapticsFeedback haptics = {};
+	haptics.type = ALVR_PACKET_TYPE_HAPTICS;
+	ASSERT_TRUE(buffer.Push((char *)&haptics, sizeof(haptics), 0, ThrottlingBuffer::PRIORITY_HAPTICS));
+	TimeSync timeSync = {};
+	timeSync.type = ALVR_PACKET_TYPE_TIME_SYNC;
+	ASSERT_TRUE(buffer.Push((char *)&timeSync, sizeof(timeSync), 0, ThrottlingBuffer::PRIORITY_CONTROL, offsetof(TimeSync, serverTime)));
+
+	std::vector<uint32_t> types;
+	std::vector<uint64_t> sentTimes;
+	auto sendFunc = [&](PacketBuffer *const *packets, int count) {
+		for (int i = 0; i < count; i++) {
+			types.push_back(*(uint32_t *)packets[i]->buf);
+			sentTimes.push_back(now);
+			if (types.back() == ALVR_PACKET_TYPE_TIME_SYNC) {
+				// Stamped at send, not at push.
+				EXPECT_EQ(((TimeSync *)packets[i]->buf)->serverTime, now + 5);
+			}
+		}
+		return count;
+	};
+
+	now = 1000;
+	while (true) {
+		while (buffer.SendBatch(sendFunc) > 0) {}
+		if (buffer.GetNextSendTime() == 0) {
+			break;
+		}
+		now = buffer.GetNextSendTime();
+	}
+	ASSERT_EQ(types.size(), 13);
+	ASSERT_EQ(types[0], ALVR_PACKET_TYPE_TIME_SYNC);
+	ASSERT_EQ(types[1], ALVR_PACKET_TYPE_HAPTICS);
+	ASSERT_EQ(types[2], ALVR_PACKET_TYPE_AUDIO_FRAME);
+	for (int i = 3; i < 13; i++) {
+		ASSERT_EQ(types[i], ALVR_PACKET_TYPE_VIDEO_FRAME);
+	}
+
+	// Bitrate limit holds back video only.
+	buffer.BeginPush();
+	for (int i = 0; i < 4; i++) {
+		PacketBuffer *packet = buffer.Allocate();
+		((VideoFrame *)packet->buf)->type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+		packet->len = ALVR_MAX_PACKET_SIZE;
+	}
+	buffer.EndPush(true);
+	while (buffer.SendBatch(sendFunc) > 0) {}
+	ASSERT_GT(buffer.GetNextSendTime(), now);
+	ASSERT_TRUE(buffer.Push((char *)&timeSync, sizeof(timeSync), 0, ThrottlingBuffer::PRIORITY_CONTROL, offsetof(TimeSync, serverTime)));
+	types.clear();
+	while (buffer.SendBatch(sendFunc) > 0) {}
+	ASSERT_EQ(types.size(), 1);
+	ASSERT_EQ(types[0], ALVR_PACKET_TYPE_TIME_SYNC);
+	ASSERT_GT(buffer.GetNextSendTime(), now);
+}
+
+// TimeSync mode 1 replies sent while the link is saturated by video, queued in the video class as before
+// and in the control class. Returns queueing delay of each reply, from Push to sendto.
+static std::vector<uint64_t> SimulateTimeSyncDelay(ThrottlingBuffer::Priority priority) {
+	static const int REFRESH_RATE = 72;
+	static const uint64_t FRAME_INTERVAL_US = 1000 * 1000 / REFRESH_RATE;
+	static const uint64_t TIME_SYNC_INTERVAL_US = 7 * 1000;
+	static const uint64_t DURATION_US = 3 * 1000 * 1000;
+	static const uint64_t STEP_US = 50;
+	// 35 Mbps of video over 30 Mbps link.
+	static const int FRAME_SIZE = 60 * 1000;
+
+	uint64_t now = 0;
+	ThrottlingBuffer buffer(Bitrate::fromMiBits(30));
+	buffer.SetClock([&now]() { return now; });
+	buffer.SetTimestampClock([&now]() { return now; });
+	buffer.SetFramePacing(REFRESH_RATE);
+
+	std::vector<uint64_t> delays;
+	uint64_t nextFrame = 0;
+	uint64_t nextTimeSync = 0;
+	uint64_t videoFrameIndex = 0;
+	for (now = 0; now < DURATION_US; now += STEP_US) {
+		if (now >= nextFrame) {
+			buffer.BeginPush();
+			bool queued = true;
+			for (int i = 0; i < (FRAME_SIZE + ALVR_MAX_VIDEO_BUFFER_SIZE - 1) / ALVR_MAX_VIDEO_BUFFER_SIZE; i++) {
+				PacketBuffer *packet = buffer.Allocate();
+				if (packet == NULL) {
+					queued = false;
+					break;
+				}
+				VideoFrame *header = (VideoFrame *)packet->buf;
+				header->type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+				header->videoFrameIndex = videoFrameIndex;
+				header->sliceIndex = 0;
+				header->sliceCount = 1;
+				packet->len = ALVR_MAX_PACKET_SIZE;
+			}
+			buffer.EndPush(queued);
+			videoFrameIndex++;
+			nextFrame += FRAME_INTERVAL_US;
+		}
+		if (now >= nextTimeSync) {
+			TimeSync timeSync = {};
+			timeSync.type = ALVR_PACKET_TYPE_TIME_SYNC;
+			timeSync.mode = 1;
+			// Push time. serverTime is overwritten at send.
+			timeSync.clientTime = now;
+			timeSync.serverTime = now;
+			buffer.Push((char *)&timeSync, sizeof(timeSync), 0, priority, offsetof(TimeSync, serverTime));
+			nextTimeSync += TIME_SYNC_INTERVAL_US;
+		}
+		while (buffer.SendBatch([&](PacketBuffer *const *packets, int count) {
+			for (int i = 0; i < count; i++) {
+				TimeSync *timeSync = (TimeSync *)packets[i]->buf;
+				if (timeSync->type == ALVR_PACKET_TYPE_TIME_SYNC) {
+					EXPECT_EQ(timeSync->serverTime, now);
+					delays.push_back(now - timeSync->clientTime);
+				}
+			}
+			return count;
+		}) > 0) {}
+	}
+	std::sort(delays.begin(), delays.end());
+	return delays;
+}
+
+TEST(pacing_test, time_sync_delay_under_video_load) {
+	std::vector<uint64_t> fifo = SimulateTimeSyncDelay(ThrottlingBuffer::PRIORITY_VIDEO);
+	std::vector<uint64_t> control = SimulateTimeSyncDelay(ThrottlingBuffer::PRIORITY_CONTROL);
+
+	printf("class    TimeSync queueing delay p50/p99/max (us)\n");
+	printf("video    %llu/%llu/%llu\n", (unsigned long long)fifo[fifo.size() / 2], (unsigned long long)fifo[fifo.size() * 99 / 100]
+		, (unsigned long long)fifo.back());
+	printf("control  %llu/%llu/%llu\n", (unsigned long long)control[control.size() / 2]
+		, (unsigned long long)control[control.size() * 99 / 100], (unsigned long long)control.back());
+
+	ASSERT_GT(control.size(), 400);
+	// Sent on the first SendBatch after Push, whatever is queued.
+	ASSERT_LE(control.back(), 50u);
+	ASSERT_GT(fifo[fifo.size() / 2], 1000u);
+}
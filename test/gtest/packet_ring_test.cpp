@@ -0,0 +1,333 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+
+#include "../../alvr_server/PacketRing.h"
+#include "../../alvr_server/SPSCQueue.h"
+#include "../../alvr_server/ThrottlingBuffer.h"
+
+TEST(packet_ring_test, basic) {
+	PacketRing ring(4);
+	ASSERT_EQ(ring.GetCapacity(), 4);
+	ASSERT_TRUE(ring.IsEmpty());
+	ASSERT_TRUE(ring.Front() == NULL);
+
+	PacketBuffer *packets[4];
+	for (int i = 0; i < 4; i++) {
+		packets[i] = ring.Reserve();
+		ASSERT_TRUE(packets[i] != NULL);
+		ASSERT_EQ((uintptr_t)packets[i] % CACHE_LINE_SIZE, 0);
+		packets[i]->len = i;
+	}
+	ASSERT_TRUE(ring.Reserve() == NULL);
+	// Reserved but not committed.
+	ASSERT_TRUE(ring.Front() == NULL);
+
+	ring.Commit();
+	ASSERT_EQ(ring.Size(), 4);
+	for (int i = 0; i < 2; i++) {
+		ASSERT_EQ(ring.Front(), packets[i]);
+		ring.Pop();
+	}
+
+	// Rollback discards only uncommitted slots.
+	ASSERT_TRUE(ring.Reserve() != NULL);
+	ASSERT_TRUE(ring.Reserve() != NULL);
+	ASSERT_TRUE(ring.Reserve() == NULL);
+	ring.Rollback();
+	ASSERT_EQ(ring.Size(), 2);
+
+	// Wrap around.
+	PacketBuffer *packet = ring.Reserve();
+	ASSERT_EQ(packet, packets[0]);
+	packet->len = 4;
+	ring.Commit();
+	for (int i = 2; i < 5; i++) {
+		ASSERT_EQ(ring.Front()->len, i);
+		ring.Pop();
+	}
+	ASSERT_TRUE(ring.IsEmpty());
+}
+
+TEST(packet_ring_test, spsc_queue) {
+	SPSCQueue<int> queue(4);
+	ASSERT_TRUE(queue.IsEmpty());
+	ASSERT_TRUE(queue.Front() == NULL);
+
+	for (int i = 0; i < 4; i++) {
+		int *value = queue.Reserve();
+		ASSERT_TRUE(value != NULL);
+		*value = i;
+		queue.Commit();
+	}
+	ASSERT_TRUE(queue.Reserve() == NULL);
+	ASSERT_EQ(queue.Size(), 4);
+
+	ASSERT_EQ(*queue.Front(), 0);
+	queue.Pop();
+	// Wrap around.
+	int *value = queue.Reserve();
+	ASSERT_TRUE(value != NULL);
+	*value = 4;
+	// Reserved but not committed.
+	ASSERT_EQ(queue.Size(), 3);
+	queue.Commit();
+	for (int i = 1; i < 5; i++) {
+		ASSERT_EQ(*queue.Front(), i);
+		queue.Pop();
+	}
+	ASSERT_TRUE(queue.IsEmpty());
+}
+
+TEST(packet_ring_test, spsc_queue_threads) {
+	const uint64_t COUNT = 1000000;
+	SPSCQueue<uint64_t> queue(256);
+	std::atomic<uint64_t> errors(0);
+
+	std::thread consumer([&]() {
+		uint64_t expected = 0;
+		while (expected < COUNT) {
+			uint64_t *value = queue.Front();
+			if (value == NULL) {
+				std::this_thread::yield();
+				continue;
+			}
+			if (*value != expected) {
+				errors++;
+			}
+			expected++;
+			queue.Pop();
+		}
+	});
+	for (uint64_t i = 0; i < COUNT; i++) {
+		uint64_t *value;
+		while ((value = queue.Reserve()) == NULL) {
+			std::this_thread::yield();
+		}
+		*value = i;
+		queue.Commit();
+	}
+	consumer.join();
+	ASSERT_EQ(errors, 0u);
+	ASSERT_TRUE(queue.IsEmpty());
+}
+
+TEST(packet_ring_test, throttling_buffer_full) {
+	ThrottlingBuffer buffer(Bitrate::fromBits(0), nullptr, 4);
+	char data[100] = {};
+
+	// Frame which does not fit is dropped as a whole.
+	buffer.BeginPush();
+	for (int i = 0; i < 4; i++) {
+		ASSERT_TRUE(buffer.Allocate() != NULL);
+	}
+	ASSERT_TRUE(buffer.Allocate() == NULL);
+	buffer.EndPush(false);
+	ASSERT_TRUE(buffer.IsEmpty());
+	ASSERT_EQ(buffer.GetDropCount(), 1);
+
+	for (int i = 0; i < 4; i++) {
+		ASSERT_TRUE(buffer.Push(data, sizeof(data), i));
+	}
+	ASSERT_FALSE(buffer.Push(data, sizeof(data), 4));
+	ASSERT_EQ(buffer.GetDropCount(), 2);
+
+	int sent = 0;
+	while (buffer.Send([&sent](char *buf, int len) { sent++; return true; })) {}
+	ASSERT_EQ(sent, 4);
+}
+
+struct StressPayload {
+	int producer;
+	uint32_t sequence;
+	uint32_t check;
+};
+
+// Several producers push batches of packets into small ring while consumer drains it.
+// Every producer's packets must arrive exactly once, in order and intact.
+TEST(packet_ring_test, stress) {
+	static const int PRODUCERS = 3;
+	static const uint32_t PACKETS_PER_PRODUCER = 300000;
+
+	ThrottlingBuffer buffer(Bitrate::fromBits(0), nullptr, 64);
+	std::atomic<int> running(PRODUCERS);
+
+	std::vector<std::thread> producers;
+	for (int p = 0; p < PRODUCERS; p++) {
+		producers.push_back(std::thread([&buffer, &running, p]() {
+			srand(p);
+			uint32_t sequence = 0;
+			while (sequence < PACKETS_PER_PRODUCER) {
+				uint32_t batch = std::min<uint32_t>(1 + rand() % 40, PACKETS_PER_PRODUCER - sequence);
+				buffer.BeginPush();
+				bool ok = true;
+				for (uint32_t i = 0; i < batch; i++) {
+					PacketBuffer *packet = buffer.Allocate();
+					if (packet == NULL) {
+						ok = false;
+						break;
+					}
+					StressPayload *payload = (StressPayload *)packet->buf;
+					payload->producer = p;
+					payload->sequence = sequence + i;
+					payload->check = (sequence + i) * 2654435761u ^ p;
+					packet->len = sizeof(StressPayload) + (sequence + i) % 1000;
+				}
+				buffer.EndPush(ok);
+				if (ok) {
+					sequence += batch;
+				}
+				else {
+					std::this_thread::yield();
+				}
+			}
+			running--;
+		}));
+	}
+
+	uint32_t expected[PRODUCERS] = {};
+	bool valid = true;
+	uint64_t received = 0;
+	while (running > 0 || !buffer.IsEmpty()) {
+		buffer.Send([&](char *buf, int len) {
+			StressPayload *payload = (StressPayload *)buf;
+			if (payload->producer < 0 || payload->producer >= PRODUCERS
+				|| payload->sequence != expected[payload->producer]
+				|| payload->check != (payload->sequence * 2654435761u ^ payload->producer)
+				|| len != (int)(sizeof(StressPayload) + payload->sequence % 1000)) {
+				valid = false;
+			}
+			else {
+				expected[payload->producer]++;
+			}
+			received++;
+			return true;
+		});
+	}
+	for (auto &t : producers) {
+		t.join();
+	}
+
+	ASSERT_TRUE(valid);
+	ASSERT_EQ(received, (uint64_t)PRODUCERS * PACKETS_PER_PRODUCER);
+	for (int p = 0; p < PRODUCERS; p++) {
+		ASSERT_EQ(expected[p], PACKETS_PER_PRODUCER);
+	}
+}
+
+// Queue with std::list and lock, which is how ThrottlingBuffer used to store packets. Reference for benchmark.
+// Bounded to same capacity as ring so that queueing delay is comparable.
+class LockedListQueue {
+public:
+	bool Push(char *buf, int len) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mQueue.size() >= ThrottlingBuffer::DEFAULT_CAPACITY) {
+			return false;
+		}
+		std::shared_ptr<char> p(new char[len], [](char *p) { delete[] p; });
+		memcpy(p.get(), buf, len);
+		mQueue.push_back(std::make_pair(p, len));
+		return true;
+	}
+	bool Send(std::function<bool(char *, int)> sendFunc) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mQueue.empty()) {
+			return false;
+		}
+		if (sendFunc(mQueue.front().first.get(), mQueue.front().second)) {
+			mQueue.pop_front();
+			return true;
+		}
+		return false;
+	}
+private:
+	std::mutex mMutex;
+	std::list<std::pair<std::shared_ptr<char>, int>> mQueue;
+};
+
+static uint64_t NowNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<typename PushFn, typename SendFn>
+static void RunQueueBenchmark(const char *name, PushFn push, SendFn send) {
+	static const int PACKETS = 500000;
+	static const int PACKET_SIZE = ALVR_MAX_PACKET_SIZE;
+
+	std::vector<uint64_t> latencies;
+	latencies.reserve(PACKETS);
+
+	uint64_t start = NowNs();
+	std::thread producer([&push]() {
+		char packet[PACKET_SIZE] = {};
+		for (int i = 0; i < PACKETS; i++) {
+			uint64_t now = NowNs();
+			memcpy(packet, &now, sizeof(now));
+			while (!push(packet, PACKET_SIZE)) {
+				std::this_thread::yield();
+			}
+		}
+	});
+	while ((int)latencies.size() < PACKETS) {
+		send([&latencies](char *buf, int len) {
+			uint64_t pushed;
+			memcpy(&pushed, buf, sizeof(pushed));
+			latencies.push_back(NowNs() - pushed);
+			return true;
+		});
+	}
+	producer.join();
+	uint64_t elapsed = NowNs() - start;
+
+	std::sort(latencies.begin(), latencies.end());
+	printf("%-20s %6.2f Mpkt/s  latency p50=%6.2fus p99=%7.2fus p99.9=%8.2fus max=%9.2fus\n", name
+		, PACKETS * 1000.0 / elapsed
+		, latencies[PACKETS / 2] / 1000.0, latencies[PACKETS * 99 / 100] / 1000.0
+		, latencies[PACKETS * 999 / 1000] / 1000.0, latencies.back() / 1000.0);
+}
+
+// Producer pushes PACKETS packets of ALVR_MAX_PACKET_SIZE as fast as possible while consumer drains.
+// Latency is time from push to consumer callback, so it includes queueing delay.
+TEST(packet_ring_test, benchmark) {
+	{
+		LockedListQueue queue;
+		RunQueueBenchmark("list+lock"
+			, [&queue](char *buf, int len) { return queue.Push(buf, len); }
+			, [&queue](std::function<bool(char *, int)> f) { return queue.Send(f); });
+	}
+	{
+		PacketRing ring(ThrottlingBuffer::DEFAULT_CAPACITY);
+		RunQueueBenchmark("ring"
+			, [&ring](char *buf, int len) {
+				PacketBuffer *packet = ring.Reserve();
+				if (packet == NULL) {
+					return false;
+				}
+				memcpy(packet->buf, buf, len);
+				packet->len = len;
+				ring.Commit();
+				return true;
+			}
+			, [&ring](std::function<bool(char *, int)> f) {
+				PacketBuffer *packet = ring.Front();
+				if (packet == NULL || !f(packet->buf, packet->len)) {
+					return false;
+				}
+				ring.Pop();
+				return true;
+			});
+	}
+	{
+		// Includes producer lock and pacing check of ThrottlingBuffer.
+		ThrottlingBuffer buffer(Bitrate::fromBits(0));
+		RunQueueBenchmark("ThrottlingBuffer"
+			, [&buffer](char *buf, int len) { return buffer.Push(buf, len, 0); }
+			, [&buffer](std::function<bool(char *, int)> f) { return buffer.Send(f); });
+	}
+}
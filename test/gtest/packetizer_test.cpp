@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <algorithm>
+
+#include "../../alvr_server/FECPacketizer.h"
+#include "../../alvr_server/ThrottlingBuffer.h"
+#include "../../ALVR-common/reedsolomon/rs_cache.h"
+
+// Packetize with intermediate shard buffers, which is how FECSend used to build packets.
+static std::vector<std::vector<uint8_t>> ReferencePacketize(const uint8_t *buf, int len, int fecPercentage) {
+	int shardPackets = CalculateFECShardPackets(len, fecPercentage);
+	int blockSize = shardPackets * ALVR_MAX_VIDEO_BUFFER_SIZE;
+	int dataShards = (len + blockSize - 1) / blockSize;
+	int totalParityShards = CalculateParityShards(dataShards, fecPercentage);
+	int totalShards = dataShards + totalParityShards;
+
+	std::vector<std::vector<uint8_t>> blocks(totalShards, std::vector<uint8_t>(blockSize, 0));
+	std::vector<uint8_t *> shards(totalShards);
+	for (int i = 0; i < totalShards; i++) {
+		shards[i] = &blocks[i][0];
+	}
+	for (int i = 0; i < dataShards; i++) {
+		memcpy(shards[i], buf + i * blockSize, std::min(blockSize, len - i * blockSize));
+	}
+	reed_solomon *rs = reed_solomon_new(dataShards, totalParityShards);
+	reed_solomon_encode(rs, &shards[0], totalShards, blockSize);
+	reed_solomon_release(rs);
+
+	std::vector<std::vector<uint8_t>> payloads;
+	int dataRemain = len;
+	for (int i = 0; i < dataShards; i++) {
+		for (int j = 0; j < shardPackets; j++) {
+			int copyLength = std::min(ALVR_MAX_VIDEO_BUFFER_SIZE, dataRemain);
+			if (copyLength <= 0) {
+				break;
+			}
+			payloads.push_back(std::vector<uint8_t>(shards[i] + j * ALVR_MAX_VIDEO_BUFFER_SIZE, shards[i] + j * ALVR_MAX_VIDEO_BUFFER_SIZE + copyLength));
+			dataRemain -= ALVR_MAX_VIDEO_BUFFER_SIZE;
+		}
+	}
+	for (int i = 0; i < totalParityShards; i++) {
+		for (int j = 0; j < shardPackets; j++) {
+			payloads.push_back(std::vector<uint8_t>(shards[dataShards + i] + j * ALVR_MAX_VIDEO_BUFFER_SIZE, shards[dataShards + i] + (j + 1) * ALVR_MAX_VIDEO_BUFFER_SIZE));
+		}
+	}
+	return payloads;
+}
+
+TEST(packetizer_test, matches_reference) {
+	reed_solomon_init();
+	srand(1);
+
+	PacketRing ring(1024);
+	FECPacketizer packetizer;
+	uint32_t packetCounter = 100;
+
+	int sizes[] = { 1, 100, ALVR_MAX_VIDEO_BUFFER_SIZE - 1, ALVR_MAX_VIDEO_BUFFER_SIZE, ALVR_MAX_VIDEO_BUFFER_SIZE + 1
+		, 18 * ALVR_MAX_VIDEO_BUFFER_SIZE, 20000, 25000, 50001, 123456, 500000 };
+	int fecPercentages[] = { 5, 10 };
+	for (int fecPercentage : fecPercentages) {
+		for (int len : sizes) {
+			std::vector<uint8_t> frame(len);
+			for (auto &b : frame) {
+				b = rand() & 0xFF;
+			}
+			auto reference = ReferencePacketize(&frame[0], len, fecPercentage);
+
+			VideoFrame header = {};
+			header.type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+			header.trackingFrameIndex = 7;
+			header.videoFrameIndex = 8;
+			header.frameByteSize = len;
+			header.fecPercentage = fecPercentage;
+
+			uint32_t firstCounter = packetCounter;
+			auto &packets = packetizer.Packetize(&frame[0], len, header, packetCounter, [&ring]() { return ring.Reserve(); });
+			ASSERT_EQ(packets.size(), reference.size());
+			ASSERT_EQ(packetCounter, firstCounter + reference.size());
+
+			int shardPackets = CalculateFECShardPackets(len, fecPercentage);
+			int dataPackets = (len + ALVR_MAX_VIDEO_BUFFER_SIZE - 1) / ALVR_MAX_VIDEO_BUFFER_SIZE;
+			int dataShards = (dataPackets + shardPackets - 1) / shardPackets;
+			for (size_t i = 0; i < packets.size(); i++) {
+				VideoFrame *packetHeader = (VideoFrame *)packets[i]->buf;
+				ASSERT_EQ(packets[i]->len, (int)(sizeof(VideoFrame) + reference[i].size()));
+				ASSERT_EQ(packets[i]->frameIndex, 7);
+				ASSERT_EQ(packetHeader->packetCounter, firstCounter + i);
+				ASSERT_EQ(packetHeader->videoFrameIndex, 8);
+				ASSERT_EQ(packetHeader->fecIndex, (int)i < dataPackets ? i : dataShards * shardPackets + i - dataPackets);
+				ASSERT_EQ(memcmp(packets[i]->buf + sizeof(VideoFrame), &reference[i][0], reference[i].size()), 0);
+			}
+			ring.Rollback();
+		}
+	}
+}
+
+TEST(packetizer_test, ring_full) {
+	PacketRing ring(4);
+	FECPacketizer packetizer;
+	uint32_t packetCounter = 0;
+	std::vector<uint8_t> frame(20000);
+
+	VideoFrame header = {};
+	header.fecPercentage = 5;
+	auto &packets = packetizer.Packetize(&frame[0], (int)frame.size(), header, packetCounter, [&ring]() { return ring.Reserve(); });
+	ASSERT_TRUE(packets.empty());
+}
+
+TEST(packetizer_test, throttling_buffer_zero_copy) {
+	ThrottlingBuffer buffer(Bitrate::fromBits(0));
+
+	std::vector<PacketBuffer *> pushed;
+	buffer.BeginPush();
+	for (int i = 0; i < 10; i++) {
+		PacketBuffer *packet = buffer.Allocate();
+		packet->len = 100 + i;
+		packet->frameIndex = i;
+		pushed.push_back(packet);
+	}
+	// Nothing is visible to consumer before EndPush.
+	ASSERT_TRUE(buffer.IsEmpty());
+	buffer.EndPush(true);
+	char small[] = "abc";
+	ASSERT_TRUE(buffer.Push(small, sizeof(small), 10));
+
+	std::vector<char *> sent;
+	while (buffer.Send([&sent](char *buf, int len) { sent.push_back(buf); return true; })) {}
+	ASSERT_TRUE(buffer.IsEmpty());
+	ASSERT_EQ(sent.size(), 11);
+	for (int i = 0; i < 10; i++) {
+		// Queued packets are sent from the buffer they were written into.
+		ASSERT_EQ(sent[i], pushed[i]->buf);
+	}
+	ASSERT_EQ(memcmp(sent[10], small, sizeof(small)), 0);
+
+	// Failed send keeps packet queued.
+	buffer.Push(small, sizeof(small), 11);
+	ASSERT_FALSE(buffer.Send([](char *buf, int len) { return false; }));
+	ASSERT_FALSE(buffer.IsEmpty());
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <atomic>
+
+#include "../../alvr_server/Poller.h"
+
+namespace {
+	void StartupSocket() {
+#ifdef _WIN32
+		WSADATA wsaData;
+		WSAStartup(MAKEWORD(2, 0), &wsaData);
+#endif
+	}
+
+	uint64_t Percentile(std::vector<uint64_t> values, double p) {
+		std::sort(values.begin(), values.end());
+		return values[std::min(values.size() - 1, static_cast<size_t>(values.size() * p))];
+	}
+}
+
+TEST(poller_test, timer_queue_order) {
+	TimerQueue timers;
+	std::vector<int> fired;
+	timers.Add(300, [&]() { fired.push_back(3); });
+	timers.Add(100, [&]() { fired.push_back(1); });
+	TimerQueue::TimerId cancelled = timers.Add(150, [&]() { fired.push_back(-1); });
+	timers.Add(200, [&]() { fired.push_back(2); });
+	timers.Add(200, [&]() { fired.push_back(22); });
+
+	ASSERT_TRUE(timers.Cancel(cancelled));
+	ASSERT_FALSE(timers.Cancel(cancelled));
+	ASSERT_EQ(timers.GetNextDeadline(), 100u);
+	ASSERT_EQ(timers.Size(), 4u);
+
+	ASSERT_EQ(timers.RunExpired(99), 0);
+	ASSERT_EQ(timers.RunExpired(250), 3);
+	ASSERT_EQ(fired.size(), 3u);
+	ASSERT_EQ(fired[0], 1);
+	ASSERT_EQ(fired[1], 2);
+	ASSERT_EQ(fired[2], 22);
+	ASSERT_EQ(timers.GetNextDeadline(), 300u);
+
+	// Timer added by a callback does not run in the same call even if already due.
+	timers.Add(260, [&]() {
+		fired.push_back(4);
+		timers.Add(0, [&]() { fired.push_back(5); });
+	});
+	ASSERT_EQ(timers.RunExpired(400), 2);
+	ASSERT_EQ(fired.size(), 5u);
+	ASSERT_EQ(fired[3], 4);
+	ASSERT_EQ(fired[4], 3);
+	ASSERT_EQ(timers.RunExpired(400), 1);
+	ASSERT_EQ(fired[5], 5);
+	ASSERT_EQ(timers.GetNextDeadline(), 0u);
+	ASSERT_EQ(timers.Size(), 0u);
+}
+
+TEST(poller_test, wake_at_keeps_earliest) {
+	StartupSocket();
+	Poller poller;
+	uint64_t start = GetCounterUs();
+	poller.WakeAt(start + 50 * 1000);
+	poller.WakeAt(start + 2 * 1000);
+	poller.WakeAt(start + 30 * 1000);
+	while (poller.Do() != 0) {}
+	uint64_t elapsed = GetCounterUs() - start;
+	ASSERT_GE(elapsed, 2 * 1000u);
+	ASSERT_LT(elapsed, 30 * 1000u);
+}
+
+// Wake-up jitter of timers against monotonic clock, for each backend.
+TEST(poller_test, wake_jitter) {
+	static const int SAMPLES = 300;
+	StartupSocket();
+
+	std::vector<SocketIOBackend> backends;
+	backends.push_back(SOCKET_IO_SELECT);
+	if (IsSocketIOBackendAvailable(SOCKET_IO_EPOLL)) {
+		backends.push_back(SOCKET_IO_EPOLL);
+	}
+	std::mt19937 random(1);
+	std::uniform_int_distribution<uint64_t> delay(100, 3000);
+
+	for (auto backend : backends) {
+		Poller poller(backend);
+		std::vector<uint64_t> jitter;
+		uint64_t waitCalls = poller.GetCounters().waitCalls;
+		for (int i = 0; i < SAMPLES; i++) {
+			uint64_t deadline = GetCounterUs() + delay(random);
+			uint64_t fired = 0;
+			poller.AddTimer(deadline, [&]() { fired = GetCounterUs(); });
+			while (fired == 0) {
+				poller.Do();
+			}
+			// Never early.
+			ASSERT_GE(fired, deadline);
+			jitter.push_back(fired - deadline);
+		}
+		printf("%-8s wake jitter p50=%llu us p99=%llu us max=%llu us, %.2f waits/timer\n", GetSocketIOBackendName(backend)
+			, (unsigned long long)Percentile(jitter, 0.5), (unsigned long long)Percentile(jitter, 0.99)
+			, (unsigned long long)Percentile(jitter, 1.0), (double)(poller.GetCounters().waitCalls - waitCalls) / SAMPLES);
+		// Old implementation overslept by up to 1ms (900us fixed wake or epoll millisecond rounding).
+		ASSERT_LT(Percentile(jitter, 0.5), 1000u);
+	}
+}
+
+TEST(poller_test, wake_from_other_thread) {
+	StartupSocket();
+	Poller poller;
+	// Nothing scheduled. Do() would wait DEFAULT_WAIT_TIME_US unless woken.
+	std::vector<uint64_t> latency;
+	for (int i = 0; i < 20; i++) {
+		std::atomic<uint64_t> wakeTime(0);
+		std::thread thread([&]() {
+			std::this_thread::sleep_for(std::chrono::microseconds(500));
+			wakeTime = GetCounterUs();
+			poller.Wake();
+		});
+		while (poller.Do() != 0 || wakeTime == 0) {}
+		uint64_t returned = GetCounterUs();
+		thread.join();
+		latency.push_back(returned - wakeTime);
+	}
+	printf("Wake() latency p50=%llu us max=%llu us\n"
+		, (unsigned long long)Percentile(latency, 0.5), (unsigned long long)Percentile(latency, 1.0));
+	ASSERT_LT(Percentile(latency, 0.5), 5000u);
+}
@@ -0,0 +1,212 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../alvr_server/RGBToNV12ConverterCPU.h"
+
+// CPU RGBA to NV12 conversion tests and benchmark. Every kernel must give the bytes of the scalar
+// reference, which must be within 1 of the floating point formula of RGBToNV12.cu. The benchmark
+// converts 2880x1600 and 3664x1920 frames with each kernel, on one thread and on all of them.
+namespace {
+	typedef RGBToNV12ConverterCPU Converter;
+
+	struct KernelInfo {
+		const char *name;
+		Converter::Kernel kernel;
+	};
+
+	const KernelInfo KERNELS[] = {
+		{ "Scalar", Converter::KERNEL_SCALAR },
+		{ "SSE4.1", Converter::KERNEL_SSE41 },
+		{ "AVX2", Converter::KERNEL_AVX2 },
+		{ "NEON", Converter::KERNEL_NEON },
+	};
+
+	// Random pixels with flat areas and edges, and all values at 0 and 255 somewhere.
+	void FillPicture(CpuFrame &frame, uint32_t seed) {
+		std::mt19937 random(seed);
+		for (int y = 0; y < frame.GetHeight(); y++) {
+			uint8_t *row = frame.GetPlane(0) + frame.GetPitch() * y;
+			for (int x = 0; x < frame.GetWidth(); x++) {
+				for (int c = 0; c < 4; c++) {
+					uint32_t r = random();
+					row[x * 4 + c] = r % 8 == 0 ? 0 : r % 8 == 1 ? 255 : (uint8_t)(r >> 8);
+				}
+			}
+		}
+	}
+
+	// RGBToNV12.cu
+	float CudaY(const uint8_t *c) {
+		return 0.257f * c[0] + 0.504f * c[1] + 0.098f * c[2] + 16.0f;
+	}
+
+	float CudaU(const uint8_t *c) {
+		return -0.148f * c[0] - 0.291f * c[1] + 0.439f * c[2] + 128.0f;
+	}
+
+	float CudaV(const uint8_t *c) {
+		return 0.439f * c[0] - 0.368f * c[1] - 0.071f * c[2] + 128.0f;
+	}
+
+	// Largest difference to the CUDA formula, and number of bytes which differ.
+	void CompareWithCuda(const CpuFrame &src, const CpuFrame &dst, int &maxDiff, int &diffCount) {
+		maxDiff = 0;
+		diffCount = 0;
+		auto check = [&](float expected, uint8_t actual) {
+			int diff = abs((int)(expected + 0.5f) - actual);
+			maxDiff = std::max(maxDiff, diff);
+			diffCount += diff != 0;
+		};
+		for (int y = 0; y < src.GetHeight(); y += 2) {
+			const uint8_t *row0 = src.GetPlane(0) + src.GetPitch() * y;
+			const uint8_t *row1 = row0 + src.GetPitch();
+			const uint8_t *y0 = dst.GetPlane(0) + dst.GetPitch() * y;
+			const uint8_t *y1 = y0 + dst.GetPitch();
+			const uint8_t *uv = dst.GetPlane(1) + dst.GetPitch() * (y / 2);
+			for (int x = 0; x < src.GetWidth(); x += 2) {
+				const uint8_t *c[4] = { row0 + x * 4, row0 + x * 4 + 4, row1 + x * 4, row1 + x * 4 + 4 };
+				check(CudaY(c[0]), y0[x]);
+				check(CudaY(c[1]), y0[x + 1]);
+				check(CudaY(c[2]), y1[x]);
+				check(CudaY(c[3]), y1[x + 1]);
+				check((CudaU(c[0]) + CudaU(c[1]) + CudaU(c[2]) + CudaU(c[3])) * 0.25f, uv[x]);
+				check((CudaV(c[0]) + CudaV(c[1]) + CudaV(c[2]) + CudaV(c[3])) * 0.25f, uv[x + 1]);
+			}
+		}
+	}
+
+	bool SamePixels(const CpuFrame &a, const CpuFrame &b) {
+		for (int plane = 0; plane < a.GetPlaneCount(); plane++) {
+			for (int y = 0; y < a.GetPlaneHeight(plane); y++) {
+				if (memcmp(a.GetPlane(plane) + a.GetPitch() * y, b.GetPlane(plane) + b.GetPitch() * y, a.GetWidth()) != 0) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+}
+
+TEST(rgb_to_nv12_test, scalar_matches_cuda_coefficients) {
+	CpuFrame src(CpuFrame::FORMAT_RGBA, 256, 256);
+	CpuFrame dst(CpuFrame::FORMAT_NV12, 256, 256);
+	int maxDiff;
+	int diffCount;
+
+	FillPicture(src, 1);
+	Converter(1, Converter::KERNEL_SCALAR).Convert(src, dst);
+	CompareWithCuda(src, dst, maxDiff, diffCount);
+	EXPECT_LE(maxDiff, 1);
+	// Only values close to .5 may round the other way.
+	EXPECT_LT(diffCount, dst.GetSize() / 100);
+
+	// Gray, black and white levels are exact.
+	for (int y = 0; y < 256; y++) {
+		for (int x = 0; x < 256; x++) {
+			uint8_t *c = src.GetPlane(0) + src.GetPitch() * y + x * 4;
+			c[0] = c[1] = c[2] = (uint8_t)x;
+		}
+	}
+	Converter(1, Converter::KERNEL_SCALAR).Convert(src, dst);
+	CompareWithCuda(src, dst, maxDiff, diffCount);
+	EXPECT_LE(maxDiff, 1);
+	EXPECT_EQ(16, dst.GetPlane(0)[0]);
+	EXPECT_EQ(235, dst.GetPlane(0)[255]);
+	EXPECT_EQ(128, dst.GetPlane(1)[0]);
+	EXPECT_EQ(128, dst.GetPlane(1)[1]);
+}
+
+TEST(rgb_to_nv12_test, kernels_are_bit_exact) {
+	// Widths cover every tail length of the 4 and 8 pixel steps. Pitches have padding.
+	const int widths[] = { 2, 4, 6, 8, 10, 12, 14, 16, 18, 30, 62, 66, 130, 1442 };
+	for (auto &info : KERNELS) {
+		if (!Converter::IsSupported(info.kernel)) {
+			printf("%-8s not supported by CPU\n", info.name);
+			continue;
+		}
+		for (int width : widths) {
+			int height = 6;
+			int srcPitch = width * 4 + 12;
+			int dstPitch = width + 6;
+			std::vector<uint8_t> srcData(srcPitch * height);
+			std::vector<uint8_t> expectedData(dstPitch * height * 3 / 2, 0xCD);
+			std::vector<uint8_t> actualData(expectedData);
+			CpuFrame src(CpuFrame::FORMAT_RGBA, width, height, srcData.data(), srcPitch);
+			CpuFrame expected(CpuFrame::FORMAT_NV12, width, height, expectedData.data(), dstPitch);
+			CpuFrame actual(CpuFrame::FORMAT_NV12, width, height, actualData.data(), dstPitch);
+			FillPicture(src, width);
+
+			Converter(1, Converter::KERNEL_SCALAR).Convert(src, expected);
+			Converter(1, info.kernel).Convert(src, actual);
+			EXPECT_TRUE(SamePixels(expected, actual));
+			// Padding is not written.
+			EXPECT_EQ(expectedData, actualData);
+		}
+	}
+}
+
+TEST(rgb_to_nv12_test, threads_are_bit_exact) {
+	// Heights which do not divide into equal bands.
+	const int heights[] = { 2, 4, 14, 34, 802 };
+	for (int height : heights) {
+		CpuFrame src(CpuFrame::FORMAT_RGBA, 96, height);
+		CpuFrame expected(CpuFrame::FORMAT_NV12, 96, height);
+		CpuFrame actual(CpuFrame::FORMAT_NV12, 96, height);
+		FillPicture(src, height);
+		Converter(1).Convert(src, expected);
+
+		Converter converter(5);
+		EXPECT_EQ(5, converter.GetThreadCount());
+		// Workers are reused between frames.
+		for (int frame = 0; frame < 3; frame++) {
+			memset(actual.GetPlane(0), 0, actual.GetSize());
+			converter.Convert(src, actual);
+			EXPECT_TRUE(SamePixels(expected, actual));
+		}
+	}
+}
+
+TEST(rgb_to_nv12_test, benchmark) {
+	const int sizes[][2] = { { 2880, 1600 }, { 3664, 1920 } };
+	const int FRAMES = 20;
+	for (auto &size : sizes) {
+		int width = size[0];
+		int height = size[1];
+		CpuFrame src(CpuFrame::FORMAT_RGBA, width, height);
+		CpuFrame expected(CpuFrame::FORMAT_NV12, width, height);
+		CpuFrame dst(CpuFrame::FORMAT_NV12, width, height);
+		FillPicture(src, 3);
+		Converter(1, Converter::KERNEL_SCALAR).Convert(src, expected);
+		printf("%dx%d\n", width, height);
+
+		double scalarRate = 0;
+		for (auto &info : KERNELS) {
+			if (!Converter::IsSupported(info.kernel)) {
+				continue;
+			}
+			for (int threadCount : { 1, 0 }) {
+				Converter converter(threadCount, info.kernel);
+				converter.Convert(src, dst);
+				EXPECT_TRUE(SamePixels(expected, dst));
+				auto start = std::chrono::steady_clock::now();
+				for (int frame = 0; frame < FRAMES; frame++) {
+					converter.Convert(src, dst);
+				}
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				double rate = (double)width * height * FRAMES / seconds / 1e9;
+				if (info.kernel == Converter::KERNEL_SCALAR && converter.GetThreadCount() == 1) {
+					scalarRate = rate;
+				}
+				// Timing is printed, not asserted, as it depends on the load of the machine.
+				printf("  %-8s %d threads %6.2f Gpixels/s %6.2f ms/frame %5.1fx scalar\n", info.name, converter.GetThreadCount(), rate
+					, seconds / FRAMES * 1e3, rate / scalarRate);
+			}
+		}
+	}
+}
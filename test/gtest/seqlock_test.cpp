@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "../../alvr_server/Seqlock.h"
+#include "../../ALVR-common/packet_types.h"
+#include "ipctools.h"
+
+// Same size as TrackingInfo. Every word holds the same value, so a torn read shows as differing words.
+struct Sample {
+	uint64_t values[(sizeof(TrackingInfo) + 7) / 8];
+
+	void Fill(uint64_t value) {
+		for (auto &v : values) {
+			v = value;
+		}
+	}
+	bool IsConsistent() const {
+		for (auto v : values) {
+			if (v != values[0]) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+TEST(seqlock_test, read_write) {
+	Seqlock<TrackingInfo> seqlock;
+	TrackingInfo info;
+	memset(&info, 0xFF, sizeof(info));
+	ASSERT_EQ(seqlock.Read(info), 0u);
+	ASSERT_EQ(info.type, 0u);
+
+	info.type = ALVR_PACKET_TYPE_TRACKING_INFO;
+	info.FrameIndex = 5;
+	seqlock.Write(info);
+	TrackingInfo read;
+	ASSERT_EQ(seqlock.Read(read), 2u);
+	ASSERT_EQ(memcmp(&read, &info, sizeof(info)), 0);
+	ASSERT_EQ(seqlock.GetSequence(), 2u);
+}
+
+TEST(seqlock_test, ring_history) {
+	SeqlockRing<Sample, 4> ring;
+	Sample samples[8];
+	ASSERT_EQ(ring.ReadRecent(samples, 8), 0);
+
+	Sample sample;
+	for (uint64_t i = 1; i <= 6; i++) {
+		sample.Fill(i);
+		ring.Push(sample);
+	}
+	ASSERT_EQ(ring.ReadRecent(samples, 2), 2);
+	ASSERT_EQ(samples[0].values[0], 6u);
+	ASSERT_EQ(samples[1].values[0], 5u);
+	ASSERT_EQ(ring.ReadRecent(samples, 8), 4);
+	ASSERT_EQ(samples[3].values[0], 3u);
+}
+
+TEST(seqlock_test, no_torn_reads) {
+	const int READERS = 3;
+	const uint64_t WRITES = 200000;
+	Seqlock<Sample> seqlock;
+	SeqlockRing<Sample, 10> ring;
+	std::atomic<bool> done(false);
+	std::atomic<int> failures(0);
+	std::atomic<uint64_t> reads(0);
+
+	std::vector<std::thread> readers;
+	for (int r = 0; r < READERS; r++) {
+		readers.emplace_back([&, r]() {
+			Sample sample;
+			Sample history[10];
+			uint64_t last = 0;
+			uint64_t count = 0;
+			while (!done) {
+				if (r == 0) {
+					int n = ring.ReadRecent(history, 10);
+					for (int i = 0; i < n; i++) {
+						// Consecutive pushes, newest first.
+						if (!history[i].IsConsistent() || history[i].values[0] != history[0].values[0] - i) {
+							failures++;
+						}
+					}
+				}
+				else {
+					seqlock.Read(sample);
+					if (!sample.IsConsistent() || sample.values[0] < last) {
+						failures++;
+					}
+					last = sample.values[0];
+				}
+				count++;
+			}
+			reads += count;
+		});
+	}
+
+	Sample sample;
+	for (uint64_t i = 1; i <= WRITES; i++) {
+		sample.Fill(i);
+		seqlock.Write(sample);
+		ring.Push(sample);
+	}
+	done = true;
+	for (auto &reader : readers) {
+		reader.join();
+	}
+	printf("%llu writes, %llu reads\n", (unsigned long long)WRITES, (unsigned long long)reads);
+	ASSERT_EQ(failures, 0);
+	ASSERT_GT(reads, 0u);
+}
+
+// Latency of TrackingInfo updates on the network thread and reads from SteamVR threads,
+// with the previous CRITICAL_SECTION copy as reference.
+template<typename Write, typename Read>
+static void MeasureLatency(const char *name, Write write, Read read) {
+	const int READERS = 2;
+	const int WRITES = 100000;
+	std::atomic<bool> done(false);
+	std::atomic<uint64_t> reads(0);
+	std::atomic<uint64_t> readNs(0);
+	std::atomic<uint64_t> readMaxNs(0);
+
+	std::vector<std::thread> readers;
+	for (int r = 0; r < READERS; r++) {
+		readers.emplace_back([&]() {
+			TrackingInfo info;
+			uint64_t count = 0, total = 0, max = 0;
+			while (!done) {
+				auto start = std::chrono::high_resolution_clock::now();
+				read(info);
+				uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+				total += ns;
+				max = std::max(max, ns);
+				count++;
+			}
+			reads += count;
+			readNs += total;
+			uint64_t prev = readMaxNs;
+			while (prev < max && !readMaxNs.compare_exchange_weak(prev, max)) {
+			}
+		});
+	}
+
+	TrackingInfo info = {};
+	info.type = ALVR_PACKET_TYPE_TRACKING_INFO;
+	std::vector<uint64_t> writeNs(WRITES);
+	for (int i = 0; i < WRITES; i++) {
+		info.FrameIndex = i;
+		auto start = std::chrono::high_resolution_clock::now();
+		write(info);
+		writeNs[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	done = true;
+	for (auto &reader : readers) {
+		reader.join();
+	}
+
+	std::sort(writeNs.begin(), writeNs.end());
+	uint64_t writeTotal = 0;
+	for (auto ns : writeNs) {
+		writeTotal += ns;
+	}
+	printf("%-16s write avg %6.1f p99 %6llu max %8llu ns | read avg %6.1f max %8llu ns (%llu reads)\n", name
+		, writeTotal / static_cast<double>(WRITES), (unsigned long long)writeNs[WRITES * 99 / 100], (unsigned long long)writeNs.back()
+		, readNs / static_cast<double>(reads), (unsigned long long)readMaxNs.load(), (unsigned long long)reads.load());
+}
+
+TEST(seqlock_test, benchmark) {
+	IPCCriticalSection cs;
+	TrackingInfo locked = {};
+	MeasureLatency("critical section"
+		, [&](const TrackingInfo &info) { IPCCriticalSectionLock lock(cs); locked = info; }
+		, [&](TrackingInfo &info) { IPCCriticalSectionLock lock(cs); info = locked; });
+
+	Seqlock<TrackingInfo> seqlock;
+	MeasureLatency("seqlock"
+		, [&](const TrackingInfo &info) { seqlock.Write(info); }
+		, [&](TrackingInfo &info) { seqlock.Read(info); });
+}
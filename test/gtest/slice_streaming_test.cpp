@@ -0,0 +1,307 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <stdio.h>
+
+#include "../../alvr_server/SliceStreamer.h"
+#include "../../alvr_server/FECPacketizer.h"
+#include "../../alvr_server/ThrottlingBuffer.h"
+
+// SliceStreamer tests, and a fake clock simulation of an encoder writing a frame slice by slice,
+// which measures how much earlier the first and last packet of a frame are sent when each slice is
+// packetized and paced as soon as it is written.
+namespace {
+	struct Unit {
+		std::vector<uint8_t> data;
+		int sliceIndex;
+		int sliceCount;
+		// Bytes passed to Update when the unit was emitted.
+		int emittedAt;
+	};
+
+	// NAL unit with 4 byte start code (or 3 byte if shortStartCode) and payload without start codes.
+	void AppendNal(std::vector<uint8_t> &out, uint8_t header, int size, std::mt19937 &random, bool shortStartCode = false) {
+		if (!shortStartCode) {
+			out.push_back(0);
+		}
+		out.push_back(0);
+		out.push_back(0);
+		out.push_back(1);
+		out.push_back(header);
+		for (int i = 0; i < size; i++) {
+			out.push_back(static_cast<uint8_t>(random() % 255 + 1));
+		}
+	}
+
+	// H.264 access unit of SPS, PPS and slices. sliceEnds receives the end offset of each slice.
+	std::vector<uint8_t> MakeFrame(int slices, int sliceSize, std::mt19937 &random, std::vector<int> &sliceEnds) {
+		std::vector<uint8_t> frame;
+		AppendNal(frame, 0x67, 20, random);
+		AppendNal(frame, 0x68, 5, random);
+		sliceEnds.clear();
+		for (int i = 0; i < slices; i++) {
+			AppendNal(frame, 0x65, sliceSize, random, i == 2);
+			sliceEnds.push_back(static_cast<int>(frame.size()));
+		}
+		return frame;
+	}
+
+	std::vector<uint8_t> Concat(const std::vector<Unit> &units) {
+		std::vector<uint8_t> data;
+		for (auto &unit : units) {
+			data.insert(data.end(), unit.data.begin(), unit.data.end());
+		}
+		return data;
+	}
+}
+
+TEST(slice_streaming_test, emits_slice_when_next_start_code_visible) {
+	std::mt19937 random(1);
+	std::vector<int> sliceEnds;
+	std::vector<uint8_t> frame = MakeFrame(4, 100, random, sliceEnds);
+
+	std::vector<Unit> units;
+	int written = 0;
+	SliceStreamer streamer(ALVR_CODEC_H264, 4, [&](uint8_t *buf, int len, int sliceIndex, int sliceCount) {
+		units.push_back({ std::vector<uint8_t>(buf, buf + len), sliceIndex, sliceCount, written });
+	});
+	// Two frames, so that state is reset in between.
+	for (int f = 0; f < 2; f++) {
+		units.clear();
+		for (written = 1; written < static_cast<int>(frame.size()); written++) {
+			streamer.Update(&frame[0], written);
+		}
+		streamer.End(&frame[0], written);
+
+		ASSERT_EQ(units.size(), 4);
+		ASSERT_EQ(Concat(units), frame);
+		for (int i = 0; i < 4; i++) {
+			ASSERT_EQ(units[i].sliceIndex, i);
+			ASSERT_EQ(units[i].sliceCount, 4);
+			if (i < 3) {
+				// Ends at the end of the slice and passed when the header of the next NAL unit is written.
+				int end = static_cast<int>(units[0].data.size());
+				for (int j = 1; j <= i; j++) {
+					end += static_cast<int>(units[j].data.size());
+				}
+				ASSERT_EQ(end, sliceEnds[i]);
+				int startCode = i + 1 == 2 ? 3 : 4;
+				ASSERT_EQ(units[i].emittedAt, sliceEnds[i] + startCode + 1);
+			}
+		}
+		// First unit carries the parameter sets.
+		ASSERT_EQ(units[0].data[4], 0x67);
+	}
+}
+
+TEST(slice_streaming_test, emits_whole_slices_immediately) {
+	std::mt19937 random(2);
+	std::vector<int> sliceEnds;
+	std::vector<uint8_t> frame = MakeFrame(4, 100, random, sliceEnds);
+
+	std::vector<Unit> units;
+	int written = 0;
+	SliceStreamer streamer(ALVR_CODEC_H264, 4, [&](uint8_t *buf, int len, int sliceIndex, int sliceCount) {
+		units.push_back({ std::vector<uint8_t>(buf, buf + len), sliceIndex, sliceCount, written });
+	});
+	for (int i = 0; i < 3; i++) {
+		written = sliceEnds[i];
+		streamer.Update(&frame[0], written, true);
+		ASSERT_EQ(units.size(), i + 1);
+		ASSERT_EQ(units[i].emittedAt, sliceEnds[i]);
+	}
+	written = sliceEnds[3];
+	streamer.End(&frame[0], written);
+
+	ASSERT_EQ(units.size(), 4);
+	ASSERT_EQ(Concat(units), frame);
+	ASSERT_EQ(units[3].sliceIndex, 3);
+	ASSERT_EQ(units[3].sliceCount, 4);
+}
+
+TEST(slice_streaming_test, fewer_slices_than_configured) {
+	std::mt19937 random(3);
+	std::vector<int> sliceEnds;
+	std::vector<uint8_t> frame = MakeFrame(2, 100, random, sliceEnds);
+
+	std::vector<Unit> units;
+	SliceStreamer streamer(ALVR_CODEC_H264, 4, [&](uint8_t *buf, int len, int sliceIndex, int sliceCount) {
+		units.push_back({ std::vector<uint8_t>(buf, buf + len), sliceIndex, sliceCount, 0 });
+	});
+	streamer.Update(&frame[0], sliceEnds[0], true);
+	streamer.End(&frame[0], static_cast<int>(frame.size()));
+
+	ASSERT_EQ(units.size(), 2);
+	ASSERT_EQ(Concat(units), frame);
+	ASSERT_EQ(units[0].sliceCount, 4);
+	// Last unit tells the actual count.
+	ASSERT_EQ(units[1].sliceIndex, 1);
+	ASSERT_EQ(units[1].sliceCount, 2);
+}
+
+TEST(slice_streaming_test, more_slices_than_configured) {
+	std::mt19937 random(4);
+	std::vector<int> sliceEnds;
+	std::vector<uint8_t> frame = MakeFrame(6, 100, random, sliceEnds);
+
+	std::vector<Unit> units;
+	SliceStreamer streamer(ALVR_CODEC_H264, 4, [&](uint8_t *buf, int len, int sliceIndex, int sliceCount) {
+		units.push_back({ std::vector<uint8_t>(buf, buf + len), sliceIndex, sliceCount, 0 });
+	});
+	for (int end : sliceEnds) {
+		streamer.Update(&frame[0], end, true);
+	}
+	streamer.End(&frame[0], static_cast<int>(frame.size()));
+
+	ASSERT_EQ(units.size(), 4);
+	ASSERT_EQ(Concat(units), frame);
+	ASSERT_EQ(units[3].sliceCount, 4);
+}
+
+TEST(slice_streaming_test, single_slice_passes_whole_frame) {
+	std::mt19937 random(5);
+	std::vector<int> sliceEnds;
+	std::vector<uint8_t> frame = MakeFrame(4, 100, random, sliceEnds);
+
+	std::vector<Unit> units;
+	SliceStreamer streamer(ALVR_CODEC_H264, 1, [&](uint8_t *buf, int len, int sliceIndex, int sliceCount) {
+		units.push_back({ std::vector<uint8_t>(buf, buf + len), sliceIndex, sliceCount, 0 });
+	});
+	for (int end : sliceEnds) {
+		streamer.Update(&frame[0], end, true);
+	}
+	ASSERT_EQ(units.size(), 0);
+	streamer.End(&frame[0], static_cast<int>(frame.size()));
+
+	ASSERT_EQ(units.size(), 1);
+	ASSERT_EQ(units[0].data, frame);
+	ASSERT_EQ(units[0].sliceIndex, 0);
+	ASSERT_EQ(units[0].sliceCount, 1);
+}
+
+// Mock encoder: each 40 KB frame takes ENCODE_US and slice k of N is written at ENCODE_US * (k + 1) / N.
+// Units are packetized with FEC and pushed to a paced ThrottlingBuffer as the streamer passes them.
+struct SliceLatencyResult {
+	int frames = 0;
+	// From encode start, averaged over frames.
+	double firstPacketUs = 0;
+	double lastPacketUs = 0;
+};
+
+static SliceLatencyResult SimulateSliceStreaming(int sliceCount) {
+	static const int REFRESH_RATE = 72;
+	static const uint64_t FRAME_INTERVAL_US = 1000 * 1000 / REFRESH_RATE;
+	static const uint64_t ENCODE_US = 8000;
+	static const int FRAME_SIZE = 40 * 1000;
+	static const uint64_t DURATION_US = 1000 * 1000;
+	static const uint64_t STEP_US = 20;
+
+	uint64_t now = 0;
+	ThrottlingBuffer buffer(Bitrate::fromMiBits(100));
+	buffer.SetClock([&now]() { return now; });
+	buffer.SetFramePacing(REFRESH_RATE);
+	FECPacketizer packetizer;
+	uint32_t packetCounter = 0;
+	uint64_t videoFrameIndex = 0;
+	uint64_t frameIndex = 0;
+
+	SliceStreamer streamer(ALVR_CODEC_H264, sliceCount, [&](uint8_t *buf, int len, int sliceIndex, int sliceCount) {
+		VideoFrame header = {};
+		header.type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+		header.trackingFrameIndex = frameIndex;
+		header.videoFrameIndex = videoFrameIndex++;
+		header.frameByteSize = len;
+		header.fecPercentage = 10;
+		header.sliceIndex = static_cast<uint8_t>(sliceIndex);
+		header.sliceCount = static_cast<uint8_t>(sliceCount);
+		buffer.BeginPush();
+		auto &packets = packetizer.Packetize(buf, len, header, packetCounter, [&]() { return buffer.Allocate(); });
+		buffer.EndPush(!packets.empty());
+	});
+
+	std::mt19937 random(6);
+	std::vector<int> sliceEnds;
+	std::vector<uint8_t> frame;
+	std::vector<uint64_t> encodeStart;
+	std::vector<uint64_t> firstSent;
+	std::vector<uint64_t> lastSent;
+	int written = 0;
+	bool encoding = false;
+
+	for (now = 0; now < DURATION_US + FRAME_INTERVAL_US * 2; now += STEP_US) {
+		if (!encoding && now < DURATION_US && now >= encodeStart.size() * FRAME_INTERVAL_US) {
+			frameIndex = encodeStart.size();
+			frame = MakeFrame(sliceCount, FRAME_SIZE / sliceCount, random, sliceEnds);
+			encodeStart.push_back(now);
+			firstSent.push_back(0);
+			lastSent.push_back(0);
+			written = 0;
+			encoding = true;
+		}
+		if (encoding) {
+			uint64_t elapsed = now - encodeStart.back();
+			int slices = static_cast<int>(std::min<uint64_t>(elapsed * sliceCount / ENCODE_US, sliceCount));
+			int visible = slices == 0 ? 0 : sliceEnds[slices - 1];
+			if (slices == sliceCount) {
+				streamer.End(&frame[0], visible);
+				encoding = false;
+			}
+			else if (visible > written) {
+				streamer.Update(&frame[0], visible, true);
+			}
+			written = visible;
+		}
+
+		while (buffer.Send([&](char *buf, int len) {
+			VideoFrame *header = (VideoFrame *)buf;
+			uint64_t index = header->trackingFrameIndex;
+			if (firstSent[index] == 0) {
+				firstSent[index] = now;
+			}
+			lastSent[index] = now;
+			return true;
+		})) {}
+	}
+
+	SliceLatencyResult result;
+	for (size_t i = 0; i < encodeStart.size(); i++) {
+		if (lastSent[i] == 0) {
+			continue;
+		}
+		result.frames++;
+		result.firstPacketUs += firstSent[i] - encodeStart[i];
+		result.lastPacketUs += lastSent[i] - encodeStart[i];
+	}
+	result.firstPacketUs /= result.frames;
+	result.lastPacketUs /= result.frames;
+	return result;
+}
+
+TEST(slice_streaming_test, slices_reduce_first_packet_latency) {
+	reed_solomon_init();
+
+	static const double ENCODE_US = 8000;
+	const int sliceCounts[] = { 1, 4, 8 };
+	SliceLatencyResult results[3];
+	printf("slices  frames  first packet (ms)  last packet (ms)\n");
+	for (int i = 0; i < 3; i++) {
+		results[i] = SimulateSliceStreaming(sliceCounts[i]);
+		printf("%6d %7d %18.2f %16.2f\n", sliceCounts[i], results[i].frames
+			, results[i].firstPacketUs / 1000.0, results[i].lastPacketUs / 1000.0);
+	}
+
+	const SliceLatencyResult &whole = results[0];
+	ASSERT_GE(whole.frames, 72);
+	ASSERT_GE(whole.firstPacketUs, ENCODE_US);
+	for (int i = 1; i < 3; i++) {
+		int n = sliceCounts[i];
+		ASSERT_EQ(results[i].frames, whole.frames);
+		// First packet leaves once the first slice is written, (1 - 1/n) of the encode time earlier.
+		ASSERT_LE(results[i].firstPacketUs, ENCODE_US / n + 500);
+		ASSERT_LE(results[i].firstPacketUs, whole.firstPacketUs - ENCODE_US * (n - 1) / n * 0.9);
+		// Whole frame is not later either, the last slice is paced over a shorter interval.
+		ASSERT_LE(results[i].lastPacketUs, whole.lastPacketUs);
+	}
+	ASSERT_LT(results[2].firstPacketUs, results[1].firstPacketUs);
+}
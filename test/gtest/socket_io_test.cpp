@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <chrono>
+
+#include "../../alvr_server/SocketIO.h"
+
+namespace {
+	SOCKET OpenLoopbackSocket(sockaddr_in *addr) {
+#ifdef _WIN32
+		WSADATA wsaData;
+		WSAStartup(MAKEWORD(2, 0), &wsaData);
+#endif
+		SOCKET s = socket(AF_INET, SOCK_DGRAM, 0);
+		int size = 8 * 1024 * 1024;
+		setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char *)&size, sizeof(size));
+		setsockopt(s, SOL_SOCKET, SO_SNDBUF, (const char *)&size, sizeof(size));
+		SetSocketNonBlocking(s);
+
+		memset(addr, 0, sizeof(*addr));
+		addr->sin_family = AF_INET;
+		addr->sin_port = htons(0);
+		inet_pton(AF_INET, "127.0.0.1", &addr->sin_addr);
+		bind(s, (sockaddr *)addr, sizeof(*addr));
+		socklen_t len = sizeof(*addr);
+		getsockname(s, (sockaddr *)addr, &len);
+		return s;
+	}
+
+	struct Mode {
+		const char *name;
+		SocketIOBackend backend;
+		bool gso;
+		// Read single datagram per wakeup like ClientConnection used to.
+		bool singleRecv;
+	};
+
+	std::vector<Mode> GetModes() {
+		std::vector<Mode> modes;
+		modes.push_back({ "select (1 recv/wake)", SOCKET_IO_SELECT, false, true });
+		modes.push_back({ "select (drain)", SOCKET_IO_SELECT, false, false });
+		if (IsSocketIOBackendAvailable(SOCKET_IO_EPOLL)) {
+			modes.push_back({ "epoll+mmsg", SOCKET_IO_EPOLL, false, false });
+			modes.push_back({ "epoll+mmsg+gso", SOCKET_IO_EPOLL, true, false });
+		}
+		return modes;
+	}
+}
+
+// Datagram boundaries and order must survive batching and GSO coalescing.
+TEST(socket_io_test, batch_roundtrip) {
+	int lengths[] = { 1400, 1400, 1400, 500, 1400, 1400, 200, 1, 1400, 1399, 1400 };
+	const int count = sizeof(lengths) / sizeof(lengths[0]);
+
+	for (auto &mode : GetModes()) {
+		sockaddr_in senderAddr, receiverAddr;
+		SOCKET sender = OpenLoopbackSocket(&senderAddr);
+		SOCKET receiver = OpenLoopbackSocket(&receiverAddr);
+		SocketWaiter waiter(mode.backend);
+		waiter.Add(receiver, false);
+
+		std::vector<std::vector<char>> payloads;
+		std::vector<SendDatagram> datagrams;
+		for (int i = 0; i < count; i++) {
+			payloads.push_back(std::vector<char>(lengths[i], (char)i));
+			datagrams.push_back({ &payloads[i][0], lengths[i] });
+		}
+		ASSERT_EQ(SendBatch(mode.backend, sender, &receiverAddr, &datagrams[0], count, mode.gso), count);
+
+		std::vector<RecvDatagram> received(SOCKET_IO_MAX_RECV_BATCH);
+		int total = 0;
+		while (total < count) {
+			ASSERT_GT(waiter.Wait(1000 * 1000), 0);
+			ASSERT_TRUE(waiter.IsReady(receiver, false));
+			int ret;
+			while ((ret = RecvBatch(mode.backend, receiver, &received[0], SOCKET_IO_MAX_RECV_BATCH)) > 0) {
+				for (int i = 0; i < ret; i++) {
+					ASSERT_EQ(received[i].len, lengths[total]);
+					ASSERT_EQ(received[i].buf[0], (char)total);
+					ASSERT_EQ(received[i].addr.sin_port, senderAddr.sin_port);
+					total++;
+				}
+			}
+		}
+		ASSERT_EQ(total, count);
+
+		closesocket(sender);
+		closesocket(receiver);
+	}
+}
+
+// Loopback benchmark. Sends video-like frames of full size packets and reads them back,
+// counting packets/s and system calls per frame on each side.
+TEST(socket_io_test, loopback_benchmark) {
+	static const int FRAMES = 300;
+	static const int PACKETS_PER_FRAME = 60;
+	static const int PACKET_SIZE = ALVR_MAX_PACKET_SIZE;
+
+	printf("%-22s %10s %14s %14s\n", "mode", "kpkt/s", "send calls/fr", "recv calls/fr");
+	for (auto &mode : GetModes()) {
+		sockaddr_in senderAddr, receiverAddr;
+		SOCKET sender = OpenLoopbackSocket(&senderAddr);
+		SOCKET receiver = OpenLoopbackSocket(&receiverAddr);
+		SocketWaiter waiter(mode.backend);
+		waiter.Add(receiver, false);
+
+		std::vector<char> frame(PACKETS_PER_FRAME * PACKET_SIZE, 1);
+		std::vector<SendDatagram> datagrams;
+		for (int i = 0; i < PACKETS_PER_FRAME; i++) {
+			datagrams.push_back({ &frame[i * PACKET_SIZE], PACKET_SIZE });
+		}
+		std::vector<RecvDatagram> received(SOCKET_IO_MAX_RECV_BATCH);
+		SocketIOCounters sendCounters;
+		SocketIOCounters recvCounters;
+
+		auto start = std::chrono::steady_clock::now();
+		uint64_t receivedTotal = 0;
+		for (int f = 0; f < FRAMES; f++) {
+			int sent = 0;
+			while (sent < PACKETS_PER_FRAME) {
+				int ret = SendBatch(mode.backend, sender, &receiverAddr, &datagrams[sent], PACKETS_PER_FRAME - sent, mode.gso, &sendCounters);
+				ASSERT_GE(ret, 0);
+				sent += ret;
+			}
+			uint64_t target = (uint64_t)(f + 1) * PACKETS_PER_FRAME;
+			while (receivedTotal < target) {
+				ASSERT_GT(waiter.Wait(1000 * 1000, &recvCounters), 0);
+				if (mode.singleRecv) {
+					int ret = RecvBatch(mode.backend, receiver, &received[0], 1, &recvCounters);
+					receivedTotal += ret > 0 ? ret : 0;
+					continue;
+				}
+				int ret;
+				while ((ret = RecvBatch(mode.backend, receiver, &received[0], SOCKET_IO_MAX_RECV_BATCH, &recvCounters)) > 0) {
+					receivedTotal += ret;
+				}
+			}
+		}
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		ASSERT_EQ(receivedTotal, (uint64_t)FRAMES * PACKETS_PER_FRAME);
+
+		printf("%-22s %10.1f %14.2f %14.2f\n", mode.name
+			, receivedTotal / elapsed / 1000.0
+			, (double)sendCounters.sendCalls / FRAMES
+			, (double)(recvCounters.waitCalls + recvCounters.recvCalls) / FRAMES);
+
+		closesocket(sender);
+		closesocket(receiver);
+	}
+}
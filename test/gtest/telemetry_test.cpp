@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <thread>
+#include <random>
+#include <memory>
+#include <algorithm>
+
+#include "../../alvr_server/NetworkTelemetry.h"
+
+TEST(telemetry_test, bucket_bounds) {
+	std::mt19937_64 random(1);
+	int lastIndex = 0;
+	for (uint64_t v = 0; v < 100000; v++) {
+		int index = LatencyHistogram::BucketIndex(v);
+		ASSERT_GE(index, lastIndex);
+		ASSERT_LT(index, LatencyHistogram::BUCKETS);
+		lastIndex = index;
+		uint64_t upper = LatencyHistogram::BucketUpperBound(index);
+		ASSERT_GE(upper, v);
+		ASSERT_LE(upper - v, v / LatencyHistogram::SUB_BUCKETS);
+	}
+	for (int i = 0; i < 100000; i++) {
+		uint64_t v = random() & 0xFFFFFFFF;
+		uint64_t upper = LatencyHistogram::BucketUpperBound(LatencyHistogram::BucketIndex(v));
+		ASSERT_GE(upper, v);
+		ASSERT_LE(upper - v, v / LatencyHistogram::SUB_BUCKETS);
+	}
+	ASSERT_EQ(LatencyHistogram::BucketIndex(UINT64_MAX), LatencyHistogram::BUCKETS - 1);
+}
+
+TEST(telemetry_test, percentiles_match_exact) {
+	std::mt19937 random(2);
+	// Latency-like distribution: median around 5 ms with long tail.
+	std::lognormal_distribution<double> distribution(8.5, 0.8);
+	auto histogram = std::make_shared<LatencyHistogram>();
+	std::vector<uint64_t> values;
+	for (int i = 0; i < 100000; i++) {
+		uint64_t v = static_cast<uint64_t>(distribution(random));
+		values.push_back(v);
+		histogram->Record(v);
+	}
+	std::sort(values.begin(), values.end());
+
+	auto snapshot = std::make_shared<LatencyHistogram::Snapshot>();
+	histogram->Read(*snapshot);
+	ASSERT_EQ(snapshot->total, values.size());
+	double percentiles[] = { 50, 95, 99, 99.9, 100 };
+	for (double p : percentiles) {
+		size_t rank = std::max<size_t>(1, static_cast<size_t>(values.size() * p / 100.0 + 0.5));
+		uint64_t exact = values[rank - 1];
+		uint64_t estimated = snapshot->ValueAtPercentile(p);
+		ASSERT_GE(estimated, exact);
+		ASSERT_LE(estimated - exact, exact / LatencyHistogram::SUB_BUCKETS);
+	}
+}
+
+TEST(telemetry_test, window) {
+	auto telemetry = std::make_shared<NetworkTelemetry>();
+	ASSERT_EQ(telemetry->Get(NetworkTelemetry::QUEUE_DELAY, 10).count, 0);
+
+	for (int i = 0; i < 100; i++) {
+		telemetry->RecordQueueDelay(1000);
+	}
+	telemetry->Tick();
+	for (int i = 0; i < 100; i++) {
+		telemetry->RecordQueueDelay(20000);
+	}
+	telemetry->RecordLossRun(3);
+	telemetry->Tick();
+	// Not yet closed by Tick.
+	telemetry->RecordQueueDelay(500000);
+
+	NetworkTelemetry::Percentiles last = telemetry->Get(NetworkTelemetry::QUEUE_DELAY, 1);
+	ASSERT_EQ(last.count, 100);
+	ASSERT_GE(last.p50, 20000);
+	ASSERT_LE(last.max, 20000 + 20000 / 16);
+
+	NetworkTelemetry::Percentiles all = telemetry->Get(NetworkTelemetry::QUEUE_DELAY, 10);
+	ASSERT_EQ(all.count, 200);
+	ASSERT_LE(all.p50, 1000 + 1000 / 16);
+	ASSERT_GE(all.p95, 20000);
+
+	NetworkTelemetry::Percentiles loss = telemetry->Get(NetworkTelemetry::LOSS_RUN_LENGTH, 1);
+	ASSERT_EQ(loss.count, 1);
+	ASSERT_EQ(loss.max, 3);
+
+	// Old intervals leave window.
+	for (int i = 0; i < NetworkTelemetry::WINDOW_SECONDS; i++) {
+		telemetry->Tick();
+	}
+	ASSERT_EQ(telemetry->Get(NetworkTelemetry::QUEUE_DELAY, 10).count, 1);
+	ASSERT_EQ(telemetry->Get(NetworkTelemetry::LOSS_RUN_LENGTH, 10).count, 0);
+}
+
+TEST(telemetry_test, concurrent_record) {
+	static const int THREADS = 4;
+	static const int COUNT = 250000;
+	auto telemetry = std::make_shared<NetworkTelemetry>();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < THREADS; t++) {
+		threads.push_back(std::thread([&telemetry, t]() {
+			for (int i = 0; i < COUNT; i++) {
+				telemetry->RecordQueueDelay((i * (t + 1)) % 5000);
+			}
+		}));
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	telemetry->Tick();
+	ASSERT_EQ(telemetry->Get(NetworkTelemetry::QUEUE_DELAY, 1).count, THREADS * COUNT);
+}
+
+TEST(telemetry_test, jitter) {
+	auto telemetry = std::make_shared<NetworkTelemetry>();
+	for (int i = 0; i < 200; i++) {
+		telemetry->RecordRoundTrip(i % 2 == 0 ? 10000 : 12000);
+	}
+	// RFC 3550 estimator converges to mean absolute difference of consecutive samples.
+	ASSERT_GT(telemetry->GetJitter(), 1990);
+	ASSERT_LE(telemetry->GetJitter(), 2000);
+}